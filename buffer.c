@@ -0,0 +1,421 @@
+/*
+ * buffer.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "config.h"
+#include "log.h"
+#include "buffer.h"
+
+// --- cSatipMemory -----------------------------------------------------------
+
+bool cSatipMemory::explicitFailedS = false;
+
+bool cSatipMemory::UseHugePages(size_t sizeP)
+{
+  // Small buffers would waste most of a huge page
+  return ((SatipConfig.GetHugePages() != cSatipConfig::eHugePagesOff) && (sizeP > eHugePageSizeB / 2));
+}
+
+size_t cSatipMemory::Length(size_t sizeP)
+{
+  size_t page = UseHugePages(sizeP) ? (size_t)eHugePageSizeB : (size_t)sysconf(_SC_PAGESIZE);
+  return (sizeP + page - 1) / page * page;
+}
+
+void *cSatipMemory::Allocate(size_t sizeP, const char *descriptionP)
+{
+  debug1("%s (%zu, %s)", __PRETTY_FUNCTION__, sizeP, descriptionP);
+  size_t len = Length(sizeP);
+  void *p = MAP_FAILED;
+  // The mappings are not touched here: each page is faulted in on the NUMA
+  // node of the thread writing it first
+#ifdef MAP_HUGETLB
+  if (UseHugePages(sizeP) && (SatipConfig.GetHugePages() == cSatipConfig::eHugePagesExplicit) && !explicitFailedS) {
+     p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+     if (p == MAP_FAILED) {
+        explicitFailedS = true;
+        info("No explicit huge pages available - using transparent ones");
+        }
+     }
+#endif // MAP_HUGETLB
+  if ((p == MAP_FAILED) && UseHugePages(sizeP)) {
+     // Map one huge page more and trim the area to a huge page boundary
+     size_t extra = len + eHugePageSizeB;
+     uchar *area = (uchar *)mmap(NULL, extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+     if (area != (uchar *)MAP_FAILED) {
+        uchar *aligned = (uchar *)(((uintptr_t)area + eHugePageSizeB - 1) & ~((uintptr_t)eHugePageSizeB - 1));
+        if (aligned > area)
+           munmap(area, aligned - area);
+        if (area + extra > aligned + len)
+           munmap(aligned + len, area + extra - aligned - len);
+        p = aligned;
+#ifdef MADV_HUGEPAGE
+        if (madvise(p, len, MADV_HUGEPAGE) < 0)
+           debug1("%s Transparent huge pages not available for %s", __PRETTY_FUNCTION__, descriptionP);
+#endif // MADV_HUGEPAGE
+        }
+     }
+  if (p == MAP_FAILED)
+     p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+     error("Cannot allocate %zu bytes for %s", sizeP, descriptionP ? descriptionP : "buffer");
+     return NULL;
+     }
+  return p;
+}
+
+void cSatipMemory::Free(void *addrP, size_t sizeP)
+{
+  debug1("%s (, %zu)", __PRETTY_FUNCTION__, sizeP);
+  if (addrP)
+     munmap(addrP, Length(sizeP));
+}
+
+// --- cSatipRingBuffer -------------------------------------------------------
+
+cSatipRingBuffer::cSatipRingBuffer(int sizeP, int marginP, const char *descriptionP)
+: cRingBuffer(sizeP),
+  sizeM(sizeP),
+  minSizeM(sizeP),
+  marginM(marginP),
+  headM(marginP),
+  tailM(marginP),
+  gottenM(0),
+  bufferM(NULL),
+  descriptionM(descriptionP),
+  mutexM(),
+  overflowsM(0),
+  overflowIntervalsM(0),
+  peakM(0),
+  highWaterM(0),
+  resizesM(0),
+  discardM(0),
+  resizeCheckM(eResizeIntervalMs),
+  shrinkM()
+{
+  debug1("%s (%d, %d, %s)", __PRETTY_FUNCTION__, sizeP, marginP, descriptionP);
+  // 'sizeP - 1' must not be 0
+  if (sizeP <= 1)
+     error("Invalid size for ring buffer %s (%d)", descriptionP, sizeP);
+  else if (marginP > sizeP / 2)
+     error("Invalid margin for ring buffer %s (%d > %d)", descriptionP, marginP, sizeP / 2);
+  else {
+     bufferM = (uchar *)cSatipMemory::Allocate(sizeM, descriptionP);
+     // Idle buffers shrink down to a quarter of the initial size
+     minSizeM = max(AlignedSize(sizeP / 4), 2 * marginM + 1);
+     Clear();
+     }
+}
+
+cSatipRingBuffer::~cSatipRingBuffer()
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *descriptionM);
+  cSatipMemory::Free(bufferM, sizeM);
+  bufferM = NULL;
+}
+
+int cSatipRingBuffer::AlignedSize(int sizeP) const
+{
+  // Keep the wrap-around on the same boundary as the initial size
+  return (marginM > 0) ? sizeP - (sizeP % marginM) + 1 : sizeP;
+}
+
+int cSatipRingBuffer::Available(void)
+{
+  int diff = headM - tailM;
+  return (diff >= 0) ? diff : sizeM + diff - marginM;
+}
+
+void cSatipRingBuffer::Clear(void)
+{
+  tailM = headM = marginM;
+  maxFill = 0;
+  EnablePut();
+}
+
+int cSatipRingBuffer::RoomLocked(void)
+{
+  int tail = tailM;
+  int rest = sizeM - headM;
+  int diff = tail - headM;
+  return ((tail < marginM) ? rest : (diff > 0) ? diff : sizeM + diff - marginM) - 1;
+}
+
+int cSatipRingBuffer::Room(void)
+{
+  cMutexLock MutexLock(&mutexM);
+  return bufferM ? max(RoomLocked(), 0) : 0;
+}
+
+void cSatipRingBuffer::ReportDrop(int bytesP)
+{
+  mutexM.Lock();
+  overflowsM++;
+  mutexM.Unlock();
+  ReportOverflow(bytesP);
+}
+
+void cSatipRingBuffer::Discard(int countP)
+{
+  // Applied by the reader on its next Get(), pending requests are merged
+  if (countP > __atomic_load_n(&discardM, __ATOMIC_RELAXED))
+     __atomic_store_n(&discardM, countP, __ATOMIC_RELAXED);
+}
+
+void cSatipRingBuffer::Skip(int countP)
+{
+  int available = Available();
+  if (countP > available)
+     countP = available;
+  if (countP > 0) {
+     int first = sizeM - tailM;
+     if ((headM >= tailM) || (countP < first))
+        tailM += countP;
+     else
+        tailM = marginM + countP - first;
+     gottenM = 0;
+     EnablePut();
+     }
+}
+
+int cSatipRingBuffer::Put(const uchar *dataP, int countP, int unitP)
+{
+  if (bufferM && (countP > 0)) {
+     int requested = countP;
+     mutexM.Lock();
+     int rest = sizeM - headM;
+     int free = RoomLocked();
+     if (free > 0) {
+        // Cut only on unit boundaries
+        if (free < countP)
+           countP = (unitP > 1) ? free - (free % unitP) : free;
+        if (countP >= rest) {
+           memcpy(bufferM + headM, dataP, rest);
+           if (countP - rest)
+              memcpy(bufferM + marginM, dataP + rest, countP - rest);
+           headM = marginM + countP - rest;
+           }
+        else {
+           memcpy(bufferM + headM, dataP, countP);
+           headM += countP;
+           }
+        }
+     else
+        countP = 0;
+     if (countP < requested)
+        overflowsM++;
+     int fill = Available();
+     if (fill > peakM)
+        peakM = fill;
+     mutexM.Unlock();
+     EnableGet();
+     if (countP == 0)
+        WaitForPut();
+     return countP;
+     }
+  return 0;
+}
+
+int cSatipRingBuffer::PutTs(const uchar *dataP, int countP, unsigned int overflowPolicyP, const uint32_t *priorityPidsP, cSatipTsDrops &dropsP)
+{
+  // Puts whole TS packets and applies the overflow policy on the rest; only the
+  // writing thread puts, so whatever is copied fits and Put() never waits
+  memset(&dropsP, 0, sizeof(dropsP));
+  if (!bufferM || (countP <= 0))
+     return 0;
+  int packets = countP / TS_SIZE;
+  if (Room() >= countP) {
+     int len = Put(dataP, countP, TS_SIZE);
+     dropsP.packets = (countP - len) / TS_SIZE;
+     }
+  else {
+     switch (overflowPolicyP) {
+       case cSatipConfig::eOverflowPolicyDropLowPriority: {
+            // Reserve the room for the packets of requested pids first
+            int free = Room();
+            int room = free;
+            for (int i = 0; i < packets; ++i) {
+                int pid = ts_pid(dataP + i * TS_SIZE);
+                if (priorityPidsP[pid >> 5] & (1U << (pid & 0x1F)))
+                   room -= TS_SIZE;
+                }
+            const uchar *run = dataP;
+            int runLength = 0;
+            for (int i = 0; i < packets; ++i) {
+                const uchar *p = dataP + i * TS_SIZE;
+                int pid = ts_pid(p);
+                bool keep = true;
+                if (!(priorityPidsP[pid >> 5] & (1U << (pid & 0x1F)))) {
+                   if (room < TS_SIZE) {
+                      dropsP.lowPriority++;
+                      keep = false;
+                      }
+                   else
+                      room -= TS_SIZE;
+                   }
+                if (keep && (free < TS_SIZE)) {
+                   dropsP.packets++;
+                   keep = false;
+                   }
+                if (keep) {
+                   free -= TS_SIZE;
+                   if (!runLength)
+                      run = p;
+                   runLength += TS_SIZE;
+                   }
+                else if (runLength) {
+                   Put(run, runLength, TS_SIZE);
+                   runLength = 0;
+                   }
+                }
+            if (runLength)
+               Put(run, runLength, TS_SIZE);
+            }
+            break;
+       case cSatipConfig::eOverflowPolicyDropOldest: {
+            // Keep what fits now and let the reader skip a chunk of the oldest data
+            int fit = min(countP, Room());
+            fit -= fit % TS_SIZE;
+            if (fit > 0)
+               Put(dataP, fit, TS_SIZE);
+            dropsP.packets = packets - fit / TS_SIZE;
+            int discard = max(countP, sizeM / eDropOldestDivisor);
+            discard -= discard % TS_SIZE;
+            Discard(discard);
+            dropsP.oldest = discard / TS_SIZE;
+            }
+            break;
+       default:
+            dropsP.datagrams = 1;
+            dropsP.packets = packets;
+            break;
+       }
+     }
+  int dropped = dropsP.packets + dropsP.lowPriority;
+  if (dropped)
+     ReportDrop(dropped * TS_SIZE);
+  return dropped;
+}
+
+uchar *cSatipRingBuffer::Get(int &countP)
+{
+  if (!bufferM)
+     return NULL;
+  int discard = __atomic_exchange_n(&discardM, 0, __ATOMIC_RELAXED);
+  if (discard > 0)
+     Skip(discard);
+  int head = headM;
+  if (getThreadTid <= 0)
+     getThreadTid = cThread::ThreadId();
+  int rest = sizeM - tailM;
+  // Move a wrapped remainder into the margin to keep the data contiguous
+  if ((rest < marginM) && (head < tailM)) {
+     int t = marginM - rest;
+     memcpy(bufferM + t, bufferM + tailM, rest);
+     tailM = t;
+     rest = head - tailM;
+     }
+  int diff = head - tailM;
+  int cont = (diff >= 0) ? diff : sizeM - tailM;
+  if (cont > rest)
+     cont = rest;
+  if (cont >= marginM) {
+     countP = gottenM = cont;
+     return bufferM + tailM;
+     }
+  WaitForGet();
+  return NULL;
+}
+
+void cSatipRingBuffer::Del(int countP)
+{
+  if (countP > gottenM) {
+     error("Invalid count in ring buffer %s: %d (limited to %d)", *descriptionM, countP, gottenM);
+     countP = gottenM;
+     }
+  if (countP > 0) {
+     int tail = tailM + countP;
+     gottenM -= countP;
+     if (tail >= sizeM)
+        tail = marginM;
+     tailM = tail;
+     EnablePut();
+     }
+}
+
+bool cSatipRingBuffer::Resize(int sizeP)
+{
+  debug1("%s (%d) %s", __PRETTY_FUNCTION__, sizeP, *descriptionM);
+  sizeP = AlignedSize(sizeP);
+  if (!bufferM || (sizeP == sizeM) || (sizeP <= 2 * marginM))
+     return false;
+  cMutexLock MutexLock(&mutexM);
+  int available = Available();
+  // Never drop any buffered data
+  if (available >= sizeP - marginM - 1)
+     return false;
+  uchar *buffer = (uchar *)cSatipMemory::Allocate(sizeP, *descriptionM);
+  if (!buffer)
+     return false;
+  // Linearize the buffered data into the new buffer
+  int first = (headM >= tailM) ? available : sizeM - tailM;
+  memcpy(buffer + marginM, bufferM + tailM, first);
+  if (available > first)
+     memcpy(buffer + marginM + first, bufferM + marginM, available - first);
+  cSatipMemory::Free(bufferM, sizeM);
+  info("Resized ring buffer %s from %d to %d kB", *descriptionM, sizeM / KILOBYTE(1), sizeP / KILOBYTE(1));
+  bufferM = buffer;
+  sizeM = sizeP;
+  tailM = marginM;
+  headM = marginM + available;
+  gottenM = 0;
+  resizesM++;
+  return true;
+}
+
+void cSatipRingBuffer::AutoResize(void)
+{
+  if (!resizeCheckM.TimedOut())
+     return;
+  resizeCheckM.Set(eResizeIntervalMs);
+  mutexM.Lock();
+  int overflows = overflowsM;
+  int peak = peakM;
+  overflowsM = 0;
+  peakM = 0;
+  mutexM.Unlock();
+  if (peak > highWaterM)
+     highWaterM = peak;
+  int maxSize = max(AlignedSize((int)MEGABYTE(SatipConfig.GetBufferSizeLimit())), minSizeM);
+  // Honour a lowered limit
+  if (sizeM > maxSize) {
+     if (Resize(maxSize))
+        highWaterM = 0;
+     return;
+     }
+  // Grow on overflows lasting several intervals
+  overflowIntervalsM = overflows ? overflowIntervalsM + 1 : 0;
+  if ((overflowIntervalsM >= eGrowIntervalCount) && (sizeM < maxSize)) {
+     if (Resize(min(2 * sizeM, maxSize)))
+        highWaterM = 0;
+     overflowIntervalsM = 0;
+     shrinkM.Set();
+     return;
+     }
+  // Shrink when the buffer has stayed nearly empty for a while
+  if ((peak >= sizeM / eShrinkFillDivisor) || (sizeM <= minSizeM))
+     shrinkM.Set();
+  else if (shrinkM.Elapsed() >= eShrinkTimeoutMs) {
+     if (Resize(max(sizeM / 2, minSizeM)))
+        highWaterM = 0;
+     shrinkM.Set();
+     }
+}
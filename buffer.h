@@ -0,0 +1,99 @@
+/*
+ * buffer.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BUFFER_H
+#define __SATIP_BUFFER_H
+
+#include <vdr/ringbuffer.h>
+
+// --- cSatipMemory -----------------------------------------------------------
+
+class cSatipMemory {
+private:
+  enum {
+    eHugePageSizeB = 2 * 1024 * 1024
+  };
+  static bool explicitFailedS;
+  static bool UseHugePages(size_t sizeP);
+  static size_t Length(size_t sizeP);
+
+public:
+  static void *Allocate(size_t sizeP, const char *descriptionP = NULL);
+  static void Free(void *addrP, size_t sizeP);
+};
+
+// --- cSatipRingBuffer -------------------------------------------------------
+
+// The TS packets lost by a PutTs(), by the way they were dropped
+struct cSatipTsDrops {
+  int datagrams;
+  int packets;
+  int lowPriority;
+  int oldest;
+};
+
+// A linear ring buffer behaving like cRingBufferLinear, but backed by memory
+// from cSatipMemory. The pages are not touched here, so they get faulted in
+// on the NUMA node of the first writer, i.e. the poller thread.
+// The buffer grows on sustained overflows and shrinks when idle; Resize() and
+// AutoResize() must be called by the reader while it holds no data from Get().
+class cSatipRingBuffer : public cRingBuffer {
+private:
+  enum {
+    eResizeIntervalMs  = 1000,  // in milliseconds
+    eGrowIntervalCount = 3,
+    eShrinkTimeoutMs   = 60000, // in milliseconds
+    eShrinkFillDivisor = 8,
+    eDropOldestDivisor = 16
+  };
+  int sizeM;
+  int minSizeM;
+  int marginM;
+  int headM;
+  int tailM;
+  int gottenM;
+  uchar *bufferM;
+  cString descriptionM;
+  cMutex mutexM;
+  int overflowsM;
+  int overflowIntervalsM;
+  int peakM;
+  int highWaterM;
+  int resizesM;
+  int discardM;
+  cTimeMs resizeCheckM;
+  cTimeMs shrinkM;
+  int AlignedSize(int sizeP) const;
+  int RoomLocked(void);
+  void Skip(int countP);
+
+  // to prevent copy constructor and assignment
+  cSatipRingBuffer(const cSatipRingBuffer&);
+  cSatipRingBuffer& operator=(const cSatipRingBuffer&);
+
+public:
+  cSatipRingBuffer(int sizeP, int marginP = 0, const char *descriptionP = NULL);
+  virtual ~cSatipRingBuffer();
+  virtual int Available(void);
+  virtual int Free(void) { return sizeM - Available() - 1 - marginM; }
+  virtual void Clear(void);
+  bool IsValid(void) const { return !!bufferM; }
+  int Room(void);
+  int Put(const uchar *dataP, int countP, int unitP = 0);
+  int PutTs(const uchar *dataP, int countP, unsigned int overflowPolicyP, const uint32_t *priorityPidsP, cSatipTsDrops &dropsP);
+  void ReportDrop(int bytesP);
+  void Discard(int countP);
+  uchar *Get(int &countP);
+  void Del(int countP);
+  bool Resize(int sizeP);
+  void AutoResize(void);
+  int Capacity(void) const { return sizeM; }
+  int HighWater(void) const { return highWaterM; }
+  int Resizes(void) const { return resizesM; }
+};
+
+#endif // __SATIP_BUFFER_H
@@ -0,0 +1,353 @@
+/*
+ * capture.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+#include "common.h"
+#include "config.h"
+#include "log.h"
+#include "socket.h"
+
+// --- cSatipCapture ----------------------------------------------------------
+
+cSatipCapture::cSatipCapture(int deviceIdP)
+: cThread(cString::sprintf("SATIP#%d capture", deviceIdP)),
+  mutexM(),
+  wakeM(),
+  activeM(false),
+  doneM(true),
+  deviceIdM(deviceIdP),
+  blocksM(NULL),
+  fillM(0),
+  readyM(0),
+  bytesM(0),
+  droppedM(0),
+  fileNameM(""),
+  fdM(-1)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  memset(lengthM, 0, sizeof(lengthM));
+  memset(countM, 0, sizeof(countM));
+}
+
+cSatipCapture::~cSatipCapture()
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  Stop();
+}
+
+bool cSatipCapture::WriteFile(const void *bufferP, int lengthP)
+{
+  const u_char *p = (const u_char *)bufferP;
+  while (lengthP > 0) {
+        ssize_t n = write(fdM, p, lengthP);
+        if (n < 0) {
+           if (errno == EINTR)
+              continue;
+           char tmp[64];
+           error("Cannot write capture file '%s': %s - capture stopped [device %d]", *fileNameM, strerror_r(errno, tmp, sizeof(tmp)), deviceIdM);
+           return false;
+           }
+        p += n;
+        lengthP -= (int)n;
+        }
+  return true;
+}
+
+void cSatipCapture::CloseFile(void)
+{
+  if (fdM >= 0) {
+     if (close(fdM) != 0)
+        error("Cannot close capture file '%s' [device %d]", *fileNameM, deviceIdM);
+     fdM = -1;
+     cMutexLock MutexLock(&mutexM);
+     info("Captured %u RTP, %u RTCP and %u RTSP packets (%" PRIu64 " bytes) into '%s' [device %d]",
+          countM[eCaptureRtp], countM[eCaptureRtcp], countM[eCaptureRtspOut] + countM[eCaptureRtspIn], bytesM, *fileNameM, deviceIdM);
+     }
+}
+
+bool cSatipCapture::Advance(void)
+{
+  // Called with the mutex locked; one block is always left for filling
+  if (readyM >= eBlockCount - 1)
+     return false;
+  readyM++;
+  fillM = (fillM + 1) % eBlockCount;
+  lengthM[fillM] = 0;
+  return true;
+}
+
+void cSatipCapture::Append(const void *dataP, int lengthP)
+{
+  // Called with the mutex locked after the room has been checked
+  const u_char *p = (const u_char *)dataP;
+  while (lengthP > 0) {
+        if ((lengthM[fillM] == eBlockSizeB) && !Advance())
+           break;
+        int n = min(lengthP, eBlockSizeB - lengthM[fillM]);
+        memcpy(blocksM + fillM * eBlockSizeB + lengthM[fillM], p, n);
+        lengthM[fillM] += n;
+        p += n;
+        lengthP -= n;
+        if ((lengthM[fillM] == eBlockSizeB) && Advance())
+           wakeM.Signal();
+        }
+}
+
+bool cSatipCapture::Flush(bool partialP)
+{
+  for (;;) {
+      int index, length;
+      {
+        cMutexLock MutexLock(&mutexM);
+        if (!readyM && partialP && (lengthM[fillM] > 0)) {
+           // Take over the block being filled, too
+           Advance();
+           partialP = false;
+           }
+        if (!readyM)
+           break;
+        index = (fillM - readyM + eBlockCount) % eBlockCount;
+        length = lengthM[index];
+      }
+      if (!WriteFile(blocksM + index * eBlockSizeB, length))
+         return false;
+      cMutexLock MutexLock(&mutexM);
+      readyM--;
+      }
+  return true;
+}
+
+bool cSatipCapture::Start(const char *fileNameP)
+{
+  debug1("%s (%s) [device %d]", __PRETTY_FUNCTION__, fileNameP, deviceIdM);
+  Stop();
+  if (!__atomic_load_n(&doneM, __ATOMIC_ACQUIRE)) {
+     error("Cannot capture while the previous capture is still being written [device %d]", deviceIdM);
+     return false;
+     }
+  int fd = open(fileNameP, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, DEFFILEMODE);
+  if (fd < 0) {
+     char tmp[64];
+     error("Cannot create capture file '%s': %s [device %d]", fileNameP, strerror_r(errno, tmp, sizeof(tmp)), deviceIdM);
+     return false;
+     }
+  fdM = fd;
+  fileNameM = fileNameP;
+  cSatipCaptureHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, Magic(), sizeof(header.magic));
+  header.version = eVersion;
+  header.deviceId = (uint16_t)deviceIdM;
+  header.startTime = cSatipSocket::Now();
+  if (!WriteFile(&header, sizeof(header))) {
+     CloseFile();
+     return false;
+     }
+  if (!(blocksM = MALLOC(u_char, eBlockCount * eBlockSizeB))) {
+     error("Cannot allocate the capture buffer [device %d]", deviceIdM);
+     CloseFile();
+     return false;
+     }
+  memset(lengthM, 0, sizeof(lengthM));
+  fillM = 0;
+  readyM = 0;
+  bytesM = sizeof(header);
+  droppedM = 0;
+  memset(countM, 0, sizeof(countM));
+  __atomic_store_n(&doneM, false, __ATOMIC_RELAXED);
+  __atomic_store_n(&activeM, true, __ATOMIC_RELAXED);
+  cThread::Start();
+  info("Capturing into '%s' [device %d]", fileNameP, deviceIdM);
+  return true;
+}
+
+void cSatipCapture::Stop(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  __atomic_store_n(&activeM, false, __ATOMIC_RELAXED);
+  // Let the writer put the remaining blocks on the disk
+  Cancel(-1);
+  wakeM.Signal();
+  Cancel(eStopTimeoutS);
+  cMutexLock MutexLock(&mutexM);
+  // A killed writer may still be using the file and the blocks
+  if (!__atomic_load_n(&doneM, __ATOMIC_ACQUIRE)) {
+     error("Capture writer didn't stop - leaving '%s' open [device %d]", *fileNameM, deviceIdM);
+     return;
+     }
+  FREE_POINTER(blocksM);
+}
+
+void cSatipCapture::Write(int typeP, const u_char *bufferP, int lengthP, uint64_t timeP)
+{
+  // Called from the poller and tuner threads for every packet, which must never wait for the disk
+  if (!IsActive() || !bufferP || (lengthP <= 0))
+     return;
+  cMutexLock MutexLock(&mutexM);
+  if (!blocksM || !IsActive())
+     return;
+  int length = (int)sizeof(cSatipCaptureRecord) + lengthP;
+  if (bytesM + length > (uint64_t)eMaxFileSizeB) {
+     info("Capture file '%s' reached its size limit [device %d]", *fileNameM, deviceIdM);
+     __atomic_store_n(&activeM, false, __ATOMIC_RELAXED);
+     wakeM.Signal();
+     return;
+     }
+  // Only whole records are queued to keep the file readable
+  if (length > eBlockSizeB - lengthM[fillM] + (eBlockCount - 1 - readyM) * eBlockSizeB) {
+     droppedM++;
+     return;
+     }
+  cSatipCaptureRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = (uint8_t)typeP;
+  record.length = (uint32_t)lengthP;
+  record.time = timeP;
+  Append(&record, sizeof(record));
+  Append(bufferP, lengthP);
+  bytesM += length;
+  if ((typeP > 0) && (typeP < (int)ELEMENTS(countM)))
+     countM[typeP]++;
+}
+
+cString cSatipCapture::GetStatus(void)
+{
+  cMutexLock MutexLock(&mutexM);
+  if (!IsActive())
+     return "";
+  return cString::sprintf("capturing into %s: %u RTP, %u RTCP, %u RTSP packets, %" PRIu64 " bytes, %" PRIu64 " records dropped", *fileNameM,
+                          countM[eCaptureRtp], countM[eCaptureRtcp], countM[eCaptureRtspOut] + countM[eCaptureRtspIn], bytesM, droppedM);
+}
+
+void cSatipCapture::Action(void)
+{
+  debug1("%s Entering [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  bool ok = true;
+  while (ok && Running() && IsActive()) {
+        wakeM.Wait(eWaitTimeoutMs);
+        ok = Flush(false);
+        }
+  if (ok)
+     Flush(true);
+  __atomic_store_n(&activeM, false, __ATOMIC_RELAXED);
+  CloseFile();
+  if (droppedM)
+     error("Dropped %" PRIu64 " records of the capture as the disk was too slow [device %d]", droppedM, deviceIdM);
+  __atomic_store_n(&doneM, true, __ATOMIC_RELEASE);
+  debug1("%s Exiting [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+}
+
+// --- cSatipReplay -----------------------------------------------------------
+
+cSatipReplay::cSatipReplay(cSatipTunerIf &tunerP, const char *fileNameP, double speedP)
+: cThread(cString::sprintf("SATIP#%d replay", tunerP.GetId())),
+  tunerM(tunerP),
+  fileNameM(fileNameP),
+  speedM(speedP),
+  sleepM(),
+  countM(0),
+  bytesM(0)
+{
+  debug1("%s (, %s, %.1f) [device %d]", __PRETTY_FUNCTION__, fileNameP, speedP, tunerM.GetId());
+  Start();
+}
+
+cSatipReplay::~cSatipReplay()
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
+  Stop();
+}
+
+void cSatipReplay::Stop(void)
+{
+  Cancel(-1);
+  sleepM.Signal();
+  Cancel(3);
+}
+
+bool cSatipReplay::Wait(uint64_t dueP)
+{
+  // Sleep the long gaps coarsely, then the remainder precisely
+  for (uint64_t now = cSatipSocket::Now(); Running() && (now < dueP); now = cSatipSocket::Now()) {
+      uint64_t delay = dueP - now;
+      if (delay > 20000)
+         sleepM.Wait(int((delay - 10000) / 1000));
+      else
+         usleep((useconds_t)delay);
+      }
+  return Running();
+}
+
+void cSatipReplay::Action(void)
+{
+  debug1("%s Entering [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
+  FILE *f = fopen(*fileNameM, "rb");
+  if (!f) {
+     char tmp[64];
+     error("Cannot open capture file '%s': %s [device %d]", *fileNameM, strerror_r(errno, tmp, sizeof(tmp)), tunerM.GetId());
+     return;
+     }
+  cSatipCaptureHeader header;
+  if ((fread(&header, sizeof(header), 1, f) != 1) || memcmp(header.magic, cSatipCapture::Magic(), sizeof(header.magic)) || (header.version != cSatipCapture::Version())) {
+     error("Invalid capture file '%s' [device %d]", *fileNameM, tunerM.GetId());
+     fclose(f);
+     return;
+     }
+  info("Replaying '%s' captured on device %d at %s speed [device %d]", *fileNameM, header.deviceId,
+       (speedM > 0) ? *cString::sprintf("%.1fx", speedM) : "maximum", tunerM.GetId());
+  uchar *buffer = MALLOC(uchar, 0x10000);
+  uint64_t firstTime = 0;
+  uint64_t start = cSatipSocket::Now();
+  cSatipCaptureRecord record;
+  while (buffer && Running() && (fread(&record, sizeof(record), 1, f) == 1)) {
+        if ((record.length > 0x10000) || (fread(buffer, record.length, 1, f) != 1)) {
+           error("Truncated capture file '%s' [device %d]", *fileNameM, tunerM.GetId());
+           break;
+           }
+        // Keep the original spacing of the records scaled by the speed
+        if (!firstTime)
+           firstTime = record.time;
+        if ((speedM > 0) && (record.time > firstTime)) {
+           if (!Wait(start + (uint64_t)((record.time - firstTime) / speedM)))
+              break;
+           }
+        switch (record.type) {
+          case cSatipCapture::eCaptureRtp:
+               tunerM.ProcessRtpData(buffer, record.length);
+               break;
+          case cSatipCapture::eCaptureRtcp:
+               tunerM.ProcessRtcpData(buffer, record.length);
+               break;
+          case cSatipCapture::eCaptureRtspOut:
+          case cSatipCapture::eCaptureRtspIn:
+               debug1("%s RTSP %s %.*s [device %d]", __PRETTY_FUNCTION__, (record.type == cSatipCapture::eCaptureRtspOut) ? ">>>" : "<<<",
+                      (int)record.length, (const char *)buffer, tunerM.GetId());
+               break;
+          default:
+               break;
+          }
+        countM++;
+        bytesM += record.length;
+        }
+  free(buffer);
+  fclose(f);
+  info("Replayed %u records (%" PRIu64 " bytes) of '%s' in %" PRIu64 " ms [device %d]", countM, bytesM, *fileNameM,
+       (cSatipSocket::Now() - start) / 1000, tunerM.GetId());
+  debug1("%s Exiting [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
+}
+
+cString cSatipReplay::GetStatus(void)
+{
+  if (!Active())
+     return "";
+  return cString::sprintf("replaying %s: %u records, %" PRIu64 " bytes", *fileNameM, countM, bytesM);
+}
@@ -0,0 +1,114 @@
+/*
+ * capture.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_CAPTURE_H
+#define __SATIP_CAPTURE_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+#include "tunerif.h"
+
+// A capture file starts with a cSatipCaptureHeader followed by records of a
+// cSatipCaptureRecord and its data; all fields are in host byte order
+struct cSatipCaptureHeader {
+  char magic[8];      // "SATIPCAP"
+  uint16_t version;
+  uint16_t deviceId;
+  uint32_t reserved;
+  uint64_t startTime; // in microseconds since the epoch
+} __attribute__((packed));
+
+struct cSatipCaptureRecord {
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t length;
+  uint64_t time;      // receive or send time in microseconds since the epoch
+} __attribute__((packed));
+
+// Captures the RTP, RTCP and RTSP traffic of a tuner; the receiving threads
+// only copy whole records into a ring of blocks, which a writer thread puts
+// on the disk, so a slow disk costs records instead of stalling the poller
+class cSatipCapture : public cThread {
+private:
+  enum {
+    eVersion        = 1,
+    eBlockSizeB     = KILOBYTE(256),
+    eBlockCount     = 8,
+    eWaitTimeoutMs  = 1000, // in milliseconds
+    eStopTimeoutS   = 10    // in seconds
+  };
+  enum {
+    eMaxFileSizeB   = MEGABYTE(2048)
+  };
+  cMutex mutexM;
+  cCondWait wakeM;
+  bool activeM;
+  bool doneM;
+  int deviceIdM;
+  // the block ring, guarded by the mutex
+  u_char *blocksM;
+  int lengthM[eBlockCount];
+  int fillM;
+  int readyM;
+  uint64_t bytesM;
+  uint64_t droppedM;
+  unsigned int countM[5];
+  // the file, owned by the writer thread while active
+  cString fileNameM;
+  int fdM;
+  bool WriteFile(const void *bufferP, int lengthP);
+  void CloseFile(void);
+  bool Advance(void);
+  void Append(const void *dataP, int lengthP);
+  bool Flush(bool partialP);
+
+protected:
+  virtual void Action(void);
+
+public:
+  enum eCaptureType {
+    eCaptureRtp = 1,
+    eCaptureRtcp,
+    eCaptureRtspOut,
+    eCaptureRtspIn
+  };
+  static const char *Magic(void) { return "SATIPCAP"; }
+  static int Version(void) { return eVersion; }
+  explicit cSatipCapture(int deviceIdP);
+  virtual ~cSatipCapture();
+  bool IsActive(void) const { return __atomic_load_n(&activeM, __ATOMIC_RELAXED); }
+  bool Start(const char *fileNameP);
+  void Stop(void);
+  void Write(int typeP, const u_char *bufferP, int lengthP, uint64_t timeP);
+  cString GetStatus(void);
+};
+
+// Feeds a capture file back into a tuner at the original or an accelerated
+// timing; a speed of zero replays as fast as possible
+class cSatipReplay : public cThread {
+private:
+  cSatipTunerIf &tunerM;
+  cString fileNameM;
+  double speedM;
+  cCondWait sleepM;
+  unsigned int countM;
+  uint64_t bytesM;
+  bool Wait(uint64_t dueP);
+
+protected:
+  virtual void Action(void);
+
+public:
+  cSatipReplay(cSatipTunerIf &tunerP, const char *fileNameP, double speedP);
+  virtual ~cSatipReplay();
+  bool IsActive(void) { return Active(); }
+  void Stop(void);
+  cString GetStatus(void);
+};
+
+#endif // __SATIP_CAPTURE_H
@@ -6,6 +6,7 @@
  */
 
 #include <ctype.h>
+#include <stdarg.h>
 #include <vdr/tools.h>
 #include "common.h"
 
@@ -77,6 +78,27 @@ cString ChangeCase(const cString &strP, bool upperP)
   return res;
 }
 
+void AppendFormat(std::string &strP, const char *formatP, ...)
+{
+  // Formats in place at the end of the string to keep long listings linear
+  va_list ap;
+  va_start(ap, formatP);
+  char tmp[256];
+  int len = vsnprintf(tmp, sizeof(tmp), formatP, ap);
+  va_end(ap);
+  if (len < (int)sizeof(tmp)) {
+     if (len > 0)
+        strP.append(tmp, len);
+     return;
+     }
+  size_t pos = strP.size();
+  strP.resize(pos + len + 1);
+  va_start(ap, formatP);
+  vsnprintf(&strP[pos], len + 1, formatP, ap);
+  va_end(ap);
+  strP.resize(pos + len);
+}
+
 const section_filter_table_type section_filter_table[SECTION_FILTER_TABLE_SIZE] =
 {
   // description                        tag    pid   tid   mask
@@ -8,6 +8,7 @@
 #ifndef __SATIP_COMMON_H
 #define __SATIP_COMMON_H
 
+#include <string>
 #include <vdr/device.h>
 #include <vdr/tools.h>
 #include <vdr/config.h>
@@ -138,6 +139,7 @@ const char *id_pid(const u_short pidP);
 char *StripTags(char *strP);
 char *SkipZeroes(const char *strP);
 cString ChangeCase(const cString &strP, bool upperP);
+void AppendFormat(std::string &strP, const char *formatP, ...) __attribute__ ((format (printf, 2, 3)));
 
 struct section_filter_table_type {
   const char *description;
@@ -16,6 +16,14 @@ cSatipConfig::cSatipConfig(void)
   traceModeM(eTraceModeNormal),
   ciExtensionM(0),
   frontendReuseM(1),
+  rtcpLockDetectionM(0),
+  failoverTimeoutM(0),
+  healthPeriodM(0),
+  healthMinQualityM(10),
+  tuningLimitM(0),
+  multicastSharingM(0),
+  bufferSizeLimitM(8),
+  overflowPolicyM(eOverflowPolicyDropLowPriority),
   eitScanM(1),
   useBytesM(1),
   portRangeStartM(0),
@@ -25,7 +33,8 @@ cSatipConfig::cSatipConfig(void)
   disableServerQuirksM(false),
   disconnectIdleStreams(true),
   useSingleModelServersM(false),
-  rtpRcvBufSizeM(0)
+  rtpRcvBufSizeM(0),
+  hugePagesM(eHugePagesTransparent)
 {
   for (unsigned int i = 0; i < MAX_CICAM_COUNT; ++i)
      for (unsigned int j = 0; j <= MAX_CAID_COUNT; ++j)
@@ -36,6 +45,11 @@ cSatipConfig::cSatipConfig(void)
       disabledSourcesM[i] = cSource::stNone;
   for (unsigned int i = 0; i < ELEMENTS(disabledFiltersM); ++i)
       disabledFiltersM[i] = -1;
+  for (unsigned int i = 0; i < eThreadClassCount; ++i) {
+      schedPolicyM[i] = eSchedPolicyDefault;
+      schedPriorityM[i] = 0;
+      CPU_ZERO(&schedCpusM[i]);
+      }
 }
 
 int cSatipConfig::GetCAID(unsigned int camIndex, unsigned int CAIDIndex) const
@@ -108,3 +122,76 @@ void cSatipConfig::SetDisabledFilters(unsigned int indexP, int numberP)
   if (indexP < ELEMENTS(disabledFiltersM))
      disabledFiltersM[indexP] = numberP;
 }
+
+bool cSatipConfig::SetScheduling(const char *paramP)
+{
+  // <class>:<policy>[:<priority>[:<cpulist>]][;...]
+  static const char *classes[eThreadClassCount] = { "poller", "section", "tuner" };
+  static const char *policies[eSchedPolicyCount] = { "default", "other", "fifo", "rr" };
+  static const int policyValues[eSchedPolicyCount] = { -1, SCHED_OTHER, SCHED_FIFO, SCHED_RR };
+  unsigned int policy[eThreadClassCount];
+  int priority[eThreadClassCount];
+  cpu_set_t cpus[eThreadClassCount];
+  for (unsigned int i = 0; i < eThreadClassCount; ++i) {
+      policy[i] = schedPolicyM[i];
+      priority[i] = schedPriorityM[i];
+      cpus[i] = schedCpusM[i];
+      }
+  bool result = true;
+  char *list = strdup(paramP);
+  char *next1, *next2;
+  for (char *p1 = strtok_r(list, ";", &next1); p1 && result; p1 = strtok_r(NULL, ";", &next1)) {
+      char *name = strtok_r(p1, ":", &next2);
+      char *pol = strtok_r(NULL, ":", &next2);
+      char *prio = strtok_r(NULL, ":", &next2);
+      char *cpulist = strtok_r(NULL, ":", &next2);
+      unsigned int c = 0, q = 0;
+      while (name && (c < eThreadClassCount) && strcasecmp(skipspace(name), classes[c]))
+            c++;
+      while (pol && (q < eSchedPolicyCount) && strcasecmp(pol, policies[q]))
+            q++;
+      if (!name || !pol || (c >= eThreadClassCount) || (q >= eSchedPolicyCount)) {
+         error("Invalid scheduling '%s'", p1);
+         result = false;
+         break;
+         }
+      int value = prio ? (int)strtol(prio, NULL, 0) : 0;
+      if ((policyValues[q] >= 0) && ((value < sched_get_priority_min(policyValues[q])) || (value > sched_get_priority_max(policyValues[q])))) {
+         error("Invalid %s priority %d for %s", policies[q], value, classes[c]);
+         result = false;
+         break;
+         }
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      // A list of cpus and ranges like 0,2-3
+      for (char *r = cpulist; r && *r; ) {
+          char *e;
+          long first = strtol(r, &e, 10);
+          long last = first;
+          if (*e == '-')
+             last = strtol(e + 1, &e, 10);
+          if ((e == r) || (first < 0) || (last < first) || (last >= CPU_SETSIZE) || (*e && (*e != ','))) {
+             error("Invalid cpu list '%s' for %s", cpulist, classes[c]);
+             result = false;
+             break;
+             }
+          for (long i = first; i <= last; ++i)
+              CPU_SET(i, &set);
+          r = *e ? e + 1 : e;
+          }
+      if (!result)
+         break;
+      policy[c] = q;
+      priority[c] = value;
+      cpus[c] = set;
+      }
+  free(list);
+  if (result) {
+     for (unsigned int i = 0; i < eThreadClassCount; ++i) {
+         schedPolicyM[i] = policy[i];
+         schedPriorityM[i] = priority[i];
+         schedCpusM[i] = cpus[i];
+         }
+     }
+  return result;
+}
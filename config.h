@@ -8,6 +8,7 @@
 #ifndef __SATIP_CONFIG_H
 #define __SATIP_CONFIG_H
 
+#include <sched.h>
 #include <vdr/menuitems.h>
 #include "common.h"
 
@@ -19,6 +20,14 @@ private:
   unsigned int traceModeM;
   unsigned int ciExtensionM;
   unsigned int frontendReuseM;
+  unsigned int rtcpLockDetectionM;
+  unsigned int failoverTimeoutM;
+  unsigned int healthPeriodM;
+  unsigned int healthMinQualityM;
+  unsigned int tuningLimitM;
+  unsigned int multicastSharingM;
+  unsigned int bufferSizeLimitM;
+  unsigned int overflowPolicyM;
   unsigned int eitScanM;
   unsigned int useBytesM;
   unsigned int portRangeStartM;
@@ -33,6 +42,7 @@ private:
   int disabledSourcesM[MAX_DISABLED_SOURCES_COUNT];
   int disabledFiltersM[SECTION_FILTER_TABLE_SIZE];
   size_t rtpRcvBufSizeM;
+  unsigned int hugePagesM;
 
 public:
   enum eOperatingMode {
@@ -48,6 +58,31 @@ public:
     eTransportModeRtpOverTcp,
     eTransportModeCount
   };
+  enum eOverflowPolicy {
+    eOverflowPolicyDropDatagram = 0,
+    eOverflowPolicyDropLowPriority,
+    eOverflowPolicyDropOldest,
+    eOverflowPolicyCount
+  };
+  enum eHugePages {
+    eHugePagesOff = 0,
+    eHugePagesTransparent,
+    eHugePagesExplicit,
+    eHugePagesCount
+  };
+  enum eThreadClass {
+    eThreadClassPoller = 0,
+    eThreadClassSection,
+    eThreadClassTuner,
+    eThreadClassCount
+  };
+  enum eSchedPolicy {
+    eSchedPolicyDefault = 0,
+    eSchedPolicyOther,
+    eSchedPolicyFifo,
+    eSchedPolicyRr,
+    eSchedPolicyCount
+  };
   enum eTraceMode {
     eTraceModeNormal  = 0x0000,
     eTraceModeDebug1  = 0x0001,
@@ -68,6 +103,13 @@ public:
     eTraceModeDebug16 = 0x8000,
     eTraceModeMask    = 0xFFFF
   };
+
+private:
+  unsigned int schedPolicyM[eThreadClassCount];
+  int schedPriorityM[eThreadClassCount];
+  cpu_set_t schedCpusM[eThreadClassCount]; // empty for no affinity
+
+public:
   cSatipConfig();
   unsigned int GetDeviceCount(void) const { return deviceCount; }
   unsigned int GetOperatingMode(void) const { return operatingModeM; }
@@ -80,6 +122,14 @@ public:
   bool IsTraceMode(eTraceMode modeP) const { return (traceModeM & modeP); }
   unsigned int GetCIExtension(void) const { return ciExtensionM; }
   unsigned int GetFrontendReuse(void) const { return frontendReuseM; }
+  unsigned int GetRtcpLockDetection(void) const { return rtcpLockDetectionM; }
+  unsigned int GetFailoverTimeout(void) const { return failoverTimeoutM; }
+  unsigned int GetHealthPeriod(void) const { return healthPeriodM; }
+  unsigned int GetHealthMinQuality(void) const { return healthMinQualityM; }
+  unsigned int GetTuningLimit(void) const { return tuningLimitM; }
+  unsigned int GetMulticastSharing(void) const { return multicastSharingM; }
+  unsigned int GetBufferSizeLimit(void) const { return bufferSizeLimitM; }
+  unsigned int GetOverflowPolicy(void) const { return overflowPolicyM; }
   int GetCAID(unsigned int camIndex, unsigned int CAIDIndex) const;
   const int *GetProvidedCAIds(unsigned int camIndex) const { return camIndex < MAX_CAID_COUNT ? providedCAIds[camIndex] : 0; };
   cString GetCAIDList(unsigned int camIndex) const;
@@ -102,12 +152,24 @@ public:
   unsigned int GetPortRangeStart(void) const { return portRangeStartM; }
   unsigned int GetPortRangeStop(void) const { return portRangeStopM; }
   size_t GetRtpRcvBufSize(void) const { return rtpRcvBufSizeM; }
+  unsigned int GetHugePages(void) const { return hugePagesM; }
+  unsigned int GetSchedPolicy(unsigned int classP) const { return (classP < eThreadClassCount) ? schedPolicyM[classP] : (unsigned int)eSchedPolicyDefault; }
+  int GetSchedPriority(unsigned int classP) const { return (classP < eThreadClassCount) ? schedPriorityM[classP] : 0; }
+  const cpu_set_t *GetSchedCpus(unsigned int classP) const { return (classP < eThreadClassCount) ? &schedCpusM[classP] : NULL; }
 
   void SetDeviceCount(unsigned int DeviceCount) { deviceCount = DeviceCount; }
   void SetOperatingMode(unsigned int operatingModeP) { operatingModeM = operatingModeP; }
   void SetTraceMode(unsigned int modeP) { traceModeM = (modeP & eTraceModeMask); }
   void SetCIExtension(unsigned int onOffP) { ciExtensionM = onOffP; }
   void SetFrontendReuse(unsigned int onOffP) { frontendReuseM = onOffP; }
+  void SetRtcpLockDetection(unsigned int onOffP) { rtcpLockDetectionM = onOffP; }
+  void SetFailoverTimeout(unsigned int timeoutP) { failoverTimeoutM = timeoutP; }
+  void SetHealthPeriod(unsigned int periodP) { healthPeriodM = periodP; }
+  void SetHealthMinQuality(unsigned int qualityP) { healthMinQualityM = qualityP; }
+  void SetTuningLimit(unsigned int limitP) { tuningLimitM = limitP; }
+  void SetMulticastSharing(unsigned int onOffP) { multicastSharingM = onOffP; }
+  void SetBufferSizeLimit(unsigned int sizeP) { bufferSizeLimitM = sizeP; }
+  void SetOverflowPolicy(unsigned int policyP) { overflowPolicyM = policyP; }
   void SetCAID(unsigned int camIndex, unsigned int CAIDIndex, int CAID);
   void SetCIAssignedDevice(unsigned int indexP, int DeviceIndex);
   void SetEITScan(unsigned int onOffP) { eitScanM = onOffP; }
@@ -122,6 +184,8 @@ public:
   void SetPortRangeStart(unsigned int rangeStartP) { portRangeStartM = rangeStartP; }
   void SetPortRangeStop(unsigned int rangeStopP) { portRangeStopM = rangeStopP; }
   void SetRtpRcvBufSize(size_t sizeP) { rtpRcvBufSizeM = sizeP; }
+  void SetHugePages(unsigned int modeP) { hugePagesM = (modeP < eHugePagesCount) ? modeP : (unsigned int)eHugePagesOff; }
+  bool SetScheduling(const char *paramP);
 };
 
 extern cSatipConfig SatipConfig;
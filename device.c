@@ -11,14 +11,15 @@
 #include "discover.h"
 #include "log.h"
 #include "param.h"
+#include "poller.h"
+#include "trace.h"
 #include "device.h"
 
 static cSatipDevice * SatipDevicesS[SATIP_MAX_DEVICES] = { NULL };
 
-cMutex cSatipDevice::mutexDevicesS = cMutex();
-
 cSatipDevice::cSatipDevice(unsigned int indexP, int CiSlot)
 : deviceIndexM(indexP),
+  mutexTuneM(),
   bytesDeliveredM(0),
   isOpenDvrM(false),
   checkTsBufferM(false),
@@ -32,11 +33,11 @@ cSatipDevice::cSatipDevice(unsigned int indexP, int CiSlot)
 {
   unsigned int bufsize = (unsigned int)SATIP_BUFFER_SIZE;
   bufsize -= (bufsize % TS_SIZE);
+  memset(priorityPidsM, 0, sizeof(priorityPidsM));
   info("Creating device CardIndex=%d DeviceNumber=%d %s%s[%s device %u]", CardIndex(), DeviceNumber(), ciSlot > 0 ? "with CI Slot " : "", ciSlot > 0 ? *itoa(ciSlot) : "", *deviceNameM, deviceIndexM);
 
-  tsBufferM = new cRingBufferLinear(bufsize + 1, TS_SIZE, false,
-                                   *cString::sprintf("SATIP#%d TS", deviceIndexM));
-  if (tsBufferM) {
+  tsBufferM = new cSatipRingBuffer(bufsize + 1, TS_SIZE, *cString::sprintf("SATIP#%d TS", deviceIndexM));
+  if (tsBufferM && tsBufferM->IsValid()) {
      tsBufferM->SetTimeouts(10, 10);
      tsBufferM->SetIoThrottle();
      pTunerM = new cSatipTuner(*this, tsBufferM->Free());
@@ -103,6 +104,15 @@ cSatipDevice *cSatipDevice::GetSatipDevice(int cardIndexP)
   return NULL;
 }
 
+void cSatipDevice::MigrateServer(unsigned int serverIdP)
+{
+  debug1("%s (%u)", __PRETTY_FUNCTION__, serverIdP);
+  for (int i = 0; i < SATIP_MAX_DEVICES; ++i) {
+      if (SatipDevicesS[i])
+         SatipDevicesS[i]->Migrate(serverIdP);
+      }
+}
+
 cString cSatipDevice::GetSatipStatus(void)
 {
   cString info = "";
@@ -146,13 +156,17 @@ cString cSatipDevice::GetGeneralInformation(void)
 {
   debug16("%s [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
   LOCK_CHANNELS_READ;
-  return cString::sprintf("SAT>IP device: %d\nCardIndex: %d\nStream: %s\nSignal: %s\nStream bitrate: %s\n%sChannel: %s\n",
+  return cString::sprintf("SAT>IP device: %d\nCardIndex: %d\nStream: %s\nSignal: %s\nStream bitrate: %s\nStream quality: %s\n%sChannel: %s\nThreads:\n%s\n%s%s%s%s",
                           deviceIndexM, CardIndex(),
                           pTunerM ? *pTunerM->GetInformation() : "",
                           pTunerM ? *pTunerM->GetSignalStatus() : "",
                           pTunerM ? *pTunerM->GetTunerStatistic() : "",
+                          pTunerM ? *pTunerM->GetStreamStatus() : "",
                           *GetBufferStatistic(),
-                          *Channels->GetByNumber(cDevice::CurrentChannel())->ToText());
+                          *Channels->GetByNumber(cDevice::CurrentChannel())->ToText(),
+                          *cSatipPoller::GetInstance()->GetThreadStatistic(),
+                          pTunerM ? *pTunerM->GetThreadStatistic() : "", pTunerM ? "\n" : "",
+                          pSectionFilterHandlerM ? *pSectionFilterHandlerM->GetThreadStatistic() : "", pSectionFilterHandlerM ? "\n" : "");
 }
 
 cString cSatipDevice::GetPidsInformation(void)
@@ -185,7 +199,10 @@ cString cSatipDevice::GetInformation(unsigned int pageP)
          s = pTunerM ? *pTunerM->GetInformation() : "";
          break;
     case SATIP_DEVICE_INFO_BITRATE:
-         s = pTunerM ? *pTunerM->GetTunerStatistic() : "";
+         if (pTunerM)
+            s = cString::sprintf("%s %s", *pTunerM->GetTunerStatistic(), *pTunerM->GetStreamStatus());
+         else
+            s = "";
          break;
     default:
          s = cString::sprintf("%s%s%s",
@@ -253,22 +270,10 @@ int cSatipDevice::SignalQuality(void) const
 
 bool cSatipDevice::ProvidesSource(int sourceP) const
 {
-  cSource *s = Sources.Get(sourceP);
-  debug9("%s (%c) desc='%s' [device %u]", __PRETTY_FUNCTION__, cSource::ToChar(sourceP), s ? s->Description() : "", deviceIndexM);
-  if (SatipConfig.GetDetachedMode())
+  debug9("%s (%c) [device %u]", __PRETTY_FUNCTION__, cSource::ToChar(sourceP), deviceIndexM);
+  if (SatipConfig.GetDetachedMode() || SatipConfig.IsOperatingModeOff())
      return false;
-  // source descriptions starting with '0' are disabled
-  if (s && s->Description() && (*(s->Description()) == '0'))
-     return false;
-  if (!SatipConfig.IsOperatingModeOff() && !!cSatipDiscover::GetInstance()->GetServer(sourceP)) {
-     int numDisabledSourcesM = SatipConfig.GetDisabledSourcesCount();
-     for (int i = 0; i < numDisabledSourcesM; ++i) {
-         if (sourceP == SatipConfig.GetDisabledSources(i))
-            return false;
-         }
-     return true;
-     }
-  return false;
+  return cSatipDiscover::GetInstance()->ProvidesSource(sourceP);
 }
 
 bool cSatipDevice::ProvidesTransponder(const cChannel *channelP) const
@@ -392,21 +397,28 @@ void cSatipDevice::SetPowerSaveMode(bool On)
 
 bool cSatipDevice::SetChannelDevice(const cChannel *channelP, bool liveViewP)
 {
-  cMutexLock MutexLock(&mutexDevicesS);  // Global lock to prevent any simultaneous zapping
   debug9("%s (%d, %d) [device %u]", __PRETTY_FUNCTION__, channelP ? channelP->Number() : -1, liveViewP, deviceIndexM);
   if (channelP) {
-     cDvbTransponderParameters dtp(channelP->Parameters());
-     cString params = GetTransponderUrlParameters(channelP);
+     int system = 0;
+     cString params = GetTransponderUrlParameters(channelP, &system);
      if (isempty(*params)) {
         error("Unrecognized channel parameters: %s [device %u]", channelP->Parameters(), deviceIndexM);
         return false;
         }
 
-     cSatipServer *server = cSatipDiscover::GetInstance()->AssignServer(deviceIndexM, channelP->Source(), channelP->Transponder(), dtp.System());
+     cSatipServer *server = cSatipDiscover::GetInstance()->AssignServer(deviceIndexM, channelP->Source(), channelP->Transponder(), system);
      if (!server) {
         debug9("%s No suitable server found [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
         return false;
         }
+     // Limit the simultaneous tunings per server to prevent frontend allocation failures;
+     // the wait is done before taking the tuning lock the failover needs, too
+     if (!cSatipDiscover::GetInstance()->AdmitTuning(server, eAdmissionTimeoutMs)) {
+        info("Too many tunings on %s - refusing channel %d [device %u]", *cSatipDiscover::GetInstance()->GetServerString(server), channelP->Number(), deviceIndexM);
+        cSatipDiscover::GetInstance()->UnassignServer(server, deviceIndexM);
+        return false;
+        }
+     cMutexLock MutexLock(&mutexTuneM);
      bool useCI = SatipConfig.GetCIExtension() && ciSlot > 0 && channelP->Ca() >= CA_ENCRYPTED_MIN;
      int pmtPid = channelP->Ca() ? ::GetPmtPid(channelP->Source(), channelP->Transponder(), channelP->Sid()) : 0;
      bool reconnect = false;
@@ -420,21 +432,25 @@ bool cSatipDevice::SetChannelDevice(const cChannel *channelP, bool liveViewP)
         debug11("%s CA: %d => %d (%d) %s [device %u]", __PRETTY_FUNCTION__, int(channelIsEncr), int(channelP->Ca() >= CA_ENCRYPTED_MIN), int(channelP->Ca() >= CA_ENCRYPTED_MIN && pmtPid > 0), reconnect ? "changed" : "same",deviceIndexM);
         if (pmtPid > 0) {
            pTunerM->AddPmtPid(pmtPid);
-           params.Append(*cString::sprintf("&addpids=%d&x_pmt=%s&x_ci=%d", pmtPid, *pTunerM->GetPmtPidList(), ciSlot));
+           params.Append(*GetCiUrlParameters(pmtPid));
         }
         debug11("%s '%s:%d' '%s' pmtPids=%s [device %u]", __PRETTY_FUNCTION__, *channelP->GetChannelID().ToString(), pmtPid, channelP->Name(), *pTunerM->GetPmtPidList(), deviceIndexM);
      }
 
+     bool result = false;
      if (pTunerM && pTunerM->SetSource(server, channelP->Transponder(), *params, deviceIndexM, reconnect)) {
         channelM = *channelP;
         channelIsEncr = channelP->Ca() >= CA_ENCRYPTED_MIN && pmtPid > 0;
         deviceNameM = cString::sprintf("%s %d %s", *DeviceType(), deviceIndexM, *cSatipDiscover::GetInstance()->GetServerString(server));
-        // Wait for actual channel tuning to prevent simultaneous frontend allocation failures
-        tunedM.TimedWait(mutexDevicesS, eTuningTimeoutMs);
-        return true;
+        // Wait for actual channel tuning before letting the next device tune on this server
+        tunedM.TimedWait(mutexTuneM, eTuningTimeoutMs);
+        result = true;
         }
+     cSatipDiscover::GetInstance()->ReleaseTuning(server);
+     return result;
      }
-  else if (pTunerM) {
+  cMutexLock MutexLock(&mutexTuneM);
+  if (pTunerM) {
      pTunerM->SetSource(NULL, 0, NULL, deviceIndexM);
      deviceNameM = cString::sprintf("%s %d", *DeviceType(), deviceIndexM);
      return true;
@@ -442,6 +458,58 @@ bool cSatipDevice::SetChannelDevice(const cChannel *channelP, bool liveViewP)
   return false;
 }
 
+void cSatipDevice::Migrate(unsigned int serverIdP)
+{
+  // Called from the discover thread, so the retune is left to the tuner thread
+  if (pTunerM && pTunerM->UsesServer(serverIdP) && (channelM.Transponder() > 0)) {
+     info("Migrating %s to another server [device %u]", channelM.Name(), deviceIndexM);
+     pTunerM->Migrate();
+     }
+}
+
+cString cSatipDevice::GetCiUrlParameters(int pmtPidP)
+{
+  return cString::sprintf("&addpids=%d&x_pmt=%s&x_ci=%d", pmtPidP, *pTunerM->GetPmtPidList(), ciSlot);
+}
+
+cSatipServer *cSatipDevice::AssignFailoverServer(unsigned int excludeIdP, cString &paramsP)
+{
+  debug9("%s [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
+  cChannel channel;
+  {
+    cMutexLock MutexLock(&mutexTuneM);
+    channel = channelM;
+  }
+  if (channel.Transponder() <= 0)
+     return NULL;
+  int system = 0;
+  cString params = GetTransponderUrlParameters(&channel, &system);
+  cSatipServer *server = cSatipDiscover::GetInstance()->AssignServer(deviceIndexM, channel.Source(), channel.Transponder(), system, excludeIdP);
+  if (!server)
+     return NULL;
+  // The failover is subject to the same tuning limit, but the tuner thread mustn't wait long
+  if (!cSatipDiscover::GetInstance()->AdmitTuning(server, eFailoverAdmissionTimeoutMs)) {
+     info("Too many tunings on %s - no failover [device %u]", *cSatipDiscover::GetInstance()->GetServerString(server), deviceIndexM);
+     cSatipDiscover::GetInstance()->UnassignServer(server, deviceIndexM);
+     return NULL;
+     }
+  // The stream parameters are rebuilt for the new server like in SetChannelDevice()
+  bool useCI = SatipConfig.GetCIExtension() && ciSlot > 0 && channel.Ca() >= CA_ENCRYPTED_MIN;
+  int pmtPid = channel.Ca() ? ::GetPmtPid(channel.Source(), channel.Transponder(), channel.Sid()) : 0;
+  if (useCI && (pmtPid > 0) && cSatipDiscover::GetInstance()->IsServerQuirk(server, cSatipServer::eSatipQuirkCiXpmt))
+     params.Append(*GetCiUrlParameters(pmtPid));
+  paramsP = params;
+  cMutexLock MutexLock(&mutexTuneM);
+  deviceNameM = cString::sprintf("%s %d %s", *DeviceType(), deviceIndexM, *cSatipDiscover::GetInstance()->GetServerString(server));
+  return server;
+}
+
+void cSatipDevice::ReleaseFailoverServer(cSatipServer *serverP)
+{
+  debug9("%s [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
+  cSatipDiscover::GetInstance()->ReleaseTuning(serverP);
+}
+
 void cSatipDevice::SetChannelTuned(void)
 {
   debug9("%s () [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
@@ -453,6 +521,9 @@ bool cSatipDevice::SetPid(cPidHandle *handleP, int typeP, bool onP)
 {
   debug12("%s (%d, %d, %d) [device %u]", __PRETTY_FUNCTION__, handleP ? handleP->pid : -1, typeP, onP, deviceIndexM);
   if (pTunerM && handleP && handleP->pid >= 0 && handleP->pid <= 8191) {
+     // Pids requested by receivers are kept on buffer overflows
+     if (onP || !handleP->used)
+        SetPriorityPid(handleP->pid, onP);
      if (onP)
         return pTunerM->SetPid(handleP->pid, typeP, true);
      else if (!handleP->used && pSectionFilterHandlerM && !pSectionFilterHandlerM->Exists(handleP->pid))
@@ -523,14 +594,30 @@ bool cSatipDevice::HasInternalCam(void)
   return SatipConfig.GetCIExtension() && ciSlot > 0;
 }
 
+void cSatipDevice::SetPriorityPid(int pidP, bool onP)
+{
+  if (onP)
+     priorityPidsM[pidP >> 5] |= (1U << (pidP & 0x1F));
+  else
+     priorityPidsM[pidP >> 5] &= ~(1U << (pidP & 0x1F));
+}
+
 void cSatipDevice::WriteData(uchar *bufferP, int lengthP)
 {
   debug16("%s [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
-  // Fill up TS buffer
+  // Fill up TS buffer, dropping only whole TS packets on overflows
   if (isOpenDvrM && tsBufferM) {
-     int len = tsBufferM->Put(bufferP, lengthP);
-     if (len != lengthP)
-        tsBufferM->ReportOverflow(lengthP - len);
+     cSatipTsDrops drops;
+     int dropped = tsBufferM->PutTs(bufferP, lengthP, SatipConfig.GetOverflowPolicy(), priorityPidsM, drops);
+     if (dropped || drops.oldest) {
+        AddDropStatistic(drops.datagrams, drops.packets, drops.lowPriority, drops.oldest);
+        cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eDroppedDatagrams, drops.datagrams);
+        cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eDroppedPackets, drops.packets);
+        cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eDroppedLowPriority, drops.lowPriority);
+        cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eDroppedOldest, drops.oldest);
+        }
+     if (dropped)
+        cSatipTrace::Record(cSatipTrace::eTraceBufferOverflow, deviceIndexM, dropped, SatipConfig.GetOverflowPolicy());
      }
   // Filter the sections
   if (pSectionFilterHandlerM)
@@ -553,6 +640,8 @@ uchar *cSatipDevice::GetData(int *availableP, bool checkTsBuffer)
         tsBufferM->Del(bytesDeliveredM);
         bytesDeliveredM = 0;
         }
+     // No data is held from the buffer here
+     tsBufferM->AutoResize();
      if (checkTsBuffer && tsBufferM->Available() < TS_SIZE)
         return NULL;
      uchar *p = tsBufferM->Get(count);
@@ -565,6 +654,7 @@ uchar *cSatipDevice::GetData(int *availableP, bool checkTsBuffer)
                   }
                }
            tsBufferM->Del(count);
+           cSatipTrace::Record(cSatipTrace::eTraceSyncLoss, deviceIndexM, count);
            info("Skipped %d bytes to sync on TS packet", count);
            return NULL;
            }
@@ -584,7 +674,11 @@ void cSatipDevice::SkipData(int countP)
   debug16("%s [device %u]", __PRETTY_FUNCTION__, deviceIndexM);
   bytesDeliveredM = countP;
   // Update buffer statistics
-  AddBufferStatistic(countP, tsBufferM->Available());
+  AddBufferStatistic(countP, tsBufferM->Available(), tsBufferM->Capacity(), tsBufferM->HighWater(), tsBufferM->Resizes());
+  cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eBufferBytes, countP);
+  cSatipMetrics::Set(deviceIndexM, cSatipMetrics::eBufferUsed, tsBufferM->Available());
+  cSatipMetrics::Set(deviceIndexM, cSatipMetrics::eBufferSize, tsBufferM->Capacity());
+  cSatipMetrics::Set(deviceIndexM, cSatipMetrics::eBufferHighWater, tsBufferM->HighWater());
 }
 
 bool cSatipDevice::GetTSPacket(uchar *&dataP)
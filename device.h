@@ -9,6 +9,7 @@
 #define __SATIP_DEVICE_H
 
 #include <vdr/device.h>
+#include "buffer.h"
 #include "common.h"
 #include "deviceif.h"
 #include "tuner.h"
@@ -23,15 +24,18 @@ public:
   static unsigned int Count(void);
   static cSatipDevice *GetSatipDevice(int CardIndex);
   static cString GetSatipStatus(void);
+  static void MigrateServer(unsigned int serverIdP);
 
   // private parts
 private:
   enum {
-    eReadyTimeoutMs  = 2000, // in milliseconds
-    eTuningTimeoutMs = 1000  // in milliseconds
+    eReadyTimeoutMs     = 2000, // in milliseconds
+    eTuningTimeoutMs    = 1000, // in milliseconds
+    eAdmissionTimeoutMs = 2 * eTuningTimeoutMs, // in milliseconds
+    eFailoverAdmissionTimeoutMs = eTuningTimeoutMs / 2 // in milliseconds
   };
   unsigned int deviceIndexM;
-  static cMutex mutexDevicesS;
+  cMutex mutexTuneM;
   int bytesDeliveredM;
   bool isOpenDvrM;
   bool checkTsBufferM;
@@ -39,17 +43,26 @@ private:
   cString deviceNameM;
   cChannel channelM;
   bool channelIsEncr;
-  cRingBufferLinear *tsBufferM;
+  cSatipRingBuffer *tsBufferM;
   cSatipTuner *pTunerM;
   cSatipSectionFilterHandler *pSectionFilterHandlerM;
   cTimeMs createdM;
   cCondVar tunedM;
+  uint32_t priorityPidsM[0x2000 / 32];
 
   // constructor & destructor
 public:
   explicit cSatipDevice(unsigned int deviceIndexP, int CiSlot);
   virtual ~cSatipDevice();
   cString GetInformation(unsigned int pageP = SATIP_DEVICE_INFO_ALL);
+  bool StartCapture(const char *fileNameP) { return pTunerM ? pTunerM->StartCapture(fileNameP) : false; }
+  void StopCapture(void) { if (pTunerM) pTunerM->StopCapture(); }
+  bool StartReplay(const char *fileNameP, double speedP) { return pTunerM ? pTunerM->StartReplay(fileNameP, speedP) : false; }
+  cString GetCaptureStatus(void) { return pTunerM ? pTunerM->GetCaptureStatus() : cString("no tuner"); }
+  bool StartDump(const char *fileNameP, bool allPidsP, unsigned int maxSizeMbP, unsigned int maxMinutesP) { return pTunerM ? pTunerM->StartDump(fileNameP, allPidsP, maxSizeMbP, maxMinutesP) : false; }
+  void StopDump(void) { if (pTunerM) pTunerM->StopDump(); }
+  cString GetDumpStatus(void) { return pTunerM ? pTunerM->GetDumpStatus() : cString("no tuner"); }
+  void RequestAllPids(bool onP) { if (pTunerM) pTunerM->RequestAllPids(onP); }
 
   // copy and assignment constructors
 private:
@@ -61,6 +74,9 @@ private:
   cString GetPidsInformation(void);
   cString GetFiltersInformation(void);
 
+  // for server migration
+  void Migrate(unsigned int serverIdP);
+
   // for channel info
 public:
   virtual bool Ready(void);
@@ -83,12 +99,16 @@ public:
   virtual bool MaySwitchTransponder(const cChannel *channelP) const;
   virtual void SetPowerSaveMode(bool On);
 
+private:
+  cString GetCiUrlParameters(int pmtPidP);
+
 protected:
   virtual bool SetChannelDevice(const cChannel *channelP, bool liveViewP);
   virtual bool ProvidesCa(const int *ChannelCAIds) const;
 
   // for recording
 private:
+  void SetPriorityPid(int pidP, bool onP);
   uchar *GetData(int *availableP = NULL, bool checkTsBuffer = false);
   void SkipData(int countP);
 
@@ -118,6 +138,8 @@ public:
   virtual int GetId(void) { return deviceIndexM; };
   virtual cString GetTnrParameterString(void);
   virtual bool IsIdle(void) { return !Receiving(); };
+  virtual cSatipServer *AssignFailoverServer(unsigned int excludeIdP, cString &paramsP);
+  virtual void ReleaseFailoverServer(cSatipServer *serverP);
 };
 
 #endif // __SATIP_DEVICE_H
@@ -8,6 +8,8 @@
 #ifndef __SATIP_DEVICEIF_H
 #define __SATIP_DEVICEIF_H
 
+class cSatipServer;
+
 class cSatipDeviceIf {
 public:
   cSatipDeviceIf() {}
@@ -17,6 +19,8 @@ public:
   virtual int GetId(void) = 0;
   virtual cString GetTnrParameterString(void) = 0;
   virtual bool IsIdle(void) = 0;
+  virtual cSatipServer *AssignFailoverServer(unsigned int excludeIdP, cString &paramsP) = 0;
+  virtual void ReleaseFailoverServer(cSatipServer *serverP) = 0;
 
 private:
   explicit cSatipDeviceIf(const cSatipDeviceIf&);
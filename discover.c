@@ -6,6 +6,7 @@
  */
 
 #include <string.h>
+#include <vdr/plugin.h>
 #ifdef USE_TINYXML2
  #include <tinyxml2.h>
 #else
@@ -15,7 +16,153 @@
 #include "config.h"
 #include "log.h"
 #include "socket.h"
+#include "device.h"
 #include "discover.h"
+#include "share.h"
+
+// --- cSatipServersLock ------------------------------------------------------
+
+class cSatipServersLock {
+private:
+  cRwLock &lockM;
+public:
+  cSatipServersLock(cRwLock &lockP, bool writeP) : lockM(lockP) { lockM.Lock(writeP); }
+  ~cSatipServersLock() { lockM.Unlock(); }
+};
+
+// --- cSatipDiscoverFetch ----------------------------------------------------
+
+cSatipDiscoverFetch::cSatipDiscoverFetch(const char *urlP)
+: handleM(curl_easy_init()),
+  headerListM(NULL),
+  urlM(urlP),
+  headerBufferM(),
+  dataBufferM()
+{
+}
+
+cSatipDiscoverFetch::~cSatipDiscoverFetch()
+{
+  if (handleM)
+     curl_easy_cleanup(handleM);
+  handleM = NULL;
+  if (headerListM)
+     curl_slist_free_all(headerListM);
+  headerListM = NULL;
+}
+
+void cSatipDiscoverFetch::SetETag(const char *etagP)
+{
+  if (handleM && !isempty(etagP)) {
+     CURLcode res = CURLE_OK;
+     headerListM = curl_slist_append(headerListM, *cString::sprintf("If-None-Match: %s", etagP));
+     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_HTTPHEADER, headerListM);
+     }
+}
+
+// --- cSatipDiscoverFetches --------------------------------------------------
+
+cSatipDiscoverFetch *cSatipDiscoverFetches::Find(const char *urlP)
+{
+  for (cSatipDiscoverFetch *f = First(); f; f = Next(f)) {
+      if (!strcmp(f->Url(), urlP))
+         return f;
+      }
+  return NULL;
+}
+
+// --- cSatipDiscoverCache ----------------------------------------------------
+
+cSatipDiscoverCacheItem *cSatipDiscoverCache::Find(const char *locationP)
+{
+  for (cSatipDiscoverCacheItem *i = First(); i; i = Next(i)) {
+      if (!strcmp(i->Location(), locationP))
+         return i;
+      }
+  return NULL;
+}
+
+cSatipDiscoverCacheItem *cSatipDiscoverCache::Update(const char *locationP, const char *etagP, const char *addressP, const int portP, const char *modelP, const char *descriptionP)
+{
+  cSatipDiscoverCacheItem *item = Find(locationP);
+  if (item)
+     Del(item);
+  item = new cSatipDiscoverCacheItem(locationP, etagP, addressP, portP, modelP, descriptionP);
+  Add(item);
+  return item;
+}
+
+bool cSatipDiscoverCache::Cleanup(uint64_t intervalMsP)
+{
+  bool removed = false;
+  for (cSatipDiscoverCacheItem *i = First(); i; ) {
+      cSatipDiscoverCacheItem *next = Next(i);
+      if (!intervalMsP || (i->LastSeen() > intervalMsP)) {
+         debug3("%s Removing cached description of '%s'", __PRETTY_FUNCTION__, i->Location());
+         Del(i);
+         removed = true;
+         }
+      i = next;
+      }
+  return removed;
+}
+
+bool cSatipDiscoverCache::Load(const char *fileNameP, int maxAgeP)
+{
+  // Format: <last seen>|<address>|<port>|<location>|<etag>|<model>|<description>
+  debug1("%s (%s, %d)", __PRETTY_FUNCTION__, fileNameP, maxAgeP);
+  FILE *f = fopen(fileNameP, "r");
+  if (!f) {
+     if (errno != ENOENT)
+        error("Cannot read server cache '%s': %s", fileNameP, strerror(errno));
+     return false;
+     }
+  char *s;
+  cReadLine readLine;
+  time_t now = time(NULL);
+  while ((s = readLine.Read(f)) != NULL) {
+        char *field[7];
+        unsigned int n = 0;
+        if (*s == '#' || isempty(s))
+           continue;
+        field[n++] = s;
+        // The description is the last field and may contain any character
+        while ((n < ELEMENTS(field)) && (s = strchr(s, '|')) != NULL) {
+              *s++ = 0;
+              field[n++] = s;
+              }
+        if (n != ELEMENTS(field)) {
+           error("Invalid server cache entry in '%s'", fileNameP);
+           continue;
+           }
+        time_t seen = strtol(field[0], NULL, 10);
+        if ((now - seen) > maxAgeP) {
+           debug3("%s Skipping outdated entry '%s'", __PRETTY_FUNCTION__, field[3]);
+           continue;
+           }
+        // Keep the time the server was last seen until it shows up again
+        if (!Find(field[3]))
+           Add(new cSatipDiscoverCacheItem(field[3], field[4], field[1], strtol(field[2], NULL, 10), field[5], field[6], seen));
+        }
+  fclose(f);
+  return (Count() > 0);
+}
+
+bool cSatipDiscoverCache::Save(const char *fileNameP)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, fileNameP);
+  cSafeFile f(fileNameP);
+  if (f.Open()) {
+     fprintf(f, "# SAT>IP server cache - generated automatically, do not edit\n");
+     for (cSatipDiscoverCacheItem *i = First(); i; i = Next(i))
+         fprintf(f, "%ld|%s|%d|%s|%s|%s|%s\n", (long)i->Seen(), i->Address(), i->Port(), i->Location(), i->ETag(), i->Model() ? i->Model() : "", i->Description() ? i->Description() : "");
+     return f.Close();
+     }
+  error("Cannot write server cache '%s'", fileNameP);
+  return false;
+}
+
+// --- cSatipDiscover ---------------------------------------------------------
 
 cSatipDiscover *cSatipDiscover::instanceS = NULL;
 
@@ -34,8 +181,11 @@ bool cSatipDiscover::Initialize(cSatipDiscoverServers *serversP)
         for (cSatipDiscoverServer *s = serversP->First(); s; s = serversP->Next(s))
             instanceS->AddServer(s->SrcAddress(), s->IpAddress(), s->IpPort(), s->Model(), s->Filters(), s->Description(), s->Quirk());
         }
-     else
+     else {
+        instanceS->LoadCache();
         instanceS->Activate();
+        }
+     instanceS->UpdateSourceIndex();
      }
   return true;
 }
@@ -49,31 +199,31 @@ void cSatipDiscover::Destroy(void)
 
 size_t cSatipDiscover::HeaderCallback(char *ptrP, size_t sizeP, size_t nmembP, void *dataP)
 {
-  cSatipDiscover *obj = reinterpret_cast<cSatipDiscover *>(dataP);
+  cSatipDiscoverFetch *obj = reinterpret_cast<cSatipDiscoverFetch *>(dataP);
   size_t len = sizeP * nmembP;
   debug16("%s len=%zu", __PRETTY_FUNCTION__, len);
 
   if (obj && (len > 0))
-     obj->headerBufferM.Add(ptrP, len);
+     obj->HeaderBuffer().Add(ptrP, len);
 
   return len;
 }
 
 size_t cSatipDiscover::DataCallback(char *ptrP, size_t sizeP, size_t nmembP, void *dataP)
 {
-  cSatipDiscover *obj = reinterpret_cast<cSatipDiscover *>(dataP);
+  cSatipDiscoverFetch *obj = reinterpret_cast<cSatipDiscoverFetch *>(dataP);
   size_t len = sizeP * nmembP;
   debug16("%s len=%zu", __PRETTY_FUNCTION__, len);
 
   if (obj && (len > 0))
-     obj->dataBufferM.Add(ptrP, len);
+     obj->DataBuffer().Add(ptrP, len);
 
   return len;
 }
 
 int cSatipDiscover::DebugCallback(CURL *handleP, curl_infotype typeP, char *dataP, size_t sizeP, void *userPtrP)
 {
-  cSatipDiscover *obj = reinterpret_cast<cSatipDiscover *>(userPtrP);
+  cSatipDiscoverFetch *obj = reinterpret_cast<cSatipDiscoverFetch *>(userPtrP);
 
   if (obj) {
      switch (typeP) {
@@ -103,16 +253,29 @@ int cSatipDiscover::DebugCallback(CURL *handleP, curl_infotype typeP, char *data
 cSatipDiscover::cSatipDiscover()
 : cThread("SATIP discover"),
   mutexDiscoverM(),
-  headerBufferM(),
-  dataBufferM(),
   msearchM(*this),
   probeUrlListM(),
-  handleM(curl_easy_init()),
+  removeUrlListM(),
+  multiHandleM(curl_multi_init()),
+  fetchesM(),
+  cacheM(),
+  cacheFileM(""),
+  cacheModifiedM(false),
+  confirmM(false),
+  confirmTimeoutM(0),
   sleepM(),
+  threadStatisticsM("SATIP discover"),
   probeIntervalM(0),
-  serversM()
+  serversLockM(),
+  serversM(),
+  sourceIndexMutexM(),
+  sourceIndexM(),
+  tuningMutexM(),
+  tuningCondM()
 {
   debug1("%s", __PRETTY_FUNCTION__);
+  if (!multiHandleM)
+     error("Cannot create discovery handle!");
 }
 
 cSatipDiscover::~cSatipDiscover()
@@ -121,10 +284,17 @@ cSatipDiscover::~cSatipDiscover()
   Deactivate();
   cMutexLock MutexLock(&mutexDiscoverM);
   // Free allocated memory
-  if (handleM)
-     curl_easy_cleanup(handleM);
-  handleM = NULL;
+  for (cSatipDiscoverFetch *f = fetchesM.First(); f; f = fetchesM.Next(f)) {
+      if (multiHandleM && f->Handle())
+         curl_multi_remove_handle(multiHandleM, f->Handle());
+      }
+  fetchesM.Clear();
+  if (multiHandleM)
+     curl_multi_cleanup(multiHandleM);
+  multiHandleM = NULL;
+  cacheM.Clear();
   probeUrlListM.Clear();
+  removeUrlListM.Clear();
 }
 
 void cSatipDiscover::Activate(void)
@@ -140,6 +310,29 @@ void cSatipDiscover::Deactivate(void)
   sleepM.Signal();
   if (Running())
      Cancel(3);
+  SaveCache();
+}
+
+void cSatipDiscover::LoadCache(void)
+{
+  cacheFileM = AddDirectory(cPlugin::ConfigDirectory(PLUGIN_NAME_I18N), "servers.cache");
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *cacheFileM);
+  if (cacheM.Load(*cacheFileM, eCacheMaxAge)) {
+     // Use the cached servers right away and confirm them in the background
+     for (cSatipDiscoverCacheItem *i = cacheM.First(); i; i = cacheM.Next(i)) {
+         AddServer(NULL, i->Address(), i->Port(), i->Model(), NULL, i->Description(), cSatipServer::eSatipQuirkNone, true);
+         SetUrl(i->Location());
+         }
+     confirmTimeoutM.Set(eConfirmTimeoutMs);
+     confirmM = true;
+     }
+}
+
+void cSatipDiscover::SaveCache(void)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *cacheFileM);
+  if (!isempty(*cacheFileM) && cacheM.Save(*cacheFileM))
+     cacheModifiedM = false;
 }
 
 void cSatipDiscover::Action(void)
@@ -150,13 +343,41 @@ void cSatipDiscover::Action(void)
   // Do the thread loop
   while (Running()) {
         cStringList tmp;
+        threadStatisticsM.Wakeup();
+        uint64_t start = cSatipThreadStatistics::Now();
 
         if (probeIntervalM.TimedOut()) {
            probeIntervalM.Set(eProbeIntervalMs);
            msearchM.Probe();
-           mutexDiscoverM.Lock();
+           serversLockM.Lock(true);
            serversM.Cleanup(eCleanupTimeoutMs);
-           mutexDiscoverM.Unlock();
+           BuildSourceIndex();
+           serversLockM.Unlock();
+           if (cacheM.Cleanup(eCleanupTimeoutMs))
+              cacheModifiedM = true;
+           }
+        if (confirmM && confirmTimeoutM.TimedOut()) {
+           // Drop the cached servers that haven't answered in time
+           serversLockM.Lock(true);
+           serversM.CleanupCached();
+           BuildSourceIndex();
+           serversLockM.Unlock();
+           confirmM = false;
+           }
+        msearchM.Reprobe();
+        if (SatipConfig.GetMulticastSharing())
+           cSatipShare::GetInstance()->Refresh();
+        mutexDiscoverM.Lock();
+        if (removeUrlListM.Size()) {
+           for (int i = 0; i < removeUrlListM.Size(); ++i)
+               tmp.Insert(strdup(removeUrlListM.At(i)));
+           removeUrlListM.Clear();
+           }
+        mutexDiscoverM.Unlock();
+        if (tmp.Size()) {
+           for (int i = 0; i < tmp.Size(); ++i)
+               RemoveServer(tmp.At(i));
+           tmp.Clear();
            }
         mutexDiscoverM.Lock();
         if (probeUrlListM.Size()) {
@@ -170,8 +391,16 @@ void cSatipDiscover::Action(void)
                Fetch(tmp.At(i));
            tmp.Clear();
            }
-        // to avoid busy loop and reduce cpu load
-        sleepM.Wait(eSleepTimeoutMs);
+        threadStatisticsM.AddProcessing(start);
+        // All pending fetches are run concurrently, so a dead server doesn't delay the others
+        if (fetchesM.Count())
+           ProcessFetches();
+        else {
+           if (cacheModifiedM)
+              SaveCache();
+           // to avoid busy loop and reduce cpu load
+           sleepM.Wait(eSleepTimeoutMs);
+           }
         }
   debug1("%s Exiting", __PRETTY_FUNCTION__);
 }
@@ -179,80 +408,177 @@ void cSatipDiscover::Action(void)
 void cSatipDiscover::Fetch(const char *urlP)
 {
   debug1("%s (%s)", __PRETTY_FUNCTION__, urlP);
-  if (handleM && !isempty(urlP)) {
-     const char *addr = NULL;
-     long rc = 0;
+  if (multiHandleM && !isempty(urlP) && !fetchesM.Find(urlP)) {
+     cSatipDiscoverFetch *fetch = new cSatipDiscoverFetch(urlP);
+     CURL *handle = fetch->Handle();
      CURLcode res = CURLE_OK;
 
+     if (!handle) {
+        error("Cannot create discovery handle for '%s'", urlP);
+        DELETENULL(fetch);
+        return;
+        }
+
      // Verbose output
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_VERBOSE, 1L);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_DEBUGFUNCTION, cSatipDiscover::DebugCallback);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_DEBUGDATA, this);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_VERBOSE, 1L);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_DEBUGFUNCTION, cSatipDiscover::DebugCallback);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_DEBUGDATA, fetch);
 
      // Set header and data callbacks
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_HEADERFUNCTION, cSatipDiscover::HeaderCallback);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_WRITEHEADER, this);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_WRITEFUNCTION, cSatipDiscover::DataCallback);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_WRITEDATA, this);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_HEADERFUNCTION, cSatipDiscover::HeaderCallback);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_WRITEHEADER, fetch);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_WRITEFUNCTION, cSatipDiscover::DataCallback);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_WRITEDATA, fetch);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_PRIVATE, fetch);
 
      // No progress meter and no signaling
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_NOPROGRESS, 1L);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_NOSIGNAL, 1L);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_NOPROGRESS, 1L);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_NOSIGNAL, 1L);
 
      // Set timeouts
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_TIMEOUT_MS, (long)eConnectTimeoutMs);
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_CONNECTTIMEOUT_MS, (long)eConnectTimeoutMs);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_TIMEOUT_MS, (long)eConnectTimeoutMs);
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_CONNECTTIMEOUT_MS, (long)eConnectTimeoutMs);
 
      // Set user-agent
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_USERAGENT, *cString::sprintf("vdr-%s/%s", PLUGIN_NAME_I18N, VERSION));
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_USERAGENT, *cString::sprintf("vdr-%s/%s", PLUGIN_NAME_I18N, VERSION));
+
+     // Ask only for a changed description, if it's already known
+     cSatipDiscoverCacheItem *item = cacheM.Find(urlP);
+     if (item && !isempty(item->ETag()))
+        fetch->SetETag(item->ETag());
 
      // Set URL
-     SATIP_CURL_EASY_SETOPT(handleM, CURLOPT_URL, urlP);
-
-     // Fetch the data
-     SATIP_CURL_EASY_PERFORM(handleM);
-     SATIP_CURL_EASY_GETINFO(handleM, CURLINFO_RESPONSE_CODE, &rc);
-     SATIP_CURL_EASY_GETINFO(handleM, CURLINFO_PRIMARY_IP, &addr);
-     if (rc == 200) {
-        ParseDeviceInfo(addr, ParseRtspPort());
-        headerBufferM.Reset();
-        dataBufferM.Reset();
+     SATIP_CURL_EASY_SETOPT(handle, CURLOPT_URL, urlP);
+
+     // Start fetching the data
+     CURLMcode mres = curl_multi_add_handle(multiHandleM, handle);
+     if (mres != CURLM_OK) {
+        error("Cannot start discovery of '%s': %s", urlP, curl_multi_strerror(mres));
+        DELETENULL(fetch);
+        return;
+        }
+     fetchesM.Add(fetch);
+     }
+}
+
+void cSatipDiscover::ProcessFetches(void)
+{
+  debug16("%s (%d)", __PRETTY_FUNCTION__, fetchesM.Count());
+  int running = 0;
+  CURLMcode mres = curl_multi_perform(multiHandleM, &running);
+  if (mres != CURLM_OK)
+     error("Discovery failed: %s", curl_multi_strerror(mres));
+
+  CURLMsg *msg;
+  int left = 0;
+  while ((msg = curl_multi_info_read(multiHandleM, &left)) != NULL) {
+        if (msg->msg == CURLMSG_DONE) {
+           CURL *handle = msg->easy_handle;
+           CURLcode result = msg->data.result;
+           cSatipDiscoverFetch *fetch = NULL;
+           curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char **)&fetch);
+           curl_multi_remove_handle(multiHandleM, handle);
+           if (fetch) {
+              ProcessFetch(fetch, result);
+              fetchesM.Del(fetch);
+              }
+           }
+        }
+
+  if (running)
+     curl_multi_wait(multiHandleM, NULL, 0, eFetchTimeoutMs, NULL);
+}
+
+void cSatipDiscover::ProcessFetch(cSatipDiscoverFetch *fetchP, CURLcode resultP)
+{
+  debug1("%s (%s, %d)", __PRETTY_FUNCTION__, fetchP->Url(), resultP);
+  if (resultP != CURLE_OK) {
+     error("Discovery of '%s' failed: %s", fetchP->Url(), curl_easy_strerror(resultP));
+     return;
+     }
+
+  CURL *handle = fetchP->Handle();
+  const char *addr = NULL;
+  long rc = 0;
+  CURLcode res = CURLE_OK;
+  SATIP_CURL_EASY_GETINFO(handle, CURLINFO_RESPONSE_CODE, &rc);
+  SATIP_CURL_EASY_GETINFO(handle, CURLINFO_PRIMARY_IP, &addr);
+  cSatipDiscoverCacheItem *item = cacheM.Find(fetchP->Url());
+  if ((rc == 304) && item) {
+     debug1("%s Description of '%s' not modified", __PRETTY_FUNCTION__, fetchP->Url());
+     item->Touch();
+     AddServer(NULL, addr, item->Port(), item->Model(), NULL, item->Description(), cSatipServer::eSatipQuirkNone);
+     }
+  else if (rc == 200) {
+     cString etag;
+     int port = ParseHeader(fetchP->HeaderBuffer().Data(), etag);
+     // Unchanged descriptions aren't parsed again
+     if (!item || isempty(*etag) || strcmp(item->ETag(), *etag) || (item->Port() != port)) {
+        cString model, desc;
+        ParseDeviceInfo(fetchP->DataBuffer(), model, desc);
+        item = cacheM.Update(fetchP->Url(), *etag, addr, port, *model, *desc);
+        cacheModifiedM = true;
         }
      else
-        error("Discovery detected invalid status code: %ld", rc);
+        debug1("%s Description of '%s' unchanged", __PRETTY_FUNCTION__, fetchP->Url());
+     item->Touch();
+     AddServer(NULL, addr, item->Port(), item->Model(), NULL, item->Description(), cSatipServer::eSatipQuirkNone);
      }
+  else
+     error("Discovery detected invalid status code: %ld", rc);
 }
 
-int cSatipDiscover::ParseRtspPort(void)
+int cSatipDiscover::ParseHeader(char *headerP, cString &etagP)
 {
   debug1("%s", __PRETTY_FUNCTION__);
-  char *s, *p = headerBufferM.Data();
-  char *r = strtok_r(p, "\r\n", &s);
   int port = SATIP_DEFAULT_RTSP_PORT;
 
+  etagP = "";
+  if (!headerP)
+     return port;
+
+  char *s, *r = strtok_r(headerP, "\r\n", &s);
   while (r) {
-        debug16("%s (%zu): %s", __PRETTY_FUNCTION__, headerBufferM.Size(), r);
+        debug16("%s: %s", __PRETTY_FUNCTION__, r);
         r = skipspace(r);
         if (strstr(r, "X-SATIP-RTSP-Port")) {
            int tmp = -1;
-           if (sscanf(r, "X-SATIP-RTSP-Port:%11d", &tmp) == 1) {
+           if (sscanf(r, "X-SATIP-RTSP-Port:%11d", &tmp) == 1)
               port = tmp;
-              break;
-              }
            }
+        else if (strcasestr(r, "ETag:") == r)
+           etagP = compactspace(r + 5);
         r = strtok_r(NULL, "\r\n", &s);
         }
 
   return port;
 }
 
-void cSatipDiscover::ParseDeviceInfo(const char *addrP, const int portP)
+void cSatipDiscover::RemoveServer(const char *urlP)
 {
-  debug1("%s (%s, %d)", __PRETTY_FUNCTION__, addrP, portP);
+  debug1("%s (%s)", __PRETTY_FUNCTION__, urlP);
+  cSatipDiscoverCacheItem *item = cacheM.Find(urlP);
+  if (!item)
+     return;
+  cVector<unsigned int> departed;
+  serversLockM.Lock(true);
+  serversM.Depart(item->Address(), departed);
+  BuildSourceIndex();
+  serversLockM.Unlock();
+  cacheM.Del(item);
+  cacheModifiedM = true;
+  // The departed servers aren't assigned anymore, so the devices will pick another one
+  for (int i = 0; i < departed.Size(); ++i)
+      cSatipDevice::MigrateServer(departed[i]);
+}
+
+void cSatipDiscover::ParseDeviceInfo(cSatipMemoryBuffer &dataP, cString &modelP, cString &descP)
+{
+  debug1("%s (%zu)", __PRETTY_FUNCTION__, dataP.Size());
   const char *desc = NULL, *model = NULL;
 #ifdef USE_TINYXML2
   tinyxml2::XMLDocument doc;
-  doc.Parse(dataBufferM.Data());
+  doc.Parse(dataP.Data());
   tinyxml2::XMLHandle docHandle(&doc);
   tinyxml2::XMLElement *descElement = docHandle.FirstChildElement("root").FirstChildElement("device").FirstChildElement("friendlyName").ToElement();
   if (descElement)
@@ -262,7 +588,7 @@ void cSatipDiscover::ParseDeviceInfo(const char *addrP, const int portP)
      model = modelElement->GetText() ? modelElement->GetText() : "DVBS2-1";
 #else
   pugi::xml_document doc;
-  if (doc.load_buffer(dataBufferM.Data(), dataBufferM.Size())) {
+  if (doc.load_buffer(dataP.Data(), dataP.Size())) {
      pugi::xml_node descNode = doc.first_element_by_path("root/device/friendlyName");
      if (descNode)
         desc = descNode.text().as_string("MyBrokenHardware");
@@ -271,13 +597,15 @@ void cSatipDiscover::ParseDeviceInfo(const char *addrP, const int portP)
         model = modelNode.text().as_string("DVBS2-1");
      }
 #endif
-  AddServer(NULL, addrP, portP, model, NULL, desc, cSatipServer::eSatipQuirkNone);
+  // Copy the strings as they belong to the document
+  modelP = model;
+  descP = desc;
 }
 
-void cSatipDiscover::AddServer(const char *srcAddrP, const char *addrP, const int portP, const char *modelP, const char *filtersP, const char *descP, const int quirkP)
+void cSatipDiscover::AddServer(const char *srcAddrP, const char *addrP, const int portP, const char *modelP, const char *filtersP, const char *descP, const int quirkP, const bool cachedP)
 {
-  debug1("%s (%s, %s, %d, %s, %s, %s, %d)", __PRETTY_FUNCTION__, srcAddrP, addrP, portP, modelP, filtersP, descP, quirkP);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  debug1("%s (%s, %s, %d, %s, %s, %s, %d, %d)", __PRETTY_FUNCTION__, srcAddrP, addrP, portP, modelP, filtersP, descP, quirkP, cachedP);
+  cSatipServersLock ServersLock(serversLockM, true);
   if (SatipConfig.GetUseSingleModelServers() && modelP && !isempty(modelP)) {
      int n = 0;
      char *s, *p = strdup(modelP);
@@ -287,7 +615,8 @@ void cSatipDiscover::AddServer(const char *srcAddrP, const char *addrP, const in
            cString desc = cString::sprintf("%s #%d", !isempty(descP) ? descP : "MyBrokenHardware", n++);
            cSatipServer *tmp = new cSatipServer(srcAddrP, addrP, portP, r, filtersP, desc, quirkP);
            if (!serversM.Update(tmp)) {
-              info("Adding server '%s|%s|%s' Bind: %s Filters: %s CI: %s Quirks: %s", tmp->Address(), tmp->Model(), tmp->Description(), !isempty(tmp->SrcAddress()) ? tmp->SrcAddress() : "default", !isempty(tmp->Filters()) ? tmp->Filters() : "none", tmp->HasCI() ? "yes" : "no", tmp->HasQuirk() ? tmp->Quirks() : "none");
+              tmp->SetCached(cachedP);
+              info("Adding %sserver '%s|%s|%s' Bind: %s Filters: %s CI: %s Quirks: %s", cachedP ? "cached " : "", tmp->Address(), tmp->Model(), tmp->Description(), !isempty(tmp->SrcAddress()) ? tmp->SrcAddress() : "default", !isempty(tmp->Filters()) ? tmp->Filters() : "none", tmp->HasCI() ? "yes" : "no", tmp->HasQuirk() ? tmp->Quirks() : "none");
               serversM.Add(tmp);
               }
            else
@@ -299,123 +628,231 @@ void cSatipDiscover::AddServer(const char *srcAddrP, const char *addrP, const in
   else {
      cSatipServer *tmp = new cSatipServer(srcAddrP, addrP, portP, modelP, filtersP, descP, quirkP);
      if (!serversM.Update(tmp)) {
-        info("Adding server '%s|%s|%s' Bind: %s Filters: %s CI: %s Quirks: %s", tmp->Address(), tmp->Model(), tmp->Description(), !isempty(tmp->SrcAddress()) ? tmp->SrcAddress() : "default", !isempty(tmp->Filters()) ? tmp->Filters() : "none", tmp->HasCI() ? "yes" : "no", tmp->HasQuirk() ? tmp->Quirks() : "none");
+        tmp->SetCached(cachedP);
+        info("Adding %sserver '%s|%s|%s' Bind: %s Filters: %s CI: %s Quirks: %s", cachedP ? "cached " : "", tmp->Address(), tmp->Model(), tmp->Description(), !isempty(tmp->SrcAddress()) ? tmp->SrcAddress() : "default", !isempty(tmp->Filters()) ? tmp->Filters() : "none", tmp->HasCI() ? "yes" : "no", tmp->HasQuirk() ? tmp->Quirks() : "none");
         serversM.Add(tmp);
         }
      else
         DELETENULL(tmp);
      }
+  BuildSourceIndex();
+}
+
+void cSatipDiscover::BuildSourceIndex(void)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  // The caller holds the servers lock. The index is built aside and only
+  // copied under its own lock, so the readers never wait for the servers.
+  cSatipSourceIndex index;
+  index.Build(serversM);
+  cMutexLock MutexLock(&sourceIndexMutexM);
+  sourceIndexM = index;
+}
+
+void cSatipDiscover::UpdateSourceIndex(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  cSatipServersLock ServersLock(serversLockM, false);
+  BuildSourceIndex();
 }
 
 int cSatipDiscover::GetServerCount(void)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.Count();
 }
 
-cSatipServer *cSatipDiscover::AssignServer(int deviceIdP, int sourceP, int transponderP, int systemP)
+cSatipServer *cSatipDiscover::AssignServer(int deviceIdP, int sourceP, int transponderP, int systemP, unsigned int excludeIdP)
 {
   debug16("%s (%d, %d, %d, %d)", __PRETTY_FUNCTION__, deviceIdP, sourceP, transponderP, systemP);
-  cMutexLock MutexLock(&mutexDiscoverM);
-  return serversM.Assign(deviceIdP, sourceP, transponderP, systemP);
+  cSatipServersLock ServersLock(serversLockM, true);
+  return serversM.Assign(deviceIdP, sourceP, transponderP, systemP, excludeIdP);
+}
+
+void cSatipDiscover::UnassignServer(cSatipServer *serverP, int deviceIdP)
+{
+  debug16("%s (, %d)", __PRETTY_FUNCTION__, deviceIdP);
+  cSatipServersLock ServersLock(serversLockM, true);
+  serversM.Unassign(serverP, deviceIdP);
 }
 
 cSatipServer *cSatipDiscover::GetServer(int sourceP)
 {
   debug16("%s (%d)", __PRETTY_FUNCTION__, sourceP);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.Find(sourceP);
 }
 
+bool cSatipDiscover::ProvidesSource(int sourceP)
+{
+  debug16("%s (%d)", __PRETTY_FUNCTION__, sourceP);
+  {
+    cMutexLock MutexLock(&sourceIndexMutexM);
+    if (sourceIndexM.IsValid())
+       return sourceIndexM.Provides(sourceP);
+  }
+  // source descriptions starting with '0' are disabled
+  cSource *s = Sources.Get(sourceP);
+  if (s && s->Description() && (*(s->Description()) == '0'))
+     return false;
+  if (!GetServer(sourceP))
+     return false;
+  for (unsigned int i = 0; i < SatipConfig.GetDisabledSourcesCount(); ++i) {
+      if (sourceP == SatipConfig.GetDisabledSources(i))
+         return false;
+      }
+  return true;
+}
+
 cSatipServer *cSatipDiscover::GetServer(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.Find(serverP);
 }
 
+bool cSatipDiscover::GetServerHandle(cSatipServer *serverP, cSatipServerHandle &handleP)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  cSatipServersLock ServersLock(serversLockM, false);
+  return serversM.GetHandle(serverP, handleP);
+}
+
 cSatipServers *cSatipDiscover::GetServers(void)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return &serversM;
 }
 
 cString cSatipDiscover::GetServerString(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.GetString(serverP);
 }
 
 cString cSatipDiscover::GetServerList(void)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.List();
 }
 
+cString cSatipDiscover::GetServerLoad(void)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  cSatipServersLock ServersLock(serversLockM, false);
+  return serversM.Load();
+}
+
+cString cSatipDiscover::GetServerMetrics(void)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  cSatipServersLock ServersLock(serversLockM, false);
+  return serversM.Metrics();
+}
+
 void cSatipDiscover::ActivateServer(cSatipServer *serverP, bool onOffP)
 {
   debug16("%s (, %d)", __PRETTY_FUNCTION__, onOffP);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, true);
   serversM.Activate(serverP, onOffP);
 }
 
-void cSatipDiscover::AttachServer(cSatipServer *serverP, int deviceIdP, int transponderP)
+bool cSatipDiscover::AdmitTuning(cSatipServer *serverP, int timeoutMsP)
 {
-  debug16("%s (, %d, %d)", __PRETTY_FUNCTION__, deviceIdP, transponderP);
-  cMutexLock MutexLock(&mutexDiscoverM);
-  serversM.Attach(serverP, deviceIdP);
+  debug16("%s (, %d)", __PRETTY_FUNCTION__, timeoutMsP);
+  cTimeMs elapsed;
+  cMutexLock MutexLock(&tuningMutexM);
+  for (;;) {
+      serversLockM.Lock(false);
+      cSatipServer *s = serversM.Find(serverP);
+      // the tuning counters are guarded by the tuning mutex
+      bool admitted = s && s->AddTuning();
+      serversLockM.Unlock();
+      if (admitted)
+         return true;
+      int remaining = timeoutMsP - (int)elapsed.Elapsed();
+      if (!s || (remaining <= 0))
+         return false;
+      tuningCondM.TimedWait(tuningMutexM, remaining);
+      }
 }
 
-void cSatipDiscover::DetachServer(cSatipServer *serverP, int deviceIdP, int transponderP)
+void cSatipDiscover::ReleaseTuning(cSatipServer *serverP)
 {
-  debug16("%s (, %d, %d)", __PRETTY_FUNCTION__, deviceIdP, transponderP);
-  cMutexLock MutexLock(&mutexDiscoverM);
-  serversM.Detach(serverP, deviceIdP);
+  debug16("%s", __PRETTY_FUNCTION__);
+  cMutexLock MutexLock(&tuningMutexM);
+  serversLockM.Lock(false);
+  cSatipServer *s = serversM.Find(serverP);
+  if (s)
+     s->RemoveTuning();
+  serversLockM.Unlock();
+  tuningCondM.Broadcast();
+}
+
+void cSatipDiscover::AttachServer(unsigned int serverIdP, int deviceIdP, int transponderP)
+{
+  debug16("%s (%u, %d, %d)", __PRETTY_FUNCTION__, serverIdP, deviceIdP, transponderP);
+  cSatipServersLock ServersLock(serversLockM, true);
+  serversM.Attach(serverIdP, deviceIdP, transponderP);
+}
+
+void cSatipDiscover::DetachServer(unsigned int serverIdP, int deviceIdP, int transponderP)
+{
+  debug16("%s (%u, %d, %d)", __PRETTY_FUNCTION__, serverIdP, deviceIdP, transponderP);
+  cSatipServersLock ServersLock(serversLockM, true);
+  serversM.Detach(serverIdP, deviceIdP);
+}
+
+void cSatipDiscover::UpdateServerHealth(unsigned int serverIdP, int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP)
+{
+  debug16("%s (%u, %d, %d, %d, %d, %d)", __PRETTY_FUNCTION__, serverIdP, deviceIdP, lossP, roundTripP, qualityP, bitrateP);
+  cSatipServersLock ServersLock(serversLockM, true);
+  serversM.UpdateHealth(serverIdP, deviceIdP, lossP, roundTripP, qualityP, bitrateP);
 }
 
 bool cSatipDiscover::IsServerQuirk(cSatipServer *serverP, int quirkP)
 {
   debug16("%s (, %d)", __PRETTY_FUNCTION__, quirkP);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.IsQuirk(serverP, quirkP);
 }
 
 bool cSatipDiscover::HasServerCI(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.HasCI(serverP);
 }
 
 cString cSatipDiscover::GetSourceAddress(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.GetSrcAddress(serverP);
 }
 
 cString cSatipDiscover::GetServerAddress(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.GetAddress(serverP);
 }
 
 int cSatipDiscover::GetServerPort(cSatipServer *serverP)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.GetPort(serverP);
 }
 
 int cSatipDiscover::NumProvidedSystems(void)
 {
   debug16("%s", __PRETTY_FUNCTION__);
-  cMutexLock MutexLock(&mutexDiscoverM);
+  cSatipServersLock ServersLock(serversLockM, false);
   return serversM.NumProvidedSystems();
 }
 
@@ -423,7 +860,31 @@ void cSatipDiscover::SetUrl(const char *urlP)
 {
   debug16("%s (%s)", __PRETTY_FUNCTION__, urlP);
   mutexDiscoverM.Lock();
-  probeUrlListM.Insert(strdup(urlP));
+  // Both probes are usually answered, so skip the duplicates
+  if (probeUrlListM.Find(urlP) < 0)
+     probeUrlListM.Insert(strdup(urlP));
   mutexDiscoverM.Unlock();
   sleepM.Signal();
 }
+
+void cSatipDiscover::RemoveUrl(const char *urlP)
+{
+  debug16("%s (%s)", __PRETTY_FUNCTION__, urlP);
+  mutexDiscoverM.Lock();
+  int i = probeUrlListM.Find(urlP);
+  if (i >= 0) {
+     free(probeUrlListM.At(i));
+     probeUrlListM.Remove(i);
+     }
+  if (removeUrlListM.Find(urlP) < 0)
+     removeUrlListM.Insert(strdup(urlP));
+  mutexDiscoverM.Unlock();
+  sleepM.Signal();
+}
+
+void cSatipDiscover::ShareNotify(const char *messageP)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  if (SatipConfig.GetMulticastSharing())
+     cSatipShare::GetInstance()->Process(messageP);
+}
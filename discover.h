@@ -18,6 +18,7 @@
 #include "msearch.h"
 #include "server.h"
 #include "socket.h"
+#include "statistics.h"
 
 class cSatipDiscoverServer : public cListObject {
 private:
@@ -45,34 +46,111 @@ public:
 class cSatipDiscoverServers : public cList<cSatipDiscoverServer> {
 };
 
+class cSatipDiscoverFetch : public cListObject {
+private:
+  CURL *handleM;
+  struct curl_slist *headerListM;
+  cString urlM;
+  cSatipMemoryBuffer headerBufferM;
+  cSatipMemoryBuffer dataBufferM;
+public:
+  cSatipDiscoverFetch(const char *urlP);
+  virtual ~cSatipDiscoverFetch();
+  CURL *Handle(void)                { return handleM; }
+  const char *Url(void)             { return *urlM; }
+  cSatipMemoryBuffer &HeaderBuffer(void) { return headerBufferM; }
+  cSatipMemoryBuffer &DataBuffer(void)   { return dataBufferM; }
+  void SetETag(const char *etagP);
+};
+
+class cSatipDiscoverFetches : public cList<cSatipDiscoverFetch> {
+public:
+  cSatipDiscoverFetch *Find(const char *urlP);
+};
+
+class cSatipDiscoverCacheItem : public cListObject {
+private:
+  cString locationM;
+  cString etagM;
+  cString addressM;
+  cString modelM;
+  cString descriptionM;
+  int portM;
+  time_t seenM;
+  cTimeMs lastSeenM;
+public:
+  cSatipDiscoverCacheItem(const char *locationP, const char *etagP, const char *addressP, const int portP, const char *modelP, const char *descriptionP, time_t seenP = 0)
+  {
+     locationM = locationP; etagM = etagP; addressM = addressP; portM = portP; modelM = modelP; descriptionM = descriptionP; seenM = seenP ? seenP : time(NULL); lastSeenM.Set(0);
+  }
+  int Port(void)                { return portM; }
+  const char *Location(void)    { return *locationM; }
+  const char *Address(void)     { return *addressM; }
+  const char *ETag(void)        { return *etagM; }
+  const char *Model(void)       { return *modelM; }
+  const char *Description(void) { return *descriptionM; }
+  uint64_t LastSeen(void)       { return lastSeenM.Elapsed(); }
+  time_t Seen(void)             { return seenM; }
+  void Touch(void)              { seenM = time(NULL); lastSeenM.Set(0); }
+};
+
+class cSatipDiscoverCache : public cList<cSatipDiscoverCacheItem> {
+public:
+  cSatipDiscoverCacheItem *Find(const char *locationP);
+  cSatipDiscoverCacheItem *Update(const char *locationP, const char *etagP, const char *addressP, const int portP, const char *modelP, const char *descriptionP);
+  bool Cleanup(uint64_t intervalMsP = 0);
+  bool Load(const char *fileNameP, int maxAgeP);
+  bool Save(const char *fileNameP);
+};
+
 class cSatipDiscover : public cThread, public cSatipDiscoverIf {
 private:
   enum {
     eSleepTimeoutMs   = 500,   // in milliseconds
+    eFetchTimeoutMs   = 100,   // in milliseconds
     eConnectTimeoutMs = 1500,  // in milliseconds
     eProbeTimeoutMs   = 2000,  // in milliseconds
     eProbeIntervalMs  = 60000, // in milliseconds
-    eCleanupTimeoutMs = 124000 // in milliseoonds
+    eConfirmTimeoutMs = 10000, // in milliseconds
+    eCleanupTimeoutMs = 124000, // in milliseoonds
+    eCacheMaxAge      = 604800 // in seconds
   };
   static cSatipDiscover *instanceS;
   static size_t HeaderCallback(char *ptrP, size_t sizeP, size_t nmembP, void *dataP);
   static size_t DataCallback(char *ptrP, size_t sizeP, size_t nmembP, void *dataP);
   static int    DebugCallback(CURL *handleP, curl_infotype typeP, char *dataP, size_t sizeP, void *userPtrP);
   cMutex mutexDiscoverM;
-  cSatipMemoryBuffer headerBufferM;
-  cSatipMemoryBuffer dataBufferM;
   cSatipMsearch msearchM;
   cStringList probeUrlListM;
-  CURL *handleM;
+  cStringList removeUrlListM;
+  CURLM *multiHandleM;
+  cSatipDiscoverFetches fetchesM;
+  cSatipDiscoverCache cacheM;
+  cString cacheFileM;
+  bool cacheModifiedM;
+  bool confirmM;
+  cTimeMs confirmTimeoutM;
   cCondWait sleepM;
+  cSatipThreadStatistics threadStatisticsM;
   cTimeMs probeIntervalM;
+  cRwLock serversLockM;
   cSatipServers serversM;
+  cMutex sourceIndexMutexM;
+  cSatipSourceIndex sourceIndexM;
+  cMutex tuningMutexM;
+  cCondVar tuningCondM;
   void Activate(void);
   void Deactivate(void);
-  int ParseRtspPort(void);
-  void ParseDeviceInfo(const char *addrP, const int portP);
-  void AddServer(const char *srcAddrP, const char *addrP, const int portP, const char *modelP, const char *filtersP, const char *descP, const int quirkP);
+  int ParseHeader(char *headerP, cString &etagP);
+  void ParseDeviceInfo(cSatipMemoryBuffer &dataP, cString &modelP, cString &descP);
+  void AddServer(const char *srcAddrP, const char *addrP, const int portP, const char *modelP, const char *filtersP, const char *descP, const int quirkP, const bool cachedP = false);
+  void RemoveServer(const char *urlP);
+  void BuildSourceIndex(void);
+  void LoadCache(void);
+  void SaveCache(void);
   void Fetch(const char *urlP);
+  void ProcessFetches(void);
+  void ProcessFetch(cSatipDiscoverFetch *fetchP, CURLcode resultP);
   // constructor
   cSatipDiscover();
   // to prevent copy constructor and assignment
@@ -88,26 +166,38 @@ public:
   static void Destroy(void);
   virtual ~cSatipDiscover();
   void TriggerScan(void) { probeIntervalM.Set(0); }
+  void Announce(const char *messageP) { msearchM.Announce(messageP); }
   int GetServerCount(void);
-  cSatipServer *AssignServer(int deviceIdP, int sourceP, int transponderP, int systemP);
+  cSatipServer *AssignServer(int deviceIdP, int sourceP, int transponderP, int systemP, unsigned int excludeIdP = 0);
+  void UnassignServer(cSatipServer *serverP, int deviceIdP);
   cSatipServer *GetServer(int sourceP);
+  bool ProvidesSource(int sourceP);
+  void UpdateSourceIndex(void);
   cSatipServer *GetServer(cSatipServer *serverP);
+  bool GetServerHandle(cSatipServer *serverP, cSatipServerHandle &handleP);
   cSatipServers *GetServers(void);
   cString GetServerString(cSatipServer *serverP);
   void ActivateServer(cSatipServer *serverP, bool onOffP);
-  void AttachServer(cSatipServer *serverP, int deviceIdP, int transponderP);
-  void DetachServer(cSatipServer *serverP, int deviceIdP, int transponderP);
+  bool AdmitTuning(cSatipServer *serverP, int timeoutMsP);
+  void ReleaseTuning(cSatipServer *serverP);
+  void AttachServer(unsigned int serverIdP, int deviceIdP, int transponderP);
+  void DetachServer(unsigned int serverIdP, int deviceIdP, int transponderP);
+  void UpdateServerHealth(unsigned int serverIdP, int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP);
   bool IsServerQuirk(cSatipServer *serverP, int quirkP);
   bool HasServerCI(cSatipServer *serverP);
   cString GetServerAddress(cSatipServer *serverP);
   cString GetSourceAddress(cSatipServer *serverP);
   int GetServerPort(cSatipServer *serverP);
   cString GetServerList(void);
+  cString GetServerLoad(void);
+  cString GetServerMetrics(void);
   int NumProvidedSystems(void);
 
   // for internal discover interface
 public:
   virtual void SetUrl(const char *urlP);
+  virtual void RemoveUrl(const char *urlP);
+  virtual void ShareNotify(const char *messageP);
 };
 
 #endif // __SATIP_DISCOVER_H
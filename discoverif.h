@@ -13,6 +13,8 @@ public:
   cSatipDiscoverIf() {}
   virtual ~cSatipDiscoverIf() {}
   virtual void SetUrl(const char *urlP) = 0;
+  virtual void RemoveUrl(const char *urlP) = 0;
+  virtual void ShareNotify(const char *messageP) = 0;
 
 private:
   explicit cSatipDiscoverIf(const cSatipDiscoverIf&);
@@ -0,0 +1,281 @@
+/*
+ * dump.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "dump.h"
+#include "log.h"
+
+// --- cSatipDump -------------------------------------------------------------
+
+cSatipDump::cSatipDump(int deviceIdP)
+: cThread(cString::sprintf("SATIP#%d dump", deviceIdP)),
+  mutexM(),
+  wakeM(),
+  activeM(false),
+  doneM(true),
+  allPidsM(false),
+  deviceIdM(deviceIdP),
+  blocksM(NULL),
+  fillM(0),
+  readyM(0),
+  fileNameM(""),
+  partNameM(""),
+  fdM(-1),
+  directM(false),
+  maxSizeM(0),
+  maxTimeM(0),
+  fileTimeM(),
+  fileBytesM(0),
+  partsM(0),
+  bytesM(0),
+  droppedM(0)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  memset(lengthM, 0, sizeof(lengthM));
+}
+
+cSatipDump::~cSatipDump()
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  Close();
+}
+
+bool cSatipDump::OpenFile(void)
+{
+  cString name = fileNameM;
+  if (partsM) {
+     // The following parts are numbered in front of the extension
+     const char *ext = strrchr(*fileNameM, '.');
+     if (ext && !strchr(ext, '/'))
+        name = cString::sprintf("%.*s-%03u%s", (int)(ext - *fileNameM), *fileNameM, partsM, ext);
+     else
+        name = cString::sprintf("%s-%03u", *fileNameM, partsM);
+     }
+  debug1("%s (%s) [device %d]", __PRETTY_FUNCTION__, *name, deviceIdM);
+  // Bypass the page cache where the file system allows it
+  bool direct = true;
+  int fd = open(*name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, DEFFILEMODE);
+  if ((fd < 0) && (errno == EINVAL)) {
+     direct = false;
+     fd = open(*name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, DEFFILEMODE);
+     }
+  if (fd < 0) {
+     char tmp[64];
+     error("Cannot create dump file '%s': %s [device %d]", *name, strerror_r(errno, tmp, sizeof(tmp)), deviceIdM);
+     return false;
+     }
+  cMutexLock MutexLock(&mutexM);
+  fdM = fd;
+  directM = direct;
+  partNameM = name;
+  fileBytesM = 0;
+  fileTimeM.Set();
+  info("Dumping the TS stream into '%s'%s [device %d]", *name, direct ? " (direct I/O)" : "", deviceIdM);
+  return true;
+}
+
+void cSatipDump::CloseFile(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  if (fdM >= 0) {
+     if (close(fdM) != 0)
+        error("Cannot close dump file '%s' [device %d]", *partNameM, deviceIdM);
+     fdM = -1;
+     info("Dumped %" PRIu64 " bytes into '%s' [device %d]", fileBytesM, *partNameM, deviceIdM);
+     }
+}
+
+bool cSatipDump::RotateFile(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  CloseFile();
+  partsM++;
+  return OpenFile();
+}
+
+bool cSatipDump::WriteFile(const u_char *bufferP, int lengthP)
+{
+  // Only whole blocks keep the offset aligned for the direct I/O
+  if (directM && (lengthP % eAlignment)) {
+     fcntl(fdM, F_SETFL, fcntl(fdM, F_GETFL) & ~O_DIRECT);
+     directM = false;
+     }
+  while (lengthP > 0) {
+        ssize_t n = write(fdM, bufferP, lengthP);
+        if (n < 0) {
+           if (errno == EINTR)
+              continue;
+           if (directM && (errno == EINVAL)) {
+              fcntl(fdM, F_SETFL, fcntl(fdM, F_GETFL) & ~O_DIRECT);
+              directM = false;
+              continue;
+              }
+           char tmp[64];
+           error("Cannot write dump file '%s': %s [device %d]", *partNameM, strerror_r(errno, tmp, sizeof(tmp)), deviceIdM);
+           return false;
+           }
+        bufferP += n;
+        lengthP -= (int)n;
+        fileBytesM += n;
+        __atomic_add_fetch(&bytesM, (uint64_t)n, __ATOMIC_RELAXED);
+        }
+  return true;
+}
+
+bool cSatipDump::Advance(void)
+{
+  // Called with the mutex locked; one block is always left for filling
+  if (readyM >= eBlockCount - 1)
+     return false;
+  readyM++;
+  fillM = (fillM + 1) % eBlockCount;
+  lengthM[fillM] = 0;
+  return true;
+}
+
+bool cSatipDump::Flush(bool partialP)
+{
+  for (;;) {
+      int index, length;
+      {
+        cMutexLock MutexLock(&mutexM);
+        if (!readyM && partialP && (lengthM[fillM] > 0)) {
+           // Take over the block being filled, too
+           Advance();
+           partialP = false;
+           }
+        if (!readyM)
+           break;
+        index = (fillM - readyM + eBlockCount) % eBlockCount;
+        length = lengthM[index];
+      }
+      // The blocks hold whole TS packets, so the parts start at a packet
+      if (maxSizeM && fileBytesM && (fileBytesM + length > maxSizeM) && !RotateFile())
+         return false;
+      if (!WriteFile(blocksM + index * eBlockSizeB, length))
+         return false;
+      cMutexLock MutexLock(&mutexM);
+      readyM--;
+      }
+  return true;
+}
+
+bool cSatipDump::Open(const char *fileNameP, bool allPidsP, unsigned int maxSizeMbP, unsigned int maxMinutesP)
+{
+  debug1("%s (%s, %d, %u, %u) [device %d]", __PRETTY_FUNCTION__, fileNameP, allPidsP, maxSizeMbP, maxMinutesP, deviceIdM);
+  Close();
+  if (!__atomic_load_n(&doneM, __ATOMIC_ACQUIRE)) {
+     error("Cannot dump while the previous dump is still being written [device %d]", deviceIdM);
+     return false;
+     }
+  void *blocks = NULL;
+  if (posix_memalign(&blocks, eAlignment, eBlockCount * eBlockSizeB) != 0) {
+     error("Cannot allocate the dump buffer [device %d]", deviceIdM);
+     return false;
+     }
+  {
+    cMutexLock MutexLock(&mutexM);
+    blocksM = (u_char *)blocks;
+    memset(lengthM, 0, sizeof(lengthM));
+    fillM = 0;
+    readyM = 0;
+    fileNameM = fileNameP;
+    allPidsM = allPidsP;
+    maxSizeM = (uint64_t)maxSizeMbP * MEGABYTE(1);
+    maxTimeM = (uint64_t)maxMinutesP * 60000;
+    partsM = 0;
+    bytesM = 0;
+    droppedM = 0;
+  }
+  if (!OpenFile()) {
+     cMutexLock MutexLock(&mutexM);
+     FREE_POINTER(blocksM);
+     return false;
+     }
+  __atomic_store_n(&doneM, false, __ATOMIC_RELAXED);
+  __atomic_store_n(&activeM, true, __ATOMIC_RELAXED);
+  Start();
+  return true;
+}
+
+void cSatipDump::Close(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  __atomic_store_n(&activeM, false, __ATOMIC_RELAXED);
+  // Let the writer put the remaining blocks on the disk
+  Cancel(-1);
+  wakeM.Signal();
+  Cancel(eStopTimeoutS);
+  cMutexLock MutexLock(&mutexM);
+  // The writer closes the file itself; a killed one may still be using it and the blocks
+  if (!__atomic_load_n(&doneM, __ATOMIC_ACQUIRE)) {
+     error("Dump writer didn't stop - leaving '%s' open [device %d]", *partNameM, deviceIdM);
+     return;
+     }
+  FREE_POINTER(blocksM);
+}
+
+void cSatipDump::Write(const u_char *bufferP, int lengthP)
+{
+  // Called from the poller thread, which must never wait for the disk
+  if (!IsActive() || !bufferP || (lengthP <= 0))
+     return;
+  cMutexLock MutexLock(&mutexM);
+  if (!blocksM)
+     return;
+  while (lengthP > 0) {
+        if ((lengthM[fillM] == eBlockSizeB) && !Advance()) {
+           // The writer lags behind, so drop the data instead of stalling
+           droppedM += lengthP;
+           break;
+           }
+        int n = min(lengthP, eBlockSizeB - lengthM[fillM]);
+        memcpy(blocksM + fillM * eBlockSizeB + lengthM[fillM], bufferP, n);
+        lengthM[fillM] += n;
+        bufferP += n;
+        lengthP -= n;
+        if ((lengthM[fillM] == eBlockSizeB) && Advance())
+           wakeM.Signal();
+        }
+}
+
+cString cSatipDump::GetStatus(void)
+{
+  cMutexLock MutexLock(&mutexM);
+  if (!IsActive())
+     return "";
+  return cString::sprintf("dumping into %s (part %u)%s: %.1f MB written, %.1f MB dropped", *partNameM, partsM + 1, allPidsM ? " with all pids" : "",
+                          __atomic_load_n(&bytesM, __ATOMIC_RELAXED) / 1048576.0, droppedM / 1048576.0);
+}
+
+void cSatipDump::Action(void)
+{
+  debug1("%s Entering [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  bool ok = true;
+  while (ok && Running()) {
+        wakeM.Wait(eWaitTimeoutMs);
+        if (maxTimeM && (fileTimeM.Elapsed() >= maxTimeM))
+           ok = Flush(true) && RotateFile();
+        else
+           ok = Flush(false);
+        }
+  if (ok)
+     Flush(true);
+  else
+     __atomic_store_n(&activeM, false, __ATOMIC_RELAXED);
+  CloseFile();
+  if (droppedM)
+     error("Dropped %" PRIu64 " bytes of the TS dump as the disk was too slow [device %d]", droppedM, deviceIdM);
+  __atomic_store_n(&doneM, true, __ATOMIC_RELEASE);
+  debug1("%s Exiting [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+}
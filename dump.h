@@ -0,0 +1,71 @@
+/*
+ * dump.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_DUMP_H
+#define __SATIP_DUMP_H
+
+#include <stdint.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+// Writes the raw TS stream of a tuner into files; the receiving thread only
+// copies into a ring of aligned blocks, which a writer thread puts on the
+// disk, so a slow disk costs data instead of stalling the poller
+class cSatipDump : public cThread {
+private:
+  enum {
+    eAlignment      = 4096,
+    eBlockSizeB     = 2 * eAlignment * 188, // aligned to the pages and the TS packets
+    eBlockCount     = 8,
+    eWaitTimeoutMs  = 1000, // in milliseconds
+    eStopTimeoutS   = 10    // in seconds
+  };
+  cMutex mutexM;
+  cCondWait wakeM;
+  bool activeM;
+  bool doneM;
+  bool allPidsM;
+  int deviceIdM;
+  // the block ring, guarded by the mutex
+  u_char *blocksM;
+  int lengthM[eBlockCount];
+  int fillM;
+  int readyM;
+  // the files, owned by the writer thread while active
+  cString fileNameM;
+  cString partNameM;
+  int fdM;
+  bool directM;
+  uint64_t maxSizeM;
+  uint64_t maxTimeM;
+  cTimeMs fileTimeM;
+  uint64_t fileBytesM;
+  unsigned int partsM;
+  uint64_t bytesM;
+  uint64_t droppedM;
+  bool OpenFile(void);
+  void CloseFile(void);
+  bool RotateFile(void);
+  bool WriteFile(const u_char *bufferP, int lengthP);
+  bool Advance(void);
+  bool Flush(bool partialP);
+
+protected:
+  virtual void Action(void);
+
+public:
+  explicit cSatipDump(int deviceIdP);
+  virtual ~cSatipDump();
+  bool IsActive(void) const { return __atomic_load_n(&activeM, __ATOMIC_RELAXED); }
+  bool IsAllPids(void) const { return IsActive() && allPidsM; }
+  bool Open(const char *fileNameP, bool allPidsP, unsigned int maxSizeMbP, unsigned int maxMinutesP);
+  void Close(void);
+  void Write(const u_char *bufferP, int lengthP);
+  cString GetStatus(void);
+};
+
+#endif // __SATIP_DUMP_H
@@ -0,0 +1,141 @@
+/*
+ * health.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+
+#include "common.h"
+#include "config.h"
+#include "log.h"
+#include "statistics.h"
+#include "health.h"
+
+cSatipHealthMonitor::cSatipHealthMonitor(int deviceIdP)
+: deviceIdM(deviceIdP),
+  suspendedM(false),
+  resetM(false),
+  evaluateM(eEvaluateIntervalMs),
+  degradedM(),
+  healthyM(),
+  isDegradedM(false),
+  actionsM(0)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  memset(continuityM, eNoCounter, sizeof(continuityM));
+  memset(samplesM, 0, sizeof(samplesM));
+}
+
+void cSatipHealthMonitor::Sample(uint64_t *samplesP)
+{
+  samplesP[eSampleRtpPackets] = cSatipMetrics::Counter(deviceIdM, cSatipMetrics::eRtpPackets);
+  samplesP[eSampleRtpLost] = cSatipMetrics::Counter(deviceIdM, cSatipMetrics::eRtpLostPackets);
+  samplesP[eSampleTsPackets] = cSatipMetrics::Counter(deviceIdM, cSatipMetrics::eTunerBytes) / TS_SIZE;
+  samplesP[eSampleCcErrors] = cSatipMetrics::Counter(deviceIdM, cSatipMetrics::eCcErrors);
+  samplesP[eSampleDropped] = cSatipMetrics::Counter(deviceIdM, cSatipMetrics::eDroppedPackets);
+}
+
+void cSatipHealthMonitor::Reset(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  // The continuity counters belong to the poller thread
+  __atomic_store_n(&resetM, true, __ATOMIC_RELEASE);
+  Sample(samplesM);
+  evaluateM.Set(eEvaluateIntervalMs);
+  isDegradedM = false;
+}
+
+void cSatipHealthMonitor::Process(const u_char *bufferP, int lengthP)
+{
+  // The counters seen before a suspension are stale
+  if (__atomic_exchange_n(&resetM, false, __ATOMIC_ACQUIRE) || suspendedM) {
+     memset(continuityM, eNoCounter, sizeof(continuityM));
+     suspendedM = false;
+     }
+  uint64_t errors = 0;
+  for (const u_char *p = bufferP; p + TS_SIZE <= bufferP + lengthP; p += TS_SIZE) {
+      if ((p[0] != TS_SYNC_BYTE) || (p[1] & 0x80))
+         continue;
+      int pid = ts_pid(p);
+      if (pid == 0x1FFF)
+         continue;
+      uint8_t cc = p[3] & 0x0F;
+      uint8_t last = continuityM[pid];
+      // Only packets with payload advance the counter
+      if (!(p[3] & 0x10)) {
+         if ((last == eNoCounter) || (cc != (last & 0x0F)))
+            continuityM[pid] = cc;
+         continue;
+         }
+      if (last == eNoCounter) {
+         continuityM[pid] = cc;
+         continue;
+         }
+      // A packet may be sent twice, any further copy is an error
+      if (cc == (last & 0x0F)) {
+         if (last & eDuplicate)
+            errors++;
+         continuityM[pid] = cc | eDuplicate;
+         continue;
+         }
+      continuityM[pid] = cc;
+      last &= 0x0F;
+      // Skip signalled discontinuities
+      if ((p[3] & 0x20) && (p[4] > 0) && (p[5] & 0x80))
+         continue;
+      if (cc != ((last + 1) & 0x0F))
+         errors++;
+      }
+  if (errors)
+     cSatipMetrics::Add(deviceIdM, cSatipMetrics::eCcErrors, errors);
+}
+
+cSatipHealthMonitor::eAction cSatipHealthMonitor::Evaluate(int signalQualityP)
+{
+  if (!SatipConfig.GetHealthPeriod() || !evaluateM.TimedOut())
+     return eActionNone;
+  evaluateM.Set(eEvaluateIntervalMs);
+  uint64_t samples[eSampleCount];
+  uint64_t delta[eSampleCount];
+  Sample(samples);
+  for (int i = 0; i < eSampleCount; ++i) {
+      delta[i] = samples[i] - samplesM[i];
+      samplesM[i] = samples[i];
+      }
+  // Stalls are left to the failover and reconnect timeouts
+  uint64_t rtp = delta[eSampleRtpPackets] + delta[eSampleRtpLost];
+  int loss = (rtp >= eMinPackets) ? (int)(delta[eSampleRtpLost] * 1000 / rtp) : 0;
+  int cc = (delta[eSampleTsPackets] >= eMinPackets) ? (int)(delta[eSampleCcErrors] * 1000 / delta[eSampleTsPackets]) : 0;
+  int overflow = (delta[eSampleTsPackets] >= eMinPackets) ? (int)(delta[eSampleDropped] * 1000 / delta[eSampleTsPackets]) : 0;
+  bool weak = (signalQualityP >= 0) && (signalQualityP < (int)SatipConfig.GetHealthMinQuality());
+  if ((loss <= eMaxRtpLossPermille) && (cc <= eMaxCcErrorPermille) && (overflow <= eMaxOverflowPermille) && !weak) {
+     if (isDegradedM) {
+        info("Stream recovered after %" PRIu64 " ms [device %d]", degradedM.Elapsed(), deviceIdM);
+        isDegradedM = false;
+        healthyM.Set();
+        }
+     // Start over with a retune once the stream has been fine for a while
+     if (actionsM && (healthyM.Elapsed() >= eRecoveryTimeMs))
+        actionsM = 0;
+     return eActionNone;
+     }
+  cString status = cString::sprintf("loss %d.%d%% cc errors %d.%d%% overflows %d.%d%% quality %d%%", loss / 10, loss % 10, cc / 10, cc % 10, overflow / 10, overflow % 10, signalQualityP);
+  if (!isDegradedM) {
+     info("Stream degraded: %s [device %d]", *status, deviceIdM);
+     cSatipMetrics::Add(deviceIdM, cSatipMetrics::eHealthDegradations);
+     isDegradedM = true;
+     degradedM.Set();
+     }
+  if (degradedM.Elapsed() < SatipConfig.GetHealthPeriod() * 1000ULL)
+     return eActionNone;
+  // Retune first and move on to another frontend or server if that didn't help
+  eAction action = actionsM++ ? eActionFailover : eActionRetune;
+  error("Stream degraded for %u s (%s) - %s [device %d]", SatipConfig.GetHealthPeriod(), *status, (action == eActionRetune) ? "retuning" : "failing over", deviceIdM);
+  cSatipMetrics::Add(deviceIdM, (action == eActionRetune) ? cSatipMetrics::eHealthRetunes : cSatipMetrics::eHealthFailovers);
+  isDegradedM = false;
+  healthyM.Set();
+  return action;
+}
@@ -0,0 +1,64 @@
+/*
+ * health.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_HEALTH_H
+#define __SATIP_HEALTH_H
+
+#include <stdint.h>
+#include <vdr/tools.h>
+
+// Watches the RTP loss, TS continuity errors, buffer overflows and the
+// signal quality of a stream and asks for a retune or a failover when the
+// stream stays degraded for the configured period
+class cSatipHealthMonitor {
+private:
+  enum {
+    eEvaluateIntervalMs  = 1000,  // in milliseconds
+    eRecoveryTimeMs      = 60000, // in milliseconds
+    eMinPackets          = 100,   // per evaluation interval
+    eMaxRtpLossPermille  = 10,
+    eMaxCcErrorPermille  = 5,
+    eMaxOverflowPermille = 5,
+    eNoCounter           = 0x10,
+    eDuplicate           = 0x20  // flags a counter already seen twice
+  };
+  enum eSample {
+    eSampleRtpPackets = 0,
+    eSampleRtpLost,
+    eSampleTsPackets,
+    eSampleCcErrors,
+    eSampleDropped,
+    eSampleCount
+  };
+  int deviceIdM;
+  // updated by the poller thread only
+  uint8_t continuityM[8192];
+  bool suspendedM;
+  bool resetM;
+  // updated by the tuner thread only
+  uint64_t samplesM[eSampleCount];
+  cTimeMs evaluateM;
+  cTimeMs degradedM;
+  cTimeMs healthyM;
+  bool isDegradedM;
+  int actionsM;
+  void Sample(uint64_t *samplesP);
+
+public:
+  enum eAction {
+    eActionNone = 0,
+    eActionRetune,
+    eActionFailover
+  };
+  explicit cSatipHealthMonitor(int deviceIdP);
+  void Reset(void);
+  void Process(const u_char *bufferP, int lengthP);
+  void Suspend(void) { suspendedM = true; }
+  eAction Evaluate(int signalQualityP);
+};
+
+#endif // __SATIP_HEALTH_H
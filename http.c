@@ -0,0 +1,664 @@
+/*
+ * http.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <vdr/channels.h>
+#include <vdr/sources.h>
+
+#include "config.h"
+#include "device.h"
+#include "http.h"
+#include "log.h"
+#include "poller.h"
+#include "statistics.h"
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define SATIP_HTTP_ZEROCOPY
+#endif
+
+// --- cSatipHttpClient -------------------------------------------------------
+
+cSatipHttpClient::cSatipHttpClient(cSatipHttpServer &serverP)
+: serverM(serverP),
+  fdM(-1),
+  addressM(""),
+  requestLengthM(0),
+  queueM(NULL),
+  headM(0),
+  sentM(0),
+  releasedM(0),
+  zeroCopyM(false),
+  zeroCopyCountM(0),
+  zeroCopyIdM(0),
+  zeroCopyDoneM(0),
+  stateM(eStateFree),
+  deviceIdM(-1),
+  allPidsM(false),
+  pathM(""),
+  receiverM(NULL),
+  flushM(),
+  allPidsCardM(-1)
+{
+  requestM[0] = 0;
+  memset(pidsM, 0, sizeof(pidsM));
+}
+
+cSatipHttpClient::~cSatipHttpClient()
+{
+  Close();
+}
+
+bool cSatipHttpClient::Open(int fdP, const char *addressP)
+{
+  debug1("%s (%d, %s)", __PRETTY_FUNCTION__, fdP, addressP);
+  if (!queueM && !(queueM = MALLOC(u_char, eQueueSizeB))) {
+     error("Cannot allocate the queue of HTTP client %s", addressP);
+     return false;
+     }
+  fdM = fdP;
+  addressM = addressP;
+  requestM[0] = 0;
+  requestLengthM = 0;
+  headM = sentM = releasedM = 0;
+  zeroCopyCountM = 0;
+  zeroCopyIdM = zeroCopyDoneM = 0;
+  zeroCopyM = false;
+#ifdef SATIP_HTTP_ZEROCOPY
+  int yes = 1;
+  zeroCopyM = (setsockopt(fdM, SOL_SOCKET, SO_ZEROCOPY, &yes, sizeof(yes)) == 0);
+#endif
+  deviceIdM = -1;
+  allPidsM = false;
+  memset(pidsM, 0, sizeof(pidsM));
+  pathM = "";
+  allPidsCardM = -1;
+  stateM = eStateRequest;
+  return true;
+}
+
+void cSatipHttpClient::Close(void)
+{
+  if (fdM >= 0) {
+     debug1("%s (%s)", __PRETTY_FUNCTION__, *addressM);
+     cSatipPoller::GetInstance()->Unregister(*this);
+     close(fdM);
+     fdM = -1;
+     }
+  // The kernel holds its own references to the pages still in flight
+  FREE_POINTER(queueM);
+  stateM = eStateFree;
+}
+
+bool cSatipHttpClient::ReadRequest(void)
+{
+  for (;;) {
+      if (requestLengthM >= (int)sizeof(requestM) - 1)
+         return false;
+      ssize_t n = recv(fdM, requestM + requestLengthM, sizeof(requestM) - 1 - requestLengthM, MSG_DONTWAIT);
+      if (n < 0)
+         return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+      if (n == 0)
+         return false;
+      requestLengthM += (int)n;
+      requestM[requestLengthM] = 0;
+      }
+}
+
+bool cSatipHttpClient::Reply(const char *statusP, const char *typeP, const char *bodyP)
+{
+  debug1("%s (%s, %s) %s", __PRETTY_FUNCTION__, statusP, typeP, *addressM);
+  cString reply = bodyP ? cString::sprintf("HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s", statusP, typeP, strlen(bodyP), bodyP) :
+                          cString::sprintf("HTTP/1.0 %s\r\nContent-Type: %s\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n", statusP, typeP);
+  // The socket buffer takes the short header at once
+  size_t length = strlen(*reply);
+  return (send(fdM, *reply, length, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)length);
+}
+
+void cSatipHttpClient::ReapZeroCopies(void)
+{
+#ifdef SATIP_HTTP_ZEROCOPY
+  while (zeroCopyCountM) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fdM, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+           break;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(((cm->cmsg_level == SOL_IP) && (cm->cmsg_type == IP_RECVERR)) || ((cm->cmsg_level == SOL_IPV6) && (cm->cmsg_type == IPV6_RECVERR))))
+               continue;
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if ((ee->ee_errno != 0) || (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+               continue;
+            // The kernel had to copy anyway, e.g. on the loopback device
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+               zeroCopyM = false;
+            if ((int32_t)(ee->ee_data + 1 - zeroCopyDoneM) > 0)
+               zeroCopyDoneM = ee->ee_data + 1;
+            }
+        }
+  // Release the queue in order up to the last completed send
+  int done = 0;
+  while ((done < zeroCopyCountM) && ((int32_t)(zeroCopyDoneM - zeroCopiesM[done].id) > 0))
+        done++;
+  if (done) {
+     releasedM = zeroCopiesM[done - 1].end;
+     zeroCopyCountM -= done;
+     memmove(zeroCopiesM, zeroCopiesM + done, zeroCopyCountM * sizeof(cZeroCopy));
+     }
+#endif
+  if (!zeroCopyCountM)
+     releasedM = sentM;
+}
+
+bool cSatipHttpClient::Queue(const u_char *bufferP, int lengthP)
+{
+  if (headM + lengthP - releasedM > (uint64_t)eQueueSizeB)
+     ReapZeroCopies();
+  if (headM + lengthP - releasedM > (uint64_t)eQueueSizeB)
+     return false;
+  int pos = (int)(headM % eQueueSizeB);
+  int n = min(lengthP, eQueueSizeB - pos);
+  memcpy(queueM + pos, bufferP, n);
+  if (n < lengthP)
+     memcpy(queueM, bufferP + n, lengthP - n);
+  headM += lengthP;
+  return true;
+}
+
+bool cSatipHttpClient::Flush(void)
+{
+  ReapZeroCopies();
+  while (headM > sentM) {
+        uint64_t left = headM - sentM;
+        int pos = (int)(sentM % eQueueSizeB);
+        struct iovec iov[2];
+        iov[0].iov_base = queueM + pos;
+        iov[0].iov_len = min(left, (uint64_t)(eQueueSizeB - pos));
+        iov[1].iov_base = queueM;
+        iov[1].iov_len = left - iov[0].iov_len;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+        int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#ifdef SATIP_HTTP_ZEROCOPY
+        bool zeroCopy = zeroCopyM && (zeroCopyCountM < eMaxZeroCopy);
+        if (zeroCopy)
+           flags |= MSG_ZEROCOPY;
+#endif
+        ssize_t n = sendmsg(fdM, &msg, flags);
+        if (n < 0) {
+           if (errno == EINTR)
+              continue;
+           if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+              break;
+#ifdef SATIP_HTTP_ZEROCOPY
+           // Out of the locked memory for the pinned pages
+           if (zeroCopy && (errno == ENOBUFS)) {
+              zeroCopyM = false;
+              continue;
+              }
+#endif
+           return false;
+           }
+        sentM += n;
+        cSatipMetrics::Add(deviceIdM, cSatipMetrics::eHttpBytes, n);
+#ifdef SATIP_HTTP_ZEROCOPY
+        if (zeroCopy) {
+           zeroCopiesM[zeroCopyCountM].end = sentM;
+           zeroCopiesM[zeroCopyCountM].id = zeroCopyIdM++;
+           zeroCopyCountM++;
+           }
+#endif
+        if (!zeroCopyCountM)
+           releasedM = sentM;
+        }
+  flushM.Set(cSatipHttpServer::eFlushTimeoutMs);
+  return true;
+}
+
+cString cSatipHttpClient::GetStatus(void)
+{
+  static const char *states[] = { "free", "request", "tuning", "streaming", "closing" };
+  return cString::sprintf("%s %s %s device %d queued %" PRIu64 " kB sent %.1f MB%s", *addressM, *pathM, states[stateM], deviceIdM,
+                          (headM - sentM) / 1024, sentM / 1048576.0, zeroCopyM ? " zerocopy" : "");
+}
+
+void cSatipHttpClient::Process(void)
+{
+  // Called from the poller thread
+  cMutexLock MutexLock(&serverM.mutexM);
+  if (stateM == eStateRequest) {
+     if (!ReadRequest())
+        serverM.Drop(this, "invalid request");
+     else if (IsRequestComplete())
+        serverM.HandleRequest(this);
+     }
+  else if ((stateM == eStateTuning) || (stateM == eStateStreaming)) {
+     // Anything after the request is ignored, but a hangup is noticed
+     char buf[256];
+     for (;;) {
+         ssize_t n = recv(fdM, buf, sizeof(buf), MSG_DONTWAIT);
+         if ((n < 0) && (errno == EINTR))
+            continue;
+         if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            break;
+         if (n <= 0) {
+            serverM.Drop(this, "closed by client");
+            break;
+            }
+         }
+     }
+}
+
+// --- cSatipHttpServer -------------------------------------------------------
+
+cSatipHttpServer *cSatipHttpServer::instanceS = NULL;
+uint32_t cSatipHttpServer::devicesS = 0;
+
+bool cSatipHttpServer::Initialize(const char *endpointP)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, endpointP);
+  if (isempty(endpointP) || instanceS)
+     return true;
+  cSatipHttpServer *server = new cSatipHttpServer(endpointP);
+  if (!server->Open()) {
+     DELETE_POINTER(server);
+     return false;
+     }
+  __atomic_store_n(&instanceS, server, __ATOMIC_RELEASE);
+  cSatipPoller::GetInstance()->Register(*server);
+  server->Start();
+  return true;
+}
+
+void cSatipHttpServer::Destroy(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  cSatipHttpServer *server = __atomic_exchange_n(&instanceS, NULL, __ATOMIC_ACQ_REL);
+  DELETE_POINTER(server);
+}
+
+cSatipHttpServer::cSatipHttpServer(const char *endpointP)
+: cThread("SATIP http"),
+  mutexM(),
+  wakeM(),
+  endpointM(endpointP),
+  fdM(-1)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, endpointP);
+  for (int i = 0; i < eMaxClients; ++i)
+      clientsM[i] = new cSatipHttpClient(*this);
+}
+
+cSatipHttpServer::~cSatipHttpServer()
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  __atomic_store_n(&devicesS, 0, __ATOMIC_RELAXED);
+  Cancel(-1);
+  wakeM.Signal();
+  Cancel(3);
+  if (fdM >= 0)
+     cSatipPoller::GetInstance()->Unregister(*this);
+  Close();
+  // The receivers are detached without the lock as that takes the device locks
+  cSatipHttpReceiver *receivers[eMaxClients];
+  {
+    cMutexLock MutexLock(&mutexM);
+    for (int i = 0; i < eMaxClients; ++i) {
+        receivers[i] = clientsM[i]->receiverM;
+        clientsM[i]->receiverM = NULL;
+        }
+  }
+  for (int i = 0; i < eMaxClients; ++i) {
+      delete receivers[i];
+      cSatipDevice *device = (clientsM[i]->allPidsCardM >= 0) ? cSatipDevice::GetSatipDevice(clientsM[i]->allPidsCardM) : NULL;
+      if (device)
+         device->RequestAllPids(false);
+      DELETE_POINTER(clientsM[i]);
+      }
+}
+
+bool cSatipHttpServer::Open(void)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *endpointM);
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_ANY);
+  const char *port = strrchr(*endpointM, ':');
+  if (port) {
+     cString address(*endpointM, port++);
+     if (inet_pton(AF_INET, *address, &sin.sin_addr) != 1) {
+        error("Invalid HTTP server address '%s'", *address);
+        return false;
+        }
+     }
+  else
+     port = *endpointM;
+  if (!isnumber(port) || (atoi(port) <= 0) || (atoi(port) > 0xFFFF)) {
+     error("Invalid HTTP server port '%s'", port);
+     return false;
+     }
+  sin.sin_port = htons((uint16_t)atoi(port));
+  int yes = 1;
+  ERROR_IF_RET((fdM = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0, "socket()", return false);
+  ERROR_IF(setsockopt(fdM, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0, "setsockopt(SO_REUSEADDR)");
+  ERROR_IF_FUNC(bind(fdM, (struct sockaddr *)&sin, sizeof(sin)) < 0, "bind()", Close(), return false);
+  ERROR_IF_FUNC(listen(fdM, eMaxClients) < 0, "listen()", Close(), return false);
+  info("Serving TS streams via HTTP on %s", *endpointM);
+  return true;
+}
+
+void cSatipHttpServer::Close(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  if (fdM >= 0) {
+     close(fdM);
+     fdM = -1;
+     }
+}
+
+void cSatipHttpServer::UpdateDevices(void)
+{
+  uint32_t devices = 0;
+  for (int i = 0; i < eMaxClients; ++i) {
+      if ((clientsM[i]->stateM == cSatipHttpClient::eStateStreaming) && (clientsM[i]->deviceIdM >= 0))
+         devices |= (1U << clientsM[i]->deviceIdM);
+      }
+  __atomic_store_n(&devicesS, devices, __ATOMIC_RELAXED);
+}
+
+void cSatipHttpServer::Drop(cSatipHttpClient *clientP, const char *reasonP)
+{
+  // Called with the lock held; the worker thread closes the connection
+  if ((clientP->stateM == cSatipHttpClient::eStateFree) || (clientP->stateM == cSatipHttpClient::eStateClosing))
+     return;
+  info("Dropping HTTP client %s: %s", *clientP->addressM, reasonP);
+  bool streaming = (clientP->stateM == cSatipHttpClient::eStateStreaming);
+  clientP->stateM = cSatipHttpClient::eStateClosing;
+  shutdown(clientP->fdM, SHUT_RDWR);
+  if (streaming)
+     UpdateDevices();
+  Wakeup();
+}
+
+void cSatipHttpServer::HandleRequest(cSatipHttpClient *clientP)
+{
+  // Called from the poller thread with the lock held
+  char method[8], path[512];
+  if (sscanf(clientP->requestM, "%7s %511s HTTP/", method, path) != 2) {
+     clientP->Reply("400 Bad Request", "text/plain", "Bad request\n");
+     Drop(clientP, "bad request");
+     return;
+     }
+  if (strcmp(method, "GET")) {
+     clientP->Reply("405 Method Not Allowed", "text/plain", "Method not allowed\n");
+     Drop(clientP, "method not allowed");
+     return;
+     }
+  clientP->pathM = path;
+  info("HTTP client %s requests %s", *clientP->addressM, path);
+  if (startswith(path, "/device/") && endswith(path, ".ts") && isdigit(path[8])) {
+     cSatipDevice *device = cSatipDevice::GetSatipDevice(atoi(path + 8));
+     if (!device) {
+        clientP->Reply("404 Not Found", "text/plain", "Device not found\n");
+        Drop(clientP, "device not found");
+        return;
+        }
+     clientP->deviceIdM = device->GetId();
+     clientP->allPidsM = true;
+     if (!clientP->Reply("200 OK", "video/mp2t")) {
+        Drop(clientP, "connection lost");
+        return;
+        }
+     clientP->stateM = cSatipHttpClient::eStateStreaming;
+     clientP->flushM.Set(eFlushTimeoutMs);
+     UpdateDevices();
+     }
+  else if (startswith(path, "/stream?")) {
+     // Tuning waits for the device, which is no job for the poller
+     clientP->stateM = cSatipHttpClient::eStateTuning;
+     Wakeup();
+     }
+  else {
+     clientP->Reply("404 Not Found", "text/plain", "Not found\n");
+     Drop(clientP, "not found");
+     }
+}
+
+void cSatipHttpServer::Tune(cSatipHttpClient *clientP)
+{
+  // Called from the worker thread without the lock; the client stays in the
+  // tuning state meanwhile
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *clientP->pathM);
+  int source = 0, frequency = 0;
+  char polarization = 0;
+  bool allPids = true;
+  cVector<int> pids;
+  char *query = strdup(*clientP->pathM + strlen("/stream?"));
+  char *save = NULL;
+  for (char *p = strtok_r(query, "&", &save); p; p = strtok_r(NULL, "&", &save)) {
+      if (startswith(p, "src="))
+         source = cSource::FromString(p + 4);
+      else if (startswith(p, "freq="))
+         frequency = atoi(p + 5);
+      else if (startswith(p, "pol="))
+         polarization = toupper(p[4]);
+      else if (startswith(p, "pids=") && strcasecmp(p + 5, "all")) {
+         allPids = false;
+         char *save2 = NULL;
+         for (char *q = strtok_r(p + 5, ",", &save2); q; q = strtok_r(NULL, ",", &save2)) {
+             int pid = atoi(q);
+             if ((pid >= 0) && (pid < 0x2000))
+                pids.Append(pid);
+             }
+         }
+      }
+  free(query);
+  const char *status = NULL;
+  cChannel channel;
+  if (!source || (frequency <= 0))
+     status = "400 Bad Request";
+  else {
+     // The transponder is looked up among the known channels
+     bool found = false;
+     int transponder = cChannel::Transponder(frequency, polarization);
+     LOCK_CHANNELS_READ;
+     for (const cChannel *c = Channels->First(); c; c = Channels->Next(c)) {
+         if (!c->GroupSep() && (c->Source() == source) &&
+             (polarization ? ISTRANSPONDER(c->Transponder(), transponder) : ISTRANSPONDER(c->Transponder() % 100000, transponder))) {
+            channel = *c;
+            found = true;
+            break;
+            }
+         }
+     if (!found)
+        status = "404 Not Found";
+     }
+  cSatipDevice *device = NULL;
+  for (int i = 0; !status && (i < cDevice::NumDevices()) && !device; ++i) {
+      cSatipDevice *d = cSatipDevice::GetSatipDevice(i);
+      bool needsDetachReceivers = true;
+      if (d && d->ProvidesChannel(&channel, eStreamPriority, &needsDetachReceivers) && !needsDetachReceivers)
+         device = d;
+      }
+  cSatipHttpReceiver *receiver = NULL;
+  if (!status && !device)
+     status = "503 Service Unavailable";
+  if (!status) {
+     receiver = new cSatipHttpReceiver(&channel, eStreamPriority);
+     // An empty receiver wouldn't keep the transponder
+     if (allPids)
+        receiver->AddPid(0);
+     for (int i = 0; i < pids.Size(); ++i)
+         receiver->AddPid(pids[i]);
+     if ((!device->IsTunedToTransponder(&channel) && !device->SwitchChannel(&channel, false)) || !device->AttachReceiver(receiver)) {
+        DELETE_POINTER(receiver);
+        status = "503 Service Unavailable";
+        }
+     else if (allPids)
+        device->RequestAllPids(true);
+     }
+  cMutexLock MutexLock(&mutexM);
+  clientP->receiverM = receiver;
+  if (receiver && allPids)
+     clientP->allPidsCardM = device->CardIndex();
+  if (clientP->stateM != cSatipHttpClient::eStateTuning)
+     return;
+  if (status) {
+     clientP->Reply(status, "text/plain", "Tuning failed\n");
+     Drop(clientP, status);
+     return;
+     }
+  clientP->deviceIdM = device->GetId();
+  clientP->allPidsM = allPids;
+  for (int i = 0; i < pids.Size(); ++i)
+      clientP->pidsM[pids[i] / 32] |= (1U << (pids[i] % 32));
+  if (!clientP->Reply("200 OK", "video/mp2t")) {
+     Drop(clientP, "connection lost");
+     return;
+     }
+  info("HTTP client %s streams %s %d MHz from device %d", *clientP->addressM, *cSource::ToString(channel.Source()), channel.Frequency(), clientP->deviceIdM);
+  clientP->stateM = cSatipHttpClient::eStateStreaming;
+  clientP->flushM.Set(eFlushTimeoutMs);
+  UpdateDevices();
+}
+
+void cSatipHttpServer::Deliver(int deviceIdP, const u_char *bufferP, int lengthP)
+{
+  // Called from the poller thread, or the tuner thread for RTP over TCP
+  cMutexLock MutexLock(&mutexM);
+  for (int i = 0; i < eMaxClients; ++i) {
+      cSatipHttpClient *c = clientsM[i];
+      if ((c->stateM != cSatipHttpClient::eStateStreaming) || (c->deviceIdM != deviceIdP))
+         continue;
+      bool ok = true;
+      if (c->allPidsM)
+         ok = c->Queue(bufferP, lengthP);
+      else {
+         for (const u_char *p = bufferP; ok && (p + TS_SIZE <= bufferP + lengthP); p += TS_SIZE) {
+             if ((p[0] == TS_SYNC_BYTE) && c->HasPid(ts_pid(p)))
+                ok = c->Queue(p, TS_SIZE);
+             }
+         }
+      // A slow client is dropped instead of stalling the others
+      if (!ok) {
+         cSatipMetrics::Add(deviceIdP, cSatipMetrics::eHttpDroppedClients);
+         Drop(c, "too slow");
+         }
+      else if ((c->Pending() >= eFlushThresholdB) && !c->Flush())
+         Drop(c, "connection lost");
+      }
+}
+
+void cSatipHttpServer::Process(void)
+{
+  // Called from the poller thread for new connections
+  for (;;) {
+      struct sockaddr_in sin;
+      socklen_t len = sizeof(sin);
+      int fd = accept4(fdM, (struct sockaddr *)&sin, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+         if (errno == EINTR)
+            continue;
+         break;
+         }
+      char buf[INET_ADDRSTRLEN];
+      cString address = cString::sprintf("%s:%d", inet_ntop(AF_INET, &sin.sin_addr, buf, sizeof(buf)), ntohs(sin.sin_port));
+      cMutexLock MutexLock(&mutexM);
+      cSatipHttpClient *client = NULL;
+      for (int i = 0; (i < eMaxClients) && !client; ++i) {
+          if (clientsM[i]->IsFree())
+             client = clientsM[i];
+          }
+      if (!client || !client->Open(fd, *address)) {
+         static const char reply[] = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+         send(fd, reply, sizeof(reply) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+         close(fd);
+         info("Rejecting HTTP client %s", *address);
+         continue;
+         }
+      debug1("%s Accepted %s", __PRETTY_FUNCTION__, *address);
+      if (!cSatipPoller::GetInstance()->Register(*client)) {
+         close(fd);
+         client->fdM = -1;
+         client->Close();
+         }
+      }
+}
+
+cString cSatipHttpServer::GetStatus(void)
+{
+  if (!instanceS)
+     return "HTTP server disabled\n";
+  cMutexLock MutexLock(&instanceS->mutexM);
+  cString s = cString::sprintf("HTTP server %s\n", *instanceS->endpointM);
+  for (int i = 0; i < eMaxClients; ++i) {
+      if (!instanceS->clientsM[i]->IsFree())
+         s = cString::sprintf("%s%s\n", *s, *instanceS->clientsM[i]->GetStatus());
+      }
+  return s;
+}
+
+void cSatipHttpServer::Action(void)
+{
+  debug1("%s Entering", __PRETTY_FUNCTION__);
+  while (Running()) {
+        wakeM.Wait(eFlushTimeoutMs);
+        cSatipHttpClient *tune[eMaxClients];
+        cSatipHttpReceiver *receivers[eMaxClients];
+        int allPidsCards[eMaxClients];
+        int tunes = 0, closed = 0;
+        {
+          cMutexLock MutexLock(&mutexM);
+          for (int i = 0; i < eMaxClients; ++i) {
+              cSatipHttpClient *c = clientsM[i];
+              switch (c->stateM) {
+                case cSatipHttpClient::eStateTuning:
+                     if (!c->receiverM)
+                        tune[tunes++] = c;
+                     break;
+                case cSatipHttpClient::eStateStreaming:
+                     // VDR may take over the device for a recording
+                     if (c->receiverM && !c->receiverM->IsAttached())
+                        Drop(c, "device taken over");
+                     // Keep the latency low on low bitrates
+                     else if (c->Pending() && c->flushM.TimedOut() && !c->Flush())
+                        Drop(c, "connection lost");
+                     break;
+                case cSatipHttpClient::eStateClosing:
+                     receivers[closed] = c->receiverM;
+                     allPidsCards[closed++] = c->allPidsCardM;
+                     c->receiverM = NULL;
+                     c->Close();
+                     break;
+                default:
+                     break;
+                }
+              }
+        }
+        // The device locks are taken without the lock held
+        for (int i = 0; i < closed; ++i) {
+            delete receivers[i];
+            cSatipDevice *device = (allPidsCards[i] >= 0) ? cSatipDevice::GetSatipDevice(allPidsCards[i]) : NULL;
+            if (device)
+               device->RequestAllPids(false);
+            }
+        for (int i = 0; i < tunes; ++i)
+            Tune(tune[i]);
+        }
+  debug1("%s Exiting", __PRETTY_FUNCTION__);
+}
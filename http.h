@@ -0,0 +1,155 @@
+/*
+ * http.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_HTTP_H
+#define __SATIP_HTTP_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <vdr/receiver.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+#include "common.h"
+#include "pollerif.h"
+
+class cSatipHttpServer;
+
+// Keeps the device of a /stream client tuned and its pids requested; the
+// data itself is taken from the tuner
+class cSatipHttpReceiver : public cReceiver {
+protected:
+  virtual void Receive(const uchar *dataP, int lengthP) {}
+
+public:
+  cSatipHttpReceiver(const cChannel *channelP, int priorityP) : cReceiver(channelP, priorityP) {}
+  virtual ~cSatipHttpReceiver() { Detach(); }
+};
+
+class cSatipHttpClient : public cSatipPollerIf {
+  friend class cSatipHttpServer;
+private:
+  enum {
+    eQueueSizeB      = MEGABYTE(2),
+    eMaxRequestSizeB = KILOBYTE(4),
+    eMaxZeroCopy     = 64
+  };
+  struct cZeroCopy {
+    uint64_t end;
+    uint32_t id;
+  };
+  cSatipHttpServer &serverM;
+  int fdM;
+  cString addressM;
+  char requestM[eMaxRequestSizeB];
+  int requestLengthM;
+  // the send queue, byte positions grow monotonically
+  u_char *queueM;
+  uint64_t headM;
+  uint64_t sentM;
+  uint64_t releasedM;
+  bool zeroCopyM;
+  cZeroCopy zeroCopiesM[eMaxZeroCopy];
+  int zeroCopyCountM;
+  uint32_t zeroCopyIdM;
+  uint32_t zeroCopyDoneM;
+  enum eState {
+    eStateFree = 0,
+    eStateRequest,
+    eStateTuning,
+    eStateStreaming,
+    eStateClosing
+  };
+  eState stateM;
+  int deviceIdM;
+  bool allPidsM;
+  uint32_t pidsM[0x2000 / 32];
+  cString pathM;
+  cSatipHttpReceiver *receiverM;
+  cTimeMs flushM;
+  int allPidsCardM;
+  void ReapZeroCopies(void);
+
+public:
+  explicit cSatipHttpClient(cSatipHttpServer &serverP);
+  virtual ~cSatipHttpClient();
+  bool Open(int fdP, const char *addressP);
+  void Close(void);
+  bool IsFree(void) const { return (stateM == eStateFree); }
+  bool HasPid(int pidP) const { return allPidsM || (pidsM[pidP / 32] & (1U << (pidP % 32))); }
+  bool ReadRequest(void);
+  bool IsRequestComplete(void) const { return strstr(requestM, "\r\n\r\n") || strstr(requestM, "\n\n"); }
+  bool Reply(const char *statusP, const char *typeP, const char *bodyP = NULL);
+  bool Queue(const u_char *bufferP, int lengthP);
+  bool Flush(void);
+  uint64_t Pending(void) const { return headM - sentM; }
+  cString GetStatus(void);
+
+  // for internal poller interface
+public:
+  virtual int GetFd(void) { return fdM; }
+  virtual void Process(void);
+  virtual void Process(unsigned char *dataP, int lengthP) {}
+  virtual cString ToString(void) const { return cString::sprintf("HTTP client %s", *addressM); }
+};
+
+// Serves the TS stream of the devices via HTTP: /device/<card index>.ts
+// re-serves a device as it is tuned and /stream?src=<source>&freq=<MHz>
+// [&pol=<h|v|l|r>][&pids=<pid>,...|all] tunes a free device for the client
+class cSatipHttpServer : public cThread, public cSatipPollerIf {
+  friend class cSatipHttpClient;
+private:
+  enum {
+    eMaxClients      = 16,
+    eFlushThresholdB = KILOBYTE(32),
+    eFlushTimeoutMs  = 100, // in milliseconds
+    eStreamPriority  = 0
+  };
+  static cSatipHttpServer *instanceS;
+  static uint32_t devicesS; // the devices with streaming clients
+  cMutex mutexM;
+  cCondWait wakeM;
+  cString endpointM;
+  int fdM;
+  cSatipHttpClient *clientsM[eMaxClients];
+  bool Open(void);
+  void Close(void);
+  void Wakeup(void) { wakeM.Signal(); }
+  void Drop(cSatipHttpClient *clientP, const char *reasonP);
+  void UpdateDevices(void);
+  void HandleRequest(cSatipHttpClient *clientP);
+  void Tune(cSatipHttpClient *clientP);
+  void Deliver(int deviceIdP, const u_char *bufferP, int lengthP);
+  cSatipHttpServer(const char *endpointP);
+
+protected:
+  virtual void Action(void);
+
+public:
+  static bool Initialize(const char *endpointP);
+  static void Destroy(void);
+  static void Feed(int deviceIdP, const u_char *bufferP, int lengthP)
+  {
+    // A single branch on the data path while nobody is listening
+    if (__builtin_expect(__atomic_load_n(&devicesS, __ATOMIC_RELAXED) & (1U << deviceIdP), false)) {
+       cSatipHttpServer *server = __atomic_load_n(&instanceS, __ATOMIC_ACQUIRE);
+       if (server)
+          server->Deliver(deviceIdP, bufferP, lengthP);
+       }
+  }
+  static cString GetStatus(void);
+  virtual ~cSatipHttpServer();
+
+  // for internal poller interface
+public:
+  virtual int GetFd(void) { return fdM; }
+  virtual void Process(void);
+  virtual void Process(unsigned char *dataP, int lengthP) {}
+  virtual cString ToString(void) const { return cString::sprintf("HTTP server %s", *endpointM); }
+};
+
+#endif // __SATIP_HTTP_H
@@ -0,0 +1,262 @@
+/*
+ * metrics.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "config.h"
+#include "discover.h"
+#include "log.h"
+#include "metrics.h"
+#include "statistics.h"
+
+// --- cSatipMetricsServer ----------------------------------------------------
+
+cSatipMetricsServer *cSatipMetricsServer::instanceS = NULL;
+
+cString cSatipMetricsServer::Export(void)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  static const struct {
+    const char *name;
+    const char *help;
+  } counters[cSatipMetrics::eCounterCount] = {
+    { "satip_tuner_bytes_total",                         "TS bytes received by the tuner" },
+    { "satip_rtp_packets_total",                         "RTP packets received" },
+    { "satip_rtp_lost_packets_total",                    "RTP packets lost by the sequence numbers" },
+    { "satip_rtcp_packets_total",                        "RTCP packets received" },
+    { "satip_buffer_delivered_bytes_total",              "TS bytes delivered from the buffer to VDR" },
+    { "satip_buffer_dropped_datagrams_total",            "Datagrams dropped on buffer overflows" },
+    { "satip_buffer_dropped_packets_total",              "TS packets dropped on buffer overflows" },
+    { "satip_buffer_dropped_low_priority_packets_total", "Low priority TS packets dropped on buffer overflows" },
+    { "satip_buffer_dropped_oldest_packets_total",       "Oldest TS packets discarded on buffer overflows" },
+    { "satip_section_bytes_total",                       "Section bytes delivered to the section filters" },
+    { "satip_sections_total",                            "Sections delivered to the section filters" },
+    { "satip_rtsp_requests_total",                       "RTSP requests sent" },
+    { "satip_rtsp_errors_total",                         "RTSP requests failed" },
+    { "satip_tunes_total",                               "Successful tunings" },
+    { "satip_tune_failures_total",                       "Failed tunings" },
+    { "satip_failovers_total",                           "Failovers to another server" },
+    { "satip_ts_cc_errors_total",                        "TS continuity counter errors" },
+    { "satip_health_degradations_total",                 "Streams found degraded by the health monitor" },
+    { "satip_health_retunes_total",                      "Retunes requested by the health monitor" },
+    { "satip_health_failovers_total",                    "Failovers requested by the health monitor" },
+    { "satip_http_bytes_total",                          "TS bytes sent to HTTP clients" },
+    { "satip_http_dropped_clients_total",                "HTTP clients dropped for being too slow" }
+  };
+  static const struct {
+    const char *name;
+    const char *help;
+  } gauges[cSatipMetrics::eGaugeCount] = {
+    { "satip_buffer_used_bytes",       "TS buffer fill level" },
+    { "satip_buffer_size_bytes",       "TS buffer size" },
+    { "satip_buffer_high_water_bytes", "TS buffer high-water mark" },
+    { "satip_signal_strength_percent", "Signal strength reported via RTCP" },
+    { "satip_signal_quality_percent",  "Signal quality reported via RTCP" },
+    { "satip_lock",                    "Whether the frontend has a lock" }
+  };
+  int devices = SatipConfig.GetDeviceCount();
+  std::string list;
+  for (int i = 0; i < cSatipMetrics::eCounterCount; ++i) {
+      AppendFormat(list, "# HELP %s %s\n# TYPE %s counter\n", counters[i].name, counters[i].help, counters[i].name);
+      for (int d = 0; d < devices; ++d)
+          AppendFormat(list, "%s{device=\"%d\"} %" PRIu64 "\n", counters[i].name, d, cSatipMetrics::Counter(d, cSatipMetrics::eCounter(i)));
+      }
+  for (int i = 0; i < cSatipMetrics::eGaugeCount; ++i) {
+      AppendFormat(list, "# HELP %s %s\n# TYPE %s gauge\n", gauges[i].name, gauges[i].help, gauges[i].name);
+      for (int d = 0; d < devices; ++d)
+          AppendFormat(list, "%s{device=\"%d\"} %" PRId64 "\n", gauges[i].name, d, cSatipMetrics::Gauge(d, cSatipMetrics::eGauge(i)));
+      }
+  AppendFormat(list, "# HELP satip_rtsp_latency_milliseconds RTSP response time\n# TYPE satip_rtsp_latency_milliseconds histogram\n");
+  for (int d = 0; d < devices; ++d) {
+      uint64_t count = 0;
+      for (int i = 0; i <= cSatipMetrics::LatencyBucketCount(); ++i) {
+          count += cSatipMetrics::Latency(d, i);
+          if (i < cSatipMetrics::LatencyBucketCount())
+             AppendFormat(list, "satip_rtsp_latency_milliseconds_bucket{device=\"%d\",le=\"%d\"} %" PRIu64 "\n", d, cSatipMetrics::LatencyBucket(i), count);
+          else
+             AppendFormat(list, "satip_rtsp_latency_milliseconds_bucket{device=\"%d\",le=\"+Inf\"} %" PRIu64 "\n", d, count);
+          }
+      AppendFormat(list, "satip_rtsp_latency_milliseconds_sum{device=\"%d\"} %" PRIu64 "\nsatip_rtsp_latency_milliseconds_count{device=\"%d\"} %" PRIu64 "\n",
+                   d, cSatipMetrics::LatencySum(d), d, count);
+      }
+  list += *cSatipDiscover::GetInstance()->GetServerMetrics();
+  return list.c_str();
+}
+
+bool cSatipMetricsServer::Initialize(const char *endpointP)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, endpointP);
+  if (isempty(endpointP) || instanceS)
+     return true;
+  instanceS = new cSatipMetricsServer(endpointP);
+  if (!instanceS->Open()) {
+     DELETE_POINTER(instanceS);
+     return false;
+     }
+  instanceS->Start();
+  return true;
+}
+
+void cSatipMetricsServer::Destroy(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  DELETE_POINTER(instanceS);
+}
+
+cSatipMetricsServer::cSatipMetricsServer(const char *endpointP)
+: cThread("SATIP metrics"),
+  endpointM(endpointP),
+  fdM(-1)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, endpointP);
+}
+
+cSatipMetricsServer::~cSatipMetricsServer()
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  Cancel(3);
+  Close();
+}
+
+bool cSatipMetricsServer::Open(void)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *endpointM);
+  // A path selects a Unix domain socket, anything else [<address>:]<port>
+  if (**endpointM == '/') {
+     struct sockaddr_un sun;
+     memset(&sun, 0, sizeof(sun));
+     sun.sun_family = AF_UNIX;
+     if (strlen(*endpointM) >= sizeof(sun.sun_path)) {
+        error("Metrics socket path '%s' too long", *endpointM);
+        return false;
+        }
+     strn0cpy(sun.sun_path, *endpointM, sizeof(sun.sun_path));
+     unlink(sun.sun_path);
+     ERROR_IF_RET((fdM = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0, "socket()", return false);
+     ERROR_IF_FUNC(bind(fdM, (struct sockaddr *)&sun, sizeof(sun)) < 0, "bind()", Close(), return false);
+     }
+  else {
+     struct sockaddr_in sin;
+     memset(&sin, 0, sizeof(sin));
+     sin.sin_family = AF_INET;
+     sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+     const char *port = strrchr(*endpointM, ':');
+     if (port) {
+        cString address(*endpointM, port++);
+        if (inet_pton(AF_INET, *address, &sin.sin_addr) != 1) {
+           error("Invalid metrics address '%s'", *address);
+           return false;
+           }
+        }
+     else
+        port = *endpointM;
+     if (!isnumber(port) || (atoi(port) <= 0) || (atoi(port) > 0xFFFF)) {
+        error("Invalid metrics port '%s'", port);
+        return false;
+        }
+     sin.sin_port = htons((uint16_t)atoi(port));
+     int yes = 1;
+     ERROR_IF_RET((fdM = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0, "socket()", return false);
+     ERROR_IF(setsockopt(fdM, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0, "setsockopt(SO_REUSEADDR)");
+     ERROR_IF_FUNC(bind(fdM, (struct sockaddr *)&sin, sizeof(sin)) < 0, "bind()", Close(), return false);
+     }
+  ERROR_IF_FUNC(listen(fdM, 4) < 0, "listen()", Close(), return false);
+  info("Serving metrics on %s", *endpointM);
+  return true;
+}
+
+void cSatipMetricsServer::Close(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  if (fdM >= 0) {
+     close(fdM);
+     fdM = -1;
+     if (**endpointM == '/')
+        unlink(*endpointM);
+     }
+}
+
+void cSatipMetricsServer::Serve(int clientP)
+{
+  debug16("%s (%d)", __PRETTY_FUNCTION__, clientP);
+  char request[eMaxRequestSizeB];
+  int length = 0;
+  // Only the request line matters, but read the headers to keep the clients happy
+  while (length < (int)sizeof(request) - 1) {
+        struct pollfd pfd = { clientP, POLLIN, 0 };
+        if (poll(&pfd, 1, eRequestTimeoutMs) <= 0)
+           return;
+        ssize_t n = recv(clientP, request + length, sizeof(request) - 1 - length, 0);
+        if (n <= 0)
+           return;
+        length += (int)n;
+        request[length] = 0;
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+           break;
+        }
+  request[length] = 0;
+  cString body;
+  const char *status;
+  if (startswith(request, "GET /metrics ") || startswith(request, "GET / ")) {
+     status = "200 OK";
+     body = Export();
+     }
+  else {
+     status = "404 Not Found";
+     body = "Not found\n";
+     }
+  cString reply = cString::sprintf("HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s",
+                                   status, strlen(*body), *body);
+  const char *p = *reply;
+  size_t left = strlen(p);
+  // A scraper that stops reading must not stall the serving thread
+  cTimeMs timeout(eReplyTimeoutMs);
+  while ((left > 0) && Running()) {
+        ssize_t n = send(clientP, p, left, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+           if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+              break;
+           struct pollfd pfd = { clientP, POLLOUT, 0 };
+           if (timeout.TimedOut() || (poll(&pfd, 1, eRequestTimeoutMs) < 0))
+              break;
+           continue;
+           }
+        p += n;
+        left -= n;
+        }
+  if (left > 0)
+     debug1("%s Reply to client %d incomplete [%zu bytes left]", __PRETTY_FUNCTION__, clientP, left);
+}
+
+void cSatipMetricsServer::Action(void)
+{
+  debug1("%s Entering", __PRETTY_FUNCTION__);
+  while (Running()) {
+        struct pollfd pfd = { fdM, POLLIN, 0 };
+        int rc = poll(&pfd, 1, 1000);
+        if ((rc < 0) && (errno != EINTR)) {
+           char tmp[64];
+           error("Metrics poll() failed: %s", strerror_r(errno, tmp, sizeof(tmp)));
+           break;
+           }
+        if (rc <= 0)
+           continue;
+        int client = accept4(fdM, NULL, NULL, SOCK_CLOEXEC);
+        if (client >= 0) {
+           Serve(client);
+           close(client);
+           }
+        }
+  debug1("%s Exiting", __PRETTY_FUNCTION__);
+}
@@ -0,0 +1,41 @@
+/*
+ * metrics.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_METRICS_H
+#define __SATIP_METRICS_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+// Serves the metrics in the text exposition format via HTTP on a local TCP
+// port or a Unix domain socket
+class cSatipMetricsServer : public cThread {
+private:
+  enum {
+    eRequestTimeoutMs = 1000,
+    eReplyTimeoutMs   = 5000,
+    eMaxRequestSizeB  = KILOBYTE(4)
+  };
+  static cSatipMetricsServer *instanceS;
+  cString endpointM;
+  int fdM;
+  bool Open(void);
+  void Close(void);
+  void Serve(int clientP);
+  cSatipMetricsServer(const char *endpointP);
+
+protected:
+  virtual void Action(void);
+
+public:
+  static cString Export(void);
+  static bool Initialize(const char *endpointP);
+  static void Destroy(void);
+  virtual ~cSatipMetricsServer();
+};
+
+#endif // __SATIP_METRICS_H
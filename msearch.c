@@ -11,6 +11,7 @@
 #include "log.h"
 #include "poller.h"
 #include "msearch.h"
+#include "share.h"
 
 const char *cSatipMsearch::bcastAddressS = "239.255.255.250";
 const char *cSatipMsearch::bcastMessageS = "M-SEARCH * HTTP/1.1\r\n"                  \
@@ -18,12 +19,16 @@ const char *cSatipMsearch::bcastMessageS = "M-SEARCH * HTTP/1.1\r\n"
                                            "MAN: \"ssdp:discover\"\r\n"               \
                                            "ST: urn:ses-com:device:SatIPServer:1\r\n" \
                                            "MX: 2\r\n\r\n";
+const char *cSatipMsearch::deviceTypeS   = "urn:ses-com:device:SatIPServer:1";
 
 cSatipMsearch::cSatipMsearch(cSatipDiscoverIf &discoverP)
 : discoverM(discoverP),
   bufferLenM(eProbeBufferSize),
   bufferM(MALLOC(unsigned char, bufferLenM)),
-  registeredM(false)
+  registeredM(false),
+  reprobeM(false),
+  reprobeTimeoutM(0),
+  locationListM()
 {
   if (bufferM)
      memset(bufferM, 0, bufferLenM);
@@ -31,11 +36,15 @@ cSatipMsearch::cSatipMsearch(cSatipDiscoverIf &discoverP)
      error("Cannot create Msearch buffer!");
   if (!Open(eDiscoveryPort, true))
      error("Cannot open Msearch port!");
+  // Listen also to the NOTIFY announcements of the servers
+  else if (!AddMembership(bcastAddressS))
+     error("Cannot listen to SSDP announcements!");
 }
 
 cSatipMsearch::~cSatipMsearch()
 {
   FREE_POINTER(bufferM);
+  locationListM.Clear();
 }
 
 void cSatipMsearch::Probe(void)
@@ -45,10 +54,55 @@ void cSatipMsearch::Probe(void)
      cSatipPoller::GetInstance()->Register(*this);
      registeredM = true;
      }
-  // Send two queries with one second interval
-  Write(bcastAddressS, reinterpret_cast<const unsigned char *>(bcastMessageS), strlen(bcastMessageS));
-  cCondWait::SleepMs(1000);
+  // Send two queries with one second interval, the second one via Reprobe()
   Write(bcastAddressS, reinterpret_cast<const unsigned char *>(bcastMessageS), strlen(bcastMessageS));
+  reprobeTimeoutM.Set(eReprobeTimeoutMs);
+  reprobeM = true;
+}
+
+void cSatipMsearch::Reprobe(void)
+{
+  if (reprobeM && reprobeTimeoutM.TimedOut()) {
+     debug1("%s", __PRETTY_FUNCTION__);
+     Write(bcastAddressS, reinterpret_cast<const unsigned char *>(bcastMessageS), strlen(bcastMessageS));
+     reprobeM = false;
+     }
+}
+
+void cSatipMsearch::StoreLocation(const char *usnP, const char *locationP)
+{
+  // The byebye announcements carry only the USN, so remember its location
+  if (!isempty(usnP) && !isempty(locationP)) {
+     cString location = TakeLocation(usnP);
+     if (locationListM.Size() >= eMaxLocations) {
+        free(locationListM.At(0));
+        locationListM.Remove(0);
+        }
+     locationListM.Append(strdup(*cString::sprintf("%s %s", usnP, locationP)));
+     }
+}
+
+void cSatipMsearch::Announce(const char *messageP)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  Write(bcastAddressS, reinterpret_cast<const unsigned char *>(messageP), strlen(messageP));
+}
+
+cString cSatipMsearch::TakeLocation(const char *usnP)
+{
+  if (!isempty(usnP)) {
+     size_t len = strlen(usnP);
+     for (int i = 0; i < locationListM.Size(); ++i) {
+         char *s = locationListM.At(i);
+         if (!strncmp(s, usnP, len) && (s[len] == ' ')) {
+            cString location = s + len + 1;
+            free(s);
+            locationListM.Remove(i);
+            return location;
+            }
+         }
+     }
+  return "";
 }
 
 int cSatipMsearch::GetFd(void)
@@ -64,38 +118,69 @@ void cSatipMsearch::Process(void)
      while ((length = Read(bufferM, bufferLenM)) > 0) {
            bufferM[min(length, int(bufferLenM - 1))] = 0;
            debug13("%s len=%d buf=%s", __PRETTY_FUNCTION__, length, bufferM);
-           bool status = false, valid = false;
-           char *s, *p = reinterpret_cast<char *>(bufferM), *location = NULL;
+           bool status = false, notify = false, valid = false, alive = false, byebye = false;
+           char *s, *p = reinterpret_cast<char *>(bufferM), *location = NULL, *usn = NULL;
+           // The stream sharing announcements of other VDRs are handled separately
+           if (startswith(p, "NOTIFY * HTTP/1.1") && strstr(p, cSatipShare::TypePrefix())) {
+              discoverM.ShareNotify(p);
+              continue;
+              }
            char *r = strtok_r(p, "\r\n", &s);
-           while (r) {
+           // Check the status code or the announcement
+           // HTTP/1.1 200 OK
+           // NOTIFY * HTTP/1.1
+           if (r && startswith(r, "HTTP/1.1 200 OK"))
+              status = true;
+           else if (r && startswith(r, "NOTIFY * HTTP/1.1"))
+              notify = true;
+           else
+              continue;
+           while ((r = strtok_r(NULL, "\r\n", &s)) != NULL) {
                  debug13("%s r=%s", __PRETTY_FUNCTION__, r);
-                 // Check the status code
-                 // HTTP/1.1 200 OK
-                 if (!status && startswith(r, "HTTP/1.1 200 OK"))
-                    status = true;
-                 if (status) {
-                    // Check the location data
-                    // LOCATION: http://192.168.0.115:8888/octonet.xml
-                    if (strcasestr(r, "LOCATION:") == r) {
-                       location = compactspace(r + 9);
-                       debug1("%s location='%s'", __PRETTY_FUNCTION__, location);
-                       }
-                    // Check the source type
-                    // ST: urn:ses-com:device:SatIPServer:1
-                    else if (strcasestr(r, "ST:") == r) {
-                       char *st = compactspace(r + 3);
-                       if (strstr(st, "urn:ses-com:device:SatIPServer:1"))
-                          valid = true;
-                       debug1("%s st='%s'", __PRETTY_FUNCTION__, st);
-                       }
-                    // Check whether all the required data is found
-                    if (valid && !isempty(location)) {
-                       discoverM.SetUrl(location);
-                       break;
-                       }
+                 // Check the location data
+                 // LOCATION: http://192.168.0.115:8888/octonet.xml
+                 if (strcasestr(r, "LOCATION:") == r) {
+                    location = compactspace(r + 9);
+                    debug1("%s location='%s'", __PRETTY_FUNCTION__, location);
+                    }
+                 // Check the source or the notification type
+                 // ST: urn:ses-com:device:SatIPServer:1
+                 // NT: urn:ses-com:device:SatIPServer:1
+                 else if ((status && (strcasestr(r, "ST:") == r)) || (notify && (strcasestr(r, "NT:") == r))) {
+                    char *st = compactspace(r + 3);
+                    if (strstr(st, deviceTypeS))
+                       valid = true;
+                    debug1("%s st='%s'", __PRETTY_FUNCTION__, st);
                     }
-                 r = strtok_r(NULL, "\r\n", &s);
+                 // Check the notification subtype
+                 // NTS: ssdp:alive
+                 else if (notify && (strcasestr(r, "NTS:") == r)) {
+                    char *nts = compactspace(r + 4);
+                    alive = !strcmp(nts, "ssdp:alive");
+                    byebye = !strcmp(nts, "ssdp:byebye");
+                    debug1("%s nts='%s'", __PRETTY_FUNCTION__, nts);
+                    }
+                 // Check the unique service name
+                 // USN: uuid:0ca6d6a0-e0a3-4a8b-9f2d-0123456789ab::urn:ses-com:device:SatIPServer:1
+                 else if (strcasestr(r, "USN:") == r)
+                    usn = compactspace(r + 4);
+                 }
+           if (!valid)
+              continue;
+           // Check whether all the required data is found
+           if ((status || alive) && !isempty(location)) {
+              StoreLocation(usn, location);
+              discoverM.SetUrl(location);
+              }
+           else if (byebye) {
+              cString departed = TakeLocation(usn);
+              if (!isempty(location))
+                 departed = location;
+              if (!isempty(*departed)) {
+                 info("Server '%s' is leaving", *departed);
+                 discoverM.RemoveUrl(*departed);
                  }
+              }
            }
      }
 }
@@ -8,6 +8,8 @@
 #ifndef __SATIP_MSEARCH_H_
 #define __SATIP_MSEARCH_H_
 
+#include <vdr/tools.h>
+
 #include "discoverif.h"
 #include "socket.h"
 #include "pollerif.h"
@@ -17,18 +19,28 @@ private:
   enum {
     eProbeBufferSize  = 1024, // in bytes
     eDiscoveryPort    = 1900,
+    eReprobeTimeoutMs = 1000, // in milliseconds
+    eMaxLocations     = 32
   };
   static const char *bcastAddressS;
   static const char *bcastMessageS;
+  static const char *deviceTypeS;
   cSatipDiscoverIf &discoverM;
   unsigned int bufferLenM;
   unsigned char *bufferM;
   bool registeredM;
+  bool reprobeM;
+  cTimeMs reprobeTimeoutM;
+  cStringList locationListM;
+  void StoreLocation(const char *usnP, const char *locationP);
+  cString TakeLocation(const char *usnP);
 
 public:
   explicit cSatipMsearch(cSatipDiscoverIf &discoverP);
   virtual ~cSatipMsearch();
   void Probe(void);
+  void Reprobe(void);
+  void Announce(const char *messageP);
 
   // for internal poller interface
 public:
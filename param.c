@@ -149,7 +149,15 @@ static int PrintUrlString(char *bufP, int lenP, int valueP, const tSatipParamete
   return ((n >= 0) && (lenP > 0)) ? snprintf(bufP, lenP, "%s", mapP[n].satipString) : 0;
 }
 
-cString GetTransponderUrlParameters(const cChannel *channelP)
+static int GetSourceIndex(const cChannel *channelP)
+{
+  // The src parameter is taken from the description in sources.conf
+  cSource *source = Sources.Get(channelP->Source());
+  int src = (strchr("S", cSource::ToChar(channelP->Source())) && source) ? atoi(source->Description()) : 1;
+  return ((src > 0) && (src <= 255)) ? src : 1;
+}
+
+static cString BuildTransponderUrlParameters(const cChannel *channelP)
 {
   if (channelP) {
      char buffer[255];
@@ -158,8 +166,7 @@ cString GetTransponderUrlParameters(const cChannel *channelP)
      int C2TuningFrequencyType = 0;
      float freq = channelP->Frequency();
      char type = cSource::ToChar(channelP->Source());
-     cSource *source = Sources.Get(channelP->Source());
-     int src = (strchr("S", type) && source) ? atoi(source->Description()) : 1;
+     int src = GetSourceIndex(channelP);
      char *q = buffer;
      *q = 0;
      // Scale down frequencies to MHz
@@ -174,7 +181,7 @@ cString GetTransponderUrlParameters(const cChannel *channelP)
        }
      if ((channelP->Rid() % 100) > 0)
                 q += snprintf(q,       STBUFLEFT, "&fe=%d",           channelP->Rid() % 100);
-     ST("  S *") q += snprintf(q,       STBUFLEFT, "&src=%d",          ((src > 0) && (src <= 255)) ? src : 1);
+     ST("  S *") q += snprintf(q,       STBUFLEFT, "&src=%d",          src);
      if (freq >= 0L)
                 q += snprintf(q,       STBUFLEFT, "&freq=%s",         *dtoa(freq, "%lg"));
      ST("  S *") q += snprintf(q,       STBUFLEFT, "&pol=%c",          tolower(dtp.Polarization()));
@@ -208,6 +215,110 @@ cString GetTransponderUrlParameters(const cChannel *channelP)
   return NULL;
 }
 
+// --- cSatipTransponderCache -------------------------------------------------
+
+// Caches the built URL parameters keyed by the tuning relevant channel data,
+// as VDR retunes to the very same transponders over and over again.
+class cSatipTransponderCache {
+private:
+  enum {
+    eCacheSize = 32
+  };
+  struct tEntry {
+    int source;
+    int frequency;
+    int srate;
+    int frontend;
+    int system;
+    int src;
+    unsigned int hash;
+    unsigned int used;
+    cString parameters;
+    cString url;
+  };
+  cMutex mutexM;
+  tEntry entriesM[eCacheSize];
+  unsigned int usedM;
+  static unsigned int Hash(const char *strP);
+
+public:
+  cSatipTransponderCache(void);
+  cString Get(const cChannel *channelP, int *systemP);
+};
+
+static cSatipTransponderCache SatipTransponderCache;
+
+cSatipTransponderCache::cSatipTransponderCache(void)
+: mutexM(),
+  usedM(0)
+{
+  for (int i = 0; i < eCacheSize; ++i) {
+      entriesM[i].source = cSource::stNone;
+      entriesM[i].frequency = 0;
+      entriesM[i].srate = 0;
+      entriesM[i].frontend = 0;
+      entriesM[i].system = 0;
+      entriesM[i].src = 0;
+      entriesM[i].hash = 0;
+      entriesM[i].used = 0;
+      }
+}
+
+unsigned int cSatipTransponderCache::Hash(const char *strP)
+{
+  // FNV-1a
+  unsigned int hash = 2166136261U;
+  while (strP && *strP)
+        hash = (hash ^ (unsigned char)*strP++) * 16777619U;
+  return hash;
+}
+
+cString cSatipTransponderCache::Get(const cChannel *channelP, int *systemP)
+{
+  unsigned int hash = Hash(channelP->Parameters());
+  int frontend = channelP->Rid() % 100;
+  // VDR keeps no state of the sources, so a changed description is caught here
+  int src = GetSourceIndex(channelP);
+  cMutexLock MutexLock(&mutexM);
+  tEntry *lru = &entriesM[0];
+  for (int i = 0; i < eCacheSize; ++i) {
+      tEntry *e = &entriesM[i];
+      if (e->used && (e->hash == hash) && (e->source == channelP->Source()) && (e->frequency == channelP->Frequency()) &&
+          (e->srate == channelP->Srate()) && (e->frontend == frontend) && (e->src == src) && !strcmp(*e->parameters, channelP->Parameters())) {
+         e->used = ++usedM;
+         if (systemP)
+            *systemP = e->system;
+         return e->url;
+         }
+      if (e->used < lru->used)
+         lru = e;
+      }
+  cString url = BuildTransponderUrlParameters(channelP);
+  if (!isempty(*url)) {
+     cDvbTransponderParameters dtp(channelP->Parameters());
+     lru->source = channelP->Source();
+     lru->frequency = channelP->Frequency();
+     lru->srate = channelP->Srate();
+     lru->frontend = frontend;
+     lru->system = dtp.System();
+     lru->src = src;
+     lru->hash = hash;
+     lru->used = ++usedM;
+     lru->parameters = channelP->Parameters();
+     lru->url = url;
+     if (systemP)
+        *systemP = lru->system;
+     }
+  return url;
+}
+
+cString GetTransponderUrlParameters(const cChannel *channelP, int *systemP)
+{
+  if (channelP)
+     return SatipTransponderCache.Get(channelP, systemP);
+  return NULL;
+}
+
 cString GetTnrUrlParameters(const cChannel *channelP)
 {
   if (channelP) {
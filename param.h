@@ -10,7 +10,7 @@
 
 #include "common.h"
 
-cString GetTransponderUrlParameters(const cChannel *channelP);
+cString GetTransponderUrlParameters(const cChannel *channelP, int *systemP = NULL);
 cString GetTnrUrlParameters(const cChannel *channelP);
 
 #endif // __SATIP_PARAM_H
@@ -13,6 +13,7 @@
 #include "common.h"
 #include "log.h"
 #include "poller.h"
+#include "trace.h"
 
 cSatipPoller *cSatipPoller::instanceS = NULL;
 
@@ -41,7 +42,8 @@ void cSatipPoller::Destroy(void)
 cSatipPoller::cSatipPoller()
 : cThread("SATIP poller"),
   mutexPollerM(),
-  fdM(epoll_create(eMaxFileDescriptors))
+  fdM(epoll_create(eMaxFileDescriptors)),
+  threadStatisticsM("SATIP poller")
 {
   debug1("%s", __PRETTY_FUNCTION__);
 }
@@ -73,24 +75,23 @@ void cSatipPoller::Action(void)
 {
   debug1("%s Entering", __PRETTY_FUNCTION__);
   struct epoll_event events[eMaxFileDescriptors];
-  uint64_t maxElapsed = 0;
-  // Increase priority
-  SetPriority(-1);
+  // Increase priority unless a scheduling is configured
+  if (SatipConfig.GetSchedPolicy(cSatipConfig::eThreadClassPoller) == cSatipConfig::eSchedPolicyDefault)
+     SetPriority(-1);
+  threadStatisticsM.ApplyScheduling(cSatipConfig::eThreadClassPoller);
   // Do the thread loop
   while (Running()) {
         int nfds = epoll_wait(fdM, events, eMaxFileDescriptors, 1000);
         ERROR_IF_FUNC((nfds == -1 && errno != EINTR), "epoll_wait() failed", break, ;);
+        threadStatisticsM.Wakeup();
         for (int i = 0; i < nfds; ++i) {
             cSatipPollerIf* poll = reinterpret_cast<cSatipPollerIf *>(events[i].data.ptr);
             if (poll) {
-               uint64_t elapsed;
-               cTimeMs processing(0);
+               uint64_t start = cSatipThreadStatistics::Now();
+               poll->Stamp();
                poll->Process();
-               elapsed = processing.Elapsed();
-               if (elapsed > maxElapsed) {
-                  maxElapsed = elapsed;
-                  debug1("%s Processing %s took %" PRIu64 " ms", __PRETTY_FUNCTION__, *(poll->ToString()), maxElapsed);
-                  }
+               uint64_t elapsed = threadStatisticsM.AddProcessing(start);
+               cSatipTrace::Record(cSatipTrace::eTracePoll, cSatipTrace::eNoDevice, poll->GetFd(), elapsed);
                }
            }
         }
@@ -12,6 +12,7 @@
 #include <vdr/tools.h>
 
 #include "pollerif.h"
+#include "statistics.h"
 
 class cSatipPoller : public cThread {
 private:
@@ -21,6 +22,7 @@ private:
   static cSatipPoller *instanceS;
   cMutex mutexPollerM;
   int fdM;
+  cSatipThreadStatistics threadStatisticsM;
   void Activate(void);
   void Deactivate(void);
   // constructor
@@ -39,6 +41,7 @@ public:
   virtual ~cSatipPoller();
   bool Register(cSatipPollerIf &pollerP);
   bool Unregister(cSatipPollerIf &pollerP);
+  cString GetThreadStatistic(void) { return threadStatisticsM.GetThreadStatistic(); }
 };
 
 #endif // __SATIP_POLLER_H
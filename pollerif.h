@@ -16,8 +16,11 @@ public:
   virtual void Process(void) = 0;
   virtual void Process(unsigned char *dataP, int lengthP) = 0;
   virtual cString ToString(void) const = 0;
+  void Stamp(void) { lastProcessM.Set(); }
+  uint64_t LastProcess(void) const { return lastProcessM.Elapsed(); }
 
 private:
+  cTimeMs lastProcessM;
   explicit cSatipPollerIf(const cSatipPollerIf&);
   cSatipPollerIf& operator=(const cSatipPollerIf&);
 };
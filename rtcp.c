@@ -5,21 +5,37 @@
  *
  */
 
+#include <unistd.h>
+
+#include "capture.h"
 #include "config.h"
 #include "common.h"
 #include "log.h"
 #include "rtcp.h"
+#include "statistics.h"
 
 cSatipRtcp::cSatipRtcp(cSatipTunerIf &tunerP)
 : tunerM(tunerP),
   bufferLenM(eApplicationMaxSizeB),
-  bufferM(MALLOC(unsigned char, bufferLenM))
+  bufferM(MALLOC(unsigned char, bufferLenM)),
+  applicationDataM(0),
+  ssrcM(0),
+  cnameM(""),
+  lastSenderReportM(0),
+  lastSenderReportTimeM(0)
 {
   debug1("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (bufferM)
      memset(bufferM, 0, bufferLenM);
   else
      error("Cannot create RTCP buffer! [device %d]", tunerM.GetId());
+  // Identify ourselves as a receiver towards the server
+  char hostname[eMaxCnameLength];
+  if (gethostname(hostname, sizeof(hostname)) < 0)
+     strn0cpy(hostname, "localhost", sizeof(hostname));
+  hostname[sizeof(hostname) - 1] = 0;
+  cnameM = cString::sprintf("vdr-%d@%s", tunerM.GetId(), hostname);
+  ssrcM = (uint32_t)(Now() ^ ((uint64_t)getpid() << 16) ^ ((uint64_t)tunerM.GetId() << 8));
 }
 
 cSatipRtcp::~cSatipRtcp()
@@ -66,7 +82,7 @@ int cSatipRtcp::GetApplicationOffset(unsigned char *bufferP, int *lengthP)
               //unsigned int id = ((bufferP[offset + 12] & 0xFF) << 8) | (bufferP[offset + 13] & 0xFF);
               // String length
               int string_length = ((bufferP[offset + 14] & 0xFF) << 8) | (bufferP[offset + 15] & 0xFF);
-              if (string_length > 0) {
+              if ((string_length > 0) && (offset + 16 + string_length <= *lengthP)) {
                  *lengthP = string_length;
                  return (offset + 16);
                  }
@@ -79,15 +95,90 @@ int cSatipRtcp::GetApplicationOffset(unsigned char *bufferP, int *lengthP)
   return -1;
 }
 
+void cSatipRtcp::ParseSenderReport(unsigned char *bufferP, int lengthP)
+{
+  debug16("%s (%d) [device %d]", __PRETTY_FUNCTION__, lengthP, tunerM.GetId());
+  int offset = 0;
+  while (offset + 4 <= lengthP) {
+        // Version
+        unsigned int v = (bufferP[offset] >> 6) & 0x03;
+        // Payload type
+        unsigned int pt = bufferP[offset + 1] & 0xFF;
+        // Length in bytes
+        int length = ((((bufferP[offset + 2] & 0xFF) << 8) | (bufferP[offset + 3] & 0xFF)) + 1) * 4;
+        // V=2, SR = 200
+        if ((v == 2) && (pt == 200) && (length >= 28) && (offset + length <= lengthP)) {
+           // Middle 32 bits of the NTP timestamp
+           lastSenderReportM = ((bufferP[offset + 10] & 0xFF) << 24) | ((bufferP[offset + 11] & 0xFF) << 16) |
+                               ((bufferP[offset + 12] & 0xFF) << 8) | (bufferP[offset + 13] & 0xFF);
+           lastSenderReportTimeM = Now();
+           }
+        offset += length;
+        }
+}
+
+bool cSatipRtcp::SendReport(const cSatipRtpReport &reportP)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
+  // Nothing to report before the first RTP packet
+  if (!reportP.ssrc || !IsOpen())
+     return false;
+  unsigned char buf[eReportMaxSizeB];
+  unsigned int len = 0;
+  uint32_t dlsr = 0;
+  // Delay since the last sender report in units of 1/65536 seconds
+  if (lastSenderReportM && lastSenderReportTimeM)
+     dlsr = (uint32_t)((Now() - lastSenderReportTimeM) * 65536 / 1000000);
+  memset(buf, 0, sizeof(buf));
+  // Receiver report (RR = 201) with one reception report block
+  buf[len++] = 0x81;
+  buf[len++] = 201;
+  buf[len++] = 0;
+  buf[len++] = 7;
+  uint32_t words[] = { ssrcM, reportP.ssrc,
+                       ((uint32_t)reportP.fractionLost << 24) | ((uint32_t)reportP.cumulativeLost & 0xFFFFFF),
+                       reportP.highestSequence, reportP.jitter, lastSenderReportM, dlsr };
+  for (unsigned int i = 0; i < ELEMENTS(words); ++i) {
+      buf[len++] = (words[i] >> 24) & 0xFF;
+      buf[len++] = (words[i] >> 16) & 0xFF;
+      buf[len++] = (words[i] >> 8) & 0xFF;
+      buf[len++] = words[i] & 0xFF;
+      }
+  // Source description (SDES = 202) with the mandatory canonical name
+  unsigned int cnamelen = min((int)strlen(*cnameM), (int)eMaxCnameLength);
+  unsigned int sdeslen = (4 + 4 + 2 + cnamelen + 1 + 3) & ~3;
+  buf[len++] = 0x81;
+  buf[len++] = 202;
+  buf[len++] = 0;
+  buf[len++] = (unsigned char)(sdeslen / 4 - 1);
+  buf[len++] = (ssrcM >> 24) & 0xFF;
+  buf[len++] = (ssrcM >> 16) & 0xFF;
+  buf[len++] = (ssrcM >> 8) & 0xFF;
+  buf[len++] = ssrcM & 0xFF;
+  buf[len++] = 1; // CNAME
+  buf[len++] = (unsigned char)cnamelen;
+  memcpy(buf + len, *cnameM, cnamelen);
+  // The item list is terminated and padded by the zeroed buffer
+  len = 32 + sdeslen;
+  debug7("%s ssrc=0x%08X lost=%d fraction=%d jitter=%u [device %d]", __PRETTY_FUNCTION__,
+         reportP.ssrc, reportP.cumulativeLost, reportP.fractionLost, reportP.jitter, tunerM.GetId());
+  return Reply(buf, len);
+}
+
 void cSatipRtcp::Process(void)
 {
   debug16("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (bufferM) {
      int length;
      while ((length = Read(bufferM, bufferLenM)) > 0) {
+           tunerM.CaptureData(cSatipCapture::eCaptureRtcp, bufferM, length, Now());
+           cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtcpPackets);
+           ParseSenderReport(bufferM, length);
            int offset = GetApplicationOffset(bufferM, &length);
-           if (offset >= 0)
+           if (offset >= 0) {
+              applicationDataM.Set(eApplicationTimeoutMs);
               tunerM.ProcessApplicationData(bufferM + offset, length);
+              }
            }
      }
 }
@@ -96,9 +187,14 @@ void cSatipRtcp::Process(unsigned char *dataP, int lengthP)
 {
   debug16("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (dataP && lengthP > 0) {
+     tunerM.CaptureData(cSatipCapture::eCaptureRtcp, dataP, lengthP, Now());
+     cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtcpPackets);
+     ParseSenderReport(dataP, lengthP);
      int offset = GetApplicationOffset(dataP, &lengthP);
-     if (offset >= 0)
+     if (offset >= 0) {
+        applicationDataM.Set(eApplicationTimeoutMs);
         tunerM.ProcessApplicationData(dataP + offset, lengthP);
+        }
      }
 }
 
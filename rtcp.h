@@ -8,6 +8,9 @@
 #ifndef __SATIP_RTCP_H_
 #define __SATIP_RTCP_H_
 
+#include <vdr/tools.h>
+
+#include "rtp.h"
 #include "socket.h"
 #include "tunerif.h"
 #include "pollerif.h"
@@ -16,15 +19,27 @@ class cSatipRtcp : public cSatipSocket, public cSatipPollerIf {
 private:
   enum {
     eApplicationMaxSizeB = 1500,
+    eApplicationTimeoutMs = 2000, // in milliseconds
+    eReportMaxSizeB       = 128,
+    eMaxCnameLength       = 64
   };
   cSatipTunerIf &tunerM;
   unsigned int bufferLenM;
   unsigned char *bufferM;
+  cTimeMs applicationDataM;
+  uint32_t ssrcM;
+  cString cnameM;
+  uint32_t lastSenderReportM;
+  uint64_t lastSenderReportTimeM;
   int GetApplicationOffset(unsigned char *bufferP, int *lengthP);
+  void ParseSenderReport(unsigned char *bufferP, int lengthP);
 
 public:
   explicit cSatipRtcp(cSatipTunerIf &tunerP);
   virtual ~cSatipRtcp();
+  bool HasApplicationData(void) const { return !applicationDataM.TimedOut(); }
+  void ResetApplicationData(void) { applicationDataM.Set(0); }
+  bool SendReport(const cSatipRtpReport &reportP);
 
   // for internal poller interface
 public:
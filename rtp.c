@@ -8,29 +8,60 @@
 #define __STDC_FORMAT_MACROS // Required for format specifiers
 #include <inttypes.h>
 
+#include "buffer.h"
+#include "capture.h"
 #include "config.h"
 #include "common.h"
 #include "log.h"
 #include "rtp.h"
+#include "statistics.h"
+#include "trace.h"
 
 cSatipRtp::cSatipRtp(cSatipTunerIf &tunerP)
 : cSatipSocket(SatipConfig.GetRtpRcvBufSize()),
   tunerM(tunerP),
   bufferLenM(eRtpPacketReadCount * eMaxUdpPacketSizeB),
-  bufferM(MALLOC(unsigned char, bufferLenM)),
+  bufferM((unsigned char *)cSatipMemory::Allocate(bufferLenM, "RTP")),
   lastErrorReportM(0),
   packetErrorsM(0),
-  sequenceNumberM(-1)
+  sequenceNumberM(-1),
+  packetCountM(0),
+  packetLossM(0),
+  ssrcM(0),
+  ssrcTimeM(0),
+  latchTimeM(0),
+  baseSequenceM(-1),
+  maxSequenceM(0),
+  cyclesM(0),
+  receivedM(0),
+  priorSsrcM(0),
+  expectedPriorM(0),
+  receivedPriorM(0),
+  jitterM(0),
+  lastTransitM(0),
+  lastArrivalM(0),
+  maxGapM(0),
+  maxBurstM(0),
+  windowStartM(0),
+  peakGapM(0),
+  peakBurstM(0),
+  resetRequestM(0),
+  resetDoneM(0),
+  resetTimeM(0),
+  snapshotSequenceM(0)
 {
   debug1("%s () [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
+  memset(&snapshotM, 0, sizeof(snapshotM));
   if (!bufferM)
      error("Cannot create RTP buffer! [device %d]", tunerM.GetId());
+  SetTimestamps(true);
 }
 
 cSatipRtp::~cSatipRtp()
 {
   debug1("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
-  FREE_POINTER(bufferM);
+  cSatipMemory::Free(bufferM, bufferLenM);
+  bufferM = NULL;
 }
 
 int cSatipRtp::GetFd(void)
@@ -44,15 +75,181 @@ void cSatipRtp::Close(void)
 
   cSatipSocket::Close();
 
+  ResetSsrc();
+}
+
+void cSatipRtp::ResetSsrc(void)
+{
+  // The statistics belong to the receiving thread, which resets them before the next packet;
+  // only packets arriving from now on may start the new synchronization source
+  __atomic_store_n(&resetTimeM, Now(), __ATOMIC_RELAXED);
+  __atomic_add_fetch(&resetRequestM, 1, __ATOMIC_RELEASE);
+}
+
+void cSatipRtp::HandleReset(void)
+{
+  uint32_t request = __atomic_load_n(&resetRequestM, __ATOMIC_ACQUIRE);
+  if (request == resetDoneM)
+     return;
+  latchTimeM = __atomic_load_n(&resetTimeM, __ATOMIC_RELAXED);
+  ssrcM = 0;
   sequenceNumberM = -1;
+  ResetStatistics();
   if (packetErrorsM) {
      info("Detected %d RTP packet error%s [device %d]", packetErrorsM, packetErrorsM == 1 ? "": "s", tunerM.GetId());
      packetErrorsM = 0;
      lastErrorReportM = time(NULL);
      }
+  PublishStatistics();
+  __atomic_store_n(&resetDoneM, request, __ATOMIC_RELEASE);
+}
+
+void cSatipRtp::PublishStatistics(void)
+{
+  // Called by the receiving thread only, so the sequence has a single writer
+  uint32_t sequence = __atomic_load_n(&snapshotSequenceM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotSequenceM, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&snapshotM.ssrc, ssrcM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotM.baseSequence, baseSequenceM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotM.extended, cyclesM + maxSequenceM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotM.received, receivedM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotM.jitter, jitterM, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshotSequenceM, sequence + 2, __ATOMIC_RELEASE);
+}
+
+bool cSatipRtp::ReadStatistics(cSnapshot &snapshotP)
+{
+  // Nothing to read until the receiving thread has handled a pending reset
+  if (__atomic_load_n(&resetDoneM, __ATOMIC_ACQUIRE) != __atomic_load_n(&resetRequestM, __ATOMIC_RELAXED))
+     return false;
+  for (;;) {
+      uint32_t sequence = __atomic_load_n(&snapshotSequenceM, __ATOMIC_ACQUIRE);
+      if (sequence & 1)
+         continue;
+      snapshotP.ssrc = __atomic_load_n(&snapshotM.ssrc, __ATOMIC_RELAXED);
+      snapshotP.baseSequence = __atomic_load_n(&snapshotM.baseSequence, __ATOMIC_RELAXED);
+      snapshotP.extended = __atomic_load_n(&snapshotM.extended, __ATOMIC_RELAXED);
+      snapshotP.received = __atomic_load_n(&snapshotM.received, __ATOMIC_RELAXED);
+      snapshotP.jitter = __atomic_load_n(&snapshotM.jitter, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&snapshotSequenceM, __ATOMIC_RELAXED) == sequence)
+         break;
+      }
+  return true;
+}
+
+int cSatipRtp::GetPacketLoss(void)
+{
+  // Packet loss in permilles since the previous query
+  // The counters are fed by the poller thread
+  int count = __atomic_exchange_n(&packetCountM, 0, __ATOMIC_RELAXED);
+  int lost = __atomic_exchange_n(&packetLossM, 0, __ATOMIC_RELAXED);
+  return (count + lost) ? (1000 * lost / (count + lost)) : 0;
+}
+
+void cSatipRtp::ResetStatistics(void)
+{
+  baseSequenceM = -1;
+  maxSequenceM = 0;
+  cyclesM = 0;
+  receivedM = 0;
+  jitterM = 0;
+  lastTransitM = 0;
+  lastArrivalM = 0;
+  maxGapM = 0;
+  maxBurstM = 0;
+  windowStartM = 0;
+  __atomic_store_n(&peakGapM, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&peakBurstM, 0, __ATOMIC_RELAXED);
+}
+
+void cSatipRtp::UpdateStatistics(int sequenceP, uint32_t timestampP, uint64_t arrivalP)
+{
+  // Extended highest sequence number as in RFC 3550, appendix A.1
+  uint16_t seq = (uint16_t)sequenceP;
+  if (baseSequenceM < 0) {
+     baseSequenceM = seq;
+     maxSequenceM = seq;
+     cyclesM = 0;
+     }
+  else if ((uint16_t)(seq - maxSequenceM) < 0x8000) {
+     if (seq < maxSequenceM)
+        cyclesM += 0x10000;
+     maxSequenceM = seq;
+     }
+  // Interarrival jitter in RTP timestamp units as in RFC 3550, appendix A.8
+  int32_t transit = (int32_t)((uint32_t)(arrivalP * eClockRateKHz / 1000) - timestampP);
+  if (receivedM) {
+     int32_t d = transit - lastTransitM;
+     if (d < 0)
+        d = -d;
+     // Kept scaled by 16 to avoid rounding errors
+     jitterM += d - ((jitterM + 8) >> 4);
+     }
+  lastTransitM = transit;
+  // Longest silence between two packets
+  if (lastArrivalM && (arrivalP > lastArrivalM) && (arrivalP - lastArrivalM > maxGapM))
+     maxGapM = arrivalP - lastArrivalM;
+  lastArrivalM = arrivalP;
+  receivedM++;
+  // Publish the peaks per window instead of resetting them on every query
+  if (!windowStartM)
+     windowStartM = arrivalP;
+  else if (arrivalP - windowStartM >= eWindowMs * 1000ULL) {
+     __atomic_store_n(&peakGapM, maxGapM, __ATOMIC_RELAXED);
+     __atomic_store_n(&peakBurstM, maxBurstM, __ATOMIC_RELAXED);
+     maxGapM = 0;
+     maxBurstM = 0;
+     windowStartM = arrivalP;
+     }
 }
 
-int cSatipRtp::GetHeaderLength(unsigned char *bufferP, unsigned int lengthP)
+void cSatipRtp::GetReport(cSatipRtpReport &reportP)
+{
+  cSnapshot snapshot;
+  if (!ReadStatistics(snapshot)) {
+     memset(&reportP, 0, sizeof(reportP));
+     return;
+     }
+  uint32_t expected = (snapshot.baseSequence >= 0) ? snapshot.extended - snapshot.baseSequence + 1 : 0;
+  int32_t lost = (int32_t)(expected - snapshot.received);
+  // A new source starts its intervals from scratch
+  if (snapshot.ssrc != priorSsrcM) {
+     priorSsrcM = snapshot.ssrc;
+     expectedPriorM = 0;
+     receivedPriorM = 0;
+     }
+  // Cumulative number of packets lost is a signed 24-bit value
+  lost = constrain(lost, -0x800000, 0x7FFFFF);
+  // Fraction lost since the previous report in 1/256
+  uint32_t expectedInterval = expected - expectedPriorM;
+  uint32_t receivedInterval = snapshot.received - receivedPriorM;
+  int32_t lostInterval = (int32_t)(expectedInterval - receivedInterval);
+  expectedPriorM = expected;
+  receivedPriorM = snapshot.received;
+  reportP.ssrc = snapshot.ssrc;
+  reportP.fractionLost = (expectedInterval && (lostInterval > 0)) ? (uint8_t)((lostInterval << 8) / expectedInterval) : 0;
+  reportP.cumulativeLost = lost;
+  reportP.highestSequence = snapshot.extended;
+  reportP.jitter = snapshot.jitter >> 4;
+}
+
+cString cSatipRtp::GetStatistic(void)
+{
+  cSnapshot snapshot;
+  if (!ReadStatistics(snapshot))
+     return "";
+  uint32_t expected = (snapshot.baseSequence >= 0) ? snapshot.extended - snapshot.baseSequence + 1 : 0;
+  int lost = (int)(expected - snapshot.received);
+  // Interarrival jitter from RTP timestamp units to milliseconds
+  cString s = cString::sprintf("jitter=%.1f ms loss=%d/%u burst=%d gap=%" PRIu64 " ms",
+                               (snapshot.jitter >> 4) / (double)eClockRateKHz, max(lost, 0), expected, __atomic_load_n(&peakBurstM, __ATOMIC_RELAXED),
+                               __atomic_load_n(&peakGapM, __ATOMIC_RELAXED) / 1000);
+  return s;
+}
+
+int cSatipRtp::GetHeaderLength(unsigned char *bufferP, unsigned int lengthP, uint64_t arrivalP)
 {
   debug16("%s (, %d) [device %d]", __PRETTY_FUNCTION__, lengthP, tunerM.GetId());
   unsigned int headerlen = 0;
@@ -74,18 +271,56 @@ int cSatipRtp::GetHeaderLength(unsigned char *bufferP, unsigned int lengthP)
         if (pt != 33)
            debug7("%s (%d) Received invalid RTP payload type %d - v=%d [device %d]",
                     __PRETTY_FUNCTION__, lengthP, pt, v, tunerM.GetId());
+        // Synchronization source: packets received before the session reply are leftovers, and
+        // another source is only filtered while the old stream may still overlap the new one
+        if (lengthP >= 12) {
+           uint32_t ssrc = ((bufferP[8] & 0xFF) << 24) | ((bufferP[9] & 0xFF) << 16) | ((bufferP[10] & 0xFF) << 8) | (bufferP[11] & 0xFF);
+           if (!ssrcM) {
+              if (arrivalP < latchTimeM) {
+                 debug7("%s (%d) Received RTP packet of previous source 0x%08X [device %d]", __PRETTY_FUNCTION__, lengthP, ssrc, tunerM.GetId());
+                 return -1;
+                 }
+              ssrcM = ssrc;
+              ssrcTimeM = arrivalP;
+              }
+           else if (ssrc != ssrcM) {
+              if (arrivalP < ssrcTimeM + eSpliceWindowMs * 1000ULL) {
+                 debug7("%s (%d) Received RTP packet of foreign source 0x%08X [device %d]", __PRETTY_FUNCTION__, lengthP, ssrc, tunerM.GetId());
+                 return -1;
+                 }
+              info("RTP source changed from 0x%08X to 0x%08X [device %d]", ssrcM, ssrc, tunerM.GetId());
+              ssrcM = ssrc;
+              ssrcTimeM = arrivalP;
+              sequenceNumberM = -1;
+              ResetStatistics();
+              }
+           }
         // Sequence number
         int seq = ((bufferP[2] & 0xFF) << 8) | (bufferP[3] & 0xFF);
+        // Timestamp
+        if (lengthP >= 12) {
+           uint32_t timestamp = ((bufferP[4] & 0xFF) << 24) | ((bufferP[5] & 0xFF) << 16) | ((bufferP[6] & 0xFF) << 8) | (bufferP[7] & 0xFF);
+           UpdateStatistics(seq, timestamp, arrivalP);
+           }
+        __atomic_add_fetch(&packetCountM, 1, __ATOMIC_RELAXED);
         if ((((sequenceNumberM + 1) % 0xFFFF) == 0) && (seq == 0xFFFF))
            sequenceNumberM = -1;
         else if ((sequenceNumberM >= 0) && (((sequenceNumberM + 1) % 0xFFFF) != seq)) {
-           packetErrorsM++;
-           if (time(NULL) - lastErrorReportM > eReportIntervalS) {
-              info("Detected %d RTP packet error%s [device %d]", packetErrorsM, packetErrorsM == 1 ? "": "s", tunerM.GetId());
-              packetErrorsM = 0;
-              lastErrorReportM = time(NULL);
+           int lost = (seq - sequenceNumberM - 1) & 0xFFFF;
+           // A sequence number behind the current one is a duplicate or reordered packet, not a loss
+           if (lost >= 0x8000)
+              debug7("%s (%d) Received late RTP packet #%d after #%d [device %d]", __PRETTY_FUNCTION__, lengthP, seq, sequenceNumberM, tunerM.GetId());
+           else {
+              packetErrorsM++;
+              __atomic_add_fetch(&packetLossM, lost, __ATOMIC_RELAXED);
+              cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtpLostPackets, lost);
+              if (time(NULL) - lastErrorReportM > eReportIntervalS) {
+                 info("Detected %d RTP packet error%s [device %d]", packetErrorsM, packetErrorsM == 1 ? "": "s", tunerM.GetId());
+                 packetErrorsM = 0;
+                 lastErrorReportM = time(NULL);
+                 }
+              sequenceNumberM = seq;
               }
-           sequenceNumberM = seq;
            }
         else
            sequenceNumberM = seq;
@@ -123,23 +358,31 @@ void cSatipRtp::Process(void)
   debug16("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (bufferM) {
      unsigned int lenMsg[eRtpPacketReadCount];
-     uint64_t elapsed;
-     int count = 0;
-     cTimeMs processing(0);
+     uint64_t timeMsg[eRtpPacketReadCount];
+     uint64_t start = cSatipTrace::IsEnabled() ? cSatipTrace::Now() : 0;
+     int count = 0, total = 0;
+     HandleReset();
 
      do {
-       count = ReadMulti(bufferM, lenMsg, eRtpPacketReadCount, eMaxUdpPacketSizeB);
+       count = ReadMulti(bufferM, lenMsg, eRtpPacketReadCount, eMaxUdpPacketSizeB, timeMsg);
+       if (count > maxBurstM)
+          maxBurstM = count;
+       if (count > 0)
+          total += count;
        for (int i = 0; i < count; ++i) {
            unsigned char *p = &bufferM[i * eMaxUdpPacketSizeB];
-           int headerlen = GetHeaderLength(p, lenMsg[i]);
+           tunerM.CaptureData(cSatipCapture::eCaptureRtp, p, lenMsg[i], timeMsg[i]);
+           int headerlen = GetHeaderLength(p, lenMsg[i], timeMsg[i]);
            if ((headerlen >= 0) && (headerlen < (int)lenMsg[i]))
               tunerM.ProcessVideoData(p + headerlen, lenMsg[i] - headerlen);
            }
        } while (count >= eRtpPacketReadCount);
 
-     elapsed = processing.Elapsed();
-     if (elapsed > 1)
-        debug6("%s %d read(s) took %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, count, elapsed, tunerM.GetId());
+     if (total)
+        PublishStatistics();
+     cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtpPackets, total);
+     if (start)
+        cSatipTrace::Record(cSatipTrace::eTraceRtpBurst, tunerM.GetId(), total, cSatipTrace::Now() - start);
      }
 }
 
@@ -147,15 +390,21 @@ void cSatipRtp::Process(unsigned char *dataP, int lengthP)
 {
   debug16("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (dataP && lengthP > 0) {
-     uint64_t elapsed;
-     cTimeMs processing(0);
-     int headerlen = GetHeaderLength(dataP, lengthP);
+     uint64_t start = cSatipTrace::IsEnabled() ? cSatipTrace::Now() : 0;
+     HandleReset();
+     Stamp();
+     if (maxBurstM < 1)
+        maxBurstM = 1;
+     uint64_t now = Now();
+     tunerM.CaptureData(cSatipCapture::eCaptureRtp, dataP, lengthP, now);
+     int headerlen = GetHeaderLength(dataP, lengthP, now);
      if ((headerlen >= 0) && (headerlen < lengthP))
         tunerM.ProcessVideoData(dataP + headerlen, lengthP - headerlen);
+     PublishStatistics();
 
-     elapsed = processing.Elapsed();
-     if (elapsed > 1)
-        debug6("%s %d read(s) took %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, lengthP, elapsed, tunerM.GetId());
+     cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtpPackets);
+     if (start)
+        cSatipTrace::Record(cSatipTrace::eTraceRtpBurst, tunerM.GetId(), 1, cSatipTrace::Now() - start);
      }
 }
 
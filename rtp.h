@@ -12,12 +12,24 @@
 #include "tunerif.h"
 #include "pollerif.h"
 
+// Reception report block of RFC 3550, section 6.4.1
+struct cSatipRtpReport {
+  uint32_t ssrc;
+  uint8_t fractionLost;
+  int32_t cumulativeLost;
+  uint32_t highestSequence;
+  uint32_t jitter;
+};
+
 class cSatipRtp : public cSatipSocket, public cSatipPollerIf {
 private:
   enum {
     eRtpPacketReadCount = 50,
     eMaxUdpPacketSizeB  = TS_SIZE * 7 + 12,
-    eReportIntervalS    = 300 // in seconds
+    eReportIntervalS    = 300, // in seconds
+    eClockRateKHz       = 90,  // RTP clock of MPEG2 TS payload
+    eWindowMs           = 5000, // in milliseconds
+    eSpliceWindowMs     = 2000  // in milliseconds
   };
   cSatipTunerIf &tunerM;
   unsigned int bufferLenM;
@@ -25,12 +37,57 @@ private:
   time_t lastErrorReportM;
   int packetErrorsM;
   int sequenceNumberM;
-  int GetHeaderLength(unsigned char *bufferP, unsigned int lengthP);
+  int packetCountM;
+  int packetLossM;
+  uint32_t ssrcM;
+  uint64_t ssrcTimeM;
+  uint64_t latchTimeM;
+  int baseSequenceM;
+  uint16_t maxSequenceM;
+  uint32_t cyclesM;
+  uint32_t receivedM;
+  // the previous report, kept by the tuner thread
+  uint32_t priorSsrcM;
+  uint32_t expectedPriorM;
+  uint32_t receivedPriorM;
+  uint32_t jitterM;
+  int32_t lastTransitM;
+  uint64_t lastArrivalM;
+  uint64_t maxGapM;
+  int maxBurstM;
+  // the peaks of the last complete window, published by the poller thread
+  uint64_t windowStartM;
+  uint64_t peakGapM;
+  int peakBurstM;
+  // the reset requests of the tuner thread, handled by the receiving thread
+  uint32_t resetRequestM;
+  uint32_t resetDoneM;
+  uint64_t resetTimeM;
+  // the report values, published by the receiving thread under a sequence lock
+  struct cSnapshot {
+    uint32_t ssrc;
+    int32_t baseSequence;
+    uint32_t extended;
+    uint32_t received;
+    uint32_t jitter;
+  };
+  uint32_t snapshotSequenceM;
+  cSnapshot snapshotM;
+  void HandleReset(void);
+  void PublishStatistics(void);
+  bool ReadStatistics(cSnapshot &snapshotP);
+  void ResetStatistics(void);
+  void UpdateStatistics(int sequenceP, uint32_t timestampP, uint64_t arrivalP);
+  int GetHeaderLength(unsigned char *bufferP, unsigned int lengthP, uint64_t arrivalP);
 
 public:
   explicit cSatipRtp(cSatipTunerIf &tunerP);
   virtual ~cSatipRtp();
   virtual void Close(void);
+  int GetPacketLoss(void);
+  void ResetSsrc(void);
+  void GetReport(cSatipRtpReport &reportP);
+  cString GetStatistic(void);
 
   // for internal poller interface
 public:
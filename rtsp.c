@@ -8,10 +8,13 @@
 #define __STDC_FORMAT_MACROS // Required for format specifiers
 #include <inttypes.h>
 
+#include "capture.h"
 #include "config.h"
 #include "common.h"
 #include "log.h"
 #include "rtsp.h"
+#include "socket.h"
+#include "statistics.h"
 
 cSatipRtsp::cSatipRtsp(cSatipTunerIf &tunerP)
 : tunerM(tunerP),
@@ -24,7 +27,8 @@ cSatipRtsp::cSatipRtsp(cSatipTunerIf &tunerP)
   errorCheckSyntaxM(""),
   modeM(cSatipConfig::eTransportModeUnicast),
   interleavedRtpIdM(0),
-  interleavedRtcpIdM(1)
+  interleavedRtcpIdM(1),
+  roundTripM(-1)
 {
   debug1("%s [device %d]", __PRETTY_FUNCTION__, tunerM.GetId());
   if (!SatipConfig.DisconnectIdleStreams())
@@ -90,6 +94,22 @@ int cSatipRtsp::DebugCallback(CURL *handleP, curl_infotype typeP, char *dataP, s
   cSatipRtsp *obj = reinterpret_cast<cSatipRtsp *>(userPtrP);
 
   if (obj) {
+     // Record the exchanges except for the interleaved RTP/RTCP data
+     switch (typeP) {
+       case CURLINFO_HEADER_OUT:
+       case CURLINFO_DATA_OUT:
+            obj->tunerM.CaptureData(cSatipCapture::eCaptureRtspOut, (const u_char *)dataP, (int)sizeP, cSatipSocket::Now());
+            break;
+       case CURLINFO_HEADER_IN:
+            obj->tunerM.CaptureData(cSatipCapture::eCaptureRtspIn, (const u_char *)dataP, (int)sizeP, cSatipSocket::Now());
+            break;
+       case CURLINFO_DATA_IN:
+            if (sizeP && (*dataP != '$'))
+               obj->tunerM.CaptureData(cSatipCapture::eCaptureRtspIn, (const u_char *)dataP, (int)sizeP, cSatipSocket::Now());
+            break;
+       default:
+            break;
+       }
      switch (typeP) {
        case CURLINFO_TEXT:
             debug2("%s [device %d] RTSP INFO %.*s", __PRETTY_FUNCTION__, obj->tunerM.GetId(), (int)sizeP, dataP);
@@ -245,6 +265,8 @@ bool cSatipRtsp::Options(const char *uriP)
      SATIP_CURL_EASY_PERFORM(handleM);
 
      result = ValidateLatestResponse(&rc);
+     if (result)
+        roundTripM = (int)processing.Elapsed();
      debug5("%s (%s) Response %ld in %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, uriP, rc, processing.Elapsed(), tunerM.GetId());
      }
 
@@ -347,6 +369,8 @@ bool cSatipRtsp::Describe(const char *uriP)
         }
 
      result = ValidateLatestResponse(&rc);
+     if (result)
+        roundTripM = (int)processing.Elapsed();
      debug5("%s (%s) Response %ld in %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, uriP, rc, processing.Elapsed(), tunerM.GetId());
      }
 
@@ -376,6 +400,8 @@ bool cSatipRtsp::Play(const char *uriP)
         }
 
      result = ValidateLatestResponse(&rc);
+     if (result)
+        roundTripM = (int)processing.Elapsed();
      debug5("%s (%s) Response %ld in %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, uriP, rc, processing.Elapsed(), tunerM.GetId());
      }
 
@@ -517,7 +543,11 @@ bool cSatipRtsp::ValidateLatestResponse(long *rcP)
      char *url = NULL;
      long rc = 0;
      CURLcode res = CURLE_OK;
+     double seconds = 0;
      SATIP_CURL_EASY_GETINFO(handleM, CURLINFO_RESPONSE_CODE, &rc);
+     SATIP_CURL_EASY_GETINFO(handleM, CURLINFO_TOTAL_TIME, &seconds);
+     cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtspRequests);
+     cSatipMetrics::AddLatency(tunerM.GetId(), (int)(seconds * 1000));
      switch (rc) {
        case 200:
             result = true;
@@ -557,6 +587,8 @@ bool cSatipRtsp::ValidateLatestResponse(long *rcP)
             error("Detected invalid status code %ld: %s [device %d]", rc, url, tunerM.GetId());
             break;
        }
+     if (!result)
+        cSatipMetrics::Add(tunerM.GetId(), cSatipMetrics::eRtspErrors);
      if (rcP)
         *rcP = rc;
      }
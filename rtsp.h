@@ -40,6 +40,7 @@ private:
   int modeM;
   unsigned int interleavedRtpIdM;
   unsigned int interleavedRtcpIdM;
+  int roundTripM;
 
   void ParseHeader(void);
   void ParseData(void);
@@ -54,6 +55,7 @@ public:
   virtual ~cSatipRtsp();
 
   cString GetActiveMode(void);
+  int GetRoundTrip(void) { return roundTripM; }
   cString RtspUnescapeString(const char *strP);
   void Create(void);
   void Destroy(void);
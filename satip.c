@@ -8,13 +8,18 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <vdr/plugin.h>
+#include <vdr/videodir.h>
 #include "common.h"
 #include "config.h"
 #include "device.h"
 #include "discover.h"
+#include "http.h"
 #include "log.h"
+#include "metrics.h"
 #include "poller.h"
 #include "setup.h"
+#include "share.h"
+#include "trace.h"
 
 #if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM < 0x072400
 #warning "CURL version >= 7.36.0 is recommended"
@@ -35,6 +40,9 @@ class cPluginSatip : public cPlugin {
 private:
   unsigned int deviceCountM;
   cSatipDiscoverServers *serversM;
+  cString metricsM;
+  cString schedulingM;
+  cString httpM;
   void ParseServer(const char *paramP);
   void ParseCAIDs(const char *paramP);
   void ParsePortRange(const char *paramP);
@@ -65,7 +73,10 @@ public:
 
 cPluginSatip::cPluginSatip(void)
 : deviceCountM(2),
-  serversM(NULL)
+  serversM(NULL),
+  metricsM(""),
+  schedulingM(""),
+  httpM("")
 {
   debug16("%s", __PRETTY_FUNCTION__);
   // Initialize any member variables here.
@@ -118,7 +129,20 @@ const char *cPluginSatip::CommandLineHelp(void)
          "  -N, --nodisconnect            disable disconnect for idle streams\n"
          "  -p, --portrange=<start>-<end> set a range of ports used for the RT[C]P server\n"
          "                                a minimum of 2 ports per device is required.\n"
-         "  -r, --rcvbuf                  override the size of the RTP receive buffer in bytes\n";
+         "  -r, --rcvbuf                  override the size of the RTP receive buffer in bytes\n"
+         "  -H, --hugepages=<mode>        set the huge page backing of the TS and section buffers\n"
+         "                                off, transparent (default) or explicit (MAP_HUGETLB).\n"
+         "  -m, --metrics=[<address>:]<port>|<path>\n"
+         "                                serve the metrics via HTTP on a TCP port (loopback\n"
+         "                                by default) or on a Unix domain socket.\n"
+         "  -w, --http=[<address>:]<port> serve the TS streams of the devices via HTTP to\n"
+         "                                the LAN as /device/<card index>.ts and\n"
+         "                                /stream?src=<source>&freq=<MHz>&pids=<pid>,...\n"
+         "  -P, --sched=<class>:<policy>[:<priority>[:<cpulist>]][;...]\n"
+         "                                set the scheduling policy, priority and cpu affinity\n"
+         "                                of the poller, section or tuner threads, e.g.\n"
+         "                                poller:fifo:20:2-3;section:rr:10;tuner:other:0:0,1\n"
+         "                                policy is default, other, fifo or rr.\n";
 }
 
 bool cPluginSatip::ProcessArgs(int argc, char *argv[])
@@ -132,6 +156,10 @@ bool cPluginSatip::ProcessArgs(int argc, char *argv[])
     { "caids",    required_argument, NULL, 'c' },
     { "portrange",    required_argument, NULL, 'p' },
     { "rcvbuf",       required_argument, NULL, 'r' },
+    { "hugepages",    required_argument, NULL, 'H' },
+    { "metrics",      required_argument, NULL, 'm' },
+    { "sched",        required_argument, NULL, 'P' },
+    { "http",         required_argument, NULL, 'w' },
     { "detach",       no_argument,       NULL, 'D' },
     { "single",       no_argument,       NULL, 'S' },
     { "noquirks",     no_argument,       NULL, 'n' },
@@ -143,7 +171,7 @@ bool cPluginSatip::ProcessArgs(int argc, char *argv[])
   cString caids;
   cString portrange;
   int c;
-  while ((c = getopt_long(argc, argv, "d:t:s:p:r:DSn", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "d:t:s:p:r:H:m:P:w:DSn", long_options, NULL)) != -1) {
     switch (c) {
       case 'd':
            deviceCountM = strtol(optarg, NULL, 0);
@@ -175,6 +203,27 @@ bool cPluginSatip::ProcessArgs(int argc, char *argv[])
       case 'r':
            SatipConfig.SetRtpRcvBufSize(strtol(optarg, NULL, 0));
            break;
+      case 'H':
+           if (!strcasecmp(optarg, "off"))
+              SatipConfig.SetHugePages(cSatipConfig::eHugePagesOff);
+           else if (!strcasecmp(optarg, "transparent"))
+              SatipConfig.SetHugePages(cSatipConfig::eHugePagesTransparent);
+           else if (!strcasecmp(optarg, "explicit"))
+              SatipConfig.SetHugePages(cSatipConfig::eHugePagesExplicit);
+           else
+              return false;
+           break;
+      case 'm':
+           metricsM = optarg;
+           break;
+      case 'P':
+           if (!SatipConfig.SetScheduling(optarg))
+              return false;
+           schedulingM = optarg;
+           break;
+      case 'w':
+           httpM = optarg;
+           break;
       default:
            return false;
       }
@@ -212,6 +261,8 @@ bool cPluginSatip::Start(void)
          info = cString::sprintf("%s %s", *info, data->protocols[i]);
       }
   info("%s", *info);
+  cSatipMetricsServer::Initialize(*metricsM);
+  cSatipHttpServer::Initialize(*httpM);
   return true;
 }
 
@@ -219,7 +270,11 @@ void cPluginSatip::Stop(void)
 {
   debug1("%s", __PRETTY_FUNCTION__);
   // Stop any background activities the plugin is performing.
+  cSatipMetricsServer::Destroy();
+  // The tuners feed the HTTP clients until the devices are shut down
   cSatipDevice::Shutdown();
+  cSatipHttpServer::Destroy();
+  cSatipShare::Destroy();
   cSatipDiscover::GetInstance()->Destroy();
   cSatipPoller::GetInstance()->Destroy();
   curl_global_cleanup();
@@ -449,6 +504,22 @@ bool cPluginSatip::SetupParse(const char *nameP, const char *valueP)
      SatipConfig.SetCIExtension(atoi(valueP));
   else if (!strcasecmp(nameP, "EnableFrontendReuse"))
      SatipConfig.SetFrontendReuse(atoi(valueP));
+  else if (!strcasecmp(nameP, "EnableRtcpLockDetection"))
+     SatipConfig.SetRtcpLockDetection(atoi(valueP));
+  else if (!strcasecmp(nameP, "FailoverTimeout"))
+     SatipConfig.SetFailoverTimeout(atoi(valueP));
+  else if (!strcasecmp(nameP, "HealthPeriod"))
+     SatipConfig.SetHealthPeriod(atoi(valueP));
+  else if (!strcasecmp(nameP, "HealthMinQuality"))
+     SatipConfig.SetHealthMinQuality(atoi(valueP));
+  else if (!strcasecmp(nameP, "TuningLimit"))
+     SatipConfig.SetTuningLimit(atoi(valueP));
+  else if (!strcasecmp(nameP, "EnableMulticastSharing"))
+     SatipConfig.SetMulticastSharing(atoi(valueP));
+  else if (!strcasecmp(nameP, "BufferSizeLimit"))
+     SatipConfig.SetBufferSizeLimit(atoi(valueP));
+  else if (!strcasecmp(nameP, "OverflowPolicy"))
+     SatipConfig.SetOverflowPolicy(atoi(valueP));
   else if (!strcasecmp(nameP, "CICAM")) {
      // ignored
      }
@@ -480,6 +551,11 @@ bool cPluginSatip::SetupParse(const char *nameP, const char *valueP)
      }
   else if (!strcasecmp(nameP, "TransportMode"))
      SatipConfig.SetTransportMode(atoi(valueP));
+  else if (!strcasecmp(nameP, "Scheduling")) {
+     // The command line option takes precedence
+     if (isempty(*schedulingM))
+        SatipConfig.SetScheduling(valueP);
+     }
   else
      return false;
   return true;
@@ -503,10 +579,22 @@ const char **cPluginSatip::SVDRPHelpPages(void)
     "    Toggles between bit or byte information mode.\n",
     "LIST\n"
     "    Lists active SAT>IP servers.\n",
+    "LOAD\n"
+    "    Lists load and stream health of SAT>IP servers.\n",
+    "THRD\n"
+    "    Lists cpu load, wakeups and processing times of the SAT>IP threads\n"
+    "    over the last five seconds, and their totals and peaks.\n",
+    "METR\n"
+    "    Lists the monotonic counters and gauges of SAT>IP devices and\n"
+    "    servers in the text exposition format of Prometheus.\n",
+    "HTTP\n"
+    "    Lists the clients of the HTTP server with their queued and\n"
+    "    sent data.\n",
     "SCAN\n"
     "    Scans active SAT>IP servers.\n",
     "STAT\n"
-    "    Lists status information of SAT>IP devices.\n",
+    "    Lists status information of SAT>IP devices and the effective\n"
+    "    scheduling policy, priority and cpu affinity of their threads.\n",
     "CONT\n"
     "    Shows SAT>IP device count.\n",
     "OPER [ off | low | normal | high ]\n"
@@ -517,6 +605,21 @@ const char **cPluginSatip::SVDRPHelpPages(void)
     "    Detachs active SAT>IP servers.\n",
     "TRAC [ <mode> ]\n"
     "    Gets and/or sets used tracing mode.\n",
+    "CAPT [ <card index> [ start [ <file> ] | stop | replay <file> [ <speed> ] ] ]\n"
+    "    Captures the RTP, RTCP and RTSP traffic of a SAT>IP device into\n"
+    "    a file or replays a capture into an idle device at the original\n"
+    "    or a multiplied speed (0 = as fast as possible). Without options\n"
+    "    the capture status of all devices is listed.\n",
+    "DUMP [ <card index> [ start [ <file> ] [ all ] [ size=<MB> ] [ time=<min> ] | stop ] ]\n"
+    "    Writes the TS stream of a SAT>IP device into a file, optionally\n"
+    "    with all pids of the transponder, and starts a new numbered file\n"
+    "    after the given size or time. The file defaults to the video\n"
+    "    directory. Without options the dump status of all devices is\n"
+    "    listed.\n",
+    "EVNT [ on | off | clear | <count> ]\n"
+    "    Enables, disables or clears the recording of binary trace events\n"
+    "    or lists the latest events (default 100, 0 = all) of all threads:\n"
+    "    time in seconds, thread, event, device and two arguments.\n",
     NULL
     };
   return HelpPages;
@@ -569,12 +672,31 @@ cString cPluginSatip::SVDRPCommand(const char *commandP, const char *optionP, in
         return cString("No SATIP servers detected!");
         }
      }
+  else if (strcasecmp(commandP, "LOAD") == 0) {
+     cString list = cSatipDiscover::GetInstance()->GetServerLoad();
+     if (!isempty(list)) {
+        return list;
+        }
+     else {
+        replyCodeP = 550; // Requested action not taken
+        return cString("No SATIP servers detected!");
+        }
+     }
+  else if (strcasecmp(commandP, "THRD") == 0) {
+     return cSatipThreadStatistics::GetAllThreadStatistics();
+     }
+  else if (strcasecmp(commandP, "METR") == 0) {
+     return cSatipMetricsServer::Export();
+     }
+  else if (strcasecmp(commandP, "HTTP") == 0) {
+     return cSatipHttpServer::GetStatus();
+     }
   else if (strcasecmp(commandP, "SCAN") == 0) {
      cSatipDiscover::GetInstance()->TriggerScan();
      return cString("SATIP server scan requested");
      }
   else if (strcasecmp(commandP, "STAT") == 0) {
-     return cSatipDevice::GetSatipStatus();
+     return cString::sprintf("%sThreads:\n%s", *cSatipDevice::GetSatipStatus(), *cSatipThreadStatistics::GetAllThreadSchedulings());
      }
   else if (strcasecmp(commandP, "CONT") == 0) {
      return cString::sprintf("SATIP device count: %u", cSatipDevice::Count());
@@ -622,9 +744,144 @@ cString cPluginSatip::SVDRPCommand(const char *commandP, const char *optionP, in
      info("SATIP servers detached");
      return cString("SATIP servers detached");
      }
+  else if (strcasecmp(commandP, "CAPT") == 0) {
+     char *opt = strdup(optionP ? optionP : "");
+     char *save = NULL;
+     char *index = strtok_r(opt, " \t", &save);
+     char *action = strtok_r(NULL, " \t", &save);
+     char *file = strtok_r(NULL, " \t", &save);
+     char *speed = strtok_r(NULL, " \t", &save);
+     cString reply;
+     if (!index) {
+        reply = "";
+        for (int i = 0; i < cDevice::NumDevices(); ++i) {
+            cSatipDevice *device = cSatipDevice::GetSatipDevice(i);
+            if (device)
+               reply = cString::sprintf("%sCardIndex: %d  %s\n", *reply, i, *device->GetCaptureStatus());
+            }
+        }
+     else {
+        cSatipDevice *device = isnumber(index) ? cSatipDevice::GetSatipDevice(atoi(index)) : NULL;
+        if (!device) {
+           replyCodeP = 550; // Requested action not taken
+           reply = "SATIP device not found!";
+           }
+        else if (!action)
+           reply = device->GetCaptureStatus();
+        else if (strcasecmp(action, "start") == 0) {
+           char stamp[32];
+           struct tm tm;
+           time_t now = time(NULL);
+           strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&now, &tm));
+           cString name = file ? cString(file) : AddDirectory(cPlugin::CacheDirectory(PLUGIN_NAME_I18N), *cString::sprintf("satip-%s-%s.cap", index, stamp));
+           if (device->StartCapture(*name))
+              reply = cString::sprintf("SATIP capture started: %s", *name);
+           else {
+              replyCodeP = 550; // Requested action not taken
+              reply = "SATIP capture failed!";
+              }
+           }
+        else if (strcasecmp(action, "stop") == 0) {
+           device->StopCapture();
+           reply = "SATIP capture stopped";
+           }
+        else if ((strcasecmp(action, "replay") == 0) && file) {
+           if (device->StartReplay(file, speed ? atof(speed) : 1.0))
+              reply = cString::sprintf("SATIP replay started: %s", file);
+           else {
+              replyCodeP = 550; // Requested action not taken
+              reply = "SATIP replay failed!";
+              }
+           }
+        else {
+           replyCodeP = 501; // Syntax error in parameters or arguments
+           reply = "Invalid SATIP capture command!";
+           }
+        }
+     free(opt);
+     return reply;
+     }
+  else if (strcasecmp(commandP, "DUMP") == 0) {
+     char *opt = strdup(optionP ? optionP : "");
+     char *save = NULL;
+     char *index = strtok_r(opt, " \t", &save);
+     char *action = strtok_r(NULL, " \t", &save);
+     cString reply;
+     if (!index) {
+        reply = "";
+        for (int i = 0; i < cDevice::NumDevices(); ++i) {
+            cSatipDevice *device = cSatipDevice::GetSatipDevice(i);
+            if (device)
+               reply = cString::sprintf("%sCardIndex: %d  %s\n", *reply, i, *device->GetDumpStatus());
+            }
+        }
+     else {
+        cSatipDevice *device = isnumber(index) ? cSatipDevice::GetSatipDevice(atoi(index)) : NULL;
+        if (!device) {
+           replyCodeP = 550; // Requested action not taken
+           reply = "SATIP device not found!";
+           }
+        else if (!action)
+           reply = device->GetDumpStatus();
+        else if (strcasecmp(action, "start") == 0) {
+           const char *file = NULL;
+           bool all = false;
+           unsigned int size = 0, minutes = 0;
+           for (char *arg = strtok_r(NULL, " \t", &save); arg; arg = strtok_r(NULL, " \t", &save)) {
+               if (strcasecmp(arg, "all") == 0)
+                  all = true;
+               else if (startswith(arg, "size="))
+                  size = atoi(arg + 5);
+               else if (startswith(arg, "time="))
+                  minutes = atoi(arg + 5);
+               else
+                  file = arg;
+               }
+           char stamp[32];
+           struct tm tm;
+           time_t now = time(NULL);
+           strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&now, &tm));
+           // A transponder grows by gigabytes per hour, so it goes next to the recordings
+           cString name = file ? cString(file) : AddDirectory(cVideoDirectory::Name(), *cString::sprintf("satip-%s-%s.ts", index, stamp));
+           if (device->StartDump(*name, all, size, minutes))
+              reply = cString::sprintf("SATIP dump started: %s", *name);
+           else {
+              replyCodeP = 550; // Requested action not taken
+              reply = "SATIP dump failed!";
+              }
+           }
+        else if (strcasecmp(action, "stop") == 0) {
+           device->StopDump();
+           reply = "SATIP dump stopped";
+           }
+        else {
+           replyCodeP = 501; // Syntax error in parameters or arguments
+           reply = "Invalid SATIP dump command!";
+           }
+        }
+     free(opt);
+     return reply;
+     }
+  else if (strcasecmp(commandP, "EVNT") == 0) {
+     if (optionP && (strcasecmp(optionP, "on") == 0))
+        cSatipTrace::SetEnabled(true);
+     else if (optionP && (strcasecmp(optionP, "off") == 0))
+        cSatipTrace::SetEnabled(false);
+     else if (optionP && (strcasecmp(optionP, "clear") == 0))
+        cSatipTrace::Clear();
+     else if (optionP && *optionP && !isnumber(optionP)) {
+        replyCodeP = 501; // Syntax error in parameters or arguments
+        return "Invalid SATIP trace event command!";
+        }
+     else
+        return cSatipTrace::Dump((optionP && *optionP) ? atoi(optionP) : 100);
+     return cString::sprintf("SATIP trace events: %s", cSatipTrace::IsEnabled() ? "on" : "off");
+     }
   else if (strcasecmp(commandP, "TRAC") == 0) {
      if (optionP && *optionP)
         SatipConfig.SetTraceMode(strtol(optionP, NULL, 0));
+     if (SatipConfig.GetTraceMode() & __SATIP_DISABLED_TRACE_MODES__)
+        return cString::sprintf("SATIP tracing mode: 0x%04X (compiled out: 0x%04X)\n", SatipConfig.GetTraceMode(), SatipConfig.GetTraceMode() & __SATIP_DISABLED_TRACE_MODES__);
      return cString::sprintf("SATIP tracing mode: 0x%04X\n", SatipConfig.GetTraceMode());
      }
 
@@ -198,6 +198,8 @@ void cSatipSectionFilter::Send(bool PollHUP)
                if ((sent = send(socketM[1], data, count, MSG_EOR)) >= 0) {
                   // Update statistics
                   AddSectionStatistic(sent, 1);
+                  cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eSectionBytes, sent);
+                  cSatipMetrics::Add(deviceIndexM, cSatipMetrics::eSections);
                }
             }
             else if (errno != EAGAIN) {
@@ -217,9 +219,10 @@ int cSatipSectionFilter::Available(void) const
 
 cSatipSectionFilterHandler::cSatipSectionFilterHandler(int deviceIndexP, unsigned int bufferLenP)
 : cThread(cString::sprintf("SATIP#%d section handler", deviceIndexP)),
-  ringBufferM(new cRingBufferLinear(bufferLenP, TS_SIZE, false, *cString::sprintf("SATIP %d section handler", deviceIndexP))),
+  ringBufferM(new cSatipRingBuffer(bufferLenP, TS_SIZE, *cString::sprintf("SATIP %d section handler", deviceIndexP))),
   mutexSecFilterHandlerM(),
-  deviceIndexM(deviceIndexP)
+  deviceIndexM(deviceIndexP),
+  threadStatisticsM(cString::sprintf("SATIP#%d section handler", deviceIndexP))
 {
   debug1("%s (%d, %d) [device %d]", __PRETTY_FUNCTION__, deviceIndexM, bufferLenP, deviceIndexM);
 
@@ -227,7 +230,7 @@ cSatipSectionFilterHandler::cSatipSectionFilterHandler(int deviceIndexP, unsigne
   memset(filtersM, 0, sizeof(filtersM));
 
   // Create input buffer
-  if (ringBufferM) {
+  if (ringBufferM && ringBufferM->IsValid()) {
      ringBufferM->SetTimeouts(100, 100);
      ringBufferM->SetIoThrottle();
      Start();
@@ -286,12 +289,19 @@ void cSatipSectionFilterHandler::SendAll(void)
 void cSatipSectionFilterHandler::Action(void)
 {
   debug1("%s Entering [device %d]", __PRETTY_FUNCTION__, deviceIndexM);
+  threadStatisticsM.ApplyScheduling(cSatipConfig::eThreadClassSection);
   // Do the thread loop
   while (Running()) {
         uchar *p = NULL;
         int len = 0;
+        uint64_t start = 0;
+        threadStatisticsM.Wakeup();
+        // No data is held from the buffer here
+        ringBufferM->AutoResize();
         // Process all pending TS packets
         while ((p  = ringBufferM->Get(len)) != NULL) {
+              if (!start)
+                 start = cSatipThreadStatistics::Now();
               if (p && (len >= TS_SIZE)) {
                  if (*p != TS_SYNC_BYTE) {
                     for (int i = 1; i < len; ++i) {
@@ -313,7 +323,12 @@ void cSatipSectionFilterHandler::Action(void)
                     mutexSecFilterHandlerM.Unlock();
                     ringBufferM->Del(TS_SIZE);
                     }
-                }
+              // Account the batch before the next Get() waits for more data
+              if (start && (ringBufferM->Available() < TS_SIZE)) {
+                 threadStatisticsM.AddProcessing(start);
+                 start = 0;
+                 }
+              }
 
         // Send demuxed section packets through all filters
         SendAll();
@@ -337,6 +352,10 @@ cString cSatipSectionFilterHandler::GetInformation(void)
             break;
          }
       }
+  if (ringBufferM && ringBufferM->IsValid())
+     s = cString::sprintf("%sSection buffer: %d/%d kB, high-water mark %d kB, %d resize%s\n", *s,
+                          ringBufferM->Available() / KILOBYTE(1), ringBufferM->Capacity() / KILOBYTE(1),
+                          ringBufferM->HighWater() / KILOBYTE(1), ringBufferM->Resizes(), (ringBufferM->Resizes() == 1) ? "" : "s");
   return s;
 }
 
@@ -432,7 +451,7 @@ void cSatipSectionFilterHandler::Write(uchar *bufferP, int lengthP)
   debug16("%s (, %d) [device %d]", __PRETTY_FUNCTION__, lengthP, deviceIndexM);
   // Fill up the buffer
   if (ringBufferM) {
-     int len = ringBufferM->Put(bufferP, lengthP);
+     int len = ringBufferM->Put(bufferP, lengthP, TS_SIZE);
      if (len != lengthP)
         ringBufferM->ReportOverflow(lengthP - len);
      }
@@ -11,6 +11,7 @@
 #include <poll.h>
 #include <vdr/device.h>
 
+#include "buffer.h"
 #include "common.h"
 #include "statistics.h"
 
@@ -64,11 +65,12 @@ private:
     eMaxSecFilterCount = 32,
     eSecFilterSendTimeoutMs = 10
   };
-  cRingBufferLinear *ringBufferM;
+  cSatipRingBuffer *ringBufferM;
   cMutex mutexSecFilterHandlerM;
   int deviceIndexM;
   cSatipSectionFilter *filtersM[eMaxSecFilterCount];
   struct pollfd pollFdsM[eMaxSecFilterCount];
+  cSatipThreadStatistics threadStatisticsM;
 
   bool Delete(unsigned int indexP);
   bool IsBlackListed(u_short pidP, u_char tidP, u_char maskP) const;
@@ -81,6 +83,7 @@ public:
   cSatipSectionFilterHandler(int deviceIndexP, unsigned int bufferLenP);
   virtual ~cSatipSectionFilterHandler();
   cString GetInformation(void);
+  cString GetThreadStatistic(void) { return threadStatisticsM.GetThreadStatistic(); }
   bool Exists(u_short pidP);
   int Open(u_short pidP, u_char tidP, u_char maskP);
   void Close(int handleP);
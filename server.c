@@ -5,6 +5,7 @@
  *
  */
 
+#include <vdr/channels.h>
 #include <vdr/sources.h>
 
 #include "config.h"
@@ -50,6 +51,49 @@ bool cSatipFrontends::Assign(int deviceIdP)
    return false;
 }
 
+bool cSatipFrontends::Unassign(int deviceIdP)
+{
+   // A frontend the device is already streaming from stays assigned
+   for(int i = 0; i < numDevices; i++) {
+      if (devicesAssigned[i] == deviceIdP && !devicesAttached[i]) {
+         devicesAssigned[i] = -1;
+         debug9("%s %s-%u unassigned, deviceID list: %s [device %u]", __PRETTY_FUNCTION__, *type, numDevices, *DeviceIDList(), deviceIdP);
+         return true;
+      }
+   }
+   return false;
+}
+
+int cSatipFrontends::Available(int deviceIdP)
+{
+   // The frontend already assigned to the device is available for it
+   int count = 0;
+   for(int i = 0; i < numDevices; i++) {
+      if (devicesAssigned[i] == -1 || devicesAssigned[i] == deviceIdP)
+         count++;
+   }
+   return count;
+}
+
+int cSatipFrontends::Used(void)
+{
+   int count = 0;
+   for(int i = 0; i < numDevices; i++) {
+      if (devicesAssigned[i] != -1)
+         count++;
+   }
+   return count;
+}
+
+bool cSatipFrontends::IsAssigned(int deviceIdP)
+{
+   for(int i = 0; i < numDevices; i++) {
+      if (devicesAssigned[i] == deviceIdP)
+         return true;
+   }
+   return false;
+}
+
 bool cSatipFrontends::Attach(int deviceIdP)
 { //
    for(int i = 0; i < numDevices; i++) {
@@ -106,14 +150,24 @@ cSatipServer::cSatipServer(const char *srcAddressP, const char *addressP, const
   filtersM((filtersP && *filtersP) ? filtersP : ""),
   descriptionM(!isempty(descriptionP) ? descriptionP : "MyBrokenHardware"),
   quirksM(""),
+  idM(0),
   portM(portP),
+  lossM(0),
+  roundTripM(0),
+  qualityM(-1),
+  tuningsM(0),
   quirkM(quirkP),
   hasCiM(false),
   activeM(true),
+  cachedM(false),
+  departedM(false),
   createdM(time(NULL)),
-  lastSeenM(0)
+  lastSeenM(0),
+  departedTimeM(0)
 {
   memset(sourceFiltersM, 0, sizeof(sourceFiltersM));
+  memset(transpondersM, 0, sizeof(transpondersM));
+  memset(bitratesM, 0, sizeof(bitratesM));
   if (!isempty(*filtersM)) {
      char *s, *p = strdup(*filtersM);
      char *r = strtok_r(p, ",", &s);
@@ -291,23 +345,87 @@ bool cSatipServer::Assign(int deviceIdP, int sourceP, int systemP)
   return result;
 }
 
+void cSatipServer::Unassign(int deviceIdP)
+{
+  for (int i = 0; i < eSatipFrontendCount; ++i) {
+      if (frontends[i].Unassign(deviceIdP))
+         return;
+      }
+}
+
 bool cSatipServer::Matches(int sourceP)
 {
+  return IsValidSource(sourceP) && HasModules(sourceP);
+}
+
+bool cSatipServer::HasModules(int sourceP)
+{
+  if (cSource::IsType(sourceP, 'S'))
+     return GetModulesDVBS2();
+  else if (cSource::IsType(sourceP, 'T'))
+     return GetModulesDVBT() || GetModulesDVBT2();
+  else if (cSource::IsType(sourceP, 'C'))
+     return GetModulesDVBC() || GetModulesDVBC2();
+  else if (cSource::IsType(sourceP, 'A'))
+     return GetModulesATSC();
+  return false;
+}
+
+int cSatipServer::Available(int deviceIdP, int sourceP, int systemP)
+{
+  int result = 0;
   if (IsValidSource(sourceP)) {
      if (cSource::IsType(sourceP, 'S'))
-        return GetModulesDVBS2();
-     else if (cSource::IsType(sourceP, 'T'))
-        return GetModulesDVBT() || GetModulesDVBT2();
-     else if (cSource::IsType(sourceP, 'C'))
-        return GetModulesDVBC() || GetModulesDVBC2();
+        result = frontends[eSatipFrontendDVBS2].Available(deviceIdP);
+     else if (cSource::IsType(sourceP, 'T')) {
+        if (systemP)
+           result = frontends[eSatipFrontendDVBT2].Available(deviceIdP);
+        else
+           result = frontends[eSatipFrontendDVBT].Available(deviceIdP) + frontends[eSatipFrontendDVBT2].Available(deviceIdP);
+        }
+     else if (cSource::IsType(sourceP, 'C')) {
+        if (systemP)
+           result = frontends[eSatipFrontendDVBC2].Available(deviceIdP);
+        else
+           result = frontends[eSatipFrontendDVBC].Available(deviceIdP) + frontends[eSatipFrontendDVBC2].Available(deviceIdP);
+        }
      else if (cSource::IsType(sourceP, 'A'))
-        return GetModulesATSC();
+        result = frontends[eSatipFrontendATSC].Available(deviceIdP);
      }
-  return false;
+  return result;
+}
+
+int cSatipServer::Score(int deviceIdP, int transponderP, int availableP)
+{
+  int score = availableP * eScoreFrontend;
+  // Keep the device on its current server
+  for (int i = 0; i < eSatipFrontendCount; ++i) {
+      if (frontends[i].IsAssigned(deviceIdP)) {
+         score += eScoreAssigned;
+         break;
+         }
+      }
+  // Prefer the server that is already receiving the transponder
+  for (int i = 0; i < SATIP_MAX_DEVICES; ++i) {
+      if ((i != deviceIdP) && transpondersM[i] && ISTRANSPONDER(transpondersM[i], transponderP)) {
+         score += eScoreSticky;
+         break;
+         }
+      }
+  // Penalties of up to 100 points for packet loss (in permilles), round-trip time (in
+  // milliseconds), bad signal quality (in percents) and bandwidth (in Mbit/s)
+  score -= min(lossM / 10, 100);
+  score -= min(roundTripM / 10, 100);
+  if (qualityM >= 0)
+     score -= (100 - min(qualityM, 100)) / 2;
+  score -= min(Bitrate() / 1000, 100);
+  return score;
 }
 
-void cSatipServer::Attach(int deviceIdP)
+void cSatipServer::Attach(int deviceIdP, int transponderP)
 {
+  if ((deviceIdP >= 0) && (deviceIdP < SATIP_MAX_DEVICES))
+     transpondersM[deviceIdP] = transponderP;
   for (int i = 0; i < eSatipFrontendCount; ++i) {
       if (frontends[i].Attach(deviceIdP))
          return;
@@ -316,12 +434,81 @@ void cSatipServer::Attach(int deviceIdP)
 
 void cSatipServer::Detach(int deviceIdP)
 {
+  if ((deviceIdP >= 0) && (deviceIdP < SATIP_MAX_DEVICES)) {
+     transpondersM[deviceIdP] = 0;
+     bitratesM[deviceIdP] = 0;
+     }
   for (int i = 0; i < eSatipFrontendCount; ++i) {
       if (frontends[i].Detach(deviceIdP))
          return;
       }
 }
 
+void cSatipServer::UpdateHealth(int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP)
+{
+  // Smoothen the measurements over the devices and time
+  if (lossP >= 0)
+     lossM = (3 * lossM + lossP) / 4;
+  if (roundTripP >= 0)
+     roundTripM = roundTripM ? (3 * roundTripM + roundTripP) / 4 : roundTripP;
+  if (qualityP >= 0)
+     qualityM = (qualityM >= 0) ? (3 * qualityM + qualityP) / 4 : qualityP;
+  if ((deviceIdP >= 0) && (deviceIdP < SATIP_MAX_DEVICES))
+     bitratesM[deviceIdP] = bitrateP;
+}
+
+int cSatipServer::Bitrate(void)
+{
+  int bitrate = 0;
+  for (int i = 0; i < SATIP_MAX_DEVICES; ++i)
+      bitrate += bitratesM[i];
+  return bitrate;
+}
+
+int cSatipServer::Streams(void)
+{
+  int count = 0;
+  for (int i = 0; i < SATIP_MAX_DEVICES; ++i) {
+      if (transpondersM[i])
+         count++;
+      }
+  return count;
+}
+
+int cSatipServer::Frontends(void)
+{
+  int count = 0;
+  for (int i = 0; i < eSatipFrontendCount; ++i)
+      count += frontends[i].Count();
+  return count;
+}
+
+int cSatipServer::UsedFrontends(void)
+{
+  int count = 0;
+  for (int i = 0; i < eSatipFrontendCount; ++i)
+      count += frontends[i].Used();
+  return count;
+}
+
+int cSatipServer::TuningLimit(void)
+{
+  if (SatipConfig.GetTuningLimit() > 0)
+     return SatipConfig.GetTuningLimit();
+  // servers with session or locking issues can handle only one SETUP at a time
+  if (quirkM & (eSatipQuirkSessionId | eSatipQuirkForceLock | eSatipQuirkTearAndPlay))
+     return 1;
+  return eTuningLimit;
+}
+
+bool cSatipServer::AddTuning(void)
+{
+  if (tuningsM >= TuningLimit())
+     return false;
+  ++tuningsM;
+  return true;
+}
+
 int cSatipServer::GetModulesDVBS2(void)
 {
   return frontends[eSatipFrontendDVBS2].Count();
@@ -352,8 +539,50 @@ int cSatipServer::GetModulesATSC(void)
   return frontends[eSatipFrontendATSC].Count();
 }
 
+// --- cSatipServerHandle -----------------------------------------------------
+
+void cSatipServerHandle::Set(cSatipServer *serverP)
+{
+  // Only the immutable attributes are copied, so the handle stays valid even after the server is gone
+  if (serverP) {
+     idM = serverP->Id();
+     quirkM = serverP->QuirkMask();
+     portM = serverP->Port();
+     hasCiM = serverP->HasCI();
+     addressM = serverP->Address();
+     srcAddressM = serverP->SrcAddress();
+     }
+  else
+     Reset();
+}
+
 // --- cSatipServers ----------------------------------------------------------
 
+void cSatipServers::Add(cSatipServer *serverP)
+{
+  serverP->SetId(++lastIdM);
+  cList<cSatipServer>::Add(serverP);
+  indexM.Add(serverP, serverP->Id());
+}
+
+void cSatipServers::Del(cSatipServer *serverP)
+{
+  indexM.Del(serverP, serverP->Id());
+  cList<cSatipServer>::Del(serverP);
+}
+
+bool cSatipServers::GetHandle(cSatipServer *serverP, cSatipServerHandle &handleP)
+{
+  for (cSatipServer *s = First(); s; s = Next(s)) {
+      if (s == serverP) {
+         handleP.Set(s);
+         return true;
+         }
+      }
+  handleP.Reset();
+  return false;
+}
+
 cSatipServer *cSatipServers::Find(cSatipServer *serverP)
 {
   for (cSatipServer *s = First(); s; s = Next(s)) {
@@ -366,21 +595,50 @@ cSatipServer *cSatipServers::Find(cSatipServer *serverP)
 cSatipServer *cSatipServers::Find(int sourceP)
 {
   for (cSatipServer *s = First(); s; s = Next(s)) {
-      if (s->Matches(sourceP))
+      if (!s->IsDeparted() && s->Matches(sourceP))
          return s;
       }
   return NULL;
 }
 
-cSatipServer *cSatipServers::Assign(int deviceIdP, int sourceP, int transponderP, int systemP)
+cSatipServer *cSatipServers::Assign(int deviceIdP, int sourceP, int transponderP, int systemP, unsigned int excludeIdP)
 {
+  cVector<cSatipServer *> candidates;
+  cVector<int> scores;
   for (cSatipServer *s = First(); s; s = Next(s)) {
-      if (s->IsActive() && s->Assign(deviceIdP, sourceP, systemP))
-         return s;
+      int available = (s->IsActive() && (s->Id() != excludeIdP)) ? s->Available(deviceIdP, sourceP, systemP) : 0;
+      if (available > 0) {
+         int score = s->Score(deviceIdP, transponderP, available);
+         debug9("%s %s|%s score=%d [device %u]", __PRETTY_FUNCTION__, s->Address(), s->Description(), score, deviceIdP);
+         candidates.Append(s);
+         scores.Append(score);
+         }
       }
+  // A server may still refuse, so go on with the next best one
+  while (candidates.Size()) {
+        int best = 0;
+        for (int i = 1; i < candidates.Size(); ++i) {
+            if (scores[i] > scores[best])
+               best = i;
+            }
+        if (candidates[best]->Assign(deviceIdP, sourceP, systemP))
+           return candidates[best];
+        candidates.Remove(best);
+        scores.Remove(best);
+        }
   return NULL;
 }
 
+void cSatipServers::Unassign(cSatipServer *serverP, int deviceIdP)
+{
+  for (cSatipServer *s = First(); s; s = Next(s)) {
+      if (s == serverP) {
+         s->Unassign(deviceIdP);
+         break;
+         }
+      }
+}
+
 cSatipServer *cSatipServers::Update(cSatipServer *serverP)
 {
   for (cSatipServer *s = First(); s; s = Next(s)) {
@@ -402,24 +660,25 @@ void cSatipServers::Activate(cSatipServer *serverP, bool onOffP)
       }
 }
 
-void cSatipServers::Attach(cSatipServer *serverP, int deviceIdP)
+void cSatipServers::Attach(unsigned int idP, int deviceIdP, int transponderP)
 {
-  for (cSatipServer *s = First(); s; s = Next(s)) {
-      if (s == serverP) {
-         s->Attach(deviceIdP);
-         break;
-         }
-      }
+  cSatipServer *s = Get(idP);
+  if (s)
+     s->Attach(deviceIdP, transponderP);
 }
 
-void cSatipServers::Detach(cSatipServer *serverP, int deviceIdP)
+void cSatipServers::Detach(unsigned int idP, int deviceIdP)
 {
-  for (cSatipServer *s = First(); s; s = Next(s)) {
-      if (s == serverP) {
-         s->Detach(deviceIdP);
-         break;
-         }
-      }
+  cSatipServer *s = Get(idP);
+  if (s)
+     s->Detach(deviceIdP);
+}
+
+void cSatipServers::UpdateHealth(unsigned int idP, int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP)
+{
+  cSatipServer *s = Get(idP);
+  if (s)
+     s->UpdateHealth(deviceIdP, lossP, roundTripP, qualityP, bitrateP);
 }
 
 bool cSatipServers::IsQuirk(cSatipServer *serverP, int quirkP)
@@ -448,11 +707,37 @@ bool cSatipServers::HasCI(cSatipServer *serverP)
 
 void cSatipServers::Cleanup(uint64_t intervalMsP)
 {
-  for (cSatipServer *s = First(); s; s = Next(s)) {
-      if (!intervalMsP || (s->LastSeen() > intervalMsP)) {
+  for (cSatipServer *s = First(); s; ) {
+      cSatipServer *next = Next(s);
+      if (!intervalMsP || (s->LastSeen() > intervalMsP) || s->IsExpired()) {
          info("Removing server %s (%s %s)", s->Description(), s->Address(), s->Model());
          Del(s);
          }
+      s = next;
+      }
+}
+
+void cSatipServers::CleanupCached(void)
+{
+  for (cSatipServer *s = First(); s; ) {
+      cSatipServer *next = Next(s);
+      if (s->IsCached()) {
+         info("Removing unconfirmed server %s (%s %s)", s->Description(), s->Address(), s->Model());
+         Del(s);
+         }
+      s = next;
+      }
+}
+
+void cSatipServers::Depart(const char *addressP, cVector<unsigned int> &departedP)
+{
+  // The servers are only deleted by Cleanup(), after the devices have let go of them
+  for (cSatipServer *s = First(); s; s = Next(s)) {
+      if (!s->IsDeparted() && !strcmp(s->Address(), addressP)) {
+         info("Server departed %s (%s %s)", s->Description(), s->Address(), s->Model());
+         s->Depart();
+         departedP.Append(s->Id());
+         }
       }
 }
 
@@ -515,6 +800,57 @@ cString cSatipServers::List(void)
   return list;
 }
 
+cString cSatipServers::Load(void)
+{
+  cString list = "";
+  for (cSatipServer *s = First(); s; s = Next(s))
+      list = cString::sprintf("%s%c %s|%s|%s frontends: %d/%d streams: %d bitrate: %d kbit/s loss: %d.%d%% rtt: %d ms quality: %d%%\n", *list,
+                              s->IsActive() ? '+' : '-', s->Address(), s->Model(), s->Description(), s->UsedFrontends(), s->Frontends(),
+                              s->Streams(), s->Bitrate(), s->Loss() / 10, s->Loss() % 10, s->RoundTrip(), max(s->Quality(), 0));
+  return list;
+}
+
+static cString SatipMetricsLabel(const char *valueP)
+{
+  // Quote the backslashes, double quotes and line feeds of a label value
+  char buffer[256];
+  unsigned int n = 0;
+  for (const char *p = valueP; p && *p && (n < sizeof(buffer) - 2); ++p) {
+      if ((*p == '\\') || (*p == '"') || (*p == '\n'))
+         buffer[n++] = '\\';
+      buffer[n++] = (*p == '\n') ? 'n' : *p;
+      }
+  buffer[n] = 0;
+  return buffer;
+}
+
+cString cSatipServers::Metrics(void)
+{
+  static const struct {
+    const char *name;
+    const char *help;
+  } families[] = {
+    { "satip_server_active",                "Whether the server is active" },
+    { "satip_server_frontends",             "Frontends provided by the server" },
+    { "satip_server_frontends_used",        "Frontends of the server used by the devices" },
+    { "satip_server_streams",               "Streams received from the server" },
+    { "satip_server_bitrate_kbits",         "Received bitrate in kbit/s" },
+    { "satip_server_loss_permille",         "RTP packet loss in permilles" },
+    { "satip_server_rtt_milliseconds",      "RTSP round-trip time in milliseconds" },
+    { "satip_server_signal_quality_percent", "Signal quality reported via RTCP" }
+  };
+  std::string list;
+  for (unsigned int i = 0; i < ELEMENTS(families); ++i) {
+      AppendFormat(list, "# HELP %s %s\n# TYPE %s gauge\n", families[i].name, families[i].help, families[i].name);
+      for (cSatipServer *s = First(); s; s = Next(s)) {
+          int values[] = { s->IsActive(), s->Frontends(), s->UsedFrontends(), s->Streams(), s->Bitrate(), s->Loss(), s->RoundTrip(), max(s->Quality(), 0) };
+          AppendFormat(list, "%s{server=\"%s\",model=\"%s\",description=\"%s\"} %d\n", families[i].name,
+                       *SatipMetricsLabel(s->Address()), *SatipMetricsLabel(s->Model()), *SatipMetricsLabel(s->Description()), values[i]);
+          }
+      }
+  return list.c_str();
+}
+
 int cSatipServers::NumProvidedSystems(void)
 {
   int count = 0;
@@ -534,3 +870,101 @@ int cSatipServers::NumProvidedSystems(void)
       }
   return count;
 }
+
+// --- cSatipSourceIndex ------------------------------------------------------
+
+cSatipSourceIndex::cSatipSourceIndex(void)
+: validM(false),
+  typesM(0),
+  providedCountM(0),
+  disabledCountM(0)
+{
+  memset(providedM, 0, sizeof(providedM));
+  memset(disabledM, 0, sizeof(disabledM));
+}
+
+unsigned int cSatipSourceIndex::TypeBit(int sourceP)
+{
+  switch (sourceP & cSource::st_Mask) {
+    case cSource::stSat:   return 0x01;
+    case cSource::stTerr:  return 0x02;
+    case cSource::stCable: return 0x04;
+    case cSource::stAtsc:  return 0x08;
+    default:               break;
+    }
+  return 0;
+}
+
+bool cSatipSourceIndex::Contains(const int *sourcesP, int countP, int sourceP)
+{
+  // the entries are kept sorted, so a binary search will do
+  int lo = 0, hi = countP - 1;
+  while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (sourcesP[mid] == sourceP)
+           return true;
+        if (sourcesP[mid] < sourceP)
+           lo = mid + 1;
+        else
+           hi = mid - 1;
+        }
+  return false;
+}
+
+bool cSatipSourceIndex::Insert(int *sourcesP, int &countP, int sourceP)
+{
+  if (Contains(sourcesP, countP, sourceP))
+     return true;
+  if (countP >= eMaxSources)
+     return false;
+  int i = countP++;
+  for (; i > 0 && sourcesP[i - 1] > sourceP; --i)
+      sourcesP[i] = sourcesP[i - 1];
+  sourcesP[i] = sourceP;
+  return true;
+}
+
+void cSatipSourceIndex::Build(cSatipServers &serversP)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  validM = true;
+  typesM = 0;
+  providedCountM = 0;
+  disabledCountM = 0;
+  for (cSatipServer *s = serversP.First(); s; s = serversP.Next(s)) {
+      if (s->IsDeparted())
+         continue;
+      if (s->SourceFilter(0)) {
+         // a filtered server provides only the listed sources
+         for (int i = 0; s->SourceFilter(i); ++i) {
+             if (s->HasModules(s->SourceFilter(i)) && !Insert(providedM, providedCountM, s->SourceFilter(i)))
+                validM = false;
+             }
+         }
+      else {
+         static const int types[] = { cSource::stSat, cSource::stTerr, cSource::stCable, cSource::stAtsc };
+         for (unsigned int i = 0; i < ELEMENTS(types); ++i) {
+             if (s->HasModules(types[i]))
+                typesM |= TypeBit(types[i]);
+             }
+         }
+      }
+  for (unsigned int i = 0; i < SatipConfig.GetDisabledSourcesCount(); ++i) {
+      if (!Insert(disabledM, disabledCountM, SatipConfig.GetDisabledSources(i)))
+         validM = false;
+      }
+  // source descriptions starting with '0' are disabled
+  for (cSource *s = Sources.First(); s; s = Sources.Next(s)) {
+      if (s->Description() && (*(s->Description()) == '0') && !Insert(disabledM, disabledCountM, s->Code()))
+         validM = false;
+      }
+  if (!validM)
+     error("Too many sources for the source index - falling back to server lookups");
+}
+
+bool cSatipSourceIndex::Provides(int sourceP) const
+{
+  if (Contains(disabledM, disabledCountM, sourceP))
+     return false;
+  return (typesM & TypeBit(sourceP)) || Contains(providedM, providedCountM, sourceP);
+}
@@ -24,6 +24,10 @@ public:
   bool Init(const char *Type, int NumDevices);
   int Count(void) { return numDevices; };
   bool Assign(int deviceIdP);
+  bool Unassign(int deviceIdP);
+  int Available(int deviceIdP);
+  int Used(void);
+  bool IsAssigned(int deviceIdP);
   bool Attach(int deviceIdP);
   bool Detach(int deviceIdP);
   cString DeviceIDList(void);
@@ -45,20 +49,41 @@ private:
   enum {
     eSatipMaxSourceFilters = 16
   };
+  enum {
+    eScoreFrontend = 100,
+    eScoreAssigned = 400,
+    eScoreSticky   = 1000
+  };
+  enum {
+    eTuningLimit = 2
+  };
+  enum {
+    eDepartedGraceMs = 10000 // in milliseconds
+  };
   cString srcAddressM;
   cString addressM;
   cString modelM;
   cString filtersM;
   cString descriptionM;
   cString quirksM;
+  unsigned int idM;
   cSatipFrontends frontends[eSatipFrontendCount];
   int sourceFiltersM[eSatipMaxSourceFilters];
+  int transpondersM[SATIP_MAX_DEVICES];
+  int bitratesM[SATIP_MAX_DEVICES];
   int portM;
+  int lossM;
+  int roundTripM;
+  int qualityM;
+  int tuningsM;
   int quirkM;
   bool hasCiM;
   bool activeM;
+  bool cachedM;
+  bool departedM;
   time_t createdM;
   cTimeMs lastSeenM;
+  cTimeMs departedTimeM;
   bool IsValidSource(int sourceP);
 
 public:
@@ -78,9 +103,21 @@ public:
   virtual ~cSatipServer();
   virtual int Compare(const cListObject &listObjectP) const;
   bool Assign(int deviceIdP, int sourceP, int systemP);
+  void Unassign(int deviceIdP);
   bool Matches(int sourceP);
-  void Attach(int deviceIdP);
+  bool HasModules(int sourceP);
+  int Available(int deviceIdP, int sourceP, int systemP);
+  int Score(int deviceIdP, int transponderP, int availableP);
+  void Attach(int deviceIdP, int transponderP);
   void Detach(int deviceIdP);
+  void UpdateHealth(int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP);
+  int Bitrate(void);
+  int Streams(void);
+  int Frontends(void);
+  int UsedFrontends(void);
+  int TuningLimit(void);
+  bool AddTuning(void);
+  void RemoveTuning(void)       { if (tuningsM > 0) --tuningsM; }
   int GetModulesDVBS2(void);
   int GetModulesDVBT(void);
   int GetModulesDVBT2(void);
@@ -95,35 +132,111 @@ public:
   const char *Description(void) { return *descriptionM; }
   const char *Quirks(void)      { return *quirksM; }
   int Port(void)                { return portM; }
+  int SourceFilter(int indexP)  { return (indexP >= 0 && indexP < eSatipMaxSourceFilters) ? sourceFiltersM[indexP] : 0; }
+  int QuirkMask(void)           { return quirkM; }
+  unsigned int Id(void)         { return idM; }
+  void SetId(unsigned int idP)  { idM = idP; }
+  int Loss(void)                { return lossM; }
+  int RoundTrip(void)           { return roundTripM; }
+  int Quality(void)             { return qualityM; }
   bool Quirk(int quirkP)        { return ((quirkP & eSatipQuirkMask) & quirkM); }
   bool HasQuirk(void)           { return (quirkM != eSatipQuirkNone); }
   bool HasCI(void)              { return hasCiM; }
-  bool IsActive(void)           { return activeM; }
-  void Update(void)             { lastSeenM.Set(); }
+  bool IsActive(void)           { return activeM && !departedM; }
+  void Update(void)             { lastSeenM.Set(); cachedM = false; departedM = false; }
+  void Depart(void)             { departedM = true; departedTimeM.Set(); }
+  bool IsDeparted(void)         { return departedM; }
+  // the devices may still hold the pointer of a departed server for a while
+  bool IsExpired(void)          { return departedM && (departedTimeM.Elapsed() > eDepartedGraceMs); }
+  void SetCached(bool onOffP)   { cachedM = onOffP; }
+  bool IsCached(void)           { return cachedM; }
   uint64_t LastSeen(void)       { return lastSeenM.Elapsed(); }
   time_t Created(void)          { return createdM; }
 };
 
+// --- cSatipServerHandle -----------------------------------------------------
+
+class cSatipServerHandle {
+private:
+  unsigned int idM;
+  int quirkM;
+  int portM;
+  bool hasCiM;
+  cString addressM;
+  cString srcAddressM;
+
+public:
+  cSatipServerHandle(void) : idM(0), quirkM(cSatipServer::eSatipQuirkNone), portM(SATIP_DEFAULT_RTSP_PORT), hasCiM(false), addressM(""), srcAddressM("") {}
+  void Set(cSatipServer *serverP);
+  void Reset(void)              { *this = cSatipServerHandle(); }
+  unsigned int Id(void) const   { return idM; }
+  bool IsValid(void) const      { return !!idM; }
+  bool Quirk(int quirkP) const  { return ((quirkP & cSatipServer::eSatipQuirkMask) & quirkM); }
+  bool HasCI(void) const        { return hasCiM; }
+  int Port(void) const          { return portM; }
+  const char *Address(void)     { return *addressM; }
+  const char *SrcAddress(void)  { return *srcAddressM; }
+};
+
 // --- cSatipServers ----------------------------------------------------------
 
 class cSatipServers : public cList<cSatipServer> {
+private:
+  cHash<cSatipServer> indexM;
+  unsigned int lastIdM;
+
 public:
+  cSatipServers(void) : indexM(), lastIdM(0) {}
+  void Add(cSatipServer *serverP);
+  void Del(cSatipServer *serverP);
+  cSatipServer *Get(unsigned int idP) { return idP ? indexM.Get(idP) : NULL; }
+  bool GetHandle(cSatipServer *serverP, cSatipServerHandle &handleP);
   cSatipServer *Find(cSatipServer *serverP);
   cSatipServer *Find(int sourceP);
-  cSatipServer *Assign(int deviceIdP, int sourceP, int transponderP, int systemP);
+  cSatipServer *Assign(int deviceIdP, int sourceP, int transponderP, int systemP, unsigned int excludeIdP = 0);
+  void Unassign(cSatipServer *serverP, int deviceIdP);
   cSatipServer *Update(cSatipServer *serverP);
   void Activate(cSatipServer *serverP, bool onOffP);
-  void Attach(cSatipServer *serverP, int deviceIdP);
-  void Detach(cSatipServer *serverP, int deviceIdP);
+  void Attach(unsigned int idP, int deviceIdP, int transponderP);
+  void Detach(unsigned int idP, int deviceIdP);
+  void UpdateHealth(unsigned int idP, int deviceIdP, int lossP, int roundTripP, int qualityP, int bitrateP);
   bool IsQuirk(cSatipServer *serverP, int quirkP);
   bool HasCI(cSatipServer *serverP);
   void Cleanup(uint64_t intervalMsP = 0);
+  void CleanupCached(void);
+  void Depart(const char *addressP, cVector<unsigned int> &departedP);
   cString GetAddress(cSatipServer *serverP);
   cString GetSrcAddress(cSatipServer *serverP);
   cString GetString(cSatipServer *serverP);
   int GetPort(cSatipServer *serverP);
   cString List(void);
+  cString Load(void);
+  cString Metrics(void);
   int NumProvidedSystems(void);
 };
 
+// --- cSatipSourceIndex ------------------------------------------------------
+
+class cSatipSourceIndex {
+private:
+  enum {
+    eMaxSources = 64
+  };
+  bool validM;
+  unsigned int typesM;
+  int providedCountM;
+  int providedM[eMaxSources];
+  int disabledCountM;
+  int disabledM[eMaxSources];
+  static unsigned int TypeBit(int sourceP);
+  static bool Contains(const int *sourcesP, int countP, int sourceP);
+  bool Insert(int *sourcesP, int &countP, int sourceP);
+
+public:
+  cSatipSourceIndex(void);
+  void Build(cSatipServers &serversP);
+  bool IsValid(void) const      { return validM; }
+  bool Provides(int sourceP) const;
+};
+
 #endif // __SATIP_SERVER_H
@@ -363,6 +363,14 @@ cSatipPluginSetup::cSatipPluginSetup()
   transportModeM(SatipConfig.GetTransportMode()),
   ciExtensionM(SatipConfig.GetCIExtension()),
   frontendReuseM(SatipConfig.GetFrontendReuse()),
+  rtcpLockDetectionM(SatipConfig.GetRtcpLockDetection()),
+  failoverTimeoutM(SatipConfig.GetFailoverTimeout()),
+  healthPeriodM(SatipConfig.GetHealthPeriod()),
+  healthMinQualityM(SatipConfig.GetHealthMinQuality()),
+  tuningLimitM(SatipConfig.GetTuningLimit()),
+  bufferSizeLimitM(SatipConfig.GetBufferSizeLimit()),
+  overflowPolicyM(SatipConfig.GetOverflowPolicy()),
+  multicastSharingM(SatipConfig.GetMulticastSharing()),
   eitScanM(SatipConfig.GetEITScan()),
   numDisabledSourcesM(SatipConfig.GetDisabledSourcesCount()),
   numDisabledFiltersM(SatipConfig.GetDisabledFiltersCount())
@@ -375,6 +383,9 @@ cSatipPluginSetup::cSatipPluginSetup()
   transportModeTextsM[cSatipConfig::eTransportModeUnicast]    = tr("Unicast");
   transportModeTextsM[cSatipConfig::eTransportModeMulticast]  = tr("Multicast");
   transportModeTextsM[cSatipConfig::eTransportModeRtpOverTcp] = tr("RTP-over-TCP");
+  overflowPolicyTextsM[cSatipConfig::eOverflowPolicyDropDatagram]    = tr("drop datagram");
+  overflowPolicyTextsM[cSatipConfig::eOverflowPolicyDropLowPriority] = tr("drop low priority");
+  overflowPolicyTextsM[cSatipConfig::eOverflowPolicyDropOldest]      = tr("drop oldest");
   for (unsigned int i = 0; i < ELEMENTS(ciAssignedDevice); ++i)
       ciAssignedDevice[i] = SatipConfig.GetCIAssignedDevice(i);
   if (numDisabledSourcesM > MAX_DISABLED_SOURCES_COUNT)
@@ -437,9 +448,33 @@ void cSatipPluginSetup::Setup(void)
   Add(new cMenuEditStraItem(tr("Transport mode"), &transportModeM, ELEMENTS(transportModeTextsM), transportModeTextsM));
   helpM.Append(tr("Define which transport mode shall be used.\n\nUnicast, Multicast, RTP-over-TCP"));
 
+  Add(new cMenuEditBoolItem(tr("Enable multicast sharing"), &multicastSharingM));
+  helpM.Append(tr("Define whether multicast streams shall be shared with other VDRs in the local network.\n\nA VDR owning a multicast stream announces it and the others join it instead of occupying another frontend."));
+
   Add(new cMenuEditBoolItem(tr("Enable frontend reuse"), &frontendReuseM));
   helpM.Append(tr("Define whether reusing a frontend for multiple channels in a transponder should be enabled."));
 
+  Add(new cMenuEditBoolItem(tr("Enable RTCP lock detection"), &rtcpLockDetectionM));
+  helpM.Append(tr("Define whether the frontend lock shall be detected from the RTCP reception reports.\n\nThis setting avoids the periodic DESCRIBE requests while tuning as long as the SAT>IP server keeps sending RTCP reports."));
+
+  Add(new cMenuEditIntItem(tr("RTP failover timeout [ms]"), &failoverTimeoutM, 0, 5000, tr("off")));
+  helpM.Append(tr("Define the time without RTP data after which a live or recording stream is moved to another SAT>IP server serving the same source.\n\nThe stream is otherwise retuned on the same server after five seconds."));
+
+  Add(new cMenuEditIntItem(tr("Stream health period [s]"), &healthPeriodM, 0, 60, tr("off")));
+  helpM.Append(tr("Define how long a stream may suffer from RTP losses, TS continuity errors, buffer overflows or a weak signal before it is retuned.\n\nIf the stream degrades again, it is moved to another frontend or SAT>IP server."));
+
+  Add(new cMenuEditIntItem(tr("Minimum signal quality [%]"), &healthMinQualityM, 0, 100, tr("off")));
+  helpM.Append(tr("Define the signal quality reported by the SAT>IP server below which a stream is considered degraded by the stream health check."));
+
+  Add(new cMenuEditIntItem(tr("Parallel tunings per server"), &tuningLimitM, 0, 8, tr("auto")));
+  helpM.Append(tr("Define how many devices may tune simultaneously on the same SAT>IP server.\n\nThe automatic setting allows two parallel tunings, or only one for servers with tuning related quirks."));
+
+  Add(new cMenuEditIntItem(tr("Buffer size limit [MB]"), &bufferSizeLimitM, 1, 64));
+  helpM.Append(tr("Define the size up to which the TS and section buffers of a device may grow on sustained overflows.\n\nThe buffers start at 2 MB and shrink again when idle."));
+
+  Add(new cMenuEditStraItem(tr("Buffer overflow policy"), &overflowPolicyM, ELEMENTS(overflowPolicyTextsM), overflowPolicyTextsM));
+  helpM.Append(tr("Define which data is dropped when the TS buffer of a device overflows.\n\ndrop datagram - drop the whole incoming datagram\ndrop low priority - drop packets of pids not requested by any receiver first, e.g. EIT\ndrop oldest - skip the oldest buffered data"));
+
   Add(new cOsdItem(tr("Active SAT>IP servers:"), osUnknown, false));
   helpM.Append("");
 
@@ -600,6 +635,14 @@ void cSatipPluginSetup::Store(void)
   SetupStore("TransportMode", transportModeM);
   SetupStore("EnableCIExtension", ciExtensionM);
   SetupStore("EnableFrontendReuse", frontendReuseM);
+  SetupStore("EnableRtcpLockDetection", rtcpLockDetectionM);
+  SetupStore("FailoverTimeout", failoverTimeoutM);
+  SetupStore("HealthPeriod", healthPeriodM);
+  SetupStore("HealthMinQuality", healthMinQualityM);
+  SetupStore("TuningLimit", tuningLimitM);
+  SetupStore("BufferSizeLimit", bufferSizeLimitM);
+  SetupStore("OverflowPolicy", overflowPolicyM);
+  SetupStore("EnableMulticastSharing", multicastSharingM);
   SetupStore("EnableEITScan", eitScanM);
   StoreCiAssignedDevices("CIAssignedDevice", ciAssignedDevice);
   StoreSources("DisabledSources", disabledSourcesM);
@@ -608,6 +651,14 @@ void cSatipPluginSetup::Store(void)
   SatipConfig.SetOperatingMode(operatingModeM);
   SatipConfig.SetTransportMode(transportModeM);
   SatipConfig.SetCIExtension(ciExtensionM);
+  SatipConfig.SetRtcpLockDetection(rtcpLockDetectionM);
+  SatipConfig.SetFailoverTimeout(failoverTimeoutM);
+  SatipConfig.SetHealthPeriod(healthPeriodM);
+  SatipConfig.SetHealthMinQuality(healthMinQualityM);
+  SatipConfig.SetTuningLimit(tuningLimitM);
+  SatipConfig.SetBufferSizeLimit(bufferSizeLimitM);
+  SatipConfig.SetOverflowPolicy(overflowPolicyM);
+  SatipConfig.SetMulticastSharing(multicastSharingM);
   SatipConfig.SetEITScan(eitScanM);
   for (int i = 0; i < MAX_CICAM_COUNT; ++i)
       SatipConfig.SetCIAssignedDevice(i, ciAssignedDevice[i]);
@@ -615,4 +666,5 @@ void cSatipPluginSetup::Store(void)
       SatipConfig.SetDisabledSources(i, disabledSourcesM[i]);
   for (int i = 0; i < SECTION_FILTER_TABLE_SIZE; ++i)
       SatipConfig.SetDisabledFilters(i, disabledFilterIndexesM[i]);
+  cSatipDiscover::GetInstance()->UpdateSourceIndex();
 }
@@ -23,6 +23,15 @@ private:
   const char *transportModeTextsM[cSatipConfig::eTransportModeCount];
   int ciExtensionM;
   int frontendReuseM;
+  int rtcpLockDetectionM;
+  int failoverTimeoutM;
+  int healthPeriodM;
+  int healthMinQualityM;
+  int tuningLimitM;
+  int bufferSizeLimitM;
+  int overflowPolicyM;
+  const char *overflowPolicyTextsM[cSatipConfig::eOverflowPolicyCount];
+  int multicastSharingM;
   int ciAssignedDevice[SATIP_MAX_DEVICES];
   int eitScanM;
   int numDisabledSourcesM;
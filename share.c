@@ -0,0 +1,377 @@
+/*
+ * share.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <unistd.h>
+
+#include "config.h"
+#include "common.h"
+#include "discover.h"
+#include "log.h"
+#include "share.h"
+
+// --- cSatipShareStreams -----------------------------------------------------
+
+cSatipShareStream *cSatipShareStreams::Find(const char *usnP)
+{
+  for (cSatipShareStream *s = First(); s; s = Next(s)) {
+      if (!strcmp(s->Usn(), usnP))
+         return s;
+      }
+  return NULL;
+}
+
+cSatipShareStream *cSatipShareStreams::Find(int deviceIdP)
+{
+  for (cSatipShareStream *s = First(); s; s = Next(s)) {
+      if (s->DeviceId() == deviceIdP)
+         return s;
+      }
+  return NULL;
+}
+
+bool cSatipShareStreams::Cleanup(uint64_t maxAgeMsP)
+{
+  bool removed = false;
+  for (cSatipShareStream *s = First(); s; ) {
+      cSatipShareStream *next = Next(s);
+      if (s->LastSeen() > maxAgeMsP) {
+         info("Shared stream '%s' from '%s' expired", s->Params(), s->Server());
+         Del(s);
+         removed = true;
+         }
+      s = next;
+      }
+  return removed;
+}
+
+// --- cSatipShareClients -----------------------------------------------------
+
+cSatipShareClient *cSatipShareClients::Find(const char *usnP)
+{
+  for (cSatipShareClient *c = First(); c; c = Next(c)) {
+      if (!strcmp(c->Usn(), usnP))
+         return c;
+      }
+  return NULL;
+}
+
+cSatipShareClient *cSatipShareClients::Find(int deviceIdP)
+{
+  for (cSatipShareClient *c = First(); c; c = Next(c)) {
+      if (c->DeviceId() == deviceIdP)
+         return c;
+      }
+  return NULL;
+}
+
+int cSatipShareClients::Count(const char *streamP)
+{
+  int count = 0;
+  for (cSatipShareClient *c = First(); c; c = Next(c)) {
+      if (!strcmp(c->Stream(), streamP))
+         ++count;
+      }
+  return count;
+}
+
+bool cSatipShareClients::Cleanup(uint64_t maxAgeMsP)
+{
+  bool removed = false;
+  for (cSatipShareClient *c = First(); c; ) {
+      cSatipShareClient *next = Next(c);
+      if (c->LastSeen() > maxAgeMsP) {
+         debug1("%s Client '%s' expired", __PRETTY_FUNCTION__, c->Usn());
+         Del(c);
+         removed = true;
+         }
+      c = next;
+      }
+  return removed;
+}
+
+// --- cSatipShare ------------------------------------------------------------
+
+cSatipShare *cSatipShare::instanceS = NULL;
+
+// The announcements use the SSDP multicast group, but with own notification types
+// that the SAT>IP servers and other control points simply ignore
+const char *cSatipShare::streamTypeS = "urn:vdr-plugin-satip:stream:1";
+const char *cSatipShare::clientTypeS = "urn:vdr-plugin-satip:client:1";
+
+cSatipShare *cSatipShare::GetInstance(void)
+{
+  if (!instanceS)
+     instanceS = new cSatipShare();
+  return instanceS;
+}
+
+void cSatipShare::Destroy(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  if (instanceS)
+     instanceS->Deactivate();
+}
+
+cSatipShare::cSatipShare()
+: mutexM(),
+  instanceM(""),
+  remoteM(),
+  ownedM(),
+  clientsM(),
+  joinedM(),
+  announceM(0)
+{
+  char hostname[64] = "vdr";
+  gethostname(hostname, sizeof(hostname) - 1);
+  hostname[sizeof(hostname) - 1] = 0;
+  instanceM = cString::sprintf("uuid:%s-%d-%ld", hostname, getpid(), (long)time(NULL));
+  debug1("%s instance=%s", __PRETTY_FUNCTION__, *instanceM);
+}
+
+cSatipShare::~cSatipShare()
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+}
+
+void cSatipShare::Deactivate(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  cMutexLock MutexLock(&mutexM);
+  // Tell the other VDRs that the streams and the clients are gone
+  for (cSatipShareStream *s = ownedM.First(); s; s = ownedM.Next(s))
+      AnnounceStream(s, false);
+  for (cSatipShareClient *c = joinedM.First(); c; c = joinedM.Next(c))
+      AnnounceClient(c, false);
+  ownedM.Clear();
+  clientsM.Clear();
+  joinedM.Clear();
+  remoteM.Clear();
+}
+
+cString cSatipShare::StreamUsn(int deviceIdP)
+{
+  return cString::sprintf("%s::stream:%d", *instanceM, deviceIdP);
+}
+
+cString cSatipShare::ClientUsn(int deviceIdP)
+{
+  return cString::sprintf("%s::client:%d", *instanceM, deviceIdP);
+}
+
+void cSatipShare::AnnounceStream(cSatipShareStream *streamP, bool aliveP)
+{
+  debug16("%s (%s, %d)", __PRETTY_FUNCTION__, streamP->Usn(), aliveP);
+  cString msg = cString::sprintf("NOTIFY * HTTP/1.1\r\n"
+                                 "HOST: 239.255.255.250:1900\r\n"
+                                 "CACHE-CONTROL: max-age=%d\r\n"
+                                 "NT: %s\r\n"
+                                 "NTS: %s\r\n"
+                                 "USN: %s\r\n"
+                                 "X-SATIP-SERVER: %s\r\n"
+                                 "X-SATIP-PARAMS: %s\r\n"
+                                 "X-SATIP-DESTINATION: %s\r\n"
+                                 "X-SATIP-PORT: %d-%d\r\n"
+                                 "X-SATIP-SOURCE: %s\r\n\r\n",
+                                 eMaxAgeMs / 1000, streamTypeS, aliveP ? "ssdp:alive" : "ssdp:byebye", streamP->Usn(),
+                                 streamP->Server(), streamP->Params(), streamP->Group(), streamP->RtpPort(), streamP->RtcpPort(),
+                                 !isempty(streamP->Source()) ? streamP->Source() : "-");
+  cSatipDiscover::GetInstance()->Announce(*msg);
+}
+
+void cSatipShare::AnnounceClient(cSatipShareClient *clientP, bool aliveP)
+{
+  debug16("%s (%s, %d)", __PRETTY_FUNCTION__, clientP->Usn(), aliveP);
+  cString msg = cString::sprintf("NOTIFY * HTTP/1.1\r\n"
+                                 "HOST: 239.255.255.250:1900\r\n"
+                                 "CACHE-CONTROL: max-age=%d\r\n"
+                                 "NT: %s\r\n"
+                                 "NTS: %s\r\n"
+                                 "USN: %s\r\n"
+                                 "X-SATIP-STREAM: %s\r\n\r\n",
+                                 eMaxAgeMs / 1000, clientTypeS, aliveP ? "ssdp:alive" : "ssdp:byebye", clientP->Usn(), clientP->Stream());
+  cSatipDiscover::GetInstance()->Announce(*msg);
+}
+
+void cSatipShare::Offer(int deviceIdP, const char *serverP, const char *paramsP, const char *groupP, int rtpPortP, int rtcpPortP, const char *sourceP)
+{
+  debug1("%s (%d, %s, %s, %s, %d, %d, %s)", __PRETTY_FUNCTION__, deviceIdP, serverP, paramsP, groupP, rtpPortP, rtcpPortP, sourceP);
+  cMutexLock MutexLock(&mutexM);
+  cSatipShareStream *s = ownedM.Find(deviceIdP);
+  if (s) {
+     AnnounceStream(s, false);
+     ownedM.Del(s);
+     }
+  s = new cSatipShareStream(*StreamUsn(deviceIdP), serverP, paramsP, groupP, rtpPortP, rtcpPortP, sourceP, deviceIdP);
+  ownedM.Add(s);
+  AnnounceStream(s, true);
+}
+
+void cSatipShare::Withdraw(int deviceIdP)
+{
+  cMutexLock MutexLock(&mutexM);
+  cSatipShareStream *s = ownedM.Find(deviceIdP);
+  if (s) {
+     debug1("%s (%d) clients=%d", __PRETTY_FUNCTION__, deviceIdP, clientsM.Count(s->Usn()));
+     AnnounceStream(s, false);
+     // The clients fall back to their own sessions after the byebye
+     for (cSatipShareClient *c = clientsM.First(); c; ) {
+         cSatipShareClient *next = clientsM.Next(c);
+         if (!strcmp(c->Stream(), s->Usn()))
+            clientsM.Del(c);
+         c = next;
+         }
+     ownedM.Del(s);
+     }
+}
+
+bool cSatipShare::HasClients(int deviceIdP)
+{
+  cMutexLock MutexLock(&mutexM);
+  cSatipShareStream *s = ownedM.Find(deviceIdP);
+  return (s && clientsM.Count(s->Usn()));
+}
+
+bool cSatipShare::Join(int deviceIdP, const char *serverP, const char *paramsP, cString &groupP, int &rtpPortP, int &rtcpPortP, cString &sourceP)
+{
+  cMutexLock MutexLock(&mutexM);
+  for (cSatipShareStream *s = remoteM.First(); s; s = remoteM.Next(s)) {
+      if (s->Matches(serverP, paramsP)) {
+         debug1("%s (%d, %s, %s) stream=%s", __PRETTY_FUNCTION__, deviceIdP, serverP, paramsP, s->Usn());
+         cSatipShareClient *c = joinedM.Find(deviceIdP);
+         if (c) {
+            AnnounceClient(c, false);
+            joinedM.Del(c);
+            }
+         c = new cSatipShareClient(*ClientUsn(deviceIdP), s->Usn(), deviceIdP);
+         joinedM.Add(c);
+         AnnounceClient(c, true);
+         groupP = s->Group();
+         rtpPortP = s->RtpPort();
+         rtcpPortP = s->RtcpPort();
+         sourceP = s->Source();
+         return true;
+         }
+      }
+  return false;
+}
+
+void cSatipShare::Leave(int deviceIdP, bool forgetP)
+{
+  cMutexLock MutexLock(&mutexM);
+  cSatipShareClient *c = joinedM.Find(deviceIdP);
+  if (c) {
+     debug1("%s (%d, %d) stream=%s", __PRETTY_FUNCTION__, deviceIdP, forgetP, c->Stream());
+     AnnounceClient(c, false);
+     // Forget a failing stream until its owner announces it again
+     cSatipShareStream *s = forgetP ? remoteM.Find(c->Stream()) : NULL;
+     if (s)
+        remoteM.Del(s);
+     joinedM.Del(c);
+     }
+}
+
+bool cSatipShare::IsJoined(int deviceIdP)
+{
+  cMutexLock MutexLock(&mutexM);
+  cSatipShareClient *c = joinedM.Find(deviceIdP);
+  return (c && remoteM.Find(c->Stream()));
+}
+
+void cSatipShare::Process(const char *messageP)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  char *s, *p = strdup(messageP);
+  char *usn = NULL, *server = NULL, *params = NULL, *group = NULL, *source = NULL, *stream = NULL;
+  bool isStream = false, isClient = false, alive = false, byebye = false;
+  int rtp = -1, rtcp = -1;
+  char *r = strtok_r(p, "\r\n", &s);
+  while ((r = strtok_r(NULL, "\r\n", &s)) != NULL) {
+        if (strcasestr(r, "NT:") == r) {
+           char *nt = compactspace(r + 3);
+           isStream = !strcmp(nt, streamTypeS);
+           isClient = !strcmp(nt, clientTypeS);
+           }
+        else if (strcasestr(r, "NTS:") == r) {
+           char *nts = compactspace(r + 4);
+           alive = !strcmp(nts, "ssdp:alive");
+           byebye = !strcmp(nts, "ssdp:byebye");
+           }
+        else if (strcasestr(r, "USN:") == r)
+           usn = compactspace(r + 4);
+        else if (strcasestr(r, "X-SATIP-SERVER:") == r)
+           server = compactspace(r + 15);
+        else if (strcasestr(r, "X-SATIP-PARAMS:") == r)
+           params = compactspace(r + 15);
+        else if (strcasestr(r, "X-SATIP-DESTINATION:") == r)
+           group = compactspace(r + 20);
+        else if (strcasestr(r, "X-SATIP-PORT:") == r) {
+           if (sscanf(r + 13, "%11d-%11d", &rtp, &rtcp) != 2)
+              rtp = rtcp = -1;
+           }
+        else if (strcasestr(r, "X-SATIP-SOURCE:") == r) {
+           source = compactspace(r + 15);
+           if (!strcmp(source, "-"))
+              source = NULL;
+           }
+        else if (strcasestr(r, "X-SATIP-STREAM:") == r)
+           stream = compactspace(r + 15);
+        }
+  // Ignore the own announcements looped back by the network stack
+  if (!isempty(usn) && !startswith(usn, *instanceM)) {
+     cMutexLock MutexLock(&mutexM);
+     if (isStream) {
+        cSatipShareStream *st = remoteM.Find(usn);
+        if (alive && !isempty(server) && !isempty(params) && !isempty(group) && (rtp > 0) && (rtcp > 0)) {
+           if (st && st->Matches(server, params))
+              st->Touch();
+           else {
+              if (st)
+                 remoteM.Del(st);
+              info("Shared stream '%s' from '%s' available at %s:%d", params, server, group, rtp);
+              remoteM.Add(new cSatipShareStream(usn, server, params, group, rtp, rtcp, source ? source : ""));
+              }
+           }
+        else if (byebye && st) {
+           info("Shared stream '%s' from '%s' withdrawn", st->Params(), st->Server());
+           remoteM.Del(st);
+           }
+        }
+     else if (isClient && !isempty(stream)) {
+        cSatipShareClient *c = clientsM.Find(usn);
+        if (alive && ownedM.Find(stream)) {
+           if (c && !strcmp(c->Stream(), stream))
+              c->Touch();
+           else {
+              if (c)
+                 clientsM.Del(c);
+              debug1("%s Client '%s' joined '%s'", __PRETTY_FUNCTION__, usn, stream);
+              clientsM.Add(new cSatipShareClient(usn, stream));
+              }
+           }
+        else if (byebye && c) {
+           debug1("%s Client '%s' left '%s'", __PRETTY_FUNCTION__, usn, c->Stream());
+           clientsM.Del(c);
+           }
+        }
+     }
+  FREE_POINTER(p);
+}
+
+void cSatipShare::Refresh(void)
+{
+  debug16("%s", __PRETTY_FUNCTION__);
+  cMutexLock MutexLock(&mutexM);
+  remoteM.Cleanup(eMaxAgeMs);
+  clientsM.Cleanup(eMaxAgeMs);
+  if (announceM.TimedOut()) {
+     announceM.Set(eAnnounceIntervalMs);
+     for (cSatipShareStream *s = ownedM.First(); s; s = ownedM.Next(s))
+         AnnounceStream(s, true);
+     for (cSatipShareClient *c = joinedM.First(); c; c = joinedM.Next(c))
+         AnnounceClient(c, true);
+     }
+}
@@ -0,0 +1,118 @@
+/*
+ * share.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_SHARE_H
+#define __SATIP_SHARE_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+class cSatipShareStream : public cListObject {
+private:
+  cString usnM;
+  cString serverM;
+  cString paramsM;
+  cString groupM;
+  cString sourceM;
+  int deviceIdM;
+  int rtpPortM;
+  int rtcpPortM;
+  cTimeMs seenM;
+public:
+  cSatipShareStream(const char *usnP, const char *serverP, const char *paramsP, const char *groupP, int rtpPortP, int rtcpPortP, const char *sourceP, int deviceIdP = -1)
+  {
+     usnM = usnP; serverM = serverP; paramsM = paramsP; groupM = groupP; rtpPortM = rtpPortP; rtcpPortM = rtcpPortP; sourceM = sourceP; deviceIdM = deviceIdP; seenM.Set();
+  }
+  const char *Usn(void)         { return *usnM; }
+  const char *Server(void)      { return *serverM; }
+  const char *Params(void)      { return *paramsM; }
+  const char *Group(void)       { return *groupM; }
+  const char *Source(void)      { return *sourceM; }
+  int DeviceId(void)            { return deviceIdM; }
+  int RtpPort(void)             { return rtpPortM; }
+  int RtcpPort(void)            { return rtcpPortM; }
+  uint64_t LastSeen(void)       { return seenM.Elapsed(); }
+  void Touch(void)              { seenM.Set(); }
+  bool Matches(const char *serverP, const char *paramsP) { return (!strcmp(*serverM, serverP) && !strcmp(*paramsM, paramsP)); }
+};
+
+class cSatipShareStreams : public cList<cSatipShareStream> {
+public:
+  cSatipShareStream *Find(const char *usnP);
+  cSatipShareStream *Find(int deviceIdP);
+  bool Cleanup(uint64_t maxAgeMsP);
+};
+
+class cSatipShareClient : public cListObject {
+private:
+  cString usnM;
+  cString streamM;
+  int deviceIdM;
+  cTimeMs seenM;
+public:
+  cSatipShareClient(const char *usnP, const char *streamP, int deviceIdP = -1)
+  {
+     usnM = usnP; streamM = streamP; deviceIdM = deviceIdP; seenM.Set();
+  }
+  const char *Usn(void)         { return *usnM; }
+  const char *Stream(void)      { return *streamM; }
+  int DeviceId(void)            { return deviceIdM; }
+  uint64_t LastSeen(void)       { return seenM.Elapsed(); }
+  void Touch(void)              { seenM.Set(); }
+};
+
+class cSatipShareClients : public cList<cSatipShareClient> {
+public:
+  cSatipShareClient *Find(const char *usnP);
+  cSatipShareClient *Find(int deviceIdP);
+  int Count(const char *streamP);
+  bool Cleanup(uint64_t maxAgeMsP);
+};
+
+class cSatipShare {
+private:
+  enum {
+    eAnnounceIntervalMs = 10000, // in milliseconds
+    eMaxAgeMs           = 35000  // in milliseconds
+  };
+  static cSatipShare *instanceS;
+  static const char *streamTypeS;
+  static const char *clientTypeS;
+  cMutex mutexM;
+  cString instanceM;
+  cSatipShareStreams remoteM;
+  cSatipShareStreams ownedM;
+  cSatipShareClients clientsM;
+  cSatipShareClients joinedM;
+  cTimeMs announceM;
+  cString StreamUsn(int deviceIdP);
+  cString ClientUsn(int deviceIdP);
+  void AnnounceStream(cSatipShareStream *streamP, bool aliveP);
+  void AnnounceClient(cSatipShareClient *clientP, bool aliveP);
+  void Deactivate(void);
+  // constructor
+  cSatipShare();
+  // to prevent copy constructor and assignment
+  cSatipShare(const cSatipShare&);
+  cSatipShare& operator=(const cSatipShare&);
+
+public:
+  static cSatipShare *GetInstance(void);
+  static void Destroy(void);
+  static const char *TypePrefix(void) { return "urn:vdr-plugin-satip:"; }
+  virtual ~cSatipShare();
+  void Offer(int deviceIdP, const char *serverP, const char *paramsP, const char *groupP, int rtpPortP, int rtcpPortP, const char *sourceP);
+  void Withdraw(int deviceIdP);
+  bool HasClients(int deviceIdP);
+  bool Join(int deviceIdP, const char *serverP, const char *paramsP, cString &groupP, int &rtpPortP, int &rtcpPortP, cString &sourceP);
+  void Leave(int deviceIdP, bool forgetP = false);
+  bool IsJoined(int deviceIdP);
+  void Process(const char *messageP);
+  void Refresh(void);
+};
+
+#endif // __SATIP_SHARE_H
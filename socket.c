@@ -10,6 +10,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <vdr/device.h>
@@ -34,7 +35,8 @@ cSatipSocket::cSatipSocket()
   useSsmM(false),
   streamAddrM(htonl(INADDR_ANY)),
   sourceAddrM(htonl(INADDR_ANY)),
-  rcvBufSizeM(0)
+  rcvBufSizeM(0),
+  timestampsM(false)
 {
   debug1("%s", __PRETTY_FUNCTION__);
   memset(&sockAddrM, 0, sizeof(sockAddrM));
@@ -47,7 +49,8 @@ cSatipSocket::cSatipSocket(size_t rcvBufSizeP)
   useSsmM(false),
   streamAddrM(htonl(INADDR_ANY)),
   sourceAddrM(htonl(INADDR_ANY)),
-  rcvBufSizeM(rcvBufSizeP)
+  rcvBufSizeM(rcvBufSizeP),
+  timestampsM(false)
 {
   debug1("%s", __PRETTY_FUNCTION__);
   memset(&sockAddrM, 0, sizeof(sockAddrM));
@@ -97,6 +100,13 @@ bool cSatipSocket::Open(const int portP, const bool reuseP)
         ERROR_IF_FUNC(setsockopt(socketDescM, SOL_SOCKET, SO_RCVBUF, &rcvBufSizeM, sizeof(rcvBufSizeM)) < 0,
                       "setsockopt(SO_RCVBUF)", Close(), return false);
      }
+#ifdef SO_TIMESTAMPNS
+     // Let the kernel stamp the arrival time of each packet if requested
+     if (timestampsM) {
+        yes = 1;
+        ERROR_IF(setsockopt(socketDescM, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(yes)) < 0, "setsockopt(SO_TIMESTAMPNS)");
+        }
+#endif // SO_TIMESTAMPNS
      // Bind socket
      memset(&sockAddrM, 0, sizeof(sockAddrM));
      sockAddrM.sin_family = AF_INET;
@@ -126,6 +136,21 @@ bool cSatipSocket::OpenMulticast(const int portP, const char *streamAddrP, const
   return false;
 }
 
+bool cSatipSocket::AddMembership(const char *groupAddrP)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, groupAddrP);
+  in_addr_t groupAddr;
+  // Unlike Join(), this keeps the unicast traffic flowing into the socket
+  if (socketDescM >= 0 && CheckAddress(groupAddrP, &groupAddr)) {
+     struct ip_mreq mreq;
+     mreq.imr_multiaddr.s_addr = groupAddr;
+     mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+     ERROR_IF_RET(setsockopt(socketDescM, SOL_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0, "setsockopt(IP_ADD_MEMBERSHIP)", return false);
+     return true;
+     }
+  return false;
+}
+
 void cSatipSocket::Close(void)
 {
   debug1("%s socketPort=%d", __PRETTY_FUNCTION__, socketPortM);
@@ -304,7 +329,7 @@ int cSatipSocket::Read(unsigned char *bufferAddrP, unsigned int bufferLenP)
   return 0;
 }
 
-int cSatipSocket::ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRecvSizeP, unsigned int elementCountP, unsigned int elementBufferSizeP)
+int cSatipSocket::ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRecvSizeP, unsigned int elementCountP, unsigned int elementBufferSizeP, uint64_t *elementTimeP)
 {
   debug16("%s (, , %d, %d)", __PRETTY_FUNCTION__, elementCountP, elementBufferSizeP);
   int count = -1;
@@ -321,19 +346,44 @@ int cSatipSocket::ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRec
   // Initialize iov and msgh structures
   struct mmsghdr mmsgh[elementCountP];
   struct iovec iov[elementCountP];
+#ifdef SO_TIMESTAMPNS
+  const unsigned int clen = CMSG_SPACE(sizeof(struct timespec));
+  char cbuf[(elementTimeP && timestampsM) ? elementCountP : 1][clen];
+#endif // SO_TIMESTAMPNS
   memset(mmsgh, 0, sizeof(mmsgh[0]) * elementCountP);
   for (unsigned int i = 0; i < elementCountP; ++i) {
       iov[i].iov_base = bufferAddrP + i * elementBufferSizeP;
       iov[i].iov_len = elementBufferSizeP;
       mmsgh[i].msg_hdr.msg_iov = &iov[i];
       mmsgh[i].msg_hdr.msg_iovlen = 1;
+#ifdef SO_TIMESTAMPNS
+      if (elementTimeP && timestampsM) {
+         mmsgh[i].msg_hdr.msg_control = cbuf[i];
+         mmsgh[i].msg_hdr.msg_controllen = clen;
+         }
+#endif // SO_TIMESTAMPNS
       }
 
   // Read data from socket as a set
   count = (int)recvmmsg(socketDescM, mmsgh, elementCountP, MSG_DONTWAIT, NULL);
   ERROR_IF_RET(count < 0 && errno != EAGAIN && errno != EWOULDBLOCK, "recvmmsg()", return -1);
-  for (int i = 0; i < count; ++i)
+  uint64_t now = elementTimeP ? Now() : 0;
+  for (int i = 0; i < count; ++i) {
       elementRecvSizeP[i] = mmsgh[i].msg_len;
+      if (elementTimeP) {
+         // Prefer the kernel receive timestamp over the time of reading
+         elementTimeP[i] = now;
+#ifdef SO_TIMESTAMPNS
+         for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mmsgh[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&mmsgh[i].msg_hdr, cmsg)) {
+             if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+                struct timespec *ts = (struct timespec *)CMSG_DATA(cmsg);
+                elementTimeP[i] = (uint64_t)ts->tv_sec * 1000000ULL + ts->tv_nsec / 1000;
+                break;
+                }
+             }
+#endif // SO_TIMESTAMPNS
+         }
+      }
 #else
   count = 0;
   while (count < (int)elementCountP) {
@@ -342,6 +392,8 @@ int cSatipSocket::ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRec
            return -1;
         else if (len == 0)
            break;
+        if (elementTimeP)
+           elementTimeP[count] = Now();
         elementRecvSizeP[count++] = len;
         }
 #endif
@@ -350,7 +402,6 @@ int cSatipSocket::ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRec
   return count;
 }
 
-
 bool cSatipSocket::Write(const char *addrP, const unsigned char *bufferAddrP, unsigned int bufferLenP)
 {
   debug1("%s (%s, , %d)", __PRETTY_FUNCTION__, addrP, bufferLenP);
@@ -367,3 +418,26 @@ bool cSatipSocket::Write(const char *addrP, const unsigned char *bufferAddrP, un
   ERROR_IF_RET(sendto(socketDescM, bufferAddrP, bufferLenP, 0, (struct sockaddr *)&sockAddr, sizeof(sockAddr)) < 0, "sendto()", return false);
   return true;
 }
+
+bool cSatipSocket::Reply(const unsigned char *bufferAddrP, unsigned int bufferLenP)
+{
+  debug16("%s (, %d)", __PRETTY_FUNCTION__, bufferLenP);
+  // Error out if socket not initialized
+  if (socketDescM <= 0) {
+     error("%s Invalid socket", __PRETTY_FUNCTION__);
+     return false;
+     }
+  // The address of the latest sender is known only after a successful read
+  if ((sockAddrM.sin_addr.s_addr == htonl(INADDR_ANY)) || !sockAddrM.sin_port)
+     return false;
+  ERROR_IF_RET(sendto(socketDescM, bufferAddrP, bufferLenP, 0, (struct sockaddr *)&sockAddrM, sizeof(sockAddrM)) < 0, "sendto()", return false);
+  return true;
+}
+
+uint64_t cSatipSocket::Now(void)
+{
+  // Same clock as the kernel uses for SO_TIMESTAMPNS, in microseconds
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
@@ -20,6 +20,7 @@ private:
   in_addr_t streamAddrM;
   in_addr_t sourceAddrM;
   size_t rcvBufSizeM;
+  bool timestampsM;
 
   bool CheckAddress(const char *addrP, in_addr_t *inAddrP);
   bool Join(void);
@@ -31,15 +32,19 @@ public:
   virtual ~cSatipSocket();
   bool Open(const int portP = 0, const bool reuseP = false);
   bool OpenMulticast(const int portP, const char *streamAddrP, const char *sourceAddrP);
+  bool AddMembership(const char *groupAddrP);
   virtual void Close(void);
   int Fd(void) { return socketDescM; }
   int Port(void) { return socketPortM; }
   bool IsMulticast(void) { return isMulticastM; }
   bool IsOpen(void) { return (socketDescM >= 0); }
+  void SetTimestamps(bool onP) { timestampsM = onP; }
   bool Flush(void);
   int Read(unsigned char *bufferAddrP, unsigned int bufferLenP);
-  int ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRecvSizeP, unsigned int elementCountP, unsigned int elementBufferSizeP);
+  int ReadMulti(unsigned char *bufferAddrP, unsigned int *elementRecvSizeP, unsigned int elementCountP, unsigned int elementBufferSizeP, uint64_t *elementTimeP = NULL);
   bool Write(const char *addrP, const unsigned char *bufferAddrP, unsigned int bufferLenP);
+  bool Reply(const unsigned char *bufferAddrP, unsigned int bufferLenP);
+  static uint64_t Now(void);
 };
 
 #endif // __SATIP_SOCKET_H
@@ -5,7 +5,13 @@
  *
  */
 
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
 
 #include "common.h"
 #include "statistics.h"
@@ -177,6 +183,13 @@ cSatipBufferStatistics::cSatipBufferStatistics()
 : dataBytesM(0),
   freeSpaceM(0),
   usedSpaceM(0),
+  totalSpaceM(SATIP_BUFFER_SIZE),
+  highWaterM(0),
+  resizesM(0),
+  droppedDatagramsM(0),
+  droppedPacketsM(0),
+  droppedLowPriorityM(0),
+  droppedOldestM(0),
   timerM(),
   mutexStatBufferM()
 {
@@ -195,28 +208,255 @@ cString cSatipBufferStatistics::GetBufferStatistic()
   uint64_t elapsed = timerM.Elapsed(); /* in milliseconds */
   timerM.Set();
   long bitrate = elapsed ? (long)(1000.0L * dataBytesM / KILOBYTE(1) / elapsed) : 0L;
-  long totalSpace = SATIP_BUFFER_SIZE;
+  long totalSpace = totalSpaceM;
   float percentage = (float)((float)usedSpaceM / (float)totalSpace * 100.0);
+  float highWater = (float)((float)highWaterM / (float)totalSpace * 100.0);
   long totalKilos = totalSpace / KILOBYTE(1);
   long usedKilos = usedSpaceM / KILOBYTE(1);
+  long highKilos = highWaterM / KILOBYTE(1);
   if (!SatipConfig.GetUseBytes()) {
      bitrate *= 8;
      totalKilos *= 8;
      usedKilos *= 8;
+     highKilos *= 8;
      }
-  cString s = cString::sprintf("Buffer bitrate: %ld k%s/s\nBuffer usage: %ld/%ld k%s (%2.1f%%)\n", bitrate,
+  cString s = cString::sprintf("Buffer bitrate: %ld k%s/s\nBuffer usage: %ld/%ld k%s (%2.1f%%)\nBuffer high-water mark: %ld k%s (%2.1f%%), %d resize%s\n", bitrate,
                                SatipConfig.GetUseBytes() ? "B" : "bit", usedKilos, totalKilos,
-                               SatipConfig.GetUseBytes() ? "B" : "bit", percentage);
+                               SatipConfig.GetUseBytes() ? "B" : "bit", percentage,
+                               highKilos, SatipConfig.GetUseBytes() ? "B" : "bit", highWater,
+                               resizesM, (resizesM == 1) ? "" : "s");
+  if (droppedDatagramsM || droppedPacketsM || droppedLowPriorityM || droppedOldestM)
+     s = cString::sprintf("%sBuffer drops: %ld datagrams, %ld packets, %ld low priority packets, %ld oldest packets\n", *s,
+                          droppedDatagramsM, droppedPacketsM, droppedLowPriorityM, droppedOldestM);
   dataBytesM = 0;
   usedSpaceM = 0;
   return s;
 }
 
-void cSatipBufferStatistics::AddBufferStatistic(long bytesP, long usedP)
+void cSatipBufferStatistics::AddBufferStatistic(long bytesP, long usedP, long totalP, long highWaterP, int resizesP)
 {
-  debug16("%s (%ld, %ld)", __PRETTY_FUNCTION__, bytesP, usedP);
+  debug16("%s (%ld, %ld, %ld, %ld, %d)", __PRETTY_FUNCTION__, bytesP, usedP, totalP, highWaterP, resizesP);
   cMutexLock MutexLock(&mutexStatBufferM);
   dataBytesM += bytesP;
   if (usedP > usedSpaceM)
      usedSpaceM = usedP;
+  if (totalP > 0)
+     totalSpaceM = totalP;
+  highWaterM = highWaterP;
+  resizesM = resizesP;
+}
+
+void cSatipBufferStatistics::AddDropStatistic(long datagramsP, long packetsP, long lowPriorityP, long oldestP)
+{
+  debug16("%s (%ld, %ld, %ld, %ld)", __PRETTY_FUNCTION__, datagramsP, packetsP, lowPriorityP, oldestP);
+  cMutexLock MutexLock(&mutexStatBufferM);
+  droppedDatagramsM += datagramsP;
+  droppedPacketsM += packetsP;
+  droppedLowPriorityM += lowPriorityP;
+  droppedOldestM += oldestP;
+}
+
+// --- cSatipThreadStatistics -------------------------------------------------
+
+cMutex cSatipThreadStatistics::mutexThreadsS;
+cSatipThreadStatistics *cSatipThreadStatistics::threadsS[eMaxThreads] = { NULL };
+
+cSatipThreadStatistics::cSatipThreadStatistics(const char *nameP)
+: nameM(nameP),
+  schedulingM("default"),
+  windowStartM(0),
+  windowCpuM(0),
+  windowWakeupsM(0),
+  windowMaxM(0),
+  iterationsM(0),
+  wakeupsM(0),
+  cpuM(0),
+  maxM(0),
+  cpuPermilleM(0),
+  wakeupsPerSecondM(0),
+  lastMaxM(0),
+  lastP99M(0)
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, nameP);
+  memset(histogramM, 0, sizeof(histogramM));
+  cMutexLock MutexLock(&mutexThreadsS);
+  for (int i = 0; i < eMaxThreads; ++i) {
+      if (!threadsS[i]) {
+         threadsS[i] = this;
+         break;
+         }
+      }
+}
+
+cSatipThreadStatistics::~cSatipThreadStatistics()
+{
+  debug1("%s (%s)", __PRETTY_FUNCTION__, *nameM);
+  cMutexLock MutexLock(&mutexThreadsS);
+  for (int i = 0; i < eMaxThreads; ++i) {
+      if (threadsS[i] == this)
+         threadsS[i] = NULL;
+      }
+}
+
+void cSatipThreadStatistics::ApplyScheduling(unsigned int threadClassP)
+{
+  // Called by the owning thread at its start
+  unsigned int policy = SatipConfig.GetSchedPolicy(threadClassP);
+  const cpu_set_t *cpus = SatipConfig.GetSchedCpus(threadClassP);
+  char tmp[64];
+  if (policy != cSatipConfig::eSchedPolicyDefault) {
+     static const int policies[cSatipConfig::eSchedPolicyCount] = { SCHED_OTHER, SCHED_OTHER, SCHED_FIFO, SCHED_RR };
+     struct sched_param param;
+     memset(&param, 0, sizeof(param));
+     param.sched_priority = SatipConfig.GetSchedPriority(threadClassP);
+     int rc = pthread_setschedparam(pthread_self(), policies[policy], &param);
+     if (rc)
+        error("Cannot set the scheduling of %s: %s", *nameM, strerror_r(rc, tmp, sizeof(tmp)));
+     }
+  if (cpus && CPU_COUNT(cpus)) {
+     int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), cpus);
+     if (rc)
+        error("Cannot set the cpu affinity of %s: %s", *nameM, strerror_r(rc, tmp, sizeof(tmp)));
+     }
+  // Report what the kernel actually applied
+  int effectivePolicy = SCHED_OTHER;
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  pthread_getschedparam(pthread_self(), &effectivePolicy, &param);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  cString list = "";
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &set)) {
+         int j = i;
+         while ((j + 1 < CPU_SETSIZE) && CPU_ISSET(j + 1, &set))
+               j++;
+         list = (i == j) ? cString::sprintf("%s%s%d", *list, isempty(*list) ? "" : ",", i) : cString::sprintf("%s%s%d-%d", *list, isempty(*list) ? "" : ",", i, j);
+         i = j;
+         }
+      }
+  const char *name = (effectivePolicy == SCHED_FIFO) ? "fifo" : (effectivePolicy == SCHED_RR) ? "rr" : "other";
+  cString scheduling = cString::sprintf("%s %d nice %d cpus %s", name, param.sched_priority, getpriority(PRIO_PROCESS, 0), *list);
+  debug1("%s (%u) %s: %s", __PRETTY_FUNCTION__, threadClassP, *nameM, *scheduling);
+  cMutexLock MutexLock(&mutexThreadsS);
+  schedulingM = scheduling;
+}
+
+cString cSatipThreadStatistics::GetScheduling(void)
+{
+  cMutexLock MutexLock(&mutexThreadsS);
+  return cString::sprintf("%s: %s", *nameM, *schedulingM);
+}
+
+uint64_t cSatipThreadStatistics::Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void cSatipThreadStatistics::Rotate(uint64_t nowP)
+{
+  // Called by the owning thread, so its own cpu clock is at hand
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  uint64_t cpu = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  if (windowStartM) {
+     uint64_t elapsed = nowP - windowStartM;
+     uint32_t count = 0;
+     for (int i = 0; i < eHistogramBuckets; ++i)
+         count += histogramM[i];
+     // The 99th percentile is the upper bound of its bucket
+     uint64_t p99 = 0;
+     uint32_t sum = 0;
+     for (int i = 0; (i < eHistogramBuckets) && count; ++i) {
+         sum += histogramM[i];
+         if (sum * 100ULL >= count * 99ULL) {
+            p99 = (1ULL << i) * 1000;
+            break;
+            }
+         }
+     __atomic_store_n(&cpuPermilleM, elapsed ? (int)((cpu - windowCpuM) * 1000 / elapsed) : 0, __ATOMIC_RELAXED);
+     __atomic_store_n(&wakeupsPerSecondM, elapsed ? (int)((wakeupsM - windowWakeupsM) * 1000000000ULL / elapsed) : 0, __ATOMIC_RELAXED);
+     __atomic_store_n(&lastMaxM, windowMaxM, __ATOMIC_RELAXED);
+     __atomic_store_n(&lastP99M, min(p99, windowMaxM), __ATOMIC_RELAXED);
+     }
+  __atomic_store_n(&cpuM, cpu, __ATOMIC_RELAXED);
+  windowStartM = nowP;
+  windowCpuM = cpu;
+  windowWakeupsM = wakeupsM;
+  windowMaxM = 0;
+  memset(histogramM, 0, sizeof(histogramM));
+}
+
+void cSatipThreadStatistics::Wakeup(void)
+{
+  __atomic_store_n(&wakeupsM, wakeupsM + 1, __ATOMIC_RELAXED);
+  uint64_t now = Now();
+  if (now - windowStartM >= eWindowMs * 1000000ULL)
+     Rotate(now);
+}
+
+uint64_t cSatipThreadStatistics::AddProcessing(uint64_t startP)
+{
+  uint64_t elapsed = Now() - startP;
+  unsigned int us = (unsigned int)min(elapsed / 1000, (uint64_t)UINT_MAX);
+  int bucket = us ? min(32 - __builtin_clz(us), eHistogramBuckets - 1) : 0;
+  histogramM[bucket]++;
+  if (elapsed > windowMaxM)
+     windowMaxM = elapsed;
+  if (elapsed > maxM)
+     __atomic_store_n(&maxM, elapsed, __ATOMIC_RELAXED);
+  __atomic_store_n(&iterationsM, iterationsM + 1, __ATOMIC_RELAXED);
+  return elapsed;
+}
+
+cString cSatipThreadStatistics::GetThreadStatistic(void)
+{
+  int cpu = __atomic_load_n(&cpuPermilleM, __ATOMIC_RELAXED);
+  return cString::sprintf("%s: cpu %d.%d%% (%.1f s) wakeups %d/s iterations %" PRIu64 " processing max %.2f ms p99 %.2f ms (peak %.2f ms)",
+                          *nameM, cpu / 10, cpu % 10, __atomic_load_n(&cpuM, __ATOMIC_RELAXED) / 1e9,
+                          __atomic_load_n(&wakeupsPerSecondM, __ATOMIC_RELAXED), __atomic_load_n(&iterationsM, __ATOMIC_RELAXED),
+                          __atomic_load_n(&lastMaxM, __ATOMIC_RELAXED) / 1e6, __atomic_load_n(&lastP99M, __ATOMIC_RELAXED) / 1e6,
+                          __atomic_load_n(&maxM, __ATOMIC_RELAXED) / 1e6);
+}
+
+cString cSatipThreadStatistics::GetAllThreadStatistics(void)
+{
+  cMutexLock MutexLock(&mutexThreadsS);
+  cString s = "";
+  for (int i = 0; i < eMaxThreads; ++i) {
+      if (threadsS[i])
+         s = cString::sprintf("%s%s\n", *s, *threadsS[i]->GetThreadStatistic());
+      }
+  return s;
+}
+
+cString cSatipThreadStatistics::GetAllThreadSchedulings(void)
+{
+  cMutexLock MutexLock(&mutexThreadsS);
+  cString s = "";
+  for (int i = 0; i < eMaxThreads; ++i) {
+      if (threadsS[i])
+         s = cString::sprintf("%s%s\n", *s, *threadsS[i]->GetScheduling());
+      }
+  return s;
+}
+
+// --- cSatipMetrics ----------------------------------------------------------
+
+cSatipMetrics::cDeviceMetrics cSatipMetrics::devicesS[SATIP_MAX_DEVICES];
+// upper bounds of the RTSP latency histogram in milliseconds
+const int cSatipMetrics::latencyBucketsS[eLatencyBucketCount] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 };
+
+void cSatipMetrics::AddLatency(int deviceP, int msP)
+{
+  if (!IsValid(deviceP))
+     return;
+  int i = 0;
+  while ((i < eLatencyBucketCount) && (msP > latencyBucketsS[i]))
+        ++i;
+  __atomic_fetch_add(&devicesS[deviceP].latencyM[i], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&devicesS[deviceP].latencySumM, (uint64_t)max(msP, 0), __ATOMIC_RELAXED);
 }
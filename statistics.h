@@ -74,14 +74,138 @@ public:
   cString GetBufferStatistic();
 
 protected:
-  void AddBufferStatistic(long bytesP, long usedP);
+  void AddBufferStatistic(long bytesP, long usedP, long totalP, long highWaterP, int resizesP);
+  void AddDropStatistic(long datagramsP, long packetsP, long lowPriorityP, long oldestP);
 
 private:
   long dataBytesM;
   long freeSpaceM;
   long usedSpaceM;
+  long totalSpaceM;
+  long highWaterM;
+  int resizesM;
+  long droppedDatagramsM;
+  long droppedPacketsM;
+  long droppedLowPriorityM;
+  long droppedOldestM;
   cTimeMs timerM;
   cMutex mutexStatBufferM;
 };
 
+// Thread statistics
+class cSatipThreadStatistics {
+public:
+  explicit cSatipThreadStatistics(const char *nameP);
+  virtual ~cSatipThreadStatistics();
+  static uint64_t Now(void);
+  static cString GetAllThreadStatistics(void);
+  static cString GetAllThreadSchedulings(void);
+  void ApplyScheduling(unsigned int threadClassP);
+  void Wakeup(void);
+  uint64_t AddProcessing(uint64_t startP);
+  cString GetThreadStatistic(void);
+  cString GetScheduling(void);
+
+private:
+  enum {
+    eWindowMs          = 5000,
+    eHistogramBuckets  = 24, // powers of two in microseconds
+    eMaxThreads        = 4 * SATIP_MAX_DEVICES + 4
+  };
+  static cMutex mutexThreadsS;
+  static cSatipThreadStatistics *threadsS[eMaxThreads];
+  cString nameM;
+  cString schedulingM;
+  // updated by the owning thread only
+  uint64_t windowStartM;
+  uint64_t windowCpuM;
+  uint64_t windowWakeupsM;
+  uint64_t windowMaxM;
+  uint32_t histogramM[eHistogramBuckets];
+  // read by anyone
+  uint64_t iterationsM;
+  uint64_t wakeupsM;
+  uint64_t cpuM;
+  uint64_t maxM;
+  int cpuPermilleM;
+  int wakeupsPerSecondM;
+  uint64_t lastMaxM;
+  uint64_t lastP99M;
+  void Rotate(uint64_t nowP);
+};
+
+// Monotonic counters and gauges of all devices; unlike the statistics shown
+// in the menus they are never reset by reading, so any number of observers
+// can scrape them
+class cSatipMetrics {
+public:
+  enum eCounter {
+    eTunerBytes = 0,
+    eRtpPackets,
+    eRtpLostPackets,
+    eRtcpPackets,
+    eBufferBytes,
+    eDroppedDatagrams,
+    eDroppedPackets,
+    eDroppedLowPriority,
+    eDroppedOldest,
+    eSectionBytes,
+    eSections,
+    eRtspRequests,
+    eRtspErrors,
+    eTunes,
+    eTuneFailures,
+    eFailovers,
+    eCcErrors,
+    eHealthDegradations,
+    eHealthRetunes,
+    eHealthFailovers,
+    eHttpBytes,
+    eHttpDroppedClients,
+    eCounterCount
+  };
+  enum eGauge {
+    eBufferUsed = 0,
+    eBufferSize,
+    eBufferHighWater,
+    eSignalStrength,
+    eSignalQuality,
+    eLock,
+    eGaugeCount
+  };
+
+private:
+  enum {
+    eLatencyBucketCount = 10
+  };
+  struct cDeviceMetrics {
+    uint64_t countersM[eCounterCount];
+    int64_t gaugesM[eGaugeCount];
+    uint64_t latencyM[eLatencyBucketCount + 1];
+    uint64_t latencySumM;
+  } __attribute__((aligned(64)));
+  static cDeviceMetrics devicesS[SATIP_MAX_DEVICES];
+  static const int latencyBucketsS[eLatencyBucketCount];
+  static bool IsValid(int deviceP) { return ((deviceP >= 0) && (deviceP < SATIP_MAX_DEVICES)); }
+
+public:
+  static void Add(int deviceP, eCounter counterP, uint64_t valueP = 1)
+  {
+    if (IsValid(deviceP))
+       __atomic_fetch_add(&devicesS[deviceP].countersM[counterP], valueP, __ATOMIC_RELAXED);
+  }
+  static void Set(int deviceP, eGauge gaugeP, int64_t valueP)
+  {
+    if (IsValid(deviceP))
+       __atomic_store_n(&devicesS[deviceP].gaugesM[gaugeP], valueP, __ATOMIC_RELAXED);
+  }
+  static void AddLatency(int deviceP, int msP);
+  static uint64_t Counter(int deviceP, eCounter counterP) { return __atomic_load_n(&devicesS[deviceP].countersM[counterP], __ATOMIC_RELAXED); }
+  static int64_t Gauge(int deviceP, eGauge gaugeP) { return __atomic_load_n(&devicesS[deviceP].gaugesM[gaugeP], __ATOMIC_RELAXED); }
+  static int LatencyBucketCount(void) { return eLatencyBucketCount; }
+  static int LatencyBucket(int indexP) { return latencyBucketsS[indexP]; }
+  static uint64_t Latency(int deviceP, int indexP) { return __atomic_load_n(&devicesS[deviceP].latencyM[indexP], __ATOMIC_RELAXED); }
+  static uint64_t LatencySum(int deviceP) { return __atomic_load_n(&devicesS[deviceP].latencySumM, __ATOMIC_RELAXED); }
+};
+
 #endif // __SATIP_STATISTICS_H
@@ -0,0 +1,21 @@
+/*
+ * device.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_DEVICE_H
+#define __SATIP_BENCH_DEVICE_H
+
+#include <sys/socket.h>
+
+#include "ringbuffer.h"
+#include "thread.h"
+#include "tools.h"
+
+#define MAXDEVICES   16
+#define TS_SIZE      188
+#define TS_SYNC_BYTE 0x47
+
+#endif // __SATIP_BENCH_DEVICE_H
@@ -0,0 +1,17 @@
+/*
+ * i18n.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_I18N_H
+#define __SATIP_BENCH_I18N_H
+
+#include "tools.h"
+
+#define tr(s)     (s)
+#define trVDR(s)  (s)
+#define trNOOP(s) (s)
+
+#endif // __SATIP_BENCH_I18N_H
@@ -0,0 +1,14 @@
+/*
+ * menuitems.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_MENUITEMS_H
+#define __SATIP_BENCH_MENUITEMS_H
+
+#include "sources.h"
+#include "tools.h"
+
+#endif // __SATIP_BENCH_MENUITEMS_H
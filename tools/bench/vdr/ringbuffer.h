@@ -0,0 +1,132 @@
+/*
+ * ringbuffer.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_RINGBUFFER_H
+#define __SATIP_BENCH_RINGBUFFER_H
+
+#include "thread.h"
+#include "tools.h"
+
+// --- cRingBuffer ------------------------------------------------------------
+
+class cRingBuffer {
+private:
+  cCondWait readyForPut, readyForGet;
+  int putTimeout;
+  int getTimeout;
+  int size;
+  int overflowCount;
+  int overflowBytes;
+protected:
+  tThreadId getThreadTid;
+  int maxFill;
+  int lastPercent;
+  bool statistics;
+  void UpdatePercentage(int Fill) { if (Fill > maxFill) maxFill = Fill; }
+  void WaitForPut(void) { if (putTimeout) readyForPut.Wait(putTimeout); }
+  void WaitForGet(void) { if (getTimeout) readyForGet.Wait(getTimeout); }
+  void EnablePut(void) { if (putTimeout) readyForPut.Signal(); }
+  void EnableGet(void) { if (getTimeout) readyForGet.Signal(); }
+public:
+  cRingBuffer(int Size, bool Statistics = false)
+  : putTimeout(0), getTimeout(0), size(Size), overflowCount(0), overflowBytes(0),
+    getThreadTid(0), maxFill(0), lastPercent(0), statistics(Statistics) {}
+  virtual ~cRingBuffer() {}
+  void SetTimeouts(int PutTimeout, int GetTimeout) { putTimeout = PutTimeout; getTimeout = GetTimeout; }
+  void SetIoThrottle(void) {}
+  void ReportOverflow(int Bytes) { overflowCount++; overflowBytes += Bytes; }
+  int Size(void) { return size; }
+  virtual int Free(void) { return Size() - Available() - 1; }
+  virtual int Available(void) = 0;
+  virtual void Clear(void) = 0;
+  int OverflowCount(void) const { return overflowCount; }
+  int OverflowBytes(void) const { return overflowBytes; }
+};
+
+// --- cFrame -----------------------------------------------------------------
+
+class cFrame {
+  friend class cRingBufferFrame;
+private:
+  cFrame *next;
+  uchar *data;
+  int count;
+public:
+  cFrame(const uchar *Data, int Count, int Type = 0, int Index = -1, uint32_t Pts = 0, bool Independent = false)
+  : next(NULL), data(NULL), count(Count)
+  {
+    if (Count > 0 && (data = (uchar *)malloc(Count)) != NULL)
+       memcpy(data, Data, Count);
+  }
+  ~cFrame() { free(data); }
+  uchar *Data(void) const { return data; }
+  int Count(void) const { return count; }
+};
+
+// --- cRingBufferFrame -------------------------------------------------------
+
+class cRingBufferFrame : public cRingBuffer {
+private:
+  cFrame *head;
+  int currentFill;
+  cMutex mutex;
+  void Delete(cFrame *Frame) { delete Frame; }
+public:
+  cRingBufferFrame(int Size, bool Statistics = false) : cRingBuffer(Size, Statistics), head(NULL), currentFill(0) {}
+  virtual ~cRingBufferFrame() { Clear(); }
+  virtual int Available(void) { return currentFill; }
+  virtual void Clear(void)
+  {
+    cMutexLock lock(&mutex);
+    cFrame *p;
+    while ((p = Get()) != NULL)
+          Drop(p);
+  }
+  bool Put(cFrame *Frame)
+  {
+    if (Frame->Count() <= Free()) {
+       cMutexLock lock(&mutex);
+       if (head) {
+          Frame->next = head->next;
+          head->next = Frame;
+          head = Frame;
+          }
+       else {
+          head = Frame->next = Frame;
+          }
+       currentFill += Frame->Count();
+       EnableGet();
+       return true;
+       }
+    return false;
+  }
+  cFrame *Get(void)
+  {
+    cMutexLock lock(&mutex);
+    return head ? head->next : NULL;
+  }
+  void Drop(cFrame *Frame)
+  {
+    cMutexLock lock(&mutex);
+    if (head) {
+       if (Frame == head->next) {
+          currentFill -= Frame->Count();
+          if (head->next != head) {
+             head->next = Frame->next;
+             Delete(Frame);
+             }
+          else {
+             Delete(head);
+             head = NULL;
+             }
+          }
+       }
+    EnablePut();
+  }
+};
+
+#endif // __SATIP_BENCH_RINGBUFFER_H
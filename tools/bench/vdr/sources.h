@@ -0,0 +1,25 @@
+/*
+ * sources.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_SOURCES_H
+#define __SATIP_BENCH_SOURCES_H
+
+#include "tools.h"
+
+class cSource : public cListObject {
+public:
+  enum eSourceType {
+    stNone  = 0x00000000,
+    stAtsc  = ('A' << 24),
+    stCable = ('C' << 24),
+    stSat   = ('S' << 24),
+    stTerr  = ('T' << 24),
+    st_Mask = 0xFF000000
+    };
+};
+
+#endif // __SATIP_BENCH_SOURCES_H
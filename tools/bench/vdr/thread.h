@@ -0,0 +1,149 @@
+/*
+ * thread.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_BENCH_THREAD_H
+#define __SATIP_BENCH_THREAD_H
+
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "tools.h"
+
+typedef pid_t tThreadId;
+
+// --- cMutex -----------------------------------------------------------------
+
+class cMutex {
+  friend class cCondVar;
+private:
+  pthread_mutex_t mutex;
+public:
+  cMutex(void)
+  {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+  }
+  ~cMutex() { pthread_mutex_destroy(&mutex); }
+  void Lock(void) { pthread_mutex_lock(&mutex); }
+  void Unlock(void) { pthread_mutex_unlock(&mutex); }
+};
+
+class cMutexLock {
+private:
+  cMutex *mutex;
+public:
+  cMutexLock(cMutex *Mutex = NULL) : mutex(Mutex) { if (mutex) mutex->Lock(); }
+  ~cMutexLock() { if (mutex) mutex->Unlock(); }
+  bool Lock(cMutex *Mutex) { if (mutex || !Mutex) return false; mutex = Mutex; mutex->Lock(); return true; }
+};
+
+// --- cCondVar ---------------------------------------------------------------
+
+class cCondVar {
+private:
+  pthread_cond_t cond;
+public:
+  cCondVar(void) { pthread_cond_init(&cond, NULL); }
+  ~cCondVar() { pthread_cond_destroy(&cond); }
+  void Wait(cMutex &Mutex) { pthread_cond_wait(&cond, &Mutex.mutex); }
+  bool TimedWait(cMutex &Mutex, int TimeoutMs)
+  {
+    struct timespec abstime;
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_sec += TimeoutMs / 1000;
+    abstime.tv_nsec += (TimeoutMs % 1000) * 1000000L;
+    if (abstime.tv_nsec >= 1000000000L) {
+       abstime.tv_sec++;
+       abstime.tv_nsec -= 1000000000L;
+       }
+    return pthread_cond_timedwait(&cond, &Mutex.mutex, &abstime) == 0;
+  }
+  void Broadcast(void) { pthread_cond_broadcast(&cond); }
+};
+
+// --- cCondWait --------------------------------------------------------------
+
+class cCondWait {
+private:
+  cMutex mutex;
+  cCondVar cond;
+  bool signaled;
+public:
+  cCondWait(void) : signaled(false) {}
+  static void SleepMs(int TimeoutMs) { usleep(max(TimeoutMs, 3) * 1000); }
+  bool Wait(int TimeoutMs = 0)
+  {
+    cMutexLock lock(&mutex);
+    if (!signaled) {
+       if (TimeoutMs)
+          cond.TimedWait(mutex, TimeoutMs);
+       else
+          cond.Wait(mutex);
+       }
+    bool r = signaled;
+    signaled = false;
+    return r;
+  }
+  void Signal(void) { cMutexLock lock(&mutex); signaled = true; cond.Broadcast(); }
+};
+
+// Declared only: used as members of classes the benchmark never creates
+class cRwLock {
+public:
+  cRwLock(bool PreferWriter = false);
+  ~cRwLock();
+};
+
+// --- cThread ----------------------------------------------------------------
+
+class cThread {
+private:
+  pthread_t childTid;
+  volatile bool active;
+  volatile bool running;
+  cString description;
+  static void *StartThread(void *Thread)
+  {
+    cThread *thread = (cThread *)Thread;
+    thread->Action();
+    thread->active = false;
+    return NULL;
+  }
+protected:
+  void SetPriority(int Priority) {}
+  void SetIOPriority(int Priority) {}
+  virtual void Action(void) = 0;
+  bool Running(void) { return running; }
+  void Cancel(int WaitSeconds = 0)
+  {
+    running = false;
+    if (active) {
+       pthread_join(childTid, NULL);
+       active = false;
+       }
+  }
+public:
+  cThread(const char *Description = NULL, bool LowPriority = false) : childTid(0), active(false), running(false), description(Description) {}
+  virtual ~cThread() { Cancel(); }
+  void SetDescription(const char *Description, ...) { description = Description; }
+  bool Start(void)
+  {
+    if (!active) {
+       running = active = true;
+       if (pthread_create(&childTid, NULL, StartThread, this) != 0)
+          running = active = false;
+       }
+    return active;
+  }
+  bool Active(void) { return active; }
+  static tThreadId ThreadId(void) { return (tThreadId)syscall(SYS_gettid); }
+};
+
+#endif // __SATIP_BENCH_THREAD_H
@@ -0,0 +1,280 @@
+/*
+ * tools.h: Minimal VDR stand-ins for the SAT>IP plugin benchmark
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * Only the parts of the VDR API used by the benchmarked plugin sources are
+ * provided here; everything else is declared at most.
+ *
+ */
+
+#ifndef __SATIP_BENCH_TOOLS_H
+#define __SATIP_BENCH_TOOLS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define APIVERSNUM 20600
+
+typedef unsigned char uchar;
+
+#define KILOBYTE(n) ((n) * 1024)
+#define MEGABYTE(n) ((n) * 1024LL * 1024LL)
+#define MALLOC(type, size) (type *)malloc(sizeof(type) * (size))
+#define DELETENULL(p) (delete (p), p = NULL)
+
+template<class T> inline T min(T a, T b) { return a <= b ? a : b; }
+template<class T> inline T max(T a, T b) { return a >= b ? a : b; }
+template<class T> inline T constrain(T v, T l, T h) { return v < l ? l : v > h ? h : v; }
+
+// Log messages are counted and printed with --verbose only
+inline int SysLogLevel = 0;
+inline int SysLogCount = 0;
+
+inline void vsyslog_bench(int levelP, const char *formatP, va_list ap)
+{
+  SysLogCount++;
+  if (levelP <= SysLogLevel) {
+     vfprintf(stderr, formatP, ap);
+     fputc('\n', stderr);
+     }
+}
+
+inline void esyslog(const char *formatP, ...) { va_list ap; va_start(ap, formatP); vsyslog_bench(1, formatP, ap); va_end(ap); }
+inline void isyslog(const char *formatP, ...) { va_list ap; va_start(ap, formatP); vsyslog_bench(2, formatP, ap); va_end(ap); }
+inline void dsyslog(const char *formatP, ...) { va_list ap; va_start(ap, formatP); vsyslog_bench(3, formatP, ap); va_end(ap); }
+
+inline bool isempty(const char *s)
+{
+  if (!s)
+     return true;
+  while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+        s++;
+  return !*s;
+}
+
+inline char *skipspace(const char *s)
+{
+  while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+        s++;
+  return (char *)s;
+}
+
+inline bool startswith(const char *s, const char *p)
+{
+  return !strncmp(s, p, strlen(p));
+}
+
+inline char *strn0cpy(char *dest, const char *src, size_t n)
+{
+  char *s = dest;
+  for ( ; --n && (*dest = *src) != 0; dest++, src++) ;
+  *dest = 0;
+  return s;
+}
+
+// --- cString ----------------------------------------------------------------
+
+class cString {
+private:
+  char *s;
+public:
+  cString(const char *S = NULL, bool TakePointer = false) { s = TakePointer ? (char *)S : S ? strdup(S) : NULL; }
+  cString(const char *S, const char *To) { s = S ? (To ? strndup(S, To - S) : strdup(S)) : NULL; }
+  cString(const cString &String) { s = String.s ? strdup(String.s) : NULL; }
+  virtual ~cString() { free(s); }
+  operator const void * () const { return s; }
+  operator const char * () const { return s; }
+  const char * operator*() const { return s; }
+  cString &operator=(const cString &String)
+  {
+    if (this != &String) {
+       free(s);
+       s = String.s ? strdup(String.s) : NULL;
+       }
+    return *this;
+  }
+  cString &operator=(const char *String)
+  {
+    if (s != String) {
+       free(s);
+       s = String ? strdup(String) : NULL;
+       }
+    return *this;
+  }
+  cString &Append(const char *String)
+  {
+    if (String) {
+       size_t l1 = s ? strlen(s) : 0;
+       size_t l2 = strlen(String);
+       if (char *p = (char *)realloc(s, l1 + l2 + 1)) {
+          memcpy(p + l1, String, l2 + 1);
+          s = p;
+          }
+       }
+    return *this;
+  }
+  cString &Truncate(int Index)
+  {
+    int l = s ? (int)strlen(s) : 0;
+    if (Index < 0)
+       Index = l + Index;
+    if (Index >= 0 && Index < l)
+       s[Index] = 0;
+    return *this;
+  }
+  static cString vsprintf(const char *fmt, va_list &ap)
+  {
+    char *buffer;
+    if (!fmt || vasprintf(&buffer, fmt, ap) < 0)
+       buffer = strdup("???");
+    return cString(buffer, true);
+  }
+  static cString sprintf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)))
+  {
+    va_list ap;
+    va_start(ap, fmt);
+    cString s = vsprintf(fmt, ap);
+    va_end(ap);
+    return s;
+  }
+};
+
+inline cString itoa(int n)
+{
+  return cString::sprintf("%d", n);
+}
+
+// --- cTimeMs ----------------------------------------------------------------
+
+class cTimeMs {
+private:
+  uint64_t begin;
+public:
+  cTimeMs(int Ms = 0) { Set(Ms); }
+  static uint64_t Now(void)
+  {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t(tp.tv_sec)) * 1000 + tp.tv_nsec / 1000000;
+  }
+  void Set(int Ms = 0) { begin = Now() + Ms; }
+  bool TimedOut(void) const { return Now() >= begin; }
+  uint64_t Elapsed(void) const { return Now() - begin; }
+};
+
+// --- cListObject ------------------------------------------------------------
+
+class cListObject {
+private:
+  cListObject *prev, *next;
+public:
+  cListObject(void) : prev(NULL), next(NULL) {}
+  virtual ~cListObject() {}
+  virtual int Compare(const cListObject &ListObject) const { return 0; }
+  void Append(cListObject *Object) { next = Object; Object->prev = this; }
+  void Insert(cListObject *Object) { prev = Object; Object->next = this; }
+  void Unlink(void)
+  {
+    if (next)
+       next->prev = prev;
+    if (prev)
+       prev->next = next;
+    next = prev = NULL;
+  }
+  cListObject *Prev(void) const { return prev; }
+  cListObject *Next(void) const { return next; }
+};
+
+class cListBase {
+protected:
+  cListObject *objects, *lastObject;
+  int count;
+  cListBase(const char *NeedsLocking = NULL) : objects(NULL), lastObject(NULL), count(0) {}
+public:
+  virtual ~cListBase() { Clear(); }
+  void Add(cListObject *Object, cListObject *After = NULL)
+  {
+    if (After && After != lastObject) {
+       After->Next()->Insert(Object);
+       After->Append(Object);
+       }
+    else {
+       if (lastObject)
+          lastObject->Append(Object);
+       else
+          objects = Object;
+       lastObject = Object;
+       }
+    count++;
+  }
+  void Del(cListObject *Object, bool DeleteObject = true)
+  {
+    if (Object == objects)
+       objects = Object->Next();
+    if (Object == lastObject)
+       lastObject = Object->Prev();
+    Object->Unlink();
+    if (DeleteObject)
+       delete Object;
+    count--;
+  }
+  virtual void Clear(void)
+  {
+    while (objects) {
+          cListObject *object = objects->Next();
+          delete objects;
+          objects = object;
+          }
+    objects = lastObject = NULL;
+    count = 0;
+  }
+  int Count(void) const { return count; }
+};
+
+template<class T> class cList : public cListBase {
+public:
+  cList(const char *NeedsLocking = NULL) : cListBase(NeedsLocking) {}
+  T *First(void) const { return (T *)objects; }
+  T *Last(void) const { return (T *)lastObject; }
+  T *Prev(const T *Object) const { return (T *)Object->cListObject::Prev(); }
+  T *Next(const T *Object) const { return (T *)Object->cListObject::Next(); }
+};
+
+// Declared only: used as members of classes the benchmark never creates
+template<class T> class cVector {
+public:
+  cVector(int Allocated = 10);
+  virtual ~cVector();
+  virtual int Size(void) const;
+  virtual void Append(T Data);
+  T& operator[](int Index);
+};
+
+class cStringList : public cVector<char *> {
+public:
+  cStringList(int Allocated = 10);
+};
+
+class cHashBase {
+public:
+  cHashBase(int Size, bool OwnObjects);
+  virtual ~cHashBase();
+  cListObject *Get(unsigned int Id) const;
+};
+
+template<class T> class cHash : public cHashBase {
+public:
+  cHash(int Size = 512, bool OwnObjects = false) : cHashBase(Size, OwnObjects) {}
+  T *Get(unsigned int Id) const { return (T *)cHashBase::Get(Id); }
+};
+
+#endif // __SATIP_BENCH_TOOLS_H
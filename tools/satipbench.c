@@ -0,0 +1,728 @@
+/*
+ * satipbench.c: Micro-benchmarks for the SAT>IP plugin data paths
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * Drives the RTP parser, the device TS buffer, the section filters and the
+ * section filter handler of the plugin with synthetic or recorded TS data
+ * and reports ns/packet, throughput, allocations and, if the kernel permits
+ * perf counters, cache misses and instructions per packet. The plugin
+ * sources are built against the minimal VDR stand-ins in tools/bench/vdr.
+ *
+ */
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../buffer.h"
+#include "../capture.h"
+#include "../common.h"
+#include "../config.h"
+#include "../rtp.h"
+#include "../sectionfilter.h"
+#include "../statistics.h"
+#include "../tunerif.h"
+
+// --- Allocation counting ----------------------------------------------------
+
+extern "C" {
+void *__libc_malloc(size_t sizeP);
+void *__libc_calloc(size_t countP, size_t sizeP);
+void *__libc_realloc(void *ptrP, size_t sizeP);
+
+static std::atomic<uint64_t> allocationsS(0);
+
+void *malloc(size_t sizeP)
+{
+  allocationsS.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(sizeP);
+}
+
+void *calloc(size_t countP, size_t sizeP)
+{
+  allocationsS.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(countP, sizeP);
+}
+
+void *realloc(void *ptrP, size_t sizeP)
+{
+  allocationsS.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptrP, sizeP);
+}
+}
+
+static uint64_t NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --- cBenchCounters ---------------------------------------------------------
+
+// Hardware counters of the calling thread and its children, if available
+class cBenchCounters {
+private:
+  enum {
+    eCacheMisses = 0,
+    eCacheReferences,
+    eInstructions,
+    eCounterCount
+  };
+  int fdM[eCounterCount];
+  uint64_t valueM[eCounterCount];
+  int Open(uint64_t configP, int groupP);
+
+public:
+  cBenchCounters();
+  ~cBenchCounters();
+  bool IsValid(void) const { return fdM[0] >= 0; }
+  void Start(void);
+  void Stop(void);
+  uint64_t CacheMisses(void) const { return valueM[eCacheMisses]; }
+  uint64_t CacheReferences(void) const { return valueM[eCacheReferences]; }
+  uint64_t Instructions(void) const { return valueM[eInstructions]; }
+};
+
+cBenchCounters::cBenchCounters()
+{
+  static const uint64_t configs[eCounterCount] = { PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_INSTRUCTIONS };
+  memset(valueM, 0, sizeof(valueM));
+  for (int i = 0; i < eCounterCount; ++i)
+      fdM[i] = Open(configs[i], i ? fdM[0] : -1);
+}
+
+cBenchCounters::~cBenchCounters()
+{
+  for (int i = 0; i < eCounterCount; ++i) {
+      if (fdM[i] >= 0)
+         close(fdM[i]);
+      }
+}
+
+int cBenchCounters::Open(uint64_t configP, int groupP)
+{
+  if (groupP < -1)
+     return -1;
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configP;
+  attr.disabled = (groupP < 0);
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupP, 0);
+}
+
+void cBenchCounters::Start(void)
+{
+  if (IsValid()) {
+     ioctl(fdM[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+     ioctl(fdM[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+     }
+}
+
+void cBenchCounters::Stop(void)
+{
+  if (IsValid()) {
+     ioctl(fdM[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+     for (int i = 0; i < eCounterCount; ++i) {
+         if ((fdM[i] < 0) || (read(fdM[i], &valueM[i], sizeof(valueM[i])) != sizeof(valueM[i])))
+            valueM[i] = 0;
+         }
+     }
+}
+
+// --- cBenchStream -----------------------------------------------------------
+
+// A TS mux held in memory and its RTP datagrams of seven packets each
+class cBenchStream {
+private:
+  enum {
+    eVideoPid = 0x100,
+    eAudioPid = 0x101,
+    ePatPid   = 0x000,
+    eSdtPid   = 0x011,
+    eEitPid   = 0x012
+  };
+  std::vector<uchar> tsM;
+  std::vector<uchar> rtpM;
+  std::vector<int> offsetsM;
+  bool capturedM;
+  uint8_t continuityM[0x2000];
+  bool LoadCapture(FILE *fileP, int maxPacketsP);
+  void AddPacket(int pidP, bool pusiP, const uchar *payloadP, int lengthP);
+  void AddSection(int pidP, const uchar *sectionP, int lengthP);
+  void AddTable(int pidP, int tidP, int lengthP);
+
+public:
+  cBenchStream();
+  bool Load(const char *fileP, int maxPacketsP);
+  void Synthesize(int packetsP, bool eitHeavyP);
+  void Packetize(void);
+  int Packets(void) const { return (int)(tsM.size() / TS_SIZE); }
+  const uchar *Packet(int indexP) const { return &tsM[indexP * TS_SIZE]; }
+  int Datagrams(void) const { return (int)offsetsM.size() - 1; }
+  uchar *Datagram(int indexP) { return &rtpM[offsetsM[indexP]]; }
+  int DatagramLength(int indexP) const { return offsetsM[indexP + 1] - offsetsM[indexP]; }
+  // The pids a receiver requests from the synthetic mux
+  static bool IsRequestedPid(int pidP) { return (pidP == eVideoPid) || (pidP == eAudioPid); }
+};
+
+cBenchStream::cBenchStream()
+: capturedM(false)
+{
+  memset(continuityM, 0, sizeof(continuityM));
+}
+
+bool cBenchStream::Load(const char *fileP, int maxPacketsP)
+{
+  FILE *f = fopen(fileP, "rb");
+  if (!f) {
+     fprintf(stderr, "Cannot open %s: %s\n", fileP, strerror(errno));
+     return false;
+     }
+  cSatipCaptureHeader header;
+  if ((fread(&header, sizeof(header), 1, f) == 1) && !memcmp(header.magic, cSatipCapture::Magic(), sizeof(header.magic))) {
+     bool ok = LoadCapture(f, maxPacketsP);
+     fclose(f);
+     return ok;
+     }
+  rewind(f);
+  uchar packet[TS_SIZE];
+  while ((Packets() < maxPacketsP) && (fread(packet, 1, 1, f) == 1)) {
+        // Sync on the packet boundaries
+        if ((packet[0] != TS_SYNC_BYTE) || (fread(packet + 1, TS_SIZE - 1, 1, f) != 1))
+           continue;
+        tsM.insert(tsM.end(), packet, packet + TS_SIZE);
+        }
+  fclose(f);
+  if (!Packets())
+     fprintf(stderr, "No TS packets in %s\n", fileP);
+  return Packets() > 0;
+}
+
+bool cBenchStream::LoadCapture(FILE *fileP, int maxPacketsP)
+{
+  // The RTP datagrams of a capture are used as received
+  cSatipCaptureRecord record;
+  uchar buffer[0x10000];
+  offsetsM.clear();
+  while ((Packets() < maxPacketsP) && (fread(&record, sizeof(record), 1, fileP) == 1)) {
+        if ((record.length > sizeof(buffer)) || (fread(buffer, record.length, 1, fileP) != 1))
+           break;
+        if ((record.type != cSatipCapture::eCaptureRtp) || (record.length < 12))
+           continue;
+        unsigned int headerlen = 12 + (buffer[0] & 0x0F) * 4;
+        if ((buffer[0] & 0x10) && (headerlen + 4 <= record.length))
+           headerlen += 4 + ((buffer[headerlen + 2] << 8) | buffer[headerlen + 3]) * 4;
+        if (headerlen >= record.length)
+           continue;
+        offsetsM.push_back((int)rtpM.size());
+        rtpM.insert(rtpM.end(), buffer, buffer + record.length);
+        unsigned int len = (record.length - headerlen) - (record.length - headerlen) % TS_SIZE;
+        tsM.insert(tsM.end(), buffer + headerlen, buffer + headerlen + len);
+        }
+  offsetsM.push_back((int)rtpM.size());
+  capturedM = true;
+  if (!Packets())
+     fprintf(stderr, "No RTP packets in the capture\n");
+  return Packets() > 0;
+}
+
+void cBenchStream::AddPacket(int pidP, bool pusiP, const uchar *payloadP, int lengthP)
+{
+  size_t offset = tsM.size();
+  tsM.resize(offset + TS_SIZE, 0xFF);
+  uchar *p = &tsM[offset];
+  p[0] = TS_SYNC_BYTE;
+  p[1] = (uchar)((pusiP ? 0x40 : 0x00) | ((pidP >> 8) & 0x1F));
+  p[2] = (uchar)(pidP & 0xFF);
+  p[3] = (uchar)(0x10 | (continuityM[pidP]++ & 0x0F));
+  memcpy(p + 4, payloadP, min(lengthP, TS_SIZE - 4));
+}
+
+void cBenchStream::AddSection(int pidP, const uchar *sectionP, int lengthP)
+{
+  // Pointer field in the first packet, stuffing after the section end
+  uchar payload[TS_SIZE - 4];
+  bool first = true;
+  while (lengthP > 0) {
+        int len = 0;
+        if (first)
+           payload[len++] = 0;
+        int chunk = min(lengthP, (int)sizeof(payload) - len);
+        memcpy(payload + len, sectionP, chunk);
+        memset(payload + len + chunk, 0xFF, sizeof(payload) - len - chunk);
+        AddPacket(pidP, first, payload, sizeof(payload));
+        sectionP += chunk;
+        lengthP -= chunk;
+        first = false;
+        }
+}
+
+void cBenchStream::AddTable(int pidP, int tidP, int lengthP)
+{
+  static int version = 0;
+  std::vector<uchar> section(lengthP, 0x55);
+  int sectionLength = lengthP - 3;
+  section[0] = (uchar)tidP;
+  section[1] = (uchar)(0xB0 | ((sectionLength >> 8) & 0x0F));
+  section[2] = (uchar)(sectionLength & 0xFF);
+  section[3] = 0x00;
+  section[4] = 0x01;
+  section[5] = (uchar)(0xC1 | ((version++ & 0x1F) << 1));
+  AddSection(pidP, &section[0], lengthP);
+}
+
+void cBenchStream::Synthesize(int packetsP, bool eitHeavyP)
+{
+  // A 90 % video/audio mux with the usual tables, or a third of the
+  // packets carrying EIT schedule sections of all tables ids
+  tsM.reserve((size_t)packetsP * TS_SIZE);
+  int eitTid = 0x4E;
+  uchar payload[TS_SIZE - 4];
+  memset(payload, 0xA5, sizeof(payload));
+  for (int i = 0; Packets() < packetsP; ++i) {
+      if (i % 1000 == 0)
+         AddTable(ePatPid, 0x00, 20);
+      else if (i % 1000 == 1)
+         AddTable(eSdtPid, 0x42, 600);
+      else if ((eitHeavyP && (i % 3 == 0)) || (!eitHeavyP && (i % 50 == 0))) {
+         AddTable(eEitPid, eitTid, 200 + (i * 7) % 3800);
+         eitTid = (eitTid >= 0x6F) ? 0x4E : eitTid + 1;
+         }
+      else
+         AddPacket((i % 10) ? eVideoPid : eAudioPid, (i % 200) == 2, payload, sizeof(payload));
+      }
+  tsM.resize((size_t)packetsP * TS_SIZE);
+}
+
+void cBenchStream::Packetize(void)
+{
+  // RTP/AVP payload type 33 with a continuous sequence
+  if (capturedM)
+     return;
+  rtpM.clear();
+  offsetsM.clear();
+  rtpM.reserve(tsM.size() + tsM.size() / (7 * TS_SIZE) * 12 + 12);
+  uint16_t seq = 0;
+  uint32_t timestamp = 0;
+  for (size_t offset = 0; offset < tsM.size(); offset += 7 * TS_SIZE) {
+      size_t len = min(tsM.size() - offset, (size_t)(7 * TS_SIZE));
+      offsetsM.push_back((int)rtpM.size());
+      uchar header[12] = { 0x80, 33, (uchar)(seq >> 8), (uchar)seq,
+                           (uchar)(timestamp >> 24), (uchar)(timestamp >> 16), (uchar)(timestamp >> 8), (uchar)timestamp,
+                           0x12, 0x34, 0x56, 0x78 };
+      rtpM.insert(rtpM.end(), header, header + sizeof(header));
+      rtpM.insert(rtpM.end(), &tsM[offset], &tsM[offset] + len);
+      seq++;
+      timestamp += 90;
+      }
+  offsetsM.push_back((int)rtpM.size());
+}
+
+// --- cBenchTuner ------------------------------------------------------------
+
+class cBenchTuner : public cSatipTunerIf {
+private:
+  uint64_t bytesM;
+public:
+  cBenchTuner() : bytesM(0) {}
+  uint64_t Bytes(void) const { return bytesM; }
+  virtual void ProcessVideoData(u_char *bufferP, int lengthP) { bytesM += lengthP; }
+  virtual void ProcessApplicationData(u_char *bufferP, int lengthP) {}
+  virtual void ProcessRtpData(u_char *bufferP, int lengthP) {}
+  virtual void ProcessRtcpData(u_char *bufferP, int lengthP) {}
+  virtual void SetStreamId(int streamIdP) {}
+  virtual void SetSessionTimeout(const char *sessionP, int timeoutP) {}
+  virtual void SetupTransport(int rtpPortP, int rtcpPortP, const char *streamAddrP, const char *sourceAddrP) {}
+  virtual void CaptureData(int typeP, const u_char *bufferP, int lengthP, uint64_t timeP) {}
+  virtual int GetId(void) { return 0; }
+};
+
+// --- cBenchDevice -----------------------------------------------------------
+
+// The TS buffer path of cSatipDevice::WriteData() and GetData(); the device
+// itself derives from VDR's cDevice and cannot be created without VDR
+class cBenchDevice : public cSatipPidStatistics {
+private:
+  cSatipRingBuffer *tsBufferM;
+  int bytesDeliveredM;
+  uint64_t droppedM;
+  uint32_t priorityPidsM[0x2000 / 32];
+
+public:
+  cBenchDevice();
+  ~cBenchDevice();
+  bool IsValid(void) const { return tsBufferM && tsBufferM->IsValid(); }
+  uint64_t Dropped(void) const { return droppedM; }
+  void SetPriorityPid(int pidP) { priorityPidsM[pidP >> 5] |= (1U << (pidP & 0x1F)); }
+  void WriteData(uchar *bufferP, int lengthP);
+  uchar *GetData(void);
+};
+
+cBenchDevice::cBenchDevice()
+: bytesDeliveredM(0),
+  droppedM(0)
+{
+  memset(priorityPidsM, 0, sizeof(priorityPidsM));
+  unsigned int bufsize = (unsigned int)SATIP_BUFFER_SIZE;
+  bufsize -= (bufsize % TS_SIZE);
+  tsBufferM = new cSatipRingBuffer(bufsize + 1, TS_SIZE, "SATIP#0 TS");
+}
+
+cBenchDevice::~cBenchDevice()
+{
+  DELETE_POINTER(tsBufferM);
+}
+
+void cBenchDevice::WriteData(uchar *bufferP, int lengthP)
+{
+  cSatipTsDrops drops;
+  droppedM += tsBufferM->PutTs(bufferP, lengthP, SatipConfig.GetOverflowPolicy(), priorityPidsM, drops);
+}
+
+uchar *cBenchDevice::GetData(void)
+{
+  int count = 0;
+  if (bytesDeliveredM) {
+     tsBufferM->Del(bytesDeliveredM);
+     bytesDeliveredM = 0;
+     }
+  tsBufferM->AutoResize();
+  uchar *p = tsBufferM->Get(count);
+  if (p && count >= TS_SIZE) {
+     if (*p != TS_SYNC_BYTE) {
+        for (int i = 1; i < count; i++) {
+            if (p[i] == TS_SYNC_BYTE) {
+               count = i;
+               break;
+               }
+            }
+        tsBufferM->Del(count);
+        return NULL;
+        }
+     bytesDeliveredM = TS_SIZE;
+     AddPidStatistic(ts_pid(p), payload(p));
+     return p;
+     }
+  return NULL;
+}
+
+// --- cBenchFilters ----------------------------------------------------------
+
+// The section filters VDR's EIT, PAT and SDT handlers typically open
+struct cBenchFilter {
+  uint16_t pid;
+  uint8_t tid;
+  uint8_t mask;
+};
+
+static const cBenchFilter benchFiltersS[] = {
+  { 0x00, 0x00, 0xFF },
+  { 0x11, 0x42, 0xFF },
+  { 0x12, 0x4E, 0xFE },
+  { 0x12, 0x50, 0xF0 },
+  { 0x12, 0x60, 0xF0 },
+  { 0x14, 0x70, 0xFC }
+};
+
+static uint64_t DrainSections(int fdP)
+{
+  uint64_t sections = 0;
+  uchar buf[4096];
+  while (recv(fdP, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        sections++;
+  return sections;
+}
+
+// --- Benchmarks -------------------------------------------------------------
+
+struct cBenchResult {
+  const char *name;
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t ns;
+  uint64_t allocations;
+  uint64_t output;
+  const char *outputUnit;
+  bool counters;
+  uint64_t cacheMisses;
+  uint64_t cacheReferences;
+  uint64_t instructions;
+};
+
+static void Report(const cBenchResult &resultP)
+{
+  double packets = resultP.packets ? (double)resultP.packets : 1.0;
+  double seconds = resultP.ns ? resultP.ns / 1e9 : 1e-9;
+  printf("%-10s %9.1f ns/pkt %8.1f MB/s %10.0f allocs/s", resultP.name, resultP.ns / packets, resultP.bytes / seconds / 1e6, resultP.allocations / seconds);
+  if (resultP.counters)
+     printf(" %6.3f misses/pkt (%4.1f%%) %7.0f insn/pkt", resultP.cacheMisses / packets,
+            resultP.cacheReferences ? 100.0 * resultP.cacheMisses / resultP.cacheReferences : 0.0, resultP.instructions / packets);
+  else
+     printf(" cache misses n/a");
+  if (resultP.outputUnit)
+     printf(" %llu %s", (unsigned long long)resultP.output, resultP.outputUnit);
+  printf("\n");
+}
+
+class cBenchRun {
+private:
+  cBenchResult &resultM;
+  cBenchCounters countersM;
+  uint64_t startM;
+  uint64_t allocationsM;
+public:
+  explicit cBenchRun(cBenchResult &resultP)
+  : resultM(resultP)
+  {
+    allocationsM = allocationsS.load();
+    countersM.Start();
+    startM = NowNs();
+  }
+  ~cBenchRun()
+  {
+    resultM.ns = NowNs() - startM;
+    countersM.Stop();
+    resultM.allocations = allocationsS.load() - allocationsM;
+    resultM.counters = countersM.IsValid();
+    resultM.cacheMisses = countersM.CacheMisses();
+    resultM.cacheReferences = countersM.CacheReferences();
+    resultM.instructions = countersM.Instructions();
+  }
+};
+
+static void BenchRtp(cBenchStream &streamP, int loopsP)
+{
+  cBenchTuner tuner;
+  cSatipRtp rtp(tuner);
+  cBenchResult result = { "rtp", 0, 0, 0, 0, 0, "payload bytes", false, 0, 0, 0 };
+  {
+    cBenchRun run(result);
+    for (int l = 0; l < loopsP; ++l) {
+        for (int i = 0; i < streamP.Datagrams(); ++i) {
+            rtp.Process(streamP.Datagram(i), streamP.DatagramLength(i));
+            result.bytes += streamP.DatagramLength(i);
+            }
+        }
+  }
+  result.packets = (uint64_t)loopsP * streamP.Packets();
+  result.output = tuner.Bytes();
+  Report(result);
+}
+
+static void BenchDevice(cBenchStream &streamP, int loopsP, int drainP)
+{
+  cBenchDevice device;
+  if (!device.IsValid()) {
+     fprintf(stderr, "Cannot allocate the TS buffer\n");
+     return;
+     }
+  for (int pid = 0; pid < 0x2000; ++pid) {
+      if (cBenchStream::IsRequestedPid(pid))
+         device.SetPriorityPid(pid);
+      }
+  cBenchResult result = { "device", 0, 0, 0, 0, 0, "packets delivered", false, 0, 0, 0 };
+  {
+    cBenchRun run(result);
+    // The poller writes datagrams, the receiver drains them in between
+    for (int l = 0; l < loopsP; ++l) {
+        for (int i = 0; i < streamP.Datagrams(); ++i) {
+            device.WriteData(streamP.Datagram(i) + 12, streamP.DatagramLength(i) - 12);
+            result.bytes += streamP.DatagramLength(i) - 12;
+            if (i % drainP == drainP - 1) {
+               while (device.GetData())
+                     result.output++;
+               }
+            }
+        }
+    while (device.GetData())
+          result.output++;
+  }
+  result.packets = (uint64_t)loopsP * streamP.Packets();
+  Report(result);
+  if (device.Dropped())
+     printf("%-10s %llu packets dropped\n", "", (unsigned long long)device.Dropped());
+}
+
+static void BenchSections(cBenchStream &streamP, int loopsP)
+{
+  std::vector<cSatipSectionFilter *> filters;
+  for (unsigned int i = 0; i < ELEMENTS(benchFiltersS); ++i)
+      filters.push_back(new cSatipSectionFilter(0, benchFiltersS[i].pid, benchFiltersS[i].tid, benchFiltersS[i].mask));
+  cBenchResult result = { "sections", 0, 0, 0, 0, 0, "sections", false, 0, 0, 0 };
+  {
+    cBenchRun run(result);
+    for (int l = 0; l < loopsP; ++l) {
+        for (int i = 0; i < streamP.Packets(); ++i) {
+            for (size_t f = 0; f < filters.size(); ++f)
+                filters[f]->Process(streamP.Packet(i));
+            result.bytes += TS_SIZE;
+            // Hand over the sections like the handler thread does
+            if (i % 64 == 63) {
+               for (size_t f = 0; f < filters.size(); ++f) {
+                   while (filters[f]->Available())
+                         filters[f]->Send(false);
+                   result.output += DrainSections(filters[f]->GetFd());
+                   }
+               }
+            }
+        }
+  }
+  result.packets = (uint64_t)loopsP * streamP.Packets();
+  Report(result);
+  for (size_t f = 0; f < filters.size(); ++f)
+      delete filters[f];
+}
+
+static void BenchHandler(cBenchStream &streamP, int loopsP)
+{
+  // End to end through the handler thread: done when no section has
+  // arrived for a while after the last write
+  enum { eIdleTimeoutMs = 200 };
+  unsigned int bufsize = (unsigned int)SATIP_BUFFER_SIZE;
+  bufsize -= (bufsize % TS_SIZE);
+  cSatipSectionFilterHandler *handler = new cSatipSectionFilterHandler(0, bufsize + 1);
+  std::vector<int> fds;
+  for (unsigned int i = 0; i < ELEMENTS(benchFiltersS); ++i)
+      fds.push_back(handler->Open(benchFiltersS[i].pid, benchFiltersS[i].tid, benchFiltersS[i].mask));
+  cBenchResult result = { "handler", 0, 0, 0, 0, 0, "sections", false, 0, 0, 0 };
+  std::atomic<bool> writing(true);
+  std::atomic<uint64_t> lastSection(NowNs());
+  std::atomic<uint64_t> sections(0);
+  std::thread reader([&]() {
+    std::vector<struct pollfd> pfds;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        struct pollfd pfd = { fds[i], POLLIN, 0 };
+        pfds.push_back(pfd);
+        }
+    while (writing || (NowNs() - lastSection < eIdleTimeoutMs * 1000000ULL)) {
+          if (poll(&pfds[0], pfds.size(), 10) > 0) {
+             for (size_t i = 0; i < pfds.size(); ++i) {
+                 if (pfds[i].revents & POLLIN) {
+                    sections += DrainSections(pfds[i].fd);
+                    lastSection = NowNs();
+                    }
+                 }
+             }
+          }
+    });
+  uint64_t start = NowNs();
+  {
+    cBenchRun run(result);
+    for (int l = 0; l < loopsP; ++l) {
+        for (int i = 0; i < streamP.Datagrams(); ++i) {
+            handler->Write(streamP.Datagram(i) + 12, streamP.DatagramLength(i) - 12);
+            result.bytes += streamP.DatagramLength(i) - 12;
+            }
+        }
+    writing = false;
+    reader.join();
+  }
+  result.ns = max(lastSection.load(), start) - start;
+  result.packets = (uint64_t)loopsP * streamP.Packets();
+  result.output = sections;
+  Report(result);
+  for (size_t i = 0; i < fds.size(); ++i)
+      handler->Close(fds[i]);
+  delete handler;
+}
+
+// --- main -------------------------------------------------------------------
+
+static void Usage(const char *nameP)
+{
+  printf("Usage: %s [options] [rtp] [device] [sections] [handler]\n\n"
+         "  -f, --file=<file>      use a recorded TS or an RTP capture of the CAPT\n"
+         "                         SVDRP command instead of a synthetic mux\n"
+         "  -e, --eit              synthesize an EIT heavy mux\n"
+         "  -p, --packets=<n>      number of TS packets held in memory (default 200000)\n"
+         "  -l, --loops=<n>        passes over the packets per benchmark (default 10)\n"
+         "  -o, --overflow=<n>     TS buffer overflow policy: 0 = drop datagram,\n"
+         "                         1 = drop low priority, 2 = drop oldest (default 0)\n"
+         "  -d, --drain=<n>        datagrams written between the reads of the device\n"
+         "                         benchmark, large values provoke overflows (default 8)\n"
+         "  -v, --verbose          print the plugin's log messages\n\n"
+         "All benchmarks are run unless some are named.\n",
+         nameP);
+}
+
+int main(int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    { "file",     required_argument, NULL, 'f' },
+    { "eit",      no_argument,       NULL, 'e' },
+    { "packets",  required_argument, NULL, 'p' },
+    { "loops",    required_argument, NULL, 'l' },
+    { "overflow", required_argument, NULL, 'o' },
+    { "drain",    required_argument, NULL, 'd' },
+    { "verbose",  no_argument,       NULL, 'v' },
+    { "help",     no_argument,       NULL, 'h' },
+    { NULL,       no_argument,       NULL,  0  }
+    };
+  const char *file = NULL;
+  bool eitHeavy = false;
+  int packets = 200000;
+  int loops = 10;
+  int drain = 8;
+  int c;
+  while ((c = getopt_long(argc, argv, "f:ep:l:o:d:vh", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'f': file = optarg; break;
+      case 'e': eitHeavy = true; break;
+      case 'p': packets = max(atoi(optarg), 7); break;
+      case 'l': loops = max(atoi(optarg), 1); break;
+      case 'o': SatipConfig.SetOverflowPolicy(constrain(atoi(optarg), 0, (int)cSatipConfig::eOverflowPolicyCount - 1)); break;
+      case 'd': drain = max(atoi(optarg), 1); break;
+      case 'v': SysLogLevel = 3; SatipConfig.SetTraceMode(0xFFFF); break;
+      default:
+           Usage(argv[0]);
+           return (c == 'h') ? 0 : 1;
+      }
+    }
+  cBenchStream stream;
+  if (file) {
+     if (!stream.Load(file, packets))
+        return 1;
+     }
+  else
+     stream.Synthesize(packets, eitHeavy);
+  stream.Packetize();
+  printf("%d TS packets (%s), %d datagrams, %d loops\n", stream.Packets(), file ? file : eitHeavy ? "synthetic, EIT heavy" : "synthetic",
+         stream.Datagrams(), loops);
+
+  bool all = (optind >= argc);
+  for (int i = optind; i < argc; ++i) {
+      if (strcmp(argv[i], "rtp") && strcmp(argv[i], "device") && strcmp(argv[i], "sections") && strcmp(argv[i], "handler")) {
+         Usage(argv[0]);
+         return 1;
+         }
+      }
+  for (const char *name : { "rtp", "device", "sections", "handler" }) {
+      bool selected = all;
+      for (int i = optind; i < argc; ++i)
+          selected |= !strcmp(argv[i], name);
+      if (!selected)
+         continue;
+      if (!strcmp(name, "rtp"))
+         BenchRtp(stream, loops);
+      else if (!strcmp(name, "device"))
+         BenchDevice(stream, loops, drain);
+      else if (!strcmp(name, "sections"))
+         BenchSections(stream, loops);
+      else
+         BenchHandler(stream, loops);
+      }
+  return 0;
+}
@@ -0,0 +1,996 @@
+/*
+ * satipsim.c: SAT>IP server simulator for the SAT>IP plugin
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * A standalone SAT>IP server for load and fault testing of the plugin
+ * without any real hardware: SSDP responder, device description, RTSP
+ * OPTIONS/SETUP/PLAY/DESCRIBE/TEARDOWN, unicast RTP streaming from a TS
+ * file (or synthetic packets) at a fixed bitrate and RTCP SR + APP "SES1"
+ * reception reports. Packet loss, reordering, delays and "503 No-More"
+ * answers can be injected.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <bitset>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TS_SIZE          188
+#define TS_SYNC_BYTE     0x47
+#define TS_NULL_PID      0x1FFF
+#define RTP_TS_PACKETS   7
+#define SSDP_ADDRESS     "239.255.255.250"
+#define SSDP_PORT        1900
+#define SSDP_SERVER_TYPE "urn:ses-com:device:SatIPServer:1"
+
+// --- cSimConfig -------------------------------------------------------------
+
+struct cSimConfig {
+  std::string address;
+  std::string name;
+  std::string capabilities;
+  std::string file;
+  std::string uuid;
+  int httpPort;
+  int rtspPort;
+  int bitrateKbps;
+  int sessionTimeoutS;
+  int lossPermille;
+  int reorderPermille;
+  int delayPermille;
+  int delayMs;
+  int noMorePermille;
+  int verbose;
+  cSimConfig()
+  : address("127.0.0.1"), name("SAT>IP simulator"), capabilities("DVBS2-4,DVBT2-2,DVBC-2"), file(""), uuid(""),
+    httpPort(8888), rtspPort(8554), bitrateKbps(8000), sessionTimeoutS(60), lossPermille(0), reorderPermille(0),
+    delayPermille(0), delayMs(0), noMorePermille(0), verbose(0) {}
+};
+
+static cSimConfig configS;
+static std::atomic<bool> runningS(true);
+
+static void Log(int levelP, const char *formatP, ...)
+{
+  if (levelP > configS.verbose)
+     return;
+  va_list ap;
+  va_start(ap, formatP);
+  vfprintf(stderr, formatP, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+static uint64_t NowUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static bool Chance(int permilleP)
+{
+  return (permilleP > 0) && ((rand() % 1000) < permilleP);
+}
+
+static std::string Parameter(const std::string &queryP, const char *nameP)
+{
+  // Values of "name=value" pairs separated by '&'
+  size_t start = 0;
+  size_t len = strlen(nameP);
+  while (start < queryP.size()) {
+        size_t end = queryP.find('&', start);
+        if (end == std::string::npos)
+           end = queryP.size();
+        if ((end - start > len) && !strncasecmp(queryP.c_str() + start, nameP, len) && (queryP[start + len] == '='))
+           return queryP.substr(start + len + 1, end - start - len - 1);
+        start = end + 1;
+        }
+  return "";
+}
+
+// --- cSimStream -------------------------------------------------------------
+
+class cSimStream {
+private:
+  int idM;
+  std::string sessionM;
+  std::string systemM;
+  int frontendM;
+  std::string clientM;
+  int rtpPortM;
+  int rtcpPortM;
+  std::string tuningM;
+  std::bitset<0x2000> pidsM;
+  bool allPidsM;
+  std::mutex mutexM;
+  std::thread threadM;
+  std::atomic<bool> playingM;
+  std::atomic<uint64_t> seenM;
+  uint32_t ssrcM;
+  uint16_t sequenceM;
+  uint8_t continuityM[0x2000];
+  FILE *fileM;
+  uint64_t packetsM;
+  uint64_t bytesM;
+  bool ReadPacket(unsigned char *packetP);
+  void SynthesizePacket(unsigned char *packetP);
+  int SendReport(int socketP, const struct sockaddr_in &addrP, uint32_t timestampP);
+  void Action(void);
+
+public:
+  cSimStream(int idP, const std::string &sessionP, const std::string &systemP, int frontendP, const std::string &clientP, int rtpPortP, int rtcpPortP);
+  ~cSimStream();
+  int Id(void) const { return idM; }
+  const std::string &Session(void) const { return sessionM; }
+  const std::string &System(void) const { return systemM; }
+  int Frontend(void) const { return frontendM; }
+  int RtpPort(void) const { return rtpPortM; }
+  int RtcpPort(void) const { return rtcpPortM; }
+  uint16_t Sequence(void) const { return sequenceM; }
+  void Touch(void) { seenM = NowUs(); }
+  bool Expired(void) const { return (NowUs() - seenM) > (uint64_t)configS.sessionTimeoutS * 1000000ULL; }
+  void Tune(const std::string &queryP);
+  std::string TunerString(void);
+  void Play(void);
+  void Stop(void);
+};
+
+cSimStream::cSimStream(int idP, const std::string &sessionP, const std::string &systemP, int frontendP, const std::string &clientP, int rtpPortP, int rtcpPortP)
+: idM(idP),
+  sessionM(sessionP),
+  systemM(systemP),
+  frontendM(frontendP),
+  clientM(clientP),
+  rtpPortM(rtpPortP),
+  rtcpPortM(rtcpPortP),
+  tuningM(""),
+  allPidsM(false),
+  playingM(false),
+  seenM(NowUs()),
+  ssrcM((uint32_t)rand()),
+  sequenceM((uint16_t)rand()),
+  fileM(NULL),
+  packetsM(0),
+  bytesM(0)
+{
+  memset(continuityM, 0, sizeof(continuityM));
+}
+
+cSimStream::~cSimStream()
+{
+  Stop();
+  Log(1, "stream %d: %llu packets, %llu bytes sent", idM, (unsigned long long)packetsM, (unsigned long long)bytesM);
+}
+
+void cSimStream::Tune(const std::string &queryP)
+{
+  std::lock_guard<std::mutex> lock(mutexM);
+  // A new transponder replaces the pid set
+  if (!Parameter(queryP, "freq").empty()) {
+     tuningM = queryP;
+     pidsM.reset();
+     allPidsM = false;
+     }
+  std::string pids = Parameter(queryP, "pids");
+  if (!pids.empty()) {
+     pidsM.reset();
+     allPidsM = (pids == "all");
+     }
+  else
+     pids = Parameter(queryP, "addpids");
+  for (const char *p = pids.c_str(); *p; ) {
+      int pid = (int)strtol(p, (char **)&p, 10);
+      if ((pid >= 0) && (pid < 0x2000))
+         pidsM.set(pid);
+      p += strspn(p, ",");
+      if (!isdigit(*p))
+         break;
+      }
+  std::string del = Parameter(queryP, "delpids");
+  for (const char *p = del.c_str(); *p; ) {
+      int pid = (int)strtol(p, (char **)&p, 10);
+      if ((pid >= 0) && (pid < 0x2000))
+         pidsM.reset(pid);
+      p += strspn(p, ",");
+      if (!isdigit(*p))
+         break;
+      }
+}
+
+std::string cSimStream::TunerString(void)
+{
+  std::lock_guard<std::mutex> lock(mutexM);
+  std::string freq = Parameter(tuningM, "freq");
+  std::string msys = Parameter(tuningM, "msys");
+  std::string pids = "";
+  if (allPidsM)
+     pids = "all";
+  else {
+     for (int i = 0; i < 0x2000; ++i) {
+         if (pidsM.test(i))
+            pids += (pids.empty() ? "" : ",") + std::to_string(i);
+         }
+     }
+  char buf[512];
+  if (!strncasecmp(msys.c_str(), "dvbs", 4))
+     snprintf(buf, sizeof(buf), "ver=1.0;src=%s;tuner=%d,224,1,15,%s,%s,%s,%s,%s,%s,%s,%s;pids=%s",
+              Parameter(tuningM, "src").empty() ? "1" : Parameter(tuningM, "src").c_str(), frontendM, freq.c_str(),
+              Parameter(tuningM, "pol").c_str(), msys.c_str(), Parameter(tuningM, "mtype").c_str(), Parameter(tuningM, "plts").c_str(),
+              Parameter(tuningM, "ro").c_str(), Parameter(tuningM, "sr").c_str(), Parameter(tuningM, "fec").c_str(), pids.c_str());
+  else if (!strncasecmp(msys.c_str(), "dvbc", 4))
+     snprintf(buf, sizeof(buf), "ver=1.2;tuner=%d,224,1,15,%s,%s,%s,%s,%s,,,,;pids=%s", frontendM, freq.c_str(),
+              Parameter(tuningM, "bw").c_str(), msys.c_str(), Parameter(tuningM, "mtype").c_str(), Parameter(tuningM, "sr").c_str(), pids.c_str());
+  else
+     snprintf(buf, sizeof(buf), "ver=1.1;tuner=%d,224,1,15,%s,%s,%s,%s,%s,%s,%s,%s,,;pids=%s", frontendM, freq.c_str(),
+              Parameter(tuningM, "bw").c_str(), msys.c_str(), Parameter(tuningM, "tmode").c_str(), Parameter(tuningM, "mtype").c_str(),
+              Parameter(tuningM, "gi").c_str(), Parameter(tuningM, "fec").c_str(), Parameter(tuningM, "plp").c_str(), pids.c_str());
+  return buf;
+}
+
+bool cSimStream::ReadPacket(unsigned char *packetP)
+{
+  // Scan at most one file round for a requested pid
+  for (int i = 0; fileM && (i < 2); ++i) {
+      while (fread(packetP, TS_SIZE, 1, fileM) == 1) {
+            if (packetP[0] != TS_SYNC_BYTE) {
+               // Resync on the next sync byte
+               unsigned char *p = (unsigned char *)memchr(packetP + 1, TS_SYNC_BYTE, TS_SIZE - 1);
+               if (p)
+                  fseek(fileM, (long)(p - packetP) - TS_SIZE, SEEK_CUR);
+               continue;
+               }
+            int pid = ((packetP[1] & 0x1F) << 8) | packetP[2];
+            std::lock_guard<std::mutex> lock(mutexM);
+            if (allPidsM || pidsM.test(pid))
+               return true;
+            }
+      rewind(fileM);
+      }
+  return false;
+}
+
+void cSimStream::SynthesizePacket(unsigned char *packetP)
+{
+  // Cycle through the requested pids with valid continuity counters
+  static const int fallbackPid = 0x100;
+  int pid = fallbackPid;
+  {
+    std::lock_guard<std::mutex> lock(mutexM);
+    if (!allPidsM && pidsM.any()) {
+       pid = (int)(packetsM % 0x2000);
+       for (int i = 0; i < 0x2000; ++i, pid = (pid + 1) % 0x2000) {
+           if (pidsM.test(pid))
+              break;
+           }
+       }
+  }
+  memset(packetP, 0xFF, TS_SIZE);
+  packetP[0] = TS_SYNC_BYTE;
+  packetP[1] = (pid >> 8) & 0x1F;
+  packetP[2] = pid & 0xFF;
+  packetP[3] = 0x10 | (continuityM[pid]++ & 0x0F);
+  memcpy(packetP + 4, &packetsM, sizeof(packetsM));
+}
+
+int cSimStream::SendReport(int socketP, const struct sockaddr_in &addrP, uint32_t timestampP)
+{
+  unsigned char buf[1024];
+  std::string app = TunerString();
+  int len = 0;
+  // Sender report
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint32_t ntpSec = (uint32_t)ts.tv_sec + 2208988800U;
+  uint32_t ntpFrac = (uint32_t)(((uint64_t)ts.tv_nsec << 32) / 1000000000ULL);
+  uint32_t sr[] = { ssrcM, ntpSec, ntpFrac, timestampP, (uint32_t)packetsM, (uint32_t)bytesM };
+  buf[len++] = 0x80;
+  buf[len++] = 200;
+  buf[len++] = 0;
+  buf[len++] = 6;
+  for (unsigned int i = 0; i < sizeof(sr) / sizeof(sr[0]); ++i) {
+      uint32_t v = htonl(sr[i]);
+      memcpy(buf + len, &v, 4);
+      len += 4;
+      }
+  // Application defined "SES1" with the reception status string
+  int slen = (int)app.size();
+  int alen = (16 + slen + 3) & ~3;
+  if (len + alen > (int)sizeof(buf))
+     return -1;
+  memset(buf + len, 0, alen);
+  buf[len] = 0x80;
+  buf[len + 1] = 204;
+  buf[len + 2] = ((alen / 4 - 1) >> 8) & 0xFF;
+  buf[len + 3] = (alen / 4 - 1) & 0xFF;
+  uint32_t ssrc = htonl(ssrcM);
+  memcpy(buf + len + 4, &ssrc, 4);
+  memcpy(buf + len + 8, "SES1", 4);
+  buf[len + 14] = (slen >> 8) & 0xFF;
+  buf[len + 15] = slen & 0xFF;
+  memcpy(buf + len + 16, app.data(), slen);
+  len += alen;
+  return (int)sendto(socketP, buf, len, 0, (const struct sockaddr *)&addrP, sizeof(addrP));
+}
+
+void cSimStream::Action(void)
+{
+  int rtpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  int rtcpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in rtpAddr, rtcpAddr;
+  memset(&rtpAddr, 0, sizeof(rtpAddr));
+  rtpAddr.sin_family = AF_INET;
+  rtpAddr.sin_addr.s_addr = inet_addr(clientM.c_str());
+  rtpAddr.sin_port = htons(rtpPortM);
+  rtcpAddr = rtpAddr;
+  rtcpAddr.sin_port = htons(rtcpPortM);
+  if (!configS.file.empty() && !(fileM = fopen(configS.file.c_str(), "rb")))
+     Log(0, "stream %d: cannot open %s - sending synthetic packets", idM, configS.file.c_str());
+  // Pace the datagrams to the configured bitrate
+  uint64_t intervalUs = (uint64_t)RTP_TS_PACKETS * TS_SIZE * 8 * 1000 / (uint64_t)configS.bitrateKbps;
+  uint64_t start = NowUs();
+  uint64_t next = start;
+  uint64_t report = start;
+  unsigned char datagram[12 + RTP_TS_PACKETS * TS_SIZE];
+  unsigned char held[sizeof(datagram)];
+  int heldLen = 0;
+  Log(1, "stream %d: streaming to %s:%d at %d kbit/s", idM, clientM.c_str(), rtpPortM, configS.bitrateKbps);
+  while (playingM && runningS) {
+        uint64_t now = NowUs();
+        if (now < next) {
+           usleep((useconds_t)(next - now));
+           continue;
+           }
+        next += intervalUs;
+        // Injected stall: the following datagrams are sent as a burst
+        if (Chance(configS.delayPermille) && configS.delayMs > 0)
+           usleep(configS.delayMs * 1000);
+        int len = 12;
+        for (int i = 0; i < RTP_TS_PACKETS; ++i) {
+            if (fileM) {
+               if (!ReadPacket(datagram + len))
+                  break;
+               }
+            else
+               SynthesizePacket(datagram + len);
+            len += TS_SIZE;
+            }
+        uint32_t timestamp = (uint32_t)((now - start) * 90 / 1000);
+        if (len > 12) {
+           datagram[0] = 0x80;
+           datagram[1] = 33;
+           datagram[2] = (sequenceM >> 8) & 0xFF;
+           datagram[3] = sequenceM & 0xFF;
+           uint32_t v = htonl(timestamp);
+           memcpy(datagram + 4, &v, 4);
+           v = htonl(ssrcM);
+           memcpy(datagram + 8, &v, 4);
+           sequenceM++;
+           packetsM++;
+           bytesM += len - 12;
+           // Injected faults: the sequence number is consumed anyway
+           if (Chance(configS.lossPermille))
+              ;
+           else if (!heldLen && Chance(configS.reorderPermille)) {
+              memcpy(held, datagram, len);
+              heldLen = len;
+              }
+           else {
+              sendto(rtpSocket, datagram, len, 0, (struct sockaddr *)&rtpAddr, sizeof(rtpAddr));
+              if (heldLen) {
+                 sendto(rtpSocket, held, heldLen, 0, (struct sockaddr *)&rtpAddr, sizeof(rtpAddr));
+                 heldLen = 0;
+                 }
+              }
+           }
+        if (now - report >= 200000) {
+           SendReport(rtcpSocket, rtcpAddr, timestamp);
+           report = now;
+           }
+        }
+  if (fileM) {
+     fclose(fileM);
+     fileM = NULL;
+     }
+  close(rtcpSocket);
+  close(rtpSocket);
+}
+
+void cSimStream::Play(void)
+{
+  if (!playingM.exchange(true))
+     threadM = std::thread(&cSimStream::Action, this);
+}
+
+void cSimStream::Stop(void)
+{
+  playingM = false;
+  if (threadM.joinable())
+     threadM.join();
+}
+
+// --- cSimServer -------------------------------------------------------------
+
+class cSimServer {
+private:
+  struct cConnection {
+    int fd;
+    bool rtsp;
+    std::string peer;
+    std::string input;
+  };
+  int ssdpM;
+  int httpM;
+  int rtspM;
+  std::vector<cConnection> connectionsM;
+  std::map<int, cSimStream *> streamsM;
+  std::map<std::string, int> frontendsM;
+  int nextStreamIdM;
+  uint64_t lastNotifyM;
+  int Listen(int portP);
+  bool OpenSsdp(void);
+  void Notify(bool aliveP);
+  void ProcessSsdp(void);
+  void ProcessConnection(cConnection &connectionP);
+  std::string HandleHttp(const std::string &requestP);
+  std::string HandleRtsp(cConnection &connectionP, const std::string &requestP);
+  std::string Description(void);
+  std::string SystemOf(const std::string &msysP);
+  int FreeFrontend(const std::string &systemP);
+  cSimStream *FindStream(const std::string &sessionP);
+  void Expire(void);
+
+public:
+  cSimServer();
+  ~cSimServer();
+  bool Open(void);
+  void Run(void);
+};
+
+cSimServer::cSimServer()
+: ssdpM(-1),
+  httpM(-1),
+  rtspM(-1),
+  nextStreamIdM(1),
+  lastNotifyM(0)
+{
+  // Frontend counts per delivery system, e.g. "DVBS2-4,DVBT2-2"
+  std::string caps = configS.capabilities;
+  size_t start = 0;
+  while (start < caps.size()) {
+        size_t end = caps.find(',', start);
+        if (end == std::string::npos)
+           end = caps.size();
+        std::string cap = caps.substr(start, end - start);
+        size_t dash = cap.find('-');
+        if (dash != std::string::npos)
+           frontendsM[cap.substr(0, dash)] += atoi(cap.c_str() + dash + 1);
+        start = end + 1;
+        }
+}
+
+cSimServer::~cSimServer()
+{
+  Notify(false);
+  for (std::map<int, cSimStream *>::iterator i = streamsM.begin(); i != streamsM.end(); ++i)
+      delete i->second;
+  for (size_t i = 0; i < connectionsM.size(); ++i)
+      close(connectionsM[i].fd);
+  if (ssdpM >= 0)
+     close(ssdpM);
+  if (httpM >= 0)
+     close(httpM);
+  if (rtspM >= 0)
+     close(rtspM);
+}
+
+int cSimServer::Listen(int portP)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(portP);
+  addr.sin_addr.s_addr = inet_addr(configS.address.c_str());
+  if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 64) < 0)) {
+     Log(0, "cannot listen on %s:%d: %s", configS.address.c_str(), portP, strerror(errno));
+     close(fd);
+     return -1;
+     }
+  return fd;
+}
+
+bool cSimServer::OpenSsdp(void)
+{
+  ssdpM = socket(AF_INET, SOCK_DGRAM, 0);
+  int yes = 1;
+  setsockopt(ssdpM, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#ifdef SO_REUSEPORT
+  setsockopt(ssdpM, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#endif
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SSDP_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(ssdpM, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+     Log(0, "cannot bind SSDP port: %s - discovery disabled", strerror(errno));
+     close(ssdpM);
+     ssdpM = -1;
+     return false;
+     }
+  struct ip_mreq mreq;
+  mreq.imr_multiaddr.s_addr = inet_addr(SSDP_ADDRESS);
+  mreq.imr_interface.s_addr = inet_addr(configS.address.c_str());
+  setsockopt(ssdpM, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+  setsockopt(ssdpM, IPPROTO_IP, IP_MULTICAST_IF, &mreq.imr_interface, sizeof(mreq.imr_interface));
+  setsockopt(ssdpM, IPPROTO_IP, IP_MULTICAST_LOOP, &yes, sizeof(yes));
+  return true;
+}
+
+bool cSimServer::Open(void)
+{
+  httpM = Listen(configS.httpPort);
+  rtspM = Listen(configS.rtspPort);
+  if ((httpM < 0) || (rtspM < 0))
+     return false;
+  OpenSsdp();
+  Notify(true);
+  Log(0, "%s: http://%s:%d/desc.xml rtsp://%s:%d/ capabilities %s", configS.name.c_str(), configS.address.c_str(), configS.httpPort,
+      configS.address.c_str(), configS.rtspPort, configS.capabilities.c_str());
+  return true;
+}
+
+void cSimServer::Notify(bool aliveP)
+{
+  if (ssdpM < 0)
+     return;
+  char msg[1024];
+  snprintf(msg, sizeof(msg),
+           "NOTIFY * HTTP/1.1\r\n"
+           "HOST: %s:%d\r\n"
+           "CACHE-CONTROL: max-age=1800\r\n"
+           "LOCATION: http://%s:%d/desc.xml\r\n"
+           "NT: %s\r\n"
+           "NTS: ssdp:%s\r\n"
+           "SERVER: Linux/1.0 UPnP/1.1 satipsim/1.0\r\n"
+           "USN: uuid:%s::%s\r\n"
+           "BOOTID.UPNP.ORG: 1\r\n"
+           "CONFIGID.UPNP.ORG: 0\r\n"
+           "DEVICEID.SES.COM: 1\r\n"
+           "\r\n",
+           SSDP_ADDRESS, SSDP_PORT, configS.address.c_str(), configS.httpPort, SSDP_SERVER_TYPE, aliveP ? "alive" : "byebye",
+           configS.uuid.c_str(), SSDP_SERVER_TYPE);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SSDP_PORT);
+  addr.sin_addr.s_addr = inet_addr(SSDP_ADDRESS);
+  sendto(ssdpM, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr));
+  lastNotifyM = NowUs();
+}
+
+void cSimServer::ProcessSsdp(void)
+{
+  char buf[2048];
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof(from);
+  int len = (int)recvfrom(ssdpM, buf, sizeof(buf) - 1, MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+  if (len <= 0)
+     return;
+  buf[len] = 0;
+  if (strncmp(buf, "M-SEARCH", 8) || (!strcasestr(buf, SSDP_SERVER_TYPE) && !strcasestr(buf, "ssdp:all")))
+     return;
+  char msg[1024];
+  snprintf(msg, sizeof(msg),
+           "HTTP/1.1 200 OK\r\n"
+           "CACHE-CONTROL: max-age=1800\r\n"
+           "EXT:\r\n"
+           "LOCATION: http://%s:%d/desc.xml\r\n"
+           "SERVER: Linux/1.0 UPnP/1.1 satipsim/1.0\r\n"
+           "ST: %s\r\n"
+           "USN: uuid:%s::%s\r\n"
+           "BOOTID.UPNP.ORG: 1\r\n"
+           "CONFIGID.UPNP.ORG: 0\r\n"
+           "DEVICEID.SES.COM: 1\r\n"
+           "\r\n",
+           configS.address.c_str(), configS.httpPort, SSDP_SERVER_TYPE, configS.uuid.c_str(), SSDP_SERVER_TYPE);
+  sendto(ssdpM, msg, strlen(msg), 0, (struct sockaddr *)&from, fromlen);
+  Log(2, "answered M-SEARCH from %s", inet_ntoa(from.sin_addr));
+}
+
+std::string cSimServer::Description(void)
+{
+  return "<?xml version=\"1.0\"?>\r\n"
+         "<root xmlns=\"urn:schemas-upnp-org:device-1-0\" configId=\"0\">\r\n"
+         "<specVersion><major>1</major><minor>1</minor></specVersion>\r\n"
+         "<device>\r\n"
+         "<deviceType>" SSDP_SERVER_TYPE "</deviceType>\r\n"
+         "<friendlyName>" + configS.name + "</friendlyName>\r\n"
+         "<manufacturer>vdr-plugin-satip</manufacturer>\r\n"
+         "<modelName>satipsim</modelName>\r\n"
+         "<UDN>uuid:" + configS.uuid + "</UDN>\r\n"
+         "<satip:X_SATIPCAP xmlns:satip=\"urn:ses-com:satip\">" + configS.capabilities + "</satip:X_SATIPCAP>\r\n"
+         "</device>\r\n"
+         "</root>\r\n";
+}
+
+std::string cSimServer::HandleHttp(const std::string &requestP)
+{
+  if (requestP.compare(0, 13, "GET /desc.xml") != 0)
+     return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  std::string body = Description();
+  char header[512];
+  snprintf(header, sizeof(header),
+           "HTTP/1.1 200 OK\r\n"
+           "Content-Type: text/xml\r\n"
+           "Content-Length: %zu\r\n"
+           "ETag: \"%s-%d\"\r\n"
+           "X-SATIP-RTSP-Port: %d\r\n"
+           "Connection: close\r\n"
+           "\r\n",
+           body.size(), configS.uuid.c_str(), configS.rtspPort, configS.rtspPort);
+  return header + body;
+}
+
+std::string cSimServer::SystemOf(const std::string &msysP)
+{
+  // Map a requested delivery system onto the announced frontend types
+  const char *candidates[4] = { NULL, NULL, NULL, NULL };
+  if (!strncasecmp(msysP.c_str(), "dvbs", 4)) {
+     candidates[0] = "DVBS2";
+     candidates[1] = "DVBS";
+     }
+  else if (!strncasecmp(msysP.c_str(), "dvbt", 4)) {
+     candidates[0] = "DVBT2";
+     candidates[1] = "DVBT";
+     }
+  else if (!strncasecmp(msysP.c_str(), "dvbc", 4)) {
+     candidates[0] = "DVBC2";
+     candidates[1] = "DVBC";
+     }
+  for (int i = 0; candidates[i]; ++i) {
+      if (frontendsM.count(candidates[i]))
+         return candidates[i];
+      }
+  return "";
+}
+
+int cSimServer::FreeFrontend(const std::string &systemP)
+{
+  std::map<std::string, int>::iterator f = frontendsM.find(systemP);
+  if (f == frontendsM.end())
+     return -1;
+  std::vector<bool> used(f->second, false);
+  for (std::map<int, cSimStream *>::iterator i = streamsM.begin(); i != streamsM.end(); ++i) {
+      if ((i->second->System() == systemP) && (i->second->Frontend() >= 1) && (i->second->Frontend() <= f->second))
+         used[i->second->Frontend() - 1] = true;
+      }
+  for (int i = 0; i < f->second; ++i) {
+      if (!used[i])
+         return i + 1;
+      }
+  return -1;
+}
+
+cSimStream *cSimServer::FindStream(const std::string &sessionP)
+{
+  for (std::map<int, cSimStream *>::iterator i = streamsM.begin(); i != streamsM.end(); ++i) {
+      if (i->second->Session() == sessionP)
+         return i->second;
+      }
+  return NULL;
+}
+
+std::string cSimServer::HandleRtsp(cConnection &connectionP, const std::string &requestP)
+{
+  char method[32] = "", url[1024] = "";
+  if (sscanf(requestP.c_str(), "%31s %1023s", method, url) != 2)
+     return "RTSP/1.0 400 Bad Request\r\n\r\n";
+  int cseq = 0;
+  std::string session = "";
+  std::string transport = "";
+  size_t pos = 0;
+  while ((pos = requestP.find("\r\n", pos)) != std::string::npos) {
+        pos += 2;
+        const char *h = requestP.c_str() + pos;
+        if (!strncasecmp(h, "CSeq:", 5))
+           cseq = atoi(h + 5);
+        else if (!strncasecmp(h, "Session:", 8))
+           session = std::string(h + 8 + strspn(h + 8, " "), strcspn(h + 8 + strspn(h + 8, " "), ";\r\n"));
+        else if (!strncasecmp(h, "Transport:", 10))
+           transport = std::string(h + 10 + strspn(h + 10, " "), strcspn(h + 10 + strspn(h + 10, " "), "\r\n"));
+        }
+  // rtsp://host:port/[stream=N][?query]
+  std::string uri = url;
+  std::string query = (uri.find('?') != std::string::npos) ? uri.substr(uri.find('?') + 1) : "";
+  int streamId = (uri.find("stream=") != std::string::npos) ? atoi(uri.c_str() + uri.find("stream=") + 7) : 0;
+  Log(2, "%s %s %s", connectionP.peer.c_str(), method, url);
+
+  if (configS.delayMs > 0 && Chance(configS.delayPermille))
+     usleep(configS.delayMs * 1000);
+
+  char head[256];
+  snprintf(head, sizeof(head), "CSeq: %d\r\n", cseq);
+  cSimStream *stream = session.empty() ? NULL : FindStream(session);
+  if (!session.empty() && !stream)
+     return std::string("RTSP/1.0 454 Session Not Found\r\n") + head + "\r\n";
+  if (stream)
+     stream->Touch();
+
+  if (!strcmp(method, "OPTIONS"))
+     return std::string("RTSP/1.0 200 OK\r\n") + head + (stream ? "Session: " + session + "\r\n" : "") + "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN\r\n\r\n";
+
+  if (!strcmp(method, "SETUP")) {
+     int rtpPort = 0, rtcpPort = 0;
+     const char *cp = strstr(transport.c_str(), "client_port=");
+     if (!strstr(transport.c_str(), "unicast") || !cp || (sscanf(cp, "client_port=%d-%d", &rtpPort, &rtcpPort) != 2))
+        return std::string("RTSP/1.0 461 Unsupported Transport\r\n") + head + "\r\n";
+     if (!stream) {
+        std::string system = SystemOf(Parameter(query, "msys"));
+        int frontend = system.empty() ? -1 : FreeFrontend(system);
+        if ((frontend < 0) || Chance(configS.noMorePermille)) {
+           Log(1, "%s SETUP: no free frontend", connectionP.peer.c_str());
+           return std::string("RTSP/1.0 503 Service Unavailable\r\n") + head + "\r\n";
+           }
+        char id[32];
+        snprintf(id, sizeof(id), "%08X", (unsigned int)rand());
+        stream = new cSimStream(nextStreamIdM++, id, system, frontend, connectionP.peer, rtpPort, rtcpPort);
+        streamsM[stream->Id()] = stream;
+        session = id;
+        }
+     stream->Tune(query);
+     char reply[512];
+     snprintf(reply, sizeof(reply),
+              "RTSP/1.0 200 OK\r\n%s"
+              "Session: %s;timeout=%d\r\n"
+              "Transport: RTP/AVP;unicast;destination=%s;source=%s;client_port=%d-%d;server_port=%d-%d\r\n"
+              "com.ses.streamID: %d\r\n\r\n",
+              head, session.c_str(), configS.sessionTimeoutS, connectionP.peer.c_str(), configS.address.c_str(),
+              stream->RtpPort(), stream->RtcpPort(), configS.rtspPort + 1, configS.rtspPort + 2, stream->Id());
+     Log(1, "%s SETUP stream %d on %s frontend %d", connectionP.peer.c_str(), stream->Id(), stream->System().c_str(), stream->Frontend());
+     return reply;
+     }
+
+  if (!strcmp(method, "PLAY")) {
+     if (!stream || (streamId && streamId != stream->Id()))
+        return std::string("RTSP/1.0 454 Session Not Found\r\n") + head + "\r\n";
+     if (!query.empty())
+        stream->Tune(query);
+     stream->Play();
+     char reply[512];
+     snprintf(reply, sizeof(reply), "RTSP/1.0 200 OK\r\n%sSession: %s\r\nRTP-Info: url=rtsp://%s:%d/stream=%d;seq=%u\r\n\r\n",
+              head, session.c_str(), configS.address.c_str(), configS.rtspPort, stream->Id(), stream->Sequence());
+     return reply;
+     }
+
+  if (!strcmp(method, "DESCRIBE")) {
+     std::string body = "v=0\r\no=- " + (stream ? stream->Session() : std::string("0")) + " 1 IN IP4 " + configS.address + "\r\n"
+                        "s=SatIPServer:1 " + configS.capabilities + "\r\nt=0 0\r\n";
+     for (std::map<int, cSimStream *>::iterator i = streamsM.begin(); i != streamsM.end(); ++i) {
+         if (streamId && (i->first != streamId))
+            continue;
+         body += "m=video 0 RTP/AVP 33\r\nc=IN IP4 0.0.0.0\r\na=control:stream=" + std::to_string(i->first) + "\r\n"
+                 "a=fmtp:33 " + i->second->TunerString() + "\r\na=sendonly\r\n";
+         }
+     char reply[512];
+     snprintf(reply, sizeof(reply), "RTSP/1.0 200 OK\r\n%sContent-Type: application/sdp\r\nContent-Base: rtsp://%s:%d/\r\nContent-Length: %zu\r\n\r\n",
+              head, configS.address.c_str(), configS.rtspPort, body.size());
+     return reply + body;
+     }
+
+  if (!strcmp(method, "TEARDOWN")) {
+     if (!stream)
+        return std::string("RTSP/1.0 454 Session Not Found\r\n") + head + "\r\n";
+     Log(1, "%s TEARDOWN stream %d", connectionP.peer.c_str(), stream->Id());
+     streamsM.erase(stream->Id());
+     delete stream;
+     return std::string("RTSP/1.0 200 OK\r\n") + head + "\r\n";
+     }
+
+  return std::string("RTSP/1.0 405 Method Not Allowed\r\n") + head + "\r\n";
+}
+
+void cSimServer::ProcessConnection(cConnection &connectionP)
+{
+  char buf[4096];
+  int len = (int)recv(connectionP.fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (len <= 0) {
+     close(connectionP.fd);
+     connectionP.fd = -1;
+     return;
+     }
+  connectionP.input.append(buf, len);
+  size_t end;
+  while ((end = connectionP.input.find("\r\n\r\n")) != std::string::npos) {
+        std::string request = connectionP.input.substr(0, end + 2);
+        connectionP.input.erase(0, end + 4);
+        std::string reply = connectionP.rtsp ? HandleRtsp(connectionP, request) : HandleHttp(request);
+        if (send(connectionP.fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0 || !connectionP.rtsp) {
+           close(connectionP.fd);
+           connectionP.fd = -1;
+           return;
+           }
+        }
+}
+
+void cSimServer::Expire(void)
+{
+  for (std::map<int, cSimStream *>::iterator i = streamsM.begin(); i != streamsM.end(); ) {
+      if (i->second->Expired()) {
+         Log(1, "stream %d: session timeout", i->first);
+         delete i->second;
+         i = streamsM.erase(i);
+         }
+      else
+         ++i;
+      }
+}
+
+void cSimServer::Run(void)
+{
+  uint64_t lastExpire = NowUs();
+  while (runningS) {
+        std::vector<struct pollfd> fds;
+        struct pollfd pfd = { -1, POLLIN, 0 };
+        pfd.fd = httpM;
+        fds.push_back(pfd);
+        pfd.fd = rtspM;
+        fds.push_back(pfd);
+        pfd.fd = ssdpM;
+        fds.push_back(pfd);
+        for (size_t i = 0; i < connectionsM.size(); ++i) {
+            pfd.fd = connectionsM[i].fd;
+            fds.push_back(pfd);
+            }
+        if (poll(&fds[0], fds.size(), 500) < 0) {
+           if (errno != EINTR)
+              break;
+           continue;
+           }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].revents & POLLIN) {
+               struct sockaddr_in from;
+               socklen_t fromlen = sizeof(from);
+               int fd = accept(fds[i].fd, (struct sockaddr *)&from, &fromlen);
+               if (fd >= 0) {
+                  cConnection c = { fd, (i == 1), inet_ntoa(from.sin_addr), "" };
+                  connectionsM.push_back(c);
+                  }
+               }
+            }
+        if ((ssdpM >= 0) && (fds[2].revents & POLLIN))
+           ProcessSsdp();
+        for (size_t i = 0; i < connectionsM.size(); ++i) {
+            if (fds[i + 3].revents & (POLLIN | POLLHUP | POLLERR))
+               ProcessConnection(connectionsM[i]);
+            }
+        for (std::vector<cConnection>::iterator i = connectionsM.begin(); i != connectionsM.end(); ) {
+            if (i->fd < 0)
+               i = connectionsM.erase(i);
+            else
+               ++i;
+            }
+        uint64_t now = NowUs();
+        if (now - lastExpire >= 1000000) {
+           Expire();
+           lastExpire = now;
+           }
+        if (now - lastNotifyM >= 60000000)
+           Notify(true);
+        }
+}
+
+// --- main -------------------------------------------------------------------
+
+static void Usage(const char *nameP)
+{
+  printf("Usage: %s [options]\n\n"
+         "  -a, --address=<ip>        address to serve on (default 127.0.0.1)\n"
+         "  -H, --http=<port>         HTTP port of the device description (default 8888)\n"
+         "  -r, --rtsp=<port>         RTSP port (default 8554)\n"
+         "  -c, --caps=<caps>         X_SATIPCAP frontends (default DVBS2-4,DVBT2-2,DVBC-2)\n"
+         "  -n, --name=<name>         friendly name (default \"SAT>IP simulator\")\n"
+         "  -u, --uuid=<uuid>         device uuid (default derived from address and port)\n"
+         "  -f, --file=<ts file>      stream the requested pids of this file in a loop\n"
+         "                            (synthetic packets of the requested pids otherwise)\n"
+         "  -b, --bitrate=<kbit/s>    bitrate of each stream (default 8000)\n"
+         "  -t, --timeout=<s>         RTSP session timeout (default 60)\n"
+         "  -l, --loss=<permille>     drop RTP datagrams\n"
+         "  -o, --reorder=<permille>  swap RTP datagrams with the following one\n"
+         "  -d, --delay=<permille>,<ms>\n"
+         "                            stall RTP streams and delay RTSP responses\n"
+         "  -N, --nomore=<permille>   answer SETUP with 503 even with free frontends\n"
+         "  -v, --verbose             increase logging\n",
+         nameP);
+}
+
+static void Stop(int)
+{
+  runningS = false;
+}
+
+int main(int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    { "address", required_argument, NULL, 'a' },
+    { "http",    required_argument, NULL, 'H' },
+    { "rtsp",    required_argument, NULL, 'r' },
+    { "caps",    required_argument, NULL, 'c' },
+    { "name",    required_argument, NULL, 'n' },
+    { "uuid",    required_argument, NULL, 'u' },
+    { "file",    required_argument, NULL, 'f' },
+    { "bitrate", required_argument, NULL, 'b' },
+    { "timeout", required_argument, NULL, 't' },
+    { "loss",    required_argument, NULL, 'l' },
+    { "reorder", required_argument, NULL, 'o' },
+    { "delay",   required_argument, NULL, 'd' },
+    { "nomore",  required_argument, NULL, 'N' },
+    { "verbose", no_argument,       NULL, 'v' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      no_argument,       NULL,  0  }
+    };
+  int c;
+  while ((c = getopt_long(argc, argv, "a:H:r:c:n:u:f:b:t:l:o:d:N:vh", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'a': configS.address = optarg; break;
+      case 'H': configS.httpPort = atoi(optarg); break;
+      case 'r': configS.rtspPort = atoi(optarg); break;
+      case 'c': configS.capabilities = optarg; break;
+      case 'n': configS.name = optarg; break;
+      case 'u': configS.uuid = optarg; break;
+      case 'f': configS.file = optarg; break;
+      case 'b': configS.bitrateKbps = atoi(optarg); break;
+      case 't': configS.sessionTimeoutS = atoi(optarg); break;
+      case 'l': configS.lossPermille = atoi(optarg); break;
+      case 'o': configS.reorderPermille = atoi(optarg); break;
+      case 'd': sscanf(optarg, "%d,%d", &configS.delayPermille, &configS.delayMs); break;
+      case 'N': configS.noMorePermille = atoi(optarg); break;
+      case 'v': configS.verbose++; break;
+      default:
+           Usage(argv[0]);
+           return (c == 'h') ? 0 : 1;
+      }
+    }
+  if (configS.bitrateKbps <= 0)
+     configS.bitrateKbps = 8000;
+  if (configS.uuid.empty()) {
+     char uuid[64];
+     snprintf(uuid, sizeof(uuid), "5a7e1b00-0000-4000-8000-%04x%08x", configS.rtspPort & 0xFFFF, (unsigned int)ntohl(inet_addr(configS.address.c_str())));
+     configS.uuid = uuid;
+     }
+  srand((unsigned int)(time(NULL) ^ getpid()));
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  cSimServer server;
+  if (!server.Open())
+     return 1;
+  server.Run();
+  return 0;
+}
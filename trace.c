@@ -0,0 +1,168 @@
+/*
+ * trace.c: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS // Required for format specifiers
+#include <inttypes.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "log.h"
+#include "trace.h"
+
+// --- cSatipTraceRing --------------------------------------------------------
+
+class cSatipTraceRing {
+public:
+  enum {
+    eSize = 8192 // in events, must be a power of two
+  };
+  cSatipTraceEvent eventsM[eSize];
+  uint64_t headM;
+  tThreadId threadIdM;
+  bool usedM;
+  cSatipTraceRing() : headM(0), threadIdM(0), usedM(false) {}
+};
+
+static cMutex SatipTraceMutexS;
+static cSatipTraceRing *SatipTraceRingsS[32] = { NULL };
+
+// Hands the ring of an exiting thread over to the next recording thread
+class cSatipTraceRingHolder {
+public:
+  cSatipTraceRing *ringM;
+  cSatipTraceRingHolder() : ringM(NULL) {}
+  ~cSatipTraceRingHolder()
+  {
+    if (ringM) {
+       cMutexLock MutexLock(&SatipTraceMutexS);
+       ringM->usedM = false;
+       }
+  }
+};
+
+static thread_local cSatipTraceRingHolder SatipTraceHolderS;
+
+static cSatipTraceRing *SatipTraceAcquireRing(void)
+{
+  cMutexLock MutexLock(&SatipTraceMutexS);
+  for (unsigned int i = 0; i < ELEMENTS(SatipTraceRingsS); ++i) {
+      if (!SatipTraceRingsS[i])
+         SatipTraceRingsS[i] = new cSatipTraceRing();
+      cSatipTraceRing *ring = SatipTraceRingsS[i];
+      if (!ring->usedM) {
+         // The readers skip the events of the previous owner by the head
+         ring->usedM = true;
+         ring->threadIdM = cThread::ThreadId();
+         __atomic_store_n(&ring->headM, (uint64_t)0, __ATOMIC_RELEASE);
+         return ring;
+         }
+      }
+  return NULL;
+}
+
+// --- cSatipTrace ------------------------------------------------------------
+
+bool cSatipTrace::enabledS = false;
+uint64_t cSatipTrace::clearTimeS = 0;
+
+void cSatipTrace::SetEnabled(bool onOffP)
+{
+  debug1("%s (%d)", __PRETTY_FUNCTION__, onOffP);
+  __atomic_store_n(&enabledS, onOffP, __ATOMIC_RELAXED);
+}
+
+void cSatipTrace::Clear(void)
+{
+  debug1("%s", __PRETTY_FUNCTION__);
+  // The rings belong to their writers, so just hide the older events
+  __atomic_store_n(&clearTimeS, Now(), __ATOMIC_RELAXED);
+}
+
+uint64_t cSatipTrace::Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void cSatipTrace::Append(int idP, int deviceP, uint32_t arg1P, uint64_t arg2P)
+{
+  cSatipTraceRing *ring = SatipTraceHolderS.ringM;
+  if (!ring) {
+     if (!(ring = SatipTraceAcquireRing()))
+        return;
+     SatipTraceHolderS.ringM = ring;
+     }
+  uint64_t head = ring->headM;
+  cSatipTraceEvent *e = &ring->eventsM[head & (cSatipTraceRing::eSize - 1)];
+  e->time = Now();
+  e->id = (uint16_t)idP;
+  e->device = (uint16_t)deviceP;
+  e->arg1 = arg1P;
+  e->arg2 = arg2P;
+  __atomic_store_n(&ring->headM, head + 1, __ATOMIC_RELEASE);
+}
+
+const char *cSatipTrace::EventName(int idP)
+{
+  switch (idP) {
+    case eTraceRtpBurst:       return "rtp-burst";
+    case eTraceVideoData:      return "video-data";
+    case eTraceBufferOverflow: return "buffer-overflow";
+    case eTraceSyncLoss:       return "sync-loss";
+    case eTracePoll:           return "poll";
+    default:                   break;
+    }
+  return "unknown";
+}
+
+cString cSatipTrace::Dump(int countP)
+{
+  debug1("%s (%d)", __PRETTY_FUNCTION__, countP);
+  struct cEntry {
+    cSatipTraceEvent event;
+    tThreadId threadId;
+  };
+  std::vector<cEntry> entries;
+  uint64_t clearTime = __atomic_load_n(&clearTimeS, __ATOMIC_RELAXED);
+  cMutexLock MutexLock(&SatipTraceMutexS);
+  for (unsigned int i = 0; i < ELEMENTS(SatipTraceRingsS) && SatipTraceRingsS[i]; ++i) {
+      cSatipTraceRing *ring = SatipTraceRingsS[i];
+      uint64_t head = __atomic_load_n(&ring->headM, __ATOMIC_ACQUIRE);
+      uint64_t first = (head > cSatipTraceRing::eSize) ? head - cSatipTraceRing::eSize : 0;
+      size_t start = entries.size();
+      for (uint64_t j = first; j < head; ++j) {
+          cEntry entry = { ring->eventsM[j & (cSatipTraceRing::eSize - 1)], ring->threadIdM };
+          entries.push_back(entry);
+          }
+      // Drop the slots the writer has reused while they were copied
+      uint64_t now = __atomic_load_n(&ring->headM, __ATOMIC_ACQUIRE);
+      if (now >= first + cSatipTraceRing::eSize) {
+         uint64_t stale = std::min(now - cSatipTraceRing::eSize + 1 - first, head - first);
+         entries.erase(entries.begin() + start, entries.begin() + start + stale);
+         }
+      }
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [clearTime](const cEntry &e) { return e.event.time < clearTime; }), entries.end());
+  std::sort(entries.begin(), entries.end(), [](const cEntry &a, const cEntry &b) { return a.event.time < b.event.time; });
+  size_t skip = ((countP > 0) && (entries.size() > (size_t)countP)) ? entries.size() - countP : 0;
+  // Appended in place, as a list of all events is too long for concatenating copies
+  char line[128];
+  snprintf(line, sizeof(line), "SATIP trace events: %s, %zu of %zu shown\n", IsEnabled() ? "on" : "off", entries.size() - skip, entries.size());
+  std::string list(line);
+  list.reserve(list.size() + (entries.size() - skip) * 64);
+  uint64_t base = (skip < entries.size()) ? entries[skip].event.time : 0;
+  for (size_t i = skip; i < entries.size(); ++i) {
+      const cSatipTraceEvent &e = entries[i].event;
+      snprintf(line, sizeof(line), "%10.6f %6d %-15s %3s %10u %" PRIu64 "\n", (double)(e.time - base) / 1e9, (int)entries[i].threadId,
+               EventName(e.id), (e.device == eNoDevice) ? "-" : *itoa(e.device), e.arg1, e.arg2);
+      list += line;
+      }
+  return list.c_str();
+}
@@ -0,0 +1,57 @@
+/*
+ * trace.h: SAT>IP plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef __SATIP_TRACE_H
+#define __SATIP_TRACE_H
+
+#include <stdint.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+struct cSatipTraceEvent {
+  uint64_t time;   // in nanoseconds of the monotonic clock
+  uint16_t id;
+  uint16_t device;
+  uint32_t arg1;
+  uint64_t arg2;
+};
+
+// Binary trace events are kept in a ring per recording thread; the owning
+// thread is the only writer, so recording an event takes no locks and costs
+// a single branch while the tracing is disabled
+class cSatipTrace {
+private:
+  static bool enabledS;
+  static uint64_t clearTimeS;
+  static void Append(int idP, int deviceP, uint32_t arg1P, uint64_t arg2P);
+
+public:
+  enum eTraceEvent {
+    eTraceRtpBurst = 1,   // arg1 = datagrams, arg2 = processing time in ns
+    eTraceVideoData,      // arg1 = bytes, arg2 = WriteData() time in ns
+    eTraceBufferOverflow, // arg1 = dropped TS packets, arg2 = overflow policy
+    eTraceSyncLoss,       // arg1 = skipped bytes
+    eTracePoll,           // arg1 = file descriptor, arg2 = processing time in ns
+    eTraceEventCount
+  };
+  enum {
+    eNoDevice = 0xFFFF
+  };
+  static bool IsEnabled(void) { return __builtin_expect(__atomic_load_n(&enabledS, __ATOMIC_RELAXED), false); }
+  static void SetEnabled(bool onOffP);
+  static void Clear(void);
+  static uint64_t Now(void);
+  static void Record(int idP, int deviceP, uint32_t arg1P = 0, uint64_t arg2P = 0)
+  {
+    if (IsEnabled())
+       Append(idP, deviceP, arg1P, arg2P);
+  }
+  static const char *EventName(int idP);
+  static cString Dump(int countP);
+};
+
+#endif // __SATIP_TRACE_H
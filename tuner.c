@@ -7,12 +7,16 @@
 
 #define __STDC_FORMAT_MACROS // Required for format specifiers
 #include <inttypes.h>
+#include <ctype.h>
 
 #include "common.h"
 #include "config.h"
 #include "discover.h"
+#include "http.h"
 #include "log.h"
 #include "poller.h"
+#include "share.h"
+#include "trace.h"
 #include "tuner.h"
 
 cSatipTuner::cSatipTuner(cSatipDeviceIf &deviceP, unsigned int packetLenP)
@@ -23,6 +27,9 @@ cSatipTuner::cSatipTuner(cSatipDeviceIf &deviceP, unsigned int packetLenP)
   rtspM(*this),
   rtpM(*this),
   rtcpM(*this),
+  captureM(deviceP.GetId()),
+  dumpM(deviceP.GetId()),
+  replayM(NULL),
   baseURL(""),
   streamParamM(""),
   lastBaseURL(""),
@@ -31,16 +38,25 @@ cSatipTuner::cSatipTuner(cSatipDeviceIf &deviceP, unsigned int packetLenP)
   currentServerM(NULL, deviceP.GetId(), 0),
   nextServerM(NULL, deviceP.GetId(), 0),
   mutexTunerM(),
+  threadStatisticsM(cString::sprintf("SATIP#%d tuner", deviceP.GetId())),
   reConnectM(),
   keepAliveM(),
   statusUpdateM(),
   pidUpdateCacheM(),
   setupTimeoutM(-1),
+  healthUpdateM(),
+  receiverReportM(),
+  failoverRetryM(),
+  healthM(deviceP.GetId()),
+  healthBytesM(0),
   sessionM(""),
   currentStateM(tsIdle),
   internalStateM(),
   externalStateM(),
   timeoutM(eMinKeepAliveIntervalMs - eKeepAlivePreBufferMs),
+  statusUpdateIntervalM(eStatusUpdateTimeoutMs),
+  paramFrequencyM(0),
+  paramSystemM(0),
   hasLockM(false),
   signalStrengthDBmM(0.0),
   signalStrengthM(-1),
@@ -51,7 +67,15 @@ cSatipTuner::cSatipTuner(cSatipDeviceIf &deviceP, unsigned int packetLenP)
   delPidsM(),
   pidsM(),
   pmtPids(),
-  needsReconnect(false)
+  needsReconnect(false),
+  sharedM(false),
+  offeredM(false),
+  allPidsM(false),
+  allPidsRequestsM(0),
+  migrateM(false),
+  failoverServerM(NULL),
+  multicastAddrM(""),
+  multicastSourceM("")
 {
   debug1("%s (, %d) [device %d]", __PRETTY_FUNCTION__, packetLenP, deviceIdM);
 
@@ -86,6 +110,10 @@ cSatipTuner::~cSatipTuner()
   sleepM.Signal();
   if (Running())
      Cancel(3);
+  ReleaseFailover();
+  DELETE_POINTER(replayM);
+  captureM.Stop();
+  dumpM.Close();
   Close();
   currentStateM = tsIdle;
   internalStateM.Clear();
@@ -107,18 +135,36 @@ void cSatipTuner::Action(void)
   cTimeMs tuning(eTuningTimeoutMs);
   reConnectM.Set(eConnectTimeoutMs);
   eTunerState lastState = tsIdle;
+  threadStatisticsM.ApplyScheduling(cSatipConfig::eThreadClassTuner);
   // Do the thread loop
   while (Running()) {
+        threadStatisticsM.Wakeup();
+        uint64_t start = cSatipThreadStatistics::Now();
         UpdateCurrentState();
+        // The session on a departed server is abandoned by the tuner thread itself
+        if (__atomic_exchange_n(&migrateM, false, __ATOMIC_RELAXED) && (currentStateM >= tsSet)) {
+           info("Server departed - migrating [device %d]", deviceIdM);
+           if (Failover())
+              UpdateCurrentState();
+           }
         switch (currentStateM) {
           case tsIdle:
                if (currentStateM != lastState)
                   debug4("%s: tsIdle [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+               ReleaseFailover();
                break;
           case tsRelease:
                if (currentStateM != lastState)
                   debug4("%s: tsRelease [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+               // Keep a shared stream running as long as other VDRs are using it
+               if (offeredM && !StateRequested() && cSatipShare::GetInstance()->HasClients(deviceIdM)) {
+                  if (currentStateM != lastState)
+                     info("Keeping shared stream for other clients [device %d]", deviceIdM);
+                  RequestState(tsLocked, smInternal);
+                  break;
+                  }
                Disconnect();
+               ReleaseFailover();
                RequestState(tsIdle, smInternal);
                break;
           case tsSet:
@@ -130,11 +176,17 @@ void cSatipTuner::Action(void)
                }
                if (Connect()) {
                   tuning.Set(eTuningTimeoutMs);
+                  healthUpdateM.Set();
+                  __atomic_store_n(&healthBytesM, 0, __ATOMIC_RELAXED);
+                  healthM.Reset();
+                  statusUpdateIntervalM = eStatusUpdateTimeoutMs;
                   RequestState(tsTuned, smInternal);
                   UpdatePids(true);
                   }
                else
                   Disconnect(false);
+               // The failover tuning is done as soon as the session is set up
+               ReleaseFailover();
                break;
           case tsTuned:
                if (currentStateM != lastState)
@@ -143,7 +195,7 @@ void cSatipTuner::Action(void)
                reConnectM.Set(eConnectTimeoutMs);
                idleCheck.Set(eIdleCheckTimeoutMs);
                lastIdleStatus = false;
-               // Read reception statistics via DESCRIBE and RTCP
+               // Read reception statistics via RTCP and DESCRIBE
                if (hasLockM || ReadReceptionStatus()) {
                   // Quirk for devices without valid reception data
                   if (currentServerM.IsQuirk(cSatipServer::eSatipQuirkForceLock)) {
@@ -152,10 +204,12 @@ void cSatipTuner::Action(void)
                      signalStrengthM = eDefaultSignalStrength;
                      signalQualityM = eDefaultSignalQuality;
                      }
-                  if (hasLockM)
+                  if (hasLockM) {
                      RequestState(tsLocked, smInternal);
+                     break;
+                     }
                   }
-               else if (tuning.TimedOut()) {
+               if (tuning.TimedOut()) {
                   info("Tuning timeout - retuning [device %d]", deviceIdM);
                   RequestState(tsSet, smInternal);
                   }
@@ -173,8 +227,24 @@ void cSatipTuner::Action(void)
                   RequestState(tsSet, smInternal);
                   break;
                   }
+               if (sharedM && !cSatipShare::GetInstance()->IsJoined(deviceIdM)) {
+                  info("Shared stream withdrawn - retuning [device %d]", deviceIdM);
+                  RequestState(tsSet, smInternal);
+                  break;
+                  }
+               if (SatipConfig.GetFailoverTimeout() && pidsM.Size() && !deviceM->IsIdle() && (rtpM.LastProcess() > SatipConfig.GetFailoverTimeout()) && failoverRetryM.TimedOut()) {
+                  error("RTP stall of %" PRIu64 " ms - failing over [device %d]", rtpM.LastProcess(), deviceIdM);
+                  if (Failover())
+                     break;
+                  // Without another server, wait for the stream or the connection timeout
+                  failoverRetryM.Set(SatipConfig.GetFailoverTimeout());
+                  }
+               if (CheckHealth())
+                  break;
                if (reConnectM.TimedOut()) {
                   error("Connection timeout - retuning [device %d]", deviceIdM);
+                  // The stream may have been filtered as a foreign source
+                  rtpM.ResetSsrc();
                   RequestState(tsSet, smInternal);
                   break;
                   }
@@ -188,6 +258,14 @@ void cSatipTuner::Action(void)
                   idleCheck.Set(eIdleCheckTimeoutMs);
                   break;
                   }
+               if (!sharedM && (healthUpdateM.Elapsed() >= eHealthUpdateTimeoutMs))
+                  UpdateServerHealth();
+               if (receiverReportM.TimedOut()) {
+                  cSatipRtpReport report;
+                  rtpM.GetReport(report);
+                  rtcpM.SendReport(report);
+                  receiverReportM.Set(eReceiverReportTimeoutMs);
+                  }
                Receive();
                break;
           default:
@@ -195,6 +273,7 @@ void cSatipTuner::Action(void)
                break;
           }
         lastState = currentStateM;
+        threadStatisticsM.AddProcessing(start);
         if (!StateRequested())
            sleepM.Wait(eSleepTimeoutMs); // to avoid busy loop and reduce cpu load
         }
@@ -231,6 +310,12 @@ bool cSatipTuner::Connect(void)
   rtspM.Create();
   if (!isempty(*baseURL)) {
      tnrParamM = "";
+     if (sharedM) {
+        // Identical parameters mean that the shared stream has failed
+        cSatipShare::GetInstance()->Leave(deviceIdM, !strcmp(*streamParamM, *lastParamM));
+        sharedM = false;
+        hasLockM = false;
+        }
      // Just retune
      if (streamIdM >= 0) {
         if (!strcmp(*streamParamM, *lastParamM) && hasLockM) {
@@ -240,12 +325,28 @@ bool cSatipTuner::Connect(void)
         cString uri = cString::sprintf("%sstream=%d?%s", *baseURL, streamIdM, *streamParamM);
         debug9("%s Retuning, PLAY '%s' [device %d]", __PRETTY_FUNCTION__, *uri, deviceIdM);
         debug4("%s Retuning, PLAY '%s' [device %d]", __PRETTY_FUNCTION__, *uri, deviceIdM);
+        // The clients of a shared stream must not follow to another transponder
+        if (offeredM) {
+           cSatipShare::GetInstance()->Withdraw(deviceIdM);
+           offeredM = false;
+           }
         if (rtspM.Play(*uri)) {
+           // Servers may pick another synchronization source per tuning
+           rtpM.ResetSsrc();
+           cSatipMetrics::Add(deviceIdM, cSatipMetrics::eTunes);
            keepAliveM.Set(timeoutM);
            lastParamM = streamParamM;
+           // Any lock reported so far belongs to the previous transponder
+           if (SatipConfig.GetRtcpLockDetection()) {
+              hasLockM = false;
+              rtcpM.ResetApplicationData();
+              }
+           OfferShared();
            return true;
            }
         }
+     else if (JoinShared())
+        return true;
      else if (rtspM.SetInterface(nextServerM.IsValid() ? *nextServerM.GetSrcAddress() : NULL) && rtspM.Options(*baseURL)) {
         cString uri = cString::sprintf("%s?%s", *baseURL, *streamParamM);
         bool useTcp = SatipConfig.IsTransportModeRtpOverTcp() && nextServerM.IsValid() && nextServerM.IsQuirk(cSatipServer::eSatipQuirkRtpOverTcp);
@@ -256,7 +357,11 @@ bool cSatipTuner::Connect(void)
            debug1("%s Requesting TCP [device %d]", __PRETTY_FUNCTION__, deviceIdM);
         debug9("%s SETUP '%s' [device %d]", __PRETTY_FUNCTION__,*uri, deviceIdM);
         debug4("%s SETUP '%s' [device %d]", __PRETTY_FUNCTION__,*uri, deviceIdM);
+        rtpM.Stamp();
         if (rtspM.Setup(*uri, rtpM.Port(), rtcpM.Port(), useTcp)) {
+           // A new session starts with its own synchronization source
+           rtpM.ResetSsrc();
+           cSatipMetrics::Add(deviceIdM, cSatipMetrics::eTunes);
            lastParamM = streamParamM;
            keepAliveM.Set(timeoutM);
            if (nextServerM.IsValid()) {
@@ -265,6 +370,7 @@ bool cSatipTuner::Connect(void)
               }
            lastBaseURL = baseURL;
            currentServerM.Attach();
+           OfferShared();
            return true;
            }
         }
@@ -273,6 +379,7 @@ bool cSatipTuner::Connect(void)
      else
         rtspM.Reset();
      streamIdM = -1;
+     cSatipMetrics::Add(deviceIdM, cSatipMetrics::eTuneFailures);
      error("Connect failed [device %d]", deviceIdM);
      }
 
@@ -285,6 +392,14 @@ bool cSatipTuner::Disconnect(bool Detach)
   debug9("%s stream=%d [device %d]", __PRETTY_FUNCTION__, streamIdM, deviceIdM);
   debug4("%s stream=%d [device %d]", __PRETTY_FUNCTION__, streamIdM, deviceIdM);
 
+  if (sharedM) {
+     cSatipShare::GetInstance()->Leave(deviceIdM);
+     sharedM = false;
+     }
+  if (offeredM) {
+     cSatipShare::GetInstance()->Withdraw(deviceIdM);
+     offeredM = false;
+     }
   if (!isempty(*lastBaseURL) && (streamIdM >= 0)) {
      cString uri = cString::sprintf("%sstream=%d", *lastBaseURL, streamIdM);
      rtspM.Teardown(*uri);
@@ -300,10 +415,14 @@ bool cSatipTuner::Disconnect(bool Detach)
 
   // Reset signal parameters
   hasLockM = false;
+  rtcpM.ResetApplicationData();
   signalStrengthDBmM = 0.0;
   signalStrengthM = -1;
   signalQualityM = -1;
   frontendIdM = -1;
+  cSatipMetrics::Set(deviceIdM, cSatipMetrics::eSignalStrength, 0);
+  cSatipMetrics::Set(deviceIdM, cSatipMetrics::eSignalQuality, 0);
+  cSatipMetrics::Set(deviceIdM, cSatipMetrics::eLock, 0);
 
   if (Detach)
      currentServerM.Detach();
@@ -316,23 +435,109 @@ bool cSatipTuner::Disconnect(bool Detach)
   return true;
 }
 
+bool cSatipTuner::Failover(bool teardownP)
+{
+  debug1("%s (%d) [device %d]", __PRETTY_FUNCTION__, teardownP, deviceIdM);
+  if (sharedM) {
+     // Fall back to an own session on the same server
+     RequestState(tsSet, smInternal);
+     return true;
+     }
+  ReleaseFailover();
+  cString params;
+  cSatipServer *server = deviceM->AssignFailoverServer(currentServerM.Id(), params);
+  if (!server) {
+     info("No server for failover available [device %d]", deviceIdM);
+     return false;
+     }
+  // The server admitted the tuning, which is released after the next setup
+  failoverServerM = server;
+  cMutexLock MutexLock(&mutexTunerM);
+  cSatipMetrics::Add(deviceIdM, cSatipMetrics::eFailovers);
+  // A stalled session is abandoned without a teardown as the server isn't responding,
+  // but a degraded one still holds a frontend there; the current pids are requested
+  // again from the new server
+  if (teardownP && !isempty(*lastBaseURL) && (streamIdM >= 0))
+     rtspM.Teardown(*cString::sprintf("%sstream=%d", *lastBaseURL, streamIdM));
+  currentServerM.Detach();
+  if (offeredM) {
+     cSatipShare::GetInstance()->Withdraw(deviceIdM);
+     offeredM = false;
+     }
+  if (SatipConfig.DisconnectIdleStreams())
+     rtspM.Destroy();
+  else
+     rtspM.Reset();
+  streamIdM = -1;
+  hasLockM = false;
+  lastParamM = "";
+  nextServerM.Set(server, currentServerM.Transponder());
+  SetBaseUrl(*rtspM.RtspUnescapeString(*nextServerM.GetAddress()), nextServerM.GetPort());
+  // The quirks of the new server apply to the stream parameters
+  SetStreamParameters(*params);
+  RequestState(tsSet, smInternal);
+  return true;
+}
+
+void cSatipTuner::ReleaseFailover(void)
+{
+  if (failoverServerM) {
+     deviceM->ReleaseFailoverServer(failoverServerM);
+     failoverServerM = NULL;
+     }
+}
+
+bool cSatipTuner::JoinShared(void)
+{
+  cSatipTunerServer &server = nextServerM.IsValid() ? nextServerM : currentServerM;
+  cString group, source;
+  int rtp = -1, rtcp = -1;
+  if (!SatipConfig.GetMulticastSharing() || !server.IsValid() || !cSatipShare::GetInstance()->Join(deviceIdM, *server.GetAddress(), *streamParamM, group, rtp, rtcp, source))
+     return false;
+  info("Joining shared stream at %s:%d [device %d]", *group, rtp, deviceIdM);
+  // The stream is received read-only, so no session nor frontend is needed
+  rtpM.ResetSsrc();
+  rtpM.Stamp();
+  SetupTransport(rtp, rtcp, *group, *source);
+  sharedM = true;
+  lastParamM = streamParamM;
+  if (nextServerM.IsValid()) {
+     currentServerM = nextServerM;
+     nextServerM.Reset();
+     }
+  lastBaseURL = baseURL;
+  return true;
+}
+
+void cSatipTuner::OfferShared(void)
+{
+  if (SatipConfig.GetMulticastSharing() && rtpM.IsMulticast() && !isempty(*multicastAddrM)) {
+     cSatipShare::GetInstance()->Offer(deviceIdM, *currentServerM.GetAddress(), *streamParamM, *multicastAddrM, rtpM.Port(), rtcpM.Port(), *multicastSourceM);
+     offeredM = true;
+     }
+}
+
 void cSatipTuner::ProcessVideoData(u_char *bufferP, int lengthP)
 {
   debug16("%s (, %d) [device %d]", __PRETTY_FUNCTION__, lengthP, deviceIdM);
   if (lengthP > 0) {
-     uint64_t elapsed;
-     cTimeMs processing(0);
-
      AddTunerStatistic(lengthP);
-     elapsed = processing.Elapsed();
-     if (elapsed > 1)
-        debug6("%s AddTunerStatistic() took %" PRIu64 " ms [device %d]", __PRETTY_FUNCTION__, elapsed, deviceIdM);
-
-     processing.Set(0);
-     deviceM->WriteData(bufferP, lengthP);
-     elapsed = processing.Elapsed();
-     if (elapsed > 1)
-        debug6("%s WriteData() took %" PRIu64 " ms [device %d]", __FUNCTION__, elapsed, deviceIdM);
+     cSatipMetrics::Add(deviceIdM, cSatipMetrics::eTunerBytes, lengthP);
+     __atomic_add_fetch(&healthBytesM, lengthP, __ATOMIC_RELAXED);
+     // The continuity check loops over every TS packet, so it only runs while monitoring
+     if (SatipConfig.GetHealthPeriod())
+        healthM.Process(bufferP, lengthP);
+     else
+        healthM.Suspend();
+     dumpM.Write(bufferP, lengthP);
+     cSatipHttpServer::Feed(deviceIdM, bufferP, lengthP);
+     if (cSatipTrace::IsEnabled()) {
+        uint64_t start = cSatipTrace::Now();
+        deviceM->WriteData(bufferP, lengthP);
+        cSatipTrace::Record(cSatipTrace::eTraceVideoData, deviceIdM, lengthP, cSatipTrace::Now() - start);
+        }
+     else
+        deviceM->WriteData(bufferP, lengthP);
      }
   reConnectM.Set(eConnectTimeoutMs);
 }
@@ -342,6 +547,90 @@ void cSatipTuner::ProcessRtpData(u_char *bufferP, int lengthP)
   rtpM.Process(bufferP, lengthP);
 }
 
+void cSatipTuner::SplitTunerFields(const char *startP, const char *endP, const char **fieldP, int *lengthP)
+{
+  const char *p = startP;
+  for (int i = 0; i < eTunerFieldCount; ++i) {
+      const char *q = p;
+      while ((q < endP) && (*q != ',') && (*q != ';') && (*q != '\r') && (*q != '\n') && *q)
+            ++q;
+      fieldP[i] = p;
+      lengthP[i] = (int)(q - p);
+      if ((q < endP) && (*q == ','))
+         p = q + 1;
+      else
+         p = q;
+      }
+}
+
+int cSatipTuner::ParseTunerField(const char *fieldP, int lengthP)
+{
+  int value = 0;
+  bool negative = false;
+  const char *e = fieldP + lengthP;
+
+  if ((fieldP < e) && (*fieldP == '-')) {
+     negative = true;
+     ++fieldP;
+     }
+  if ((fieldP >= e) || !isdigit(*fieldP))
+     return -1;
+  while ((fieldP < e) && isdigit(*fieldP) && (value < 100000000))
+        value = value * 10 + (*fieldP++ - '0');
+
+  return negative ? -value : value;
+}
+
+int cSatipTuner::ParseTunerFrequency(const char *fieldP, int lengthP)
+{
+  // Frequency in MHz with an optional fraction, converted to kHz
+  const char *e = fieldP + lengthP;
+  int value = 0;
+  int scale = 1000;
+
+  if ((fieldP >= e) || !isdigit(*fieldP))
+     return 0;
+  while ((fieldP < e) && isdigit(*fieldP) && (value < 1000000))
+        value = value * 10 + (*fieldP++ - '0');
+  value *= 1000;
+  if ((fieldP < e) && (*fieldP == '.')) {
+     while ((++fieldP < e) && isdigit(*fieldP) && (scale > 1)) {
+           scale /= 10;
+           value += (*fieldP - '0') * scale;
+           }
+     }
+
+  return value;
+}
+
+char cSatipTuner::ParseTunerSystem(const char *fieldP, int lengthP)
+{
+  // Only the delivery system family is compared, as "dvbs" and "dvbs2" are interchangeable with auto-detection
+  if ((lengthP >= 4) && !strncasecmp(fieldP, "dvb", 3))
+     return (char)tolower(fieldP[3]);
+  if ((lengthP >= 4) && !strncasecmp(fieldP, "atsc", 4))
+     return 'a';
+
+  return 0;
+}
+
+void cSatipTuner::ParseTransponderParameters(const char *parameterP)
+{
+  debug16("%s (%s) [device %d]", __PRETTY_FUNCTION__, parameterP, deviceIdM);
+  const char *p;
+
+  paramFrequencyM = 0;
+  paramSystemM = 0;
+  if ((p = strstr(parameterP, "freq=")) != NULL) {
+     p += 5;
+     paramFrequencyM = ParseTunerFrequency(p, strcspn(p, "&"));
+     }
+  if ((p = strstr(parameterP, "msys=")) != NULL) {
+     p += 5;
+     paramSystemM = ParseTunerSystem(p, strcspn(p, "&"));
+     }
+}
+
 void cSatipTuner::ProcessApplicationData(u_char *bufferP, int lengthP)
 {
   debug16("%s (%d) [device %d]", __PRETTY_FUNCTION__, lengthP, deviceIdM);
@@ -352,15 +641,20 @@ void cSatipTuner::ProcessApplicationData(u_char *bufferP, int lengthP)
   // DVB-C2:
   // ver=1.2;tuner=<feID>,<level>,<lock>,<quality>,<freq>,<bw>,<msys>,<mtype>,<sr>,<c2tft>,<ds>,<plp>,<specinv>;pids=<pid0>,...,<pidn>
   if (lengthP > 0) {
-     char s[lengthP];
-     memcpy(s, (char *)bufferP, lengthP);
-     debug10("%s (%s) [device %d]", __PRETTY_FUNCTION__, s, deviceIdM);
-     char *c = strstr(s, ";tuner=");
-     if (c)  {
+     const char *s = (const char *)bufferP;
+     const char *e = s + lengthP;
+     debug10("%s (%.*s) [device %d]", __PRETTY_FUNCTION__, lengthP, s, deviceIdM);
+     const char *c = (const char *)memmem(s, lengthP, ";tuner=", 7);
+     if (c) {
+        const char *field[eTunerFieldCount];
+        int length[eTunerFieldCount];
         int value;
 
+        // The string isn't null-terminated, so split it in place within its bounds
+        SplitTunerFields(c + 7, e, field, length);
+
         // feID:
-        frontendIdM = atoi(c + 7);
+        frontendIdM = ParseTunerField(field[eTunerFieldFrontend], length[eTunerFieldFrontend]);
 
         // level:
         // Numerical value between 0 and 255
@@ -368,8 +662,7 @@ void cSatipTuner::ProcessApplicationData(u_char *bufferP, int lengthP)
         // -25dBm corresponds to 224
         // -65dBm corresponds to 32
         // No signal corresponds to 0
-        c = strstr(c, ",");
-        value = min(atoi(++c), 255);
+        value = min(ParseTunerField(field[eTunerFieldLevel], length[eTunerFieldLevel]), 255);
         signalStrengthDBmM = (value > 0) ? 40.0 * (value - 32) / 192.0 - 65.0 : 0.0;
         // Scale value to 0-100
         signalStrengthM = (value >= 0) ? 0.5 + value * 100.0 / 255.0 : -1;
@@ -378,8 +671,19 @@ void cSatipTuner::ProcessApplicationData(u_char *bufferP, int lengthP)
         // lock Set to one of the following values:
         // "0" the frontend is not locked
         // "1" the frontend is locked
-        c = strstr(c, ",");
-        hasLockM = !!atoi(++c);
+        bool lock = (ParseTunerField(field[eTunerFieldLock], length[eTunerFieldLock]) > 0);
+
+        // frequency and system:
+        // Validate them against the requested ones as the server might still
+        // report the previous transponder right after retuning
+        int frequency = ParseTunerFrequency(field[eTunerFieldFrequency], length[eTunerFieldFrequency]);
+        char system = ParseTunerSystem(field[eTunerFieldSystem], length[eTunerFieldSystem]);
+        if (lock && (((frequency > 0) && (paramFrequencyM > 0) && (abs(frequency - paramFrequencyM) > eFrequencyToleranceKHz)) ||
+                     (system && paramSystemM && (system != paramSystemM)))) {
+           debug10("%s Ignoring lock for freq=%d system=%c (requested freq=%d system=%c) [device %d]", __PRETTY_FUNCTION__, frequency, system ? system : '-', paramFrequencyM, paramSystemM ? paramSystemM : '-', deviceIdM);
+           lock = false;
+           }
+        hasLockM = lock;
 
         // quality:
         // Numerical value between 0 and 15
@@ -387,10 +691,12 @@ void cSatipTuner::ProcessApplicationData(u_char *bufferP, int lengthP)
         // The value 15 shall correspond to
         // -a BER lower than 2x10-4 after Viterbi for DVB-S
         // -a PER lower than 10-7 for DVB-S2
-        c = strstr(c, ",");
-        value = min(atoi(++c), 15);
+        value = min(ParseTunerField(field[eTunerFieldQuality], length[eTunerFieldQuality]), 15);
         // Scale value to 0-100
         signalQualityM = (hasLockM && (value >= 0)) ? 0.5 + (value * 100.0 / 15.0) : 0;
+        cSatipMetrics::Set(deviceIdM, cSatipMetrics::eSignalStrength, max(signalStrengthM, 0));
+        cSatipMetrics::Set(deviceIdM, cSatipMetrics::eSignalQuality, signalQualityM);
+        cSatipMetrics::Set(deviceIdM, cSatipMetrics::eLock, hasLockM);
         }
      }
   reConnectM.Set(eConnectTimeoutMs);
@@ -424,6 +730,8 @@ void cSatipTuner::SetupTransport(int rtpPortP, int rtcpPortP, const char *stream
   cMutexLock MutexLock(&mutexTunerM);
   debug1("%s (%d, %d, %s, %s) [device %d]", __PRETTY_FUNCTION__, rtpPortP, rtcpPortP, streamAddrP, sourceAddrP, deviceIdM);
   bool multicast = !isempty(streamAddrP);
+  multicastAddrM = multicast ? streamAddrP : "";
+  multicastSourceM = (multicast && sourceAddrP) ? sourceAddrP : "";
   // Adapt RTP to any transport media change
   if (multicast != rtpM.IsMulticast() || rtpPortP != rtpM.Port()) {
      cSatipPoller::GetInstance()->Unregister(rtpM);
@@ -460,6 +768,11 @@ void cSatipTuner::SetBaseUrl(const char *addressP, const int portP)
      baseURL = cString::sprintf("rtsp://%s/", addressP);
 }
 
+void cSatipTuner::CaptureData(int typeP, const u_char *bufferP, int lengthP, uint64_t timeP)
+{
+  captureM.Write(typeP, bufferP, lengthP, timeP);
+}
+
 int cSatipTuner::GetId(void)
 {
   debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
@@ -475,12 +788,9 @@ bool cSatipTuner::SetSource(cSatipServer *serverP, const int transponderP, const
      if (!isempty(*nextServerM.GetAddress()) && !isempty(parameterP)) {
         // Update stream address and parameter
         cString streamAddr = rtspM.RtspUnescapeString(*nextServerM.GetAddress());
-        streamParamM = rtspM.RtspUnescapeString(parameterP);
         int streamPort = nextServerM.GetPort();
         SetBaseUrl(*streamAddr, streamPort);
-        // Modify parameter if required
-        if (nextServerM.IsQuirk(cSatipServer::eSatipQuirkForcePilot) && strstr(parameterP, "msys=dvbs2") && !strstr(parameterP, "plts="))
-           streamParamM = rtspM.RtspUnescapeString(*cString::sprintf("%s&plts=on", parameterP));
+        SetStreamParameters(parameterP);
         // Reconnect
         if (!isempty(*lastBaseURL)) {
            if (strcmp(*baseURL, *lastBaseURL)) {
@@ -502,6 +812,63 @@ bool cSatipTuner::SetSource(cSatipServer *serverP, const int transponderP, const
   return true;
 }
 
+void cSatipTuner::SetStreamParameters(const char *parameterP)
+{
+  streamParamM = rtspM.RtspUnescapeString(parameterP);
+  ParseTransponderParameters(parameterP);
+  // Modify parameter if required by the next server
+  if (nextServerM.IsQuirk(cSatipServer::eSatipQuirkForcePilot) && strstr(parameterP, "msys=dvbs2") && !strstr(parameterP, "plts="))
+     streamParamM = rtspM.RtspUnescapeString(*cString::sprintf("%s&plts=on", parameterP));
+}
+
+bool cSatipTuner::CheckHealth(void)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  if (!pidsM.Size() || deviceM->IsIdle())
+     return false;
+  // The quality of servers without valid reception data can't be judged
+  int quality = currentServerM.IsQuirk(cSatipServer::eSatipQuirkForceLock) ? -1 : signalQualityM;
+  switch (healthM.Evaluate(quality)) {
+    case cSatipHealthMonitor::eActionFailover:
+         if (Failover(true))
+            return true;
+         // fall through
+    case cSatipHealthMonitor::eActionRetune:
+         // A new session lets the server pick another frontend
+         needsReconnect = true;
+         RequestState(tsSet, smInternal);
+         return true;
+    default:
+         break;
+    }
+  return false;
+}
+
+void cSatipTuner::UpdateServerHealth(void)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  // Feed the stream health into the server selection, bitrate in kbit/s
+  uint64_t elapsed = healthUpdateM.Elapsed();
+  long bytes = __atomic_exchange_n(&healthBytesM, 0, __ATOMIC_RELAXED);
+  int bitrate = elapsed ? (int)(8 * bytes / elapsed) : 0;
+  currentServerM.UpdateHealth(rtpM.GetPacketLoss(), rtspM.GetRoundTrip(), signalQualityM, bitrate);
+  healthUpdateM.Set();
+}
+
+bool cSatipTuner::UsesServer(unsigned int serverIdP)
+{
+  debug16("%s (%u) [device %d]", __PRETTY_FUNCTION__, serverIdP, deviceIdM);
+  cMutexLock MutexLock(&mutexTunerM);
+  return (currentServerM.Is(serverIdP) || nextServerM.Is(serverIdP));
+}
+
+void cSatipTuner::Migrate(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  __atomic_store_n(&migrateM, true, __ATOMIC_RELAXED);
+  sleepM.Signal();
+}
+
 bool cSatipTuner::SetPid(int pidP, int typeP, bool Add)
 {
   debug16("%s (%d, %d, %d) [device %d]", __PRETTY_FUNCTION__, pidP, typeP, Add, deviceIdM);
@@ -529,12 +896,22 @@ bool cSatipTuner::UpdatePids(bool forceP)
   debug16("%s (%d) tunerState=%s [device %d]", __PRETTY_FUNCTION__, forceP, TunerStateString(currentStateM), deviceIdM);
   cMutexLock MutexLock(&mutexTunerM);
 
+  // A shared, dumped or HTTP served stream carries the whole transponder
+  bool allPids = offeredM || dumpM.IsAllPids() || (__atomic_load_n(&allPidsRequestsM, __ATOMIC_RELAXED) > 0);
+  if (allPids != allPidsM)
+     forceP = true;
   if ((forceP || (pidUpdateCacheM.TimedOut() && ((addPidsM.Size() || delPidsM.Size()))) || (pmtPids.Size() && pmtPidLinger.TimedOut())) &&
       !isempty(*baseURL) && (streamIdM >= 0)) {
      cString uri = cString::sprintf("%sstream=%d", *baseURL, streamIdM);
      bool usedummy = currentServerM.IsQuirk(cSatipServer::eSatipQuirkPlayPids);
      bool paramadded = false;
-     if (forceP || usedummy) {
+     if (allPids) {
+        if (forceP) {
+           uri = cString::sprintf("%s?pids=all", *uri);
+           paramadded = true;
+           }
+        }
+     else if (forceP || usedummy) {
         uri = cString::sprintf("%s?pids=%s", *uri, *pidsM.ListPids());
         paramadded = true;
         if (usedummy && (pidsM.Size() == 1) && (pidsM[0] < 0x20))
@@ -593,6 +970,7 @@ bool cSatipTuner::UpdatePids(bool forceP)
         debug11("%s PLAY '%s' [device %d]", __PRETTY_FUNCTION__, *uri, deviceIdM);
         if (!rtspM.Play(*uri))
            return false;
+        allPidsM = allPids;
         }
      addPidsM.Clear();
      delPidsM.Clear();
@@ -627,7 +1005,7 @@ bool cSatipTuner::KeepAlive(bool forceP)
      keepAliveM.Set(timeoutM);
      forceP = true;
      }
-  if (forceP && !isempty(*baseURL)) {
+  if (forceP && !isempty(*baseURL) && !sharedM) {
      if (!rtspM.Options(*baseURL))
         return false;
      }
@@ -639,7 +1017,17 @@ bool cSatipTuner::ReadReceptionStatus(bool forceP)
 {
   debug16("%s (%d) tunerState=%s [device %d]", __PRETTY_FUNCTION__, forceP, TunerStateString(currentStateM), deviceIdM);
   cMutexLock MutexLock(&mutexTunerM);
-  if (statusUpdateM.TimedOut()) {
+  if (SatipConfig.GetRtcpLockDetection()) {
+     // RTCP reports carry the same reception status, so DESCRIBE is needed only without them
+     if (!forceP && rtcpM.HasApplicationData())
+        return true;
+     if (statusUpdateM.TimedOut()) {
+        statusUpdateM.Set(statusUpdateIntervalM);
+        statusUpdateIntervalM = min(2 * statusUpdateIntervalM, (int)eStatusUpdateMaxTimeoutMs);
+        forceP = true;
+        }
+     }
+  else if (statusUpdateM.TimedOut()) {
      statusUpdateM.Set(eStatusUpdateTimeoutMs);
      forceP = true;
      }
@@ -782,6 +1170,88 @@ cString cSatipTuner::GetSignalStatus(void)
   return cString::sprintf("lock=%d strength=%d quality=%d frontend=%d", HasLock(), SignalStrength(), SignalQuality(), FrontendId());
 }
 
+cString cSatipTuner::GetStreamStatus(void)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  return (currentStateM >= tsTuned) ? rtpM.GetStatistic() : cString("");
+}
+
+bool cSatipTuner::StartCapture(const char *fileNameP)
+{
+  debug1("%s (%s) [device %d]", __PRETTY_FUNCTION__, fileNameP, deviceIdM);
+  cMutexLock MutexLock(&mutexTunerM);
+  if (replayM && replayM->IsActive()) {
+     error("Cannot capture while replaying [device %d]", deviceIdM);
+     return false;
+     }
+  return captureM.Start(fileNameP);
+}
+
+void cSatipTuner::StopCapture(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  cMutexLock MutexLock(&mutexTunerM);
+  captureM.Stop();
+  DELETE_POINTER(replayM);
+}
+
+bool cSatipTuner::StartReplay(const char *fileNameP, double speedP)
+{
+  debug1("%s (%s, %.1f) [device %d]", __PRETTY_FUNCTION__, fileNameP, speedP, deviceIdM);
+  cMutexLock MutexLock(&mutexTunerM);
+  // The replayed packets would be mixed with a live stream
+  if ((currentStateM >= tsTuned) || captureM.IsActive()) {
+     error("Cannot replay while streaming or capturing [device %d]", deviceIdM);
+     return false;
+     }
+  DELETE_POINTER(replayM);
+  // The replayed session has its own synchronization source
+  rtpM.ResetSsrc();
+  replayM = new cSatipReplay(*this, fileNameP, speedP);
+  return true;
+}
+
+cString cSatipTuner::GetCaptureStatus(void)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  cMutexLock MutexLock(&mutexTunerM);
+  cString status = captureM.GetStatus();
+  if (isempty(*status) && replayM)
+     status = replayM->GetStatus();
+  return isempty(*status) ? cString("idle") : status;
+}
+
+bool cSatipTuner::StartDump(const char *fileNameP, bool allPidsP, unsigned int maxSizeMbP, unsigned int maxMinutesP)
+{
+  debug1("%s (%s, %d, %u, %u) [device %d]", __PRETTY_FUNCTION__, fileNameP, allPidsP, maxSizeMbP, maxMinutesP, deviceIdM);
+  if (!dumpM.Open(fileNameP, allPidsP, maxSizeMbP, maxMinutesP))
+     return false;
+  // Request the whole transponder right away
+  sleepM.Signal();
+  return true;
+}
+
+void cSatipTuner::StopDump(void)
+{
+  debug1("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  dumpM.Close();
+  sleepM.Signal();
+}
+
+cString cSatipTuner::GetDumpStatus(void)
+{
+  debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
+  cString status = dumpM.GetStatus();
+  return isempty(*status) ? cString("idle") : status;
+}
+
+void cSatipTuner::RequestAllPids(bool onP)
+{
+  debug1("%s (%d) [device %d]", __PRETTY_FUNCTION__, onP, deviceIdM);
+  __atomic_add_fetch(&allPidsRequestsM, onP ? 1 : -1, __ATOMIC_RELAXED);
+  sleepM.Signal();
+}
+
 cString cSatipTuner::GetInformation(void)
 {
   debug16("%s [device %d]", __PRETTY_FUNCTION__, deviceIdM);
@@ -11,8 +11,11 @@
 #include <vdr/thread.h>
 #include <vdr/tools.h>
 
+#include "capture.h"
 #include "deviceif.h"
 #include "discover.h"
+#include "dump.h"
+#include "health.h"
 #include "rtp.h"
 #include "rtcp.h"
 #include "rtsp.h"
@@ -53,26 +56,30 @@ public:
 class cSatipTunerServer
 {
 private:
-  cSatipServer *serverM;
+  cSatipServerHandle handleM;
   int deviceIdM;
   int transponderM;
 
 public:
-  cSatipTunerServer(cSatipServer *serverP, const int deviceIdP, const int transponderP) : serverM(serverP), deviceIdM(deviceIdP), transponderM(transponderP) {}
+  cSatipTunerServer(cSatipServer *serverP, const int deviceIdP, const int transponderP) : handleM(), deviceIdM(deviceIdP), transponderM(transponderP) { if (serverP) Set(serverP, transponderP); }
   ~cSatipTunerServer() {}
-  cSatipTunerServer(const cSatipTunerServer &objP) { serverM = NULL; deviceIdM = -1; transponderM = 0; }
-  cSatipTunerServer& operator= (const cSatipTunerServer &objP) { serverM = objP.serverM; deviceIdM = objP.deviceIdM; transponderM = objP.transponderM; return *this; }
-  bool IsValid(void) { return !!serverM; }
-  bool IsQuirk(int quirkP) { return (serverM && cSatipDiscover::GetInstance()->IsServerQuirk(serverM, quirkP)); }
-  bool HasCI(void) { return (serverM && cSatipDiscover::GetInstance()->HasServerCI(serverM)); }
-  void Attach(void) { if (serverM) cSatipDiscover::GetInstance()->AttachServer(serverM, deviceIdM, transponderM); }
-  void Detach(void) { if (serverM) cSatipDiscover::GetInstance()->DetachServer(serverM, deviceIdM, transponderM); }
-  void Set(cSatipServer *serverP, const int transponderP) { serverM = serverP; transponderM = transponderP; }
-  void Reset(void) { serverM = NULL; transponderM = 0; }
-  cString GetAddress(void) { return serverM ? cSatipDiscover::GetInstance()->GetServerAddress(serverM) : ""; }
-  cString GetSrcAddress(void) { return serverM ? cSatipDiscover::GetInstance()->GetSourceAddress(serverM) : ""; }
-  int GetPort(void) { return serverM ? cSatipDiscover::GetInstance()->GetServerPort(serverM) : SATIP_DEFAULT_RTSP_PORT; }
-  cString GetInfo(void) { return cString::sprintf("server=%s deviceid=%d transponder=%d", serverM ? "assigned" : "null", deviceIdM, transponderM); }
+  cSatipTunerServer(const cSatipTunerServer &objP) { deviceIdM = -1; transponderM = 0; }
+  cSatipTunerServer& operator= (const cSatipTunerServer &objP) { handleM = objP.handleM; deviceIdM = objP.deviceIdM; transponderM = objP.transponderM; return *this; }
+  bool IsValid(void) { return handleM.IsValid(); }
+  bool Is(unsigned int serverIdP) { return (handleM.IsValid() && (handleM.Id() == serverIdP)); }
+  unsigned int Id(void) { return handleM.Id(); }
+  int Transponder(void) { return transponderM; }
+  bool IsQuirk(int quirkP) { return handleM.Quirk(quirkP); }
+  bool HasCI(void) { return handleM.HasCI(); }
+  void Attach(void) { if (handleM.IsValid()) cSatipDiscover::GetInstance()->AttachServer(handleM.Id(), deviceIdM, transponderM); }
+  void Detach(void) { if (handleM.IsValid()) cSatipDiscover::GetInstance()->DetachServer(handleM.Id(), deviceIdM, transponderM); }
+  void Set(cSatipServer *serverP, const int transponderP) { cSatipDiscover::GetInstance()->GetServerHandle(serverP, handleM); transponderM = transponderP; }
+  void Reset(void) { handleM.Reset(); transponderM = 0; }
+  void UpdateHealth(int lossP, int roundTripP, int qualityP, int bitrateP) { if (handleM.IsValid()) cSatipDiscover::GetInstance()->UpdateServerHealth(handleM.Id(), deviceIdM, lossP, roundTripP, qualityP, bitrateP); }
+  cString GetAddress(void) { return handleM.Address(); }
+  cString GetSrcAddress(void) { return handleM.SrcAddress(); }
+  int GetPort(void) { return handleM.Port(); }
+  cString GetInfo(void) { return cString::sprintf("server=%u deviceid=%d transponder=%d", handleM.Id(), deviceIdM, transponderM); }
 };
 
 class cSatipTuner : public cThread, public cSatipTunerStatistics, public cSatipTunerIf
@@ -85,9 +92,13 @@ private:
     eDefaultSignalQuality     = 15,
     eSleepTimeoutMs           = 250,   // in milliseconds
     eStatusUpdateTimeoutMs    = 1000,  // in milliseconds
+    eStatusUpdateMaxTimeoutMs = 8000,  // in milliseconds
+    eFrequencyToleranceKHz    = 1000,
     ePidUpdateIntervalMs      = 250,   // in milliseconds
     eConnectTimeoutMs         = 5000,  // in milliseconds
     eIdleCheckTimeoutMs       = 15000, // in milliseconds
+    eHealthUpdateTimeoutMs    = 5000,  // in milliseconds
+    eReceiverReportTimeoutMs  = 5000,  // in milliseconds
     eTuningTimeoutMs          = 20000, // in milliseconds
     eMinKeepAliveIntervalMs   = 30000, // in milliseconds
     eKeepAlivePreBufferMs     = 2000,  // in milliseconds
@@ -95,6 +106,15 @@ private:
     ePmtPidLingerTime         = 2000   // in milliseconds
   };
   enum eTunerState { tsIdle, tsRelease, tsSet, tsTuned, tsLocked };
+  enum eTunerField {
+    eTunerFieldFrontend = 0,
+    eTunerFieldLevel,
+    eTunerFieldLock,
+    eTunerFieldQuality,
+    eTunerFieldFrequency,
+    eTunerFieldSystem = 6, // preceded by either polarisation or bandwidth
+    eTunerFieldCount
+  };
   enum eStateMode { smInternal, smExternal };
 
   cCondWait sleepM;
@@ -103,6 +123,9 @@ private:
   cSatipRtsp rtspM;
   cSatipRtp rtpM;
   cSatipRtcp rtcpM;
+  cSatipCapture captureM;
+  cSatipDump dumpM;
+  cSatipReplay *replayM;
   cString baseURL;
   cString streamParamM;
   cString lastBaseURL;
@@ -111,17 +134,26 @@ private:
   cSatipTunerServer currentServerM;
   cSatipTunerServer nextServerM;
   cMutex mutexTunerM;
+  cSatipThreadStatistics threadStatisticsM;
   cTimeMs reConnectM;
   cTimeMs keepAliveM;
   cTimeMs statusUpdateM;
   cTimeMs pidUpdateCacheM;
   cTimeMs setupTimeoutM;
   cTimeMs pmtPidLinger;
+  cTimeMs healthUpdateM;
+  cTimeMs receiverReportM;
+  cTimeMs failoverRetryM;
+  cSatipHealthMonitor healthM;
+  long healthBytesM;
   cString sessionM;
   eTunerState currentStateM;
   cVector<eTunerState> internalStateM;
   cVector<eTunerState> externalStateM;
   int timeoutM;
+  int statusUpdateIntervalM;
+  int paramFrequencyM;
+  char paramSystemM;
   bool hasLockM;
   double signalStrengthDBmM;
   int signalStrengthM;
@@ -133,6 +165,14 @@ private:
   cSatipPid pidsM;
   cSatipPid pmtPids;
   bool needsReconnect;
+  bool sharedM;
+  bool offeredM;
+  bool allPidsM;
+  int allPidsRequestsM;
+  bool migrateM;
+  cSatipServer *failoverServerM;
+  cString multicastAddrM;
+  cString multicastSourceM;
 
   bool Connect(void);
   bool Disconnect(bool Detach = true);
@@ -140,12 +180,24 @@ private:
   bool KeepAlive(bool forceP = false);
   bool ReadReceptionStatus(bool forceP = false);
   bool UpdatePids(bool forceP = false);
+  void UpdateServerHealth(void);
+  bool Failover(bool teardownP = false);
+  void ReleaseFailover(void);
+  bool CheckHealth(void);
+  bool JoinShared(void);
+  void OfferShared(void);
   void UpdateCurrentState(void);
   bool StateRequested(void);
   bool RequestState(eTunerState stateP, eStateMode modeP);
   const char *StateModeString(eStateMode modeP);
   const char *TunerStateString(eTunerState stateP);
   void SetBaseUrl(const char *addressP, const int portP);
+  void SetStreamParameters(const char *parameterP);
+  void ParseTransponderParameters(const char *parameterP);
+  static void SplitTunerFields(const char *startP, const char *endP, const char **fieldP, int *lengthP);
+  static int ParseTunerField(const char *fieldP, int lengthP);
+  static int ParseTunerFrequency(const char *fieldP, int lengthP);
+  static char ParseTunerSystem(const char *fieldP, int lengthP);
 
 protected:
   virtual void Action(void);
@@ -154,6 +206,8 @@ public:
   cSatipTuner(cSatipDeviceIf &deviceP, unsigned int packetLenP);
   virtual ~cSatipTuner();
   bool IsTuned(void) const { return (currentStateM >= tsTuned); }
+  bool UsesServer(unsigned int serverIdP);
+  void Migrate(void);
   bool SetSource(cSatipServer *serverP, const int transponderP, const char *parameterP, const int indexP, const bool NeedsReconnect = false);
   bool SetPid(int pidP, int typeP, bool Add);
   void AddPmtPid(int pmtPid) { pidsM.AddPid(pmtPid); pmtPids.AddPid(pmtPid, false); }
@@ -168,6 +222,16 @@ public:
   bool HasLock(void);
   cString GetSignalStatus(void);
   cString GetInformation(void);
+  cString GetThreadStatistic(void) { return threadStatisticsM.GetThreadStatistic(); }
+  cString GetStreamStatus(void);
+  bool StartCapture(const char *fileNameP);
+  void StopCapture(void);
+  bool StartReplay(const char *fileNameP, double speedP);
+  cString GetCaptureStatus(void);
+  bool StartDump(const char *fileNameP, bool allPidsP, unsigned int maxSizeMbP, unsigned int maxMinutesP);
+  void StopDump(void);
+  cString GetDumpStatus(void);
+  void RequestAllPids(bool onP);
 
   // for internal tuner interface
 public:
@@ -178,6 +242,7 @@ public:
   virtual void SetStreamId(int streamIdP);
   virtual void SetSessionTimeout(const char *sessionP, int timeoutP);
   virtual void SetupTransport(int rtpPortP, int rtcpPortP, const char *streamAddrP, const char *sourceAddrP);
+  virtual void CaptureData(int typeP, const u_char *bufferP, int lengthP, uint64_t timeP);
   virtual int GetId(void);
 };
 